@@ -0,0 +1,166 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+#endif
+
+#include "core/profiler.h"
+#include "core/arena.h"
+#include "extra/cJSON.h"
+#include "utils/utils.h"
+
+volatile float bench_sink = 0.0f;
+
+//time stamp counter, it counts at a constant rate close to the nominal frequency of the cpu
+//without one (arm) nanoseconds are used instead
+static uint64_t readCycles()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return CORE::Profiler::now();
+#endif
+}
+
+static double percentile(const std::vector<double>& sorted, float p)
+{
+	int index = (int)(p * (sorted.size() - 1) + 0.5f);
+	return sorted[index];
+}
+
+BenchRunner::BenchRunner()
+{
+	warmup = 3;
+	repetitions = 30;
+}
+
+bool BenchRunner::isEnabled(const char* name)
+{
+	return filter.empty() || std::string(name).find(filter) != std::string::npos;
+}
+
+void BenchRunner::run(const char* name, std::function<void()> func, int ops)
+{
+	if (!isEnabled(name))
+		return;
+
+	for (int i = 0; i < warmup; ++i)
+		func();
+
+	std::vector<double> times(repetitions);
+	std::vector<double> cycles(repetitions);
+	long heap_allocations = CORE::FrameArena::getHeapAllocations();
+	for (int i = 0; i < repetitions; ++i)
+	{
+		uint64_t start = CORE::Profiler::now();
+		uint64_t start_cycles = readCycles();
+		func();
+		cycles[i] = (double)(readCycles() - start_cycles) / std::max(ops, 1);
+		times[i] = (CORE::Profiler::now() - start) * 0.001;
+	}
+	if (heap_allocations != -1)
+		heap_allocations = CORE::FrameArena::getHeapAllocations() - heap_allocations;
+	std::sort(times.begin(), times.end());
+	std::sort(cycles.begin(), cycles.end());
+
+	BenchResult result;
+	result.name = name;
+	result.repetitions = repetitions;
+	result.min = times.front();
+	result.p50 = percentile(times, 0.5f);
+	result.p90 = percentile(times, 0.9f);
+	result.p99 = percentile(times, 0.99f);
+	result.max = times.back();
+	result.cycles = percentile(cycles, 0.5f);
+	result.heap_allocations = heap_allocations;
+	results.push_back(result);
+
+	printf("%-40s p50 %10.2f us  p90 %10.2f us  p99 %10.2f us  min %10.2f us  max %10.2f us  %10.1f cycles/op\n",
+		name, result.p50, result.p90, result.p99, result.min, result.max, result.cycles);
+}
+
+bool BenchRunner::saveJSON(const char* filename)
+{
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write bench results: " << filename << std::endl;
+		return false;
+	}
+
+	fprintf(f, "{\n\t\"repetitions\": %d,\n\t\"warmup\": %d,\n\t\"results\": [\n", repetitions, warmup);
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		BenchResult& r = results[i];
+		fprintf(f, "\t\t{ \"name\": \"%s\", \"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"cycles\": %.1f, \"heap_allocations\": %ld }%s\n",
+			r.name.c_str(), r.min, r.p50, r.p90, r.p99, r.max, r.cycles, r.heap_allocations, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "\t]\n}\n");
+	fclose(f);
+
+	std::cout << " + Bench results saved: " << TermColor::YELLOW << filename << TermColor::DEFAULT << std::endl;
+	return true;
+}
+
+int BenchRunner::compareBaseline(const char* filename, float threshold)
+{
+	std::string content;
+	if (!readFile(filename, content))
+	{
+		std::cout << "[ERROR] baseline not found: " << filename << std::endl;
+		return -1;
+	}
+
+	cJSON* json = cJSON_Parse(content.c_str());
+	cJSON* baseline = json ? cJSON_GetObjectItem(json, "results") : NULL;
+	if (!baseline)
+	{
+		std::cout << "[ERROR] invalid baseline: " << filename << std::endl;
+		if (json)
+			cJSON_Delete(json);
+		return -1;
+	}
+
+	std::cout << "\nCompared with " << TermColor::YELLOW << filename << TermColor::DEFAULT << " (p50):" << std::endl;
+	int num_regressions = 0;
+	for (BenchResult& r : results)
+	{
+		double old_p50 = -1.0;
+		for (int i = 0; i < cJSON_GetArraySize(baseline); ++i)
+		{
+			cJSON* item = cJSON_GetArrayItem(baseline, i);
+			cJSON* name = cJSON_GetObjectItem(item, "name");
+			cJSON* p50 = cJSON_GetObjectItem(item, "p50");
+			if (name && p50 && name->valuestring && r.name == name->valuestring)
+				old_p50 = p50->valuedouble;
+		}
+		if (old_p50 <= 0.0)
+		{
+			printf("%-40s %10.2f us  (new)\n", r.name.c_str(), r.p50);
+			continue;
+		}
+
+		double change = r.p50 / old_p50 - 1.0;
+		const char* color = TermColor::DEFAULT;
+		if (change > threshold)
+		{
+			color = TermColor::RED;
+			num_regressions++;
+		}
+		else if (change < -threshold)
+			color = TermColor::GREEN;
+		printf("%-40s %10.2f us -> %10.2f us  %s%+6.1f%%%s\n", r.name.c_str(), old_p50, r.p50, color, change * 100.0, TermColor::DEFAULT);
+	}
+	cJSON_Delete(json);
+
+	if (num_regressions)
+		std::cout << TermColor::RED << num_regressions << " cases slower than " << int(threshold * 100) << "%" << TermColor::DEFAULT << std::endl;
+	return num_regressions;
+}
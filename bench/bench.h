@@ -0,0 +1,44 @@
+/*  Small harness used by gtr_bench to time the CPU side of the framework.
+	Every case runs some warm-up iterations, then N timed repetitions, and the percentiles are stored
+	so they can be saved as JSON and compared against a previous run (the baseline).
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+//timings of one case, in microseconds
+struct BenchResult {
+	std::string name;
+	int repetitions;
+	double min;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+	double cycles;	//p50 of the cpu cycles (time stamp counter) of one operation
+	long heap_allocations;	//calls to operator new of the timed repetitions (not the warm-up), -1 if not counted
+};
+
+class BenchRunner {
+public:
+	int warmup;
+	int repetitions;
+	std::string filter;	//only cases whose name contains this string are run
+	std::vector<BenchResult> results;
+
+	BenchRunner();
+
+	bool isEnabled(const char* name);	//use it to skip expensive setups of cases that are filtered out
+	//ops is how many operations one call performs, only used for the cycles per operation
+	void run(const char* name, std::function<void()> func, int ops = 1);
+
+	bool saveJSON(const char* filename);
+	//prints the p50 of every case against the baseline, returns how many are slower than the threshold (0.1 means 10%)
+	int compareBaseline(const char* filename, float threshold);
+};
+
+//cases accumulate something here so the compiler cannot remove the work whose result is not used
+extern volatile float bench_sink;
@@ -0,0 +1,710 @@
+/*  gtr_bench: benchmarks of the CPU side of the framework (loaders, math, culling, picking, animation).
+	It doesnt create a window or a GL context, so only the functions that dont touch the GPU are timed.
+
+	usage: gtr_bench [--filter name] [--reps 30] [--warmup 3] [--out bench_results.json] [--baseline old.json] [--threshold 0.1]
+	It must run from the root folder (where data/ is). The exit code is 1 if some case is slower than the baseline
+	or if a round trip check fails (scene JSON -> BIN -> JSON).
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <map>
+
+#include "bench.h"
+
+#include "core/math.h"
+#include "core/task.h"
+#include "core/registry.h"
+#include "extra/cgltf.h"
+#include "extra/cJSON.h"
+#include "gfx/mesh.h"
+#include "gfx/texture.h"
+#include "gfx/sphericalharmonics.h"
+#include "pipeline/camera.h"
+#include "pipeline/animation.h"
+#include "pipeline/crowd.h"
+#include "pipeline/scene.h"
+#include "pipeline/light.h"
+#include "pipeline/clusters.h"
+#include "pipeline/occlusion.h"
+#include "utils/utils.h"
+#include "utils/jsonreader.h"
+
+const char* prefabs[] = {
+	"data/prefabs/gmc/scene.gltf",
+	"data/prefabs/house_test/scene.gltf",
+	"data/prefabs/road/road.gltf",
+	"data/prefabs/trash_can/scene.gltf",
+	"data/prefabs/axis.glb",
+	"data/prefabs/floor.glb"
+};
+
+//name used in the cases, the folder for gltfs and the filename for glbs
+std::string getPrefabName(const char* filename)
+{
+	std::string name = filename;
+	if (getExtension(name) == "glb")
+		return name.substr(name.find_last_of('/') + 1);
+	name = name.substr(0, name.find_last_of('/'));
+	return name.substr(name.find_last_of('/') + 1);
+}
+
+//CPU part of parseGLTFMesh (that one uploads to VRAM), all the primitives are merged in one mesh
+GFX::Mesh* unpackGLTFMeshes(cgltf_data* data)
+{
+	GFX::Mesh* mesh = new GFX::Mesh();
+	bool has_normals = true;
+	bool has_uvs = true;
+
+	for (size_t i = 0; i < data->meshes_count; ++i)
+	{
+		cgltf_mesh* gltf_mesh = &data->meshes[i];
+		for (size_t j = 0; j < gltf_mesh->primitives_count; ++j)
+		{
+			cgltf_primitive* primitive = &gltf_mesh->primitives[j];
+			if (primitive->type != cgltf_primitive_type_triangles)
+				continue;
+
+			size_t base = mesh->vertices.size();
+			size_t num_vertices = 0;
+			bool primitive_normals = false;
+			bool primitive_uvs = false;
+			for (size_t k = 0; k < primitive->attributes_count; ++k)
+			{
+				cgltf_attribute* attr = &primitive->attributes[k];
+				cgltf_accessor* acc = attr->data;
+				if (attr->type == cgltf_attribute_type_position)
+				{
+					num_vertices = acc->count;
+					mesh->vertices.resize(base + acc->count);
+					cgltf_accessor_unpack_floats(acc, (float*)&mesh->vertices[base], acc->count * 3);
+				}
+				else if (attr->type == cgltf_attribute_type_normal)
+				{
+					mesh->normals.resize(base + acc->count);
+					cgltf_accessor_unpack_floats(acc, (float*)&mesh->normals[base], acc->count * 3);
+					primitive_normals = true;
+				}
+				else if (attr->type == cgltf_attribute_type_texcoord && attr->index == 0)
+				{
+					mesh->uvs.resize(base + acc->count);
+					cgltf_accessor_unpack_floats(acc, (float*)&mesh->uvs[base], acc->count * 2);
+					primitive_uvs = true;
+				}
+			}
+			has_normals = has_normals && primitive_normals;
+			has_uvs = has_uvs && primitive_uvs;
+
+			if (primitive->indices)
+				for (size_t k = 0; k < primitive->indices->count; ++k)
+					mesh->indices.push_back((unsigned int)(base + cgltf_accessor_read_index(primitive->indices, k)));
+			else
+				for (size_t k = 0; k < num_vertices; ++k)
+					mesh->indices.push_back((unsigned int)(base + k));
+		}
+	}
+
+	//streams must match the vertices or the bin would be wrong
+	if (!has_normals || mesh->normals.size() != mesh->vertices.size())
+		mesh->normals.clear();
+	if (!has_uvs || mesh->uvs.size() != mesh->vertices.size())
+		mesh->uvs.clear();
+	mesh->updateBoundingBox();
+	return mesh;
+}
+
+cgltf_data* parseGLTF(const char* filename)
+{
+	cgltf_options options = {};
+	cgltf_data* data = NULL;
+	if (cgltf_parse_file(&options, filename, &data) != cgltf_result_success)
+		return NULL;
+	if (cgltf_load_buffers(&options, data, filename) != cgltf_result_success)
+	{
+		cgltf_free(data);
+		return NULL;
+	}
+	return data;
+}
+
+//a clip with a binary tree of bones where every bone rotates with a different phase
+Animation* createSyntheticAnimation(int num_bones, int num_keyframes, bool quantized)
+{
+	Animation* anim = new Animation();
+	Skeleton& skeleton = anim->skeleton;
+	skeleton.num_bones = num_bones;
+	for (int i = 0; i < num_bones; ++i)
+	{
+		Skeleton::Bone& bone = skeleton.bones[i];
+		bone.parent = i ? (i - 1) / 2 : -1;
+		snprintf(bone.name, sizeof(bone.name), "bone_%d", i);
+		bone.model.setTranslation(0.0f, 1.0f, 0.0f);
+		bone.layer = 0xFF;
+		bone.num_children = 0;
+		if (i)
+		{
+			Skeleton::Bone& parent = skeleton.bones[bone.parent];
+			parent.children[parent.num_children++] = i;
+		}
+	}
+	for (int i = 0; i < num_bones; ++i)
+		skeleton.bones_by_name[skeleton.bones[i].name] = i;
+
+	anim->samples_per_second = 30.0f;
+	anim->num_keyframes = num_keyframes;
+	anim->duration = num_keyframes / anim->samples_per_second;
+	anim->num_animated_bones = num_bones;
+	for (int i = 0; i < num_bones; ++i)
+		anim->bones_map[i] = i;
+
+	anim->keyframes = new BoneKey[num_keyframes * num_bones];
+	for (int k = 0; k < num_keyframes; ++k)
+		for (int i = 0; i < num_bones; ++i)
+		{
+			BoneKey& key = anim->keyframes[k * num_bones + i];
+			key.rotation = Quaternion(Vector3f(0.0f, 0.0f, 1.0f), sinf(k * 0.2f + i) * 0.5f);
+			key.translation.set(0.0f, 1.0f, 0.0f);
+			key.scale.set(1.0f, 1.0f, 1.0f);
+		}
+
+	if (quantized)
+		anim->quantize();
+	return anim;
+}
+
+//a skinned mesh only needs the bones info to be used by the crowd
+GFX::Mesh* createSyntheticSkinnedMesh(Animation* anim)
+{
+	GFX::Mesh* mesh = new GFX::Mesh();
+	mesh->bones_info.resize(anim->skeleton.num_bones);
+	for (int i = 0; i < anim->skeleton.num_bones; ++i)
+	{
+		BoneInfo& info = mesh->bones_info[i];
+		strcpy(info.name, anim->skeleton.bones[i].name);
+		info.bind_pose.setIdentity();
+	}
+	return mesh;
+}
+
+bool benchMath(BenchRunner& bench)
+{
+	const int num = 4096;
+	std::vector<Matrix44> a(num), b(num), result(num);
+	std::vector<Vector3f> points(num * 16), transformed(num * 16);
+	std::vector<BoundingBox> boxes(num);
+	for (int i = 0; i < num; ++i)
+	{
+		a[i].setRotation(random(6.28f), Vector3f(random(1.0f), random(1.0f), random(1.0f)).normalize());
+		a[i].translateGlobal(random(100.0f, -50), random(100.0f, -50), random(100.0f, -50));
+		b[i].setRotation(random(6.28f), Vector3f(0.0f, 1.0f, 0.0f));
+		boxes[i] = BoundingBox(Vector3f(random(100.0f, -50), random(100.0f, -50), random(100.0f, -50)), Vector3f(random(5.0f) + 0.1f));
+	}
+	for (Vector3f& p : points)
+		p.set(random(100.0f, -50), random(100.0f, -50), random(100.0f, -50));
+
+	bench.run("math/multiply_matrices_4k", [&]() {
+		multiplyMatrices(&a[0], &b[0], &result[0], num);
+		bench_sink = bench_sink + result[num - 1].m[12];
+	}, num);
+	bench.run("math/transform_points_64k", [&]() {
+		transformPoints(a[0], &points[0], &transformed[0], (int)points.size());
+		bench_sink = bench_sink + transformed.back().x;
+	}, (int)points.size());
+	bench.run("math/inverse_4k", [&]() {
+		for (int i = 0; i < num; ++i)
+		{
+			result[i] = a[i];
+			result[i].inverse();
+		}
+		bench_sink = bench_sink + result[num - 1].m[12];
+	}, num);
+	bench.run("math/transform_aabb_4k", [&]() {
+		float sum = 0.0f;
+		for (int i = 0; i < num; ++i)
+			sum += transformBoundingBox(a[i], boxes[i]).halfsize.x;
+		bench_sink = bench_sink + sum;
+	}, num);
+
+	//the inverse must undo the matrix (the SSE and scalar versions give the same bits, this also catches a broken kernel)
+	float max_error = 0.0f;
+	for (int i = 0; i < num; ++i)
+	{
+		Matrix44 inv = a[i];
+		inv.inverse();
+		Matrix44 identity = a[i] * inv;
+		for (int j = 0; j < 16; ++j)
+			max_error = std::max(max_error, std::abs(identity.m[j] - (j % 5 == 0 ? 1.0f : 0.0f)));
+	}
+	if (max_error > 1e-4f)
+	{
+		std::cout << TermColor::RED << "[ERROR] Matrix44::inverse error " << max_error << TermColor::DEFAULT << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void benchCulling(BenchRunner& bench)
+{
+	const int num = 10000;
+	Camera camera;
+	camera.setPerspective(60.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	camera.lookAt(Vector3f(0.0f, 50.0f, 200.0f), Vector3f(0.0f, 0.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f));
+
+	std::vector<Matrix44> models(num);
+	std::vector<BoundingBox> boxes(num);
+	for (int i = 0; i < num; ++i)
+	{
+		models[i].setRotation(random(6.28f), Vector3f(0.0f, 1.0f, 0.0f));
+		models[i].translateGlobal(random(1000.0f, -500), random(100.0f, -50), random(1000.0f, -500));
+		boxes[i] = BoundingBox(Vector3f(0.0f), Vector3f(random(10.0f) + 0.5f));
+	}
+
+	bench.run("culling/frustum_10k_boxes", [&]() {
+		int visible = 0;
+		for (int i = 0; i < num; ++i)
+		{
+			BoundingBox world_box = transformBoundingBox(models[i], boxes[i]);
+			if (camera.testBoxInFrustum(world_box.center, world_box.halfsize) != CLIP_OUTSIDE)
+				visible++;
+		}
+		bench_sink = bench_sink + (float)visible;
+	});
+
+	//walls in front of the camera hiding the boxes
+	const int num_walls = 32;
+	Vector3f wall[6] = { Vector3f(-40, -20, 0), Vector3f(40, -20, 0), Vector3f(40, 60, 0), Vector3f(-40, -20, 0), Vector3f(40, 60, 0), Vector3f(-40, 60, 0) };
+	std::vector<Matrix44> wall_models(num_walls);
+	for (int i = 0; i < num_walls; ++i)
+		wall_models[i].setTranslation(random(600.0f, -300), 0.0f, random(300.0f, -200));
+	std::vector<BoundingBox> world_boxes(num);
+	std::vector<uint8> visible(num);
+	for (int i = 0; i < num; ++i)
+		world_boxes[i] = transformBoundingBox(models[i], boxes[i]);
+
+	SCN::OcclusionCuller culler;
+	bench.run("culling/occlusion_raster_32_walls", [&]() {
+		culler.begin(camera.viewprojection_matrix);
+		for (int i = 0; i < num_walls; ++i)
+			culler.addOccluder(wall_models[i], wall, 2);
+		culler.rasterize();
+		bench_sink = bench_sink + culler.getDepth()[0];
+	});
+	bench.run("culling/occlusion_10k_boxes", [&]() {
+		culler.testBoxes(world_boxes.data(), num, visible.data());
+		bench_sink = bench_sink + (float)culler.num_occluded;
+	});
+}
+
+void benchClusters(BenchRunner& bench)
+{
+	const int num = 1024;
+	Camera camera;
+	camera.setPerspective(60.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	camera.lookAt(Vector3f(0.0f, 20.0f, 100.0f), Vector3f(0.0f, 0.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f));
+
+	std::vector<SCN::LightEntity> lights(num);
+	std::vector<SCN::LightEntity*> pointers(num);
+	for (int i = 0; i < num; ++i)
+	{
+		SCN::LightEntity& light = lights[i];
+		light.light_type = i % 4 ? SCN::eLightType::POINT : SCN::eLightType::SPOT;
+		light.max_distance = random(20.0f) + 2.0f;
+		light.cone_info.set(20.0f, 35.0f);
+		light.root.model.setRotation(random(6.28f), Vector3f(1.0f, 0.0f, 0.0f));
+		light.root.model.translateGlobal(random(400.0f, -200), random(40.0f, -20), random(400.0f, -300));
+		pointers[i] = &light;
+	}
+
+	SCN::LightClusters clusters;
+	bench.run("lights/clusters_1k_lights", [&]() {
+		clusters.build(pointers.data(), num, &camera);
+		bench_sink = bench_sink + (float)clusters.indices.size();
+	});
+}
+
+void benchPrefabs(BenchRunner& bench)
+{
+	for (const char* filename : prefabs)
+	{
+		std::string name = getPrefabName(filename);
+
+		bench.run(("gltf/parse/" + name).c_str(), [&]() {
+			cgltf_data* data = parseGLTF(filename);
+			bench_sink = bench_sink + (data ? (float)data->meshes_count : 0.0f);
+			if (data)
+				cgltf_free(data);
+		});
+
+		cgltf_data* data = parseGLTF(filename);
+		if (!data)
+		{
+			std::cout << "[ERROR] prefab not found: " << filename << std::endl;
+			continue;
+		}
+
+		bench.run(("gltf/unpack/" + name).c_str(), [&]() {
+			GFX::Mesh* mesh = unpackGLTFMeshes(data);
+			bench_sink = bench_sink + (float)mesh->vertices.size();
+			delete mesh;
+		});
+
+		GFX::Mesh* mesh = unpackGLTFMeshes(data);
+		cgltf_free(data);
+		if (mesh->vertices.empty())
+		{
+			delete mesh;
+			continue;
+		}
+
+		//writeBin appends the extension
+		std::string bin_filename = "gtr_bench_" + name;
+		bench.run(("mesh/write_bin/" + name).c_str(), [&]() {
+			mesh->writeBin(bin_filename.c_str());
+		});
+		bin_filename += ".mbin";
+		//readBin also builds the collision model, most of the time goes there
+		bench.run(("mesh/read_bin/" + name).c_str(), [&]() {
+			GFX::Mesh* loaded = new GFX::Mesh();
+			if (!loaded->readBin(bin_filename.c_str()))
+				std::cout << "[ERROR] cannot read mesh bin: " << bin_filename << std::endl;
+			bench_sink = bench_sink + (float)loaded->vertices.size();
+			delete loaded;
+		});
+		remove(bin_filename.c_str());
+
+		mesh->createCollisionModel();
+
+		//rays from a sphere around the mesh towards random points inside its box
+		const int num_rays = 256;
+		std::vector<Vector3f> origins(num_rays), directions(num_rays);
+		float radius = mesh->box.halfsize.length() * 2.0f + 1.0f;
+		for (int i = 0; i < num_rays; ++i)
+		{
+			Vector3f dir = Vector3f(random(2.0f, -1), random(2.0f, -1), random(2.0f, -1));
+			origins[i] = mesh->box.center + dir.normalize() * radius;
+			Vector3f target = mesh->box.center + Vector3f(random(2.0f, -1) * mesh->box.halfsize.x, random(2.0f, -1) * mesh->box.halfsize.y, random(2.0f, -1) * mesh->box.halfsize.z);
+			directions[i] = (target - origins[i]).normalize();
+		}
+		Matrix44 model;
+		bench.run(("picking/rays_256/" + name).c_str(), [&]() {
+			int hits = 0;
+			Vector3f collision, normal;
+			for (int i = 0; i < num_rays; ++i)
+				if (mesh->testRayCollision(model, origins[i], directions[i], collision, normal))
+					hits++;
+			bench_sink = bench_sink + (float)hits;
+		});
+
+		//what the import adds to every mesh
+		bench.run(("mesh/generate_lods/" + name).c_str(), [&]() {
+			mesh->generateLODs();
+			bench_sink = bench_sink + (float)mesh->lod_indices.size();
+		});
+
+		bench.run(("mesh/generate_meshlets/" + name).c_str(), [&]() {
+			mesh->generateMeshlets();
+			bench_sink = bench_sink + (float)mesh->meshlets.size();
+		});
+
+		delete mesh;
+	}
+
+	bench.run("mesh/create_sphere", [&]() {
+		GFX::Mesh mesh;
+		mesh.createSphere(1.0f, 64, 32);
+		bench_sink = bench_sink + (float)mesh.vertices.size();
+	});
+}
+
+void benchAnimation(BenchRunner& bench)
+{
+	const int num_bones = 64;
+	Animation* anim = createSyntheticAnimation(num_bones, 120, false);
+	Animation* quantized = createSyntheticAnimation(num_bones, 120, true);
+	Skeleton pose = anim->skeleton;
+
+	bench.run("anim/sample_64_bones_x100", [&]() {
+		for (int i = 0; i < 100; ++i)
+			anim->samplePose(i * 0.037f, pose);
+		bench_sink = bench_sink + pose.bones[num_bones - 1].model.m[0];
+	});
+	bench.run("anim/sample_quantized_64_bones_x100", [&]() {
+		for (int i = 0; i < 100; ++i)
+			quantized->samplePose(i * 0.037f, pose);
+		bench_sink = bench_sink + pose.bones[num_bones - 1].model.m[0];
+	});
+	bench.run("anim/global_matrices_64_bones_x100", [&]() {
+		for (int i = 0; i < 100; ++i)
+			pose.updateGlobalMatrices();
+		bench_sink = bench_sink + pose.global_bone_matrices[num_bones - 1].m[12];
+	});
+
+	//how the crowd scales with the number of agents (JobPool with all the cores)
+	GFX::Mesh* mesh = createSyntheticSkinnedMesh(quantized);
+	const int sizes[] = { 1, 10, 100, 1000 };
+	for (int size : sizes)
+	{
+		std::string name = "crowd/update_" + std::to_string(size) + "_agents";
+		if (!bench.isEnabled(name.c_str()))
+			continue;
+		AnimationCrowd crowd;
+		for (int i = 0; i < size; ++i)
+		{
+			CrowdAgent* agent = crowd.addAgent(mesh, quantized, random(quantized->duration));
+			crowd.setBlend(agent, anim, random(1.0f));
+		}
+		bench.run(name.c_str(), [&]() {
+			crowd.update(1.0f / 60.0f);
+			bench_sink = bench_sink + crowd.palette.back().m[12];
+		});
+	}
+	delete mesh;
+	delete anim;
+	delete quantized;
+}
+
+void benchSphericalHarmonics(BenchRunner& bench)
+{
+	const int size = 64;
+	FloatImage faces[6];
+	for (int i = 0; i < 6; ++i)
+	{
+		faces[i].resize(size, size, 3);
+		for (int j = 0; j < size * size * 3; ++j)
+			faces[i].data[j] = random(4.0f);
+	}
+
+	bench.run("sh/compute_64x64", [&]() {
+		SphericalHarmonics sh = computeSH(faces);
+		bench_sink = bench_sink + sh.coeffs[0].x;
+	});
+}
+
+//instancing a prefab copies its tree of nodes, done in one block per copy
+void benchNodes(BenchRunner& bench)
+{
+	//similar to a gltf with 200 nodes
+	SCN::Node tree;
+	for (int i = 0; i < 20; ++i)
+	{
+		SCN::Node* node = new SCN::Node();
+		node->name = "node_" + std::to_string(i);
+		tree.addChild(node);
+		for (int j = 0; j < 9; ++j)
+			node->addChild(new SCN::Node());
+	}
+
+	const int num_copies = 1000;
+	bench.run("nodes/instantiate_1000x200", [&]() {
+		std::vector<SCN::Node> copies(num_copies);
+		for (SCN::Node& copy : copies)
+			copy.addChildCopy(tree);
+		bench_sink = bench_sink + (float)copies.back().block_size;
+	});
+}
+
+//lookups of resource names, against the std::map the managers used before
+void benchRegistry(BenchRunner& bench)
+{
+	const int num = 10000;
+	std::vector<std::string> names(num);
+	std::vector<int> values(num);
+	std::map<std::string, int*> map;
+	CORE::Registry<int> registry;
+	for (int i = 0; i < num; ++i)
+	{
+		names[i] = "data/models/scene/mesh_" + std::to_string(i) + ".obj";
+		map[names[i]] = &values[i];
+		registry.add(names[i], &values[i]);
+	}
+
+	bench.run("registry/map_find_10k", [&]() {
+		int found = 0;
+		for (const std::string& name : names)
+			found += map.find(name.c_str()) != map.end();
+		bench_sink = bench_sink + (float)found;
+	});
+	bench.run("registry/find_10k", [&]() {
+		int found = 0;
+		for (const std::string& name : names)
+			found += registry.find(name.c_str()) != nullptr;
+		bench_sink = bench_sink + (float)found;
+	});
+}
+
+void benchJSON(BenchRunner& bench)
+{
+	std::string content;
+	if (!readFile("data/scene.json", content))
+	{
+		std::cout << "[ERROR] scene not found: data/scene.json" << std::endl;
+		return;
+	}
+
+	bench.run("json/parse_scene", [&]() {
+		cJSON* json = cJSON_Parse(content.c_str());
+		bench_sink = bench_sink + (json ? (float)cJSON_GetArraySize(json) : 0.0f);
+		if (json)
+			cJSON_Delete(json);
+	});
+	bench.run("json/read_scene", [&]() {
+		JSONDocument doc;
+		doc.parse(content.c_str(), content.size());
+		bench_sink = bench_sink + (float)doc.tokens.size();
+	});
+}
+
+//lights and entities of unknown types, prefabs would need a GL context
+void createSyntheticScene(SCN::Scene& scene, int num_entities)
+{
+	scene.clear();
+	scene.skybox_filename = "data/textures/skybox.hdre";
+	for (int i = 0; i < num_entities; ++i)
+	{
+		SCN::BaseEntity* ent = NULL;
+		if (i % 4)
+		{
+			SCN::LightEntity* light = new SCN::LightEntity();
+			light->light_type = (SCN::eLightType)(1 + i % 3);
+			light->color.set(random(1.0f), random(1.0f), random(1.0f));
+			light->intensity = random(10.0f);
+			light->cast_shadows = (i % 2) == 0;
+			ent = light;
+		}
+		else
+		{
+			SCN::UnknownEntity* unknown = new SCN::UnknownEntity();
+			unknown->original_type = "DECAL";
+			cJSON* json = cJSON_CreateObject();
+			writeJSONString(json, "texture", "data/textures/decal.png");
+			writeJSONNumber(json, "size", random(5.0f));
+			unknown->data = json;
+			ent = unknown;
+		}
+		ent->name = "entity_" + std::to_string(i);
+		ent->layers = 1 + i % 3;
+		ent->visible = (i % 7) != 0;
+		ent->root.model.setRotation(random(6.28f), Vector3f(0.0f, 1.0f, 0.0f));
+		ent->root.model.translateGlobal(random(1000.0f, -500), random(100.0f), random(1000.0f, -500));
+		scene.addEntity(ent);
+	}
+}
+
+//times both scene formats and checks the round trips, returns false if they fail
+bool benchScene(BenchRunner& bench)
+{
+	const int num_entities = 10000;
+	if (!bench.isEnabled("scene/"))
+		return true;
+
+	SCN::Scene scene;
+	createSyntheticScene(scene, num_entities);
+	std::string json;
+	scene.toString(json);
+	scene.saveBinary("gtr_bench_scene.sbin");
+
+	//the loaders print every entity, it would hide the results
+	bench.run("scene/load_json_10k", [&]() {
+		std::cout.setstate(std::ios::failbit);
+		scene.fromString(json);
+		std::cout.clear();
+		bench_sink = bench_sink + (float)scene.entities.size();
+	});
+	bench.run("scene/load_bin_10k", [&]() {
+		std::cout.setstate(std::ios::failbit);
+		scene.loadBinary("gtr_bench_scene.sbin");
+		std::cout.clear();
+		bench_sink = bench_sink + (float)scene.entities.size();
+	});
+
+	//JSON -> BIN -> JSON must give the same text
+	bool valid = true;
+	std::string from_bin;
+	scene.loadBinary("gtr_bench_scene.sbin");
+	scene.toString(from_bin);
+	if (from_bin != json)
+	{
+		std::cout << TermColor::RED << "[ERROR] scene JSON -> BIN -> JSON round trip differs" << TermColor::DEFAULT << std::endl;
+		valid = false;
+	}
+
+	//BIN -> scene -> BIN must give the same bytes
+	std::vector<unsigned char> bin, bin2;
+	readFileBin("gtr_bench_scene.sbin", bin);
+	scene.saveBinary("gtr_bench_scene.sbin");
+	readFileBin("gtr_bench_scene.sbin", bin2);
+	if (bin != bin2)
+	{
+		std::cout << TermColor::RED << "[ERROR] scene BIN -> BIN round trip differs" << TermColor::DEFAULT << std::endl;
+		valid = false;
+	}
+	remove("gtr_bench_scene.sbin");
+	scene.clear();
+	return valid;
+}
+
+//the work done every frame must not allocate once it is warmed up (the renderer asserts the same in debug builds)
+bool checkFrameAllocations(BenchRunner& bench)
+{
+	const char* frame_cases[] = { "math/", "culling/", "lights/", "anim/", "crowd/" };
+	bool valid = true;
+	for (const BenchResult& r : bench.results)
+		for (const char* prefix : frame_cases)
+			if (r.name.compare(0, strlen(prefix), prefix) == 0 && r.heap_allocations > 0)
+			{
+				std::cout << TermColor::RED << "[ERROR] " << r.name << " allocated from the heap " << r.heap_allocations << " times after the warm-up" << TermColor::DEFAULT << std::endl;
+				valid = false;
+			}
+	return valid;
+}
+
+int main(int argc, char** argv)
+{
+	BenchRunner bench;
+	const char* output = "bench_results.json";
+	const char* baseline = NULL;
+	float threshold = 0.1f;
+	for (int i = 1; i < argc - 1; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--filter")
+			bench.filter = argv[++i];
+		else if (arg == "--reps")
+			bench.repetitions = std::max(1, atoi(argv[++i]));
+		else if (arg == "--warmup")
+			bench.warmup = std::max(0, atoi(argv[++i]));
+		else if (arg == "--out")
+			output = argv[++i];
+		else if (arg == "--baseline")
+			baseline = argv[++i];
+		else if (arg == "--threshold")
+			threshold = (float)atof(argv[++i]);
+	}
+
+	//same sequence in every run
+	srand(1234);
+	REGISTER_ENTITY_TYPE(SCN::LightEntity);
+
+	std::cout << "Running benchmarks (" << bench.warmup << " warm-up, " << bench.repetitions << " repetitions)" << std::endl;
+	bool valid = benchMath(bench);
+	benchCulling(bench);
+	benchClusters(bench);
+	benchPrefabs(bench);
+	benchAnimation(bench);
+	benchSphericalHarmonics(bench);
+	benchNodes(bench);
+	benchRegistry(bench);
+	benchJSON(bench);
+	valid = benchScene(bench) && valid;
+	valid = checkFrameAllocations(bench) && valid;
+	JobPool::global.stop();
+
+	if (output)
+		bench.saveJSON(output);
+
+	if (baseline && bench.compareBaseline(baseline, threshold) != 0)
+		return 1;
+	return valid ? 0 : 1;
+}
@@ -4,6 +4,13 @@ texture basic.vs texture.fs
 skybox basic.vs skybox.fs
 depth quad.vs depth.fs
 multi basic.vs multi.fs
+clustered basic.vs clustered.fs
+gbuffers basic.vs gbuffers.fs
+deferred_global quad.vs deferred_global.fs
+deferred_light_quad quad.vs deferred_light.fs
+deferred_light_volume basic.vs deferred_light.fs
+deferred_resolve quad.vs deferred_resolve.fs
+prepass position.vs empty.fs
 
 \perturbNormal
 
@@ -35,6 +42,83 @@ vec3 perturbNormal(vec3 N, vec3 WP, vec2 uv, vec3 normal_pixel)
 	return normalize(TBN * normal_pixel);
 }
 
+\shadows
+
+//shadow tiles (see ShadowAtlas), 5 texels per tile: viewprojection and rect + bias
+uniform sampler2D u_shadow_atlas;
+uniform samplerBuffer u_shadows;
+
+//directional lights have several tiles (cascades), the first one that contains the pixel is used
+float computeShadow(vec3 world_position, int first_tile, int num_tiles)
+{
+	for (int tile = first_tile; tile < first_tile + num_tiles; ++tile)
+	{
+		mat4 viewprojection = mat4(texelFetch(u_shadows, tile * 5), texelFetch(u_shadows, tile * 5 + 1), texelFetch(u_shadows, tile * 5 + 2), texelFetch(u_shadows, tile * 5 + 3));
+		vec4 rect = texelFetch(u_shadows, tile * 5 + 4);
+		vec4 proj = viewprojection * vec4(world_position, 1.0);
+		proj.xyz /= proj.w;
+		if (any(greaterThan(abs(proj.xyz), vec3(0.99, 0.99, 1.0))))
+			continue; //outside of the light frustum
+		vec2 uv = rect.xy + (proj.xy * 0.5 + 0.5) * rect.z;
+		float depth = proj.z * 0.5 + 0.5;
+		return texture(u_shadow_atlas, uv).x < depth - rect.w ? 0.0 : 1.0;
+	}
+	return 1.0;
+}
+
+\lighting
+
+//light in the layout of ClusterLight: position + max distance, color + type, front + cos outer, cos inner + shadow tiles
+vec3 computeLight(vec3 world_position, vec3 N, vec4 position, vec4 color, vec4 direction, vec4 cone)
+{
+	float shadow = cone.y >= 0.0 ? computeShadow(world_position, int(cone.y), int(cone.z)) : 1.0;
+
+	//directional
+	if (color.w == 3.0)
+		return color.xyz * max(dot(N, -direction.xyz), 0.0) * shadow;
+
+	vec3 L = position.xyz - world_position;
+	float dist = length(L);
+	L /= dist;
+	float att = clamp(1.0 - dist / position.w, 0.0, 1.0);
+	att *= att;
+
+	//spot
+	if (color.w == 2.0)
+		att *= smoothstep(direction.w, cone.x, dot(-L, direction.xyz));
+	return color.xyz * max(dot(N, L), 0.0) * att * shadow;
+}
+
+//direction to the light, same layout
+vec3 getLightVector(vec3 world_position, vec4 position, vec4 color, vec4 direction)
+{
+	if (color.w == 3.0)
+		return -direction.xyz;
+	return normalize(position.xyz - world_position);
+}
+
+//metallic workflow: lambert + GGX (schlick fresnel, smith visibility), what multiplies the light from computeLight
+//it keeps the scale of the lights (no 1/PI in the diffuse), so a dielectric looks as bright as with the forward shaders
+vec3 computeBRDF(vec3 N, vec3 L, vec3 V, vec3 albedo, float metallic, float roughness)
+{
+	vec3 H = normalize(L + V);
+	float NdotL = max(dot(N, L), 0.0001);
+	float NdotV = max(dot(N, V), 0.0001);
+	float NdotH = max(dot(N, H), 0.0);
+	float a = max(roughness * roughness, 0.002);
+	float a2 = a * a;
+
+	vec3 F0 = mix(vec3(0.04), albedo, metallic);
+	vec3 F = F0 + (1.0 - F0) * pow(1.0 - max(dot(V, H), 0.0), 5.0);
+	float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+	float D = a2 / (d * d); //the PI of GGX cancels with the missing one of the diffuse
+	float k = a * 0.5;
+	float vis = 0.25 / ((NdotL * (1.0 - k) + k) * (NdotV * (1.0 - k) + k));
+
+	vec3 diffuse = albedo * (1.0 - metallic) * (1.0 - F);
+	return diffuse + F * D * vis;
+}
+
 \basic.vs
 
 #version 330 core
@@ -58,6 +142,8 @@ out vec4 v_color;
 
 uniform float u_time;
 
+invariant gl_Position; //same depth as the prepass
+
 void main()
 {	
 	//calcule the normal in camera space (the NormalMatrix is like ViewMatrix but without traslation)
@@ -77,6 +163,24 @@ void main()
 	gl_Position = u_viewprojection * vec4( v_world_position, 1.0 );
 }
 
+\position.vs
+
+#version 330 core
+
+//depth prepass, the position computed exactly like basic.vs
+in vec3 a_vertex;
+
+uniform mat4 u_model;
+uniform mat4 u_viewprojection;
+
+invariant gl_Position;
+
+void main()
+{
+	vec3 world_position = (u_model * vec4( a_vertex, 1.0) ).xyz;
+	gl_Position = u_viewprojection * vec4( world_position, 1.0 );
+}
+
 \quad.vs
 
 #version 330 core
@@ -92,6 +196,15 @@ void main()
 }
 
 
+\empty.fs
+
+#version 330 core
+
+void main()
+{
+}
+
+
 \flat.fs
 
 #version 330 core
@@ -136,6 +249,245 @@ void main()
 }
 
 
+\clustered.fs
+
+#version 330 core
+
+in vec3 v_position;
+in vec3 v_world_position;
+in vec3 v_normal;
+in vec2 v_uv;
+in vec4 v_color;
+
+uniform vec4 u_color;
+uniform sampler2D u_texture;
+uniform float u_alpha_cutoff;
+uniform vec3 u_camera_position;
+uniform vec3 u_ambient_light;
+
+//lights binned in froxels (see LightClusters), 4 texels per light
+uniform samplerBuffer u_lights;
+uniform usamplerBuffer u_clusters;
+uniform usamplerBuffer u_light_indices;
+uniform int u_num_directional;
+uniform ivec3 u_cluster_grid;
+uniform vec2 u_cluster_slice; //slice = log(depth) * x + y
+uniform vec2 u_viewport_size;
+uniform vec3 u_camera_front;
+uniform bool u_light_heatmap;
+
+out vec4 FragColor;
+
+#include "shadows"
+#include "lighting"
+
+vec3 computeLight(int index, vec3 N)
+{
+	return computeLight(v_world_position, N, texelFetch(u_lights, index * 4), texelFetch(u_lights, index * 4 + 1), texelFetch(u_lights, index * 4 + 2), texelFetch(u_lights, index * 4 + 3));
+}
+
+void main()
+{
+	vec4 color = u_color;
+	color *= texture( u_texture, v_uv );
+
+	if(color.a < u_alpha_cutoff)
+		discard;
+
+	//find the cluster of the pixel
+	float depth = max(dot(v_world_position - u_camera_position, u_camera_front), 0.0001);
+	ivec3 cluster;
+	cluster.xy = ivec2(gl_FragCoord.xy / u_viewport_size * vec2(u_cluster_grid.xy));
+	cluster.z = int(log(depth) * u_cluster_slice.x + u_cluster_slice.y);
+	cluster = clamp(cluster, ivec3(0), u_cluster_grid - ivec3(1));
+	uvec2 range = texelFetch(u_clusters, (cluster.z * u_cluster_grid.y + cluster.y) * u_cluster_grid.x + cluster.x).xy;
+
+	if (u_light_heatmap)
+	{
+		float heat = float(range.y) / 32.0;
+		FragColor = vec4(mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), clamp(heat, 0.0, 1.0)) + vec3(max(heat - 1.0, 0.0)), 1.0);
+		return;
+	}
+
+	vec3 N = normalize(v_normal);
+	vec3 light = u_ambient_light;
+	for (int i = 0; i < u_num_directional; ++i)
+		light += computeLight(i, N);
+	for (uint i = 0u; i < range.y; ++i)
+		light += computeLight(int(texelFetch(u_light_indices, int(range.x + i)).x), N);
+
+	FragColor = vec4(color.xyz * light, color.a);
+}
+
+
+\gbuffers.fs
+
+#version 330 core
+
+in vec3 v_position;
+in vec3 v_world_position;
+in vec3 v_normal;
+in vec2 v_uv;
+in vec4 v_color;
+
+uniform vec4 u_color;
+uniform sampler2D u_texture;
+uniform float u_alpha_cutoff;
+uniform sampler2D u_emissive_texture;
+uniform sampler2D u_metallic_roughness_texture;
+uniform sampler2D u_occlusion_texture;
+uniform sampler2D u_normal_texture;
+uniform bool u_has_normalmap;
+uniform vec3 u_emissive_factor;
+uniform vec2 u_metallic_roughness;
+
+//albedo + occlusion, normal (octahedral) + metallic + roughness, emissive
+layout(location = 0) out vec4 GBuffer0;
+layout(location = 1) out vec4 GBuffer1;
+layout(location = 2) out vec4 GBuffer2;
+
+#include "perturbNormal"
+
+vec2 encodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return e * 0.5 + 0.5;
+}
+
+void main()
+{
+	vec4 color = u_color;
+	color *= texture( u_texture, v_uv );
+
+	if(color.a < u_alpha_cutoff)
+		discard;
+
+	vec3 N = normalize(v_normal);
+	if (!gl_FrontFacing)
+		N = -N;
+	if (u_has_normalmap)
+		N = perturbNormal(N, v_world_position, v_uv, texture(u_normal_texture, v_uv).xyz * 2.0 - 1.0);
+
+	//gltf: occlusion in red, roughness in green, metallic in blue
+	float occlusion = texture(u_occlusion_texture, v_uv).x;
+	vec3 metallic_roughness = texture(u_metallic_roughness_texture, v_uv).xyz;
+	vec3 emissive = u_emissive_factor * texture(u_emissive_texture, v_uv).xyz;
+
+	GBuffer0 = vec4(color.xyz, occlusion);
+	GBuffer1 = vec4(encodeNormal(N), metallic_roughness.z * u_metallic_roughness.x, metallic_roughness.y * u_metallic_roughness.y);
+	GBuffer2 = vec4(emissive, 1.0);
+}
+
+
+\gbuffer_read
+
+uniform sampler2D u_gbuffer0;
+uniform sampler2D u_gbuffer1;
+uniform sampler2D u_gbuffer2;
+uniform sampler2D u_depth_texture;
+uniform mat4 u_inverse_viewprojection;
+uniform vec3 u_camera_position;
+uniform vec2 u_iRes; //1 / viewport size
+
+vec3 decodeNormal(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+vec3 getWorldPosition(vec2 uv, float depth)
+{
+	vec4 pos = u_inverse_viewprojection * vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	return pos.xyz / pos.w;
+}
+
+
+\deferred_global.fs
+
+#version 330 core
+
+uniform vec3 u_ambient_light;
+
+out vec4 FragColor;
+
+#include "gbuffer_read"
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy * u_iRes;
+	float depth = texture(u_depth_texture, uv).x;
+	if (depth == 1.0)
+		discard; //the background (skybox) stays
+
+	vec4 albedo = texture(u_gbuffer0, uv);
+	vec2 metallic_roughness = texture(u_gbuffer1, uv).zw;
+	vec3 emissive = texture(u_gbuffer2, uv).xyz;
+
+	//the ambient has no direction, metals only reflect it (tinted by their color) and rough surfaces less of it
+	vec3 F0 = mix(vec3(0.04), albedo.xyz, metallic_roughness.x);
+	vec3 reflected = F0 * (1.0 - 0.5 * metallic_roughness.y);
+	vec3 ambient = (albedo.xyz * (1.0 - metallic_roughness.x) + reflected) * u_ambient_light * albedo.w;
+	FragColor = vec4(ambient + emissive, 1.0);
+}
+
+
+\deferred_light.fs
+
+#version 330 core
+
+//one light, in the layout of ClusterLight
+uniform vec4 u_light_position;
+uniform vec4 u_light_color;
+uniform vec4 u_light_direction;
+uniform vec4 u_light_cone;
+
+out vec4 FragColor;
+
+#include "gbuffer_read"
+#include "shadows"
+#include "lighting"
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy * u_iRes;
+	float depth = texture(u_depth_texture, uv).x;
+	if (depth == 1.0)
+		discard;
+
+	vec3 world_position = getWorldPosition(uv, depth);
+	vec3 albedo = texture(u_gbuffer0, uv).xyz;
+	vec4 gbuffer1 = texture(u_gbuffer1, uv);
+	vec3 N = decodeNormal(gbuffer1.xy);
+	vec3 V = normalize(u_camera_position - world_position);
+	vec3 L = getLightVector(world_position, u_light_position, u_light_color, u_light_direction);
+	vec3 light = computeLight(world_position, N, u_light_position, u_light_color, u_light_direction, u_light_cone);
+	FragColor = vec4(light * computeBRDF(N, L, V, albedo, gbuffer1.z, gbuffer1.w), 1.0);
+}
+
+
+\deferred_resolve.fs
+
+#version 330 core
+
+uniform sampler2D u_texture;
+uniform sampler2D u_depth_texture;
+uniform vec2 u_iRes;
+
+out vec4 FragColor;
+
+//copies the lighting and its depth to the screen, so what is rendered after can use the depth
+void main()
+{
+	vec2 uv = gl_FragCoord.xy * u_iRes;
+	FragColor = texture(u_texture, uv);
+	gl_FragDepth = texture(u_depth_texture, uv).x;
+}
+
+
 \skybox.fs
 
 #version 330 core
@@ -244,3 +596,166 @@ void main()
 	//calcule the position of the vertex using the matrices
 	gl_Position = u_viewprojection * vec4( v_world_position, 1.0 );
 }
+
+
+\multidraw.vs
+
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+
+//basic.vs for glMultiDrawElementsIndirect, the model of every draw comes from a buffer
+in vec3 a_vertex;
+in vec3 a_normal;
+in vec2 a_coord;
+
+layout(std430, binding = 0) readonly buffer ModelsBlock { mat4 u_models[]; };
+uniform int u_first_draw;	//gl_DrawID starts at 0 in every call
+
+uniform mat4 u_viewprojection;
+
+out vec3 v_position;
+out vec3 v_world_position;
+out vec3 v_normal;
+out vec2 v_uv;
+out vec4 v_color;
+
+invariant gl_Position;
+
+void main()
+{
+	mat4 model = u_models[u_first_draw + gl_DrawIDARB];
+	v_normal = (model * vec4( a_normal, 0.0) ).xyz;
+	v_position = a_vertex;
+	v_world_position = (model * vec4( v_position, 1.0) ).xyz;
+	v_color = vec4(1.0);
+	v_uv = a_coord;
+	gl_Position = u_viewprojection * vec4( v_world_position, 1.0 );
+}
+
+
+\skinned.vs
+
+#version 430 core
+
+//basic.vs for the characters of the crowd, every vertex is moved by up to 4 bones of the palette
+in vec3 a_vertex;
+in vec3 a_normal;
+in vec2 a_coord;
+in vec4 a_bones;	//bone indices (as floats)
+in vec4 a_weights;
+
+layout(std430, binding = 0) readonly buffer BonesBlock { mat4 u_bones[]; };
+uniform int u_bones_offset;	//first bone of this agent in the palette
+
+uniform mat4 u_model;
+uniform mat4 u_viewprojection;
+
+out vec3 v_position;
+out vec3 v_world_position;
+out vec3 v_normal;
+out vec2 v_uv;
+out vec4 v_color;
+
+invariant gl_Position;
+
+void main()
+{
+	ivec4 bones = ivec4(a_bones) + u_bones_offset;
+	mat4 skin = u_bones[bones.x] * a_weights.x + u_bones[bones.y] * a_weights.y + u_bones[bones.z] * a_weights.z + u_bones[bones.w] * a_weights.w;
+	v_position = (skin * vec4( a_vertex, 1.0 )).xyz;
+	v_normal = (u_model * skin * vec4( a_normal, 0.0 )).xyz;
+	v_world_position = (u_model * vec4( v_position, 1.0 )).xyz;
+	v_color = vec4(1.0);
+	v_uv = a_coord;
+	gl_Position = u_viewprojection * vec4( v_world_position, 1.0 );
+}
+
+
+\multidraw_position.vs
+
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+
+//depth prepass of the multi draw, the position computed exactly like multidraw.vs
+in vec3 a_vertex;
+
+layout(std430, binding = 0) readonly buffer ModelsBlock { mat4 u_models[]; };
+uniform int u_first_draw;
+
+uniform mat4 u_viewprojection;
+
+invariant gl_Position;
+
+void main()
+{
+	vec3 world_position = (u_models[u_first_draw + gl_DrawIDARB] * vec4( a_vertex, 1.0) ).xyz;
+	gl_Position = u_viewprojection * vec4( world_position, 1.0 );
+}
+
+
+\meshlet_cull.cs
+
+#version 430 core
+
+//one group per meshlet: the first thread tests it, then they copy its indices to the compacted list
+layout(local_size_x = 64) in;
+
+struct Meshlet {
+	vec4 sphere;	//center, radius
+	vec4 cone;	//axis, cutoff
+	uvec4 range;	//first index, num indices, num vertices
+};
+
+layout(std430, binding = 0) readonly buffer MeshletBlock { Meshlet u_meshlets[]; };
+layout(std430, binding = 1) readonly buffer IndicesBlock { uint u_indices[]; };
+layout(std430, binding = 2) writeonly buffer VisibleBlock { uint u_visible_indices[]; };
+layout(std430, binding = 3) buffer CommandsBlock { uint u_commands[]; };	//count, instances, first index, base vertex, base instance
+
+uniform mat4 u_model;
+uniform vec4 u_frustum[6];
+uniform vec3 u_camera_position;
+uniform float u_max_scale;
+uniform int u_two_sided;
+uniform int u_num_meshlets;
+uniform int u_command;
+
+shared uint s_offset;
+shared bool s_visible;
+
+void main()
+{
+	uint id = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+	if (id >= uint(u_num_meshlets))
+		return;
+	Meshlet meshlet = u_meshlets[id];
+
+	if (gl_LocalInvocationIndex == 0u)
+	{
+		vec3 center = (u_model * vec4(meshlet.sphere.xyz, 1.0)).xyz;
+		float radius = meshlet.sphere.w * u_max_scale;
+		bool visible = true;
+		for (int i = 0; i < 6; ++i)
+			if (dot(u_frustum[i].xyz, center) + u_frustum[i].w <= -radius)
+				visible = false;
+
+		//every triangle faces away from the camera
+		if (visible && u_two_sided == 0 && meshlet.cone.w < 1.0)
+		{
+			vec3 axis = normalize(mat3(u_model) * meshlet.cone.xyz);
+			vec3 to_center = center - u_camera_position;
+			if (dot(to_center, axis) >= meshlet.cone.w * length(to_center) + radius)
+				visible = false;
+		}
+
+		s_visible = visible;
+		if (visible)
+			s_offset = atomicAdd(u_commands[uint(u_command) * 5u], meshlet.range.y);
+	}
+	barrier();
+
+	if (!s_visible)
+		return;
+	uint first = u_commands[uint(u_command) * 5u + 2u] + s_offset;
+	for (uint i = gl_LocalInvocationIndex; i < meshlet.range.y; i += 64u)
+		u_visible_indices[first + i] = u_indices[meshlet.range.x + i];
+}
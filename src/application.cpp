@@ -6,6 +6,7 @@
 
 #include "editor.h"
 #include "pipeline/light.h"
+#include "pipeline/character.h"
 
 std::vector<vec3> debug_points; //useful
 
@@ -13,7 +14,7 @@ float cam_speed = 1.5;
 
 SceneEditor* editor = nullptr;
 
-Application::Application()
+Application::Application(const char* scene_filename)
 {
 	instance = this;
 	mouse_locked = false;
@@ -22,6 +23,7 @@ Application::Application()
 	REGISTER_ENTITY_TYPE(SCN::PrefabEntity);
 	//add here your own entities
 	REGISTER_ENTITY_TYPE(SCN::LightEntity);
+	REGISTER_ENTITY_TYPE(SCN::CharacterEntity);
 	//...
 
 	// Create camera
@@ -31,7 +33,7 @@ Application::Application()
 
 	//load scene
 	scene = new SCN::Scene();
-	if (!scene->load(getRelativePath("data/scene.json").c_str()))
+	if (!scene->load(getRelativePath(scene_filename).c_str()))
 		exit(1);
 
 	camera->lookAt(scene->main_camera.eye, scene->main_camera.center, vec3(0, 1, 0));
@@ -116,6 +118,21 @@ void Application::update(double seconds_elapsed)
 	{
 		Input::centerMouse();
 	}
+
+	//poses of the animated characters
+	renderer->updateCrowd(scene, (float)seconds_elapsed);
+}
+
+//fixed camera path for benchmarks: one orbit around the scene camera target
+void Application::setBenchFrame(int frame, int num_frames)
+{
+	vec3 center = scene->main_camera.center;
+	vec3 offset = scene->main_camera.eye - center;
+	float angle = 2.0f * PI * frame / (float)num_frames;
+	Matrix44 rotation;
+	rotation.setRotation(angle, vec3(0, 1, 0));
+	camera->lookAt(center + rotation.rotateVector(offset), center, vec3(0, 1, 0));
+	camera->fov = scene->main_camera.fov;
 }
 
 //called to render the GUI from
@@ -18,7 +18,7 @@ public:
 	SCN::Renderer* renderer = nullptr;
 	bool render_debug = true;
 
-	Application();
+	Application(const char* scene_filename = "data/scene.json");
 
 	//main functions
 	void render( void );
@@ -36,6 +36,7 @@ public:
 	void onGamepadButtonUp(SDL_JoyButtonEvent event);
 	void onResize(int width, int height);
 	void onFileDrop(std::string filename, std::string relative, SDL_Event event );
+	void setBenchFrame(int frame, int num_frames);
 };
 
 
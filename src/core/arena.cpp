@@ -0,0 +1,108 @@
+#include "arena.h"
+#include "memory.h"
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+static thread_local long t_heap_allocations = 0;
+
+void* operator new(size_t size)
+{
+	t_heap_allocations++;
+	void* ptr = CORE::MemoryTracker::taggedAllocate(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept { CORE::MemoryTracker::taggedFree(ptr); }
+void operator delete(void* ptr, size_t size) noexcept { CORE::MemoryTracker::taggedFree(ptr); }
+#endif
+
+CORE::LinearArena CORE::FrameArena::arenas[2];
+int CORE::FrameArena::current = 0;
+long CORE::FrameArena::heap_allocations = -1;
+
+CORE::LinearArena::LinearArena()
+{
+	buffer = nullptr;
+	capacity = used = peak = 0;
+	overflows = 0;
+	overflow_bytes = 0;
+}
+
+CORE::LinearArena::~LinearArena()
+{
+	reset();
+	free(buffer);
+}
+
+void* CORE::LinearArena::allocate(size_t size, size_t alignment)
+{
+	if (!buffer)
+	{
+		capacity = FRAME_ARENA_INITIAL_SIZE;
+		buffer = (char*)malloc(capacity);
+	}
+
+	//alignment must be a power of two
+	size_t start = (size_t)(((uintptr_t)buffer + used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - (size_t)(uintptr_t)buffer;
+	if (start + size <= capacity)
+	{
+		used = start + size;
+		if (used + overflow_bytes > peak)
+			peak = used + overflow_bytes;
+		return buffer + start;
+	}
+
+	//doesnt fit, use the heap for this frame, the buffer will be bigger in the next one
+	overflows++;
+	overflow_bytes += size + alignment;
+	if (used + overflow_bytes > peak)
+		peak = used + overflow_bytes;
+	void* block = malloc(size + alignment);
+	overflow_blocks.push_back(block);
+	return (void*)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void CORE::LinearArena::reset()
+{
+	for (void* block : overflow_blocks)
+		free(block);
+	overflow_blocks.clear();
+
+	if (overflows && buffer)
+	{
+		//the next frames will probably need the same
+		while (capacity < peak)
+			capacity *= 2;
+		free(buffer);
+		buffer = (char*)malloc(capacity);
+	}
+	used = 0;
+	overflows = 0;
+	overflow_bytes = 0;
+}
+
+void CORE::FrameArena::beginFrame()
+{
+#ifdef COUNT_HEAP_ALLOCATIONS
+	static long last_count = 0;
+	long count = t_heap_allocations;
+	heap_allocations = count - last_count;
+	last_count = count;
+#endif
+	current = (current + 1) % 2;
+	arenas[current].reset();
+}
+
+long CORE::FrameArena::getHeapAllocations()
+{
+#ifdef COUNT_HEAP_ALLOCATIONS
+	return t_heap_allocations;
+#else
+	return -1;
+#endif
+}
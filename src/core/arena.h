@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+//Linear (bump) allocators for the data that only lives during a frame: render lists, sort keys, culling results...
+//allocating is moving a pointer and everything is freed at once when the frame starts.
+//There are two arenas, so what was allocated in the previous frame is still valid during the current one.
+//Only for the main thread.
+
+//counts the calls to the global operator new of every thread, to check that the frames dont allocate (the renderer asserts it)
+#if defined(_DEBUG) && !defined(COUNT_HEAP_ALLOCATIONS)
+	#define COUNT_HEAP_ALLOCATIONS
+#endif
+
+#define FRAME_ARENA_INITIAL_SIZE (1 << 20) //1MB, it grows if a frame needs more
+
+namespace CORE {
+
+	class LinearArena {
+	public:
+		size_t capacity;
+		size_t used;
+		size_t peak;		//max used in a frame, including the overflow
+		int overflows;		//allocations that didnt fit since the last reset
+
+		LinearArena();
+		~LinearArena();
+
+		void* allocate(size_t size, size_t alignment = 16);
+		void reset(); //frees everything, and grows the buffer if it overflowed
+
+	private:
+		char* buffer;
+		size_t overflow_bytes;
+		std::vector<void*> overflow_blocks; //taken from the heap when the buffer is full
+	};
+
+	class FrameArena {
+	public:
+		static LinearArena arenas[2];
+		static int current;
+		static long heap_allocations; //calls to operator new from the main thread during the last frame, -1 if not counted
+
+		static void beginFrame(); //called by the main loop
+		static LinearArena& get() { return arenas[current]; }
+		static void* allocate(size_t size, size_t alignment = 16) { return arenas[current].allocate(size, alignment); }
+		static long getHeapAllocations(); //from the calling thread since it started (the loader threads dont count), -1 if not counted
+	};
+
+	//STL adapter: std::vector<T, FrameAllocator<T>> takes its memory from the current frame arena, deallocate does nothing.
+	//Containers must be refilled every frame (assign an empty one before using it again)
+	template<typename T>
+	class FrameAllocator {
+	public:
+		typedef T value_type;
+
+		FrameAllocator() noexcept {}
+		template<typename U> FrameAllocator(const FrameAllocator<U>&) noexcept {}
+
+		T* allocate(size_t n) { return (T*)FrameArena::allocate(n * sizeof(T), alignof(T) < 16 ? 16 : alignof(T)); }
+		void deallocate(T*, size_t) noexcept {}
+
+		template<typename U> bool operator == (const FrameAllocator<U>&) const noexcept { return true; }
+		template<typename U> bool operator != (const FrameAllocator<U>&) const noexcept { return false; }
+	};
+
+	template<typename T>
+	using FrameVector = std::vector<T, FrameAllocator<T>>;
+};
@@ -2,12 +2,18 @@
 
 #include "input.h"
 #include "task.h"
+#include "profiler.h"
+#include "registry.h"
+#include "arena.h"
 #include "ui.h"
 
 #include "../gfx/gfx.h" //check errors
 #include "../gfx/texture.h" //??
+#include "../gfx/mesh.h" //stats
 #include "../utils/utils.h" //cleanPath
 
+#include <algorithm> //sort
+
 #ifdef WIN32
 	#include <Commdlg.h>
 	#include <windows.h> //time
@@ -19,6 +25,7 @@ SDL_GLContext glcontext;
 SDL_Window* current_window = nullptr;
 long last_time = 0; //this is used to calcule the elapsed time between frames
 std::string CORE::base_path;
+bool CORE::headless = false;
 
 CORE::BaseApplication* CORE::BaseApplication::instance = nullptr;
 
@@ -41,8 +48,13 @@ CORE::BaseApplication::BaseApplication()
 	this->window_height = (int)window_size.y;
 }
 
-void CORE::init()
+void CORE::init(bool headless)
 {
+	//without display, SDL creates the GL context with EGL (works with software GL too)
+	CORE::headless = headless;
+	if (headless)
+		SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+
 	//prepare SDL
 	// TODO(Juan): SDL_init_everything?
 	SDL_Init(SDL_INIT_JOYSTICK | SDL_INIT_GAMEPAD | SDL_INIT_TIMER  | SDL_INIT_EVENTS | SDL_INIT_VIDEO);
@@ -53,7 +65,7 @@ void CORE::init()
 //create a window using SDL
 CORE::Window* CORE::createWindow(const char* caption, int width, int height, bool fullscreen)
 {
-	int multisample = 8;
+	int multisample = headless ? 0 : 8; //no antialiasing in benchmarks, slow in software GL
 	bool retina = false; //change this to use a retina display
 
 	//set attributes
@@ -69,7 +81,7 @@ CORE::Window* CORE::createWindow(const char* caption, int width, int height, boo
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
 	//antialiasing (disable this lines if it goes too slow)
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
+	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, multisample ? 1 : 0);
 	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, multisample); //increase to have smoother polygons
 
 	// Initialize the joystick subsystem
@@ -79,7 +91,8 @@ CORE::Window* CORE::createWindow(const char* caption, int width, int height, boo
 	// TODO(Juan): SDL_WINDOWPOS_CENTERED in SDL3?
 	SDL_Window* sdl_window = SDL_CreateWindow(caption, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE |
 		(retina ? SDL_WINDOW_HIGH_PIXEL_DENSITY : 0) |
-		(fullscreen ? SDL_WINDOW_FULLSCREEN : 0));
+		(fullscreen ? SDL_WINDOW_FULLSCREEN : 0) |
+		(headless ? SDL_WINDOW_HIDDEN : 0));
 	if (!sdl_window)
 	{
 		fprintf(stderr, "Window creation error: %s\n", SDL_GetError());
@@ -90,8 +103,8 @@ CORE::Window* CORE::createWindow(const char* caption, int width, int height, boo
 	glcontext = SDL_GL_CreateContext(sdl_window);
 	SDL_GL_MakeCurrent(sdl_window, glcontext);
 
-	// Enable Vsync
-	SDL_GL_SetSwapInterval(1);
+	// Enable Vsync (not when measuring)
+	SDL_GL_SetSwapInterval(headless ? 0 : 1);
 
 	//in case of exit, call SDL_Quit()
 	atexit(SDL_Quit);
@@ -158,22 +171,18 @@ void CORE::mainLoop(CORE::Window* window, BaseApplication* app)
 	long start_time = CORE::getTime();
 	long now = start_time;
 	long frames_this_second = 0;
-	int history_pos = 0;
 
 	memset(GFX::gpu_frame_microseconds_history, 0, sizeof(GFX::gpu_frame_microseconds_history));
-	GFX::GPUQuery gputime(GL_TIME_ELAPSED);
 	GFX::checkGLErrors();
+	Profiler::setThreadName("Main");
 
 	while (!app->must_exit)
 	{
-		//add timer to check gpu frame time with precission instead of using CPU
-		if (gputime.isReady())
-		{
-			GFX::gpu_frame_microseconds = gputime.value / 1000;
-			GFX::gpu_frame_microseconds_history[history_pos] = GFX::gpu_frame_microseconds;
-			history_pos = (history_pos + 1) % GPU_FRAME_HISTORY_SIZE;
-		}
-		gputime.start();
+		Profiler::beginFrame();
+		FrameArena::beginFrame(); //frees the temporary data of two frames ago
+
+		//gpu timers of an old frame are read here (without waiting) to get the gpu time per pass
+		GFX::GPUTimers::beginFrame();
 
 		//render frame
 		GFX::startGPULabel("Frame");
@@ -184,13 +193,20 @@ void CORE::mainLoop(CORE::Window* window, BaseApplication* app)
 
 		//render graphical user interface
 		if (app->render_ui)
+		{
+			GFX::startGPULabel("UI");
 			renderUI(window, app);
+			GFX::endGPULabel();
+		}
 
 		GFX::checkGLErrors();
-		gputime.finish();
+		GFX::GPUTimers::endFrame();
 
 		// swap between front buffer and back buffer
-		SDL_GL_SwapWindow(window);
+		{
+			PROFILE_SCOPE("Swap");
+			SDL_GL_SwapWindow(window);
+		}
 
 		//update events
 		while (SDL_PollEvent(&sdlEvent))
@@ -271,11 +287,17 @@ void CORE::mainLoop(CORE::Window* window, BaseApplication* app)
 		}
 
 		//update app logic
-		app->update(elapsed_time);
+		{
+			PROFILE_SCOPE("Update");
+			app->update(elapsed_time);
+		}
 
 		//execute a task in the main task manager (blocking)
 		TaskManager::foreground.fetchTask();
 
+		//destroy the resources released during this frame
+		CORE::BaseRegistry::collectAll();
+
 		//check errors in opengl only when working in debug
 #ifdef _DEBUG
 		GFX::checkGLErrors();
@@ -283,6 +305,127 @@ void CORE::mainLoop(CORE::Window* window, BaseApplication* app)
 	}
 }
 
+struct sBenchFrame {
+	long cpu_microseconds;
+	long gpu_microseconds;
+	long draw_calls;
+	long triangles;
+	std::vector<long> passes_microseconds;
+};
+
+bool CORE::benchLoop(CORE::Window* window, BaseApplication* app, int num_frames, const char* csv_filename, int capture_every)
+{
+	assert(num_frames > 0);
+	std::vector<sBenchFrame> frames(num_frames);
+	Image capture;
+	Profiler::setThreadName("Main");
+	app->render_ui = false;
+
+	//no input during the run, update must do the same in every run (the camera path is set by setBenchFrame)
+	static Uint8 no_keys[SDL_NUM_SCANCODES] = {};
+	Input::keystate = no_keys;
+	memset(Input::prev_keystate, 0, sizeof(Input::prev_keystate));
+	Input::mouse_state = 0;
+	Input::mouse_delta.set(0.0f, 0.0f);
+	Input::mouse_wheel_delta = 0.0f;
+
+	std::cout << " + Bench: " << TermColor::YELLOW << num_frames << TermColor::DEFAULT << " frames" << std::endl;
+
+	//some extra frames at the end to read the GPU timers still in flight
+	for (int i = 0; i < num_frames + GPU_TIMER_FRAMES; ++i)
+	{
+		FrameArena::beginFrame();
+		GFX::GPUTimers::beginFrame();
+		long read = GFX::GPUTimers::last_read_frame;
+		if (read >= 0 && read < num_frames)
+		{
+			sBenchFrame& bench_frame = frames[read];
+			bench_frame.gpu_microseconds = GFX::gpu_frame_microseconds;
+			for (auto& pass : GFX::GPUTimers::passes)
+				bench_frame.passes_microseconds.push_back(pass.microseconds);
+		}
+		if (i >= num_frames)
+		{
+			glFinish();
+			continue;
+		}
+
+		SDL_PumpEvents();
+		Profiler::beginFrame();
+
+		//fixed time step so every run renders the same frames
+		app->frame = i;
+		app->elapsed_time = 1.0f / 60.0f;
+		app->time = i * app->elapsed_time;
+
+		GFX::Mesh::num_meshes_rendered = 0;
+		GFX::Mesh::num_triangles_rendered = 0;
+		uint64_t start = Profiler::now();
+		{
+			PROFILE_SCOPE("Update");
+			app->update(app->elapsed_time); //animated characters
+		}
+		app->setBenchFrame(i, num_frames);
+		GFX::startGPULabel("Frame");
+			app->render();
+		GFX::endGPULabel();
+		GFX::GPUTimers::endFrame();
+
+		sBenchFrame& bench_frame = frames[i];
+		bench_frame.cpu_microseconds = long((Profiler::now() - start) / 1000);
+		bench_frame.gpu_microseconds = 0;
+		bench_frame.draw_calls = GFX::Mesh::num_meshes_rendered;
+		bench_frame.triangles = GFX::Mesh::num_triangles_rendered;
+
+		if (capture_every > 0 && i % capture_every == 0)
+		{
+			capture.fromScreen(app->window_width, app->window_height);
+			capture.saveTGA(("bench_frame_" + std::to_string(i) + ".tga").c_str());
+		}
+
+		SDL_GL_SwapWindow(window);
+		GFX::checkGLErrors();
+
+		//destroy the resources released during this frame
+		CORE::BaseRegistry::collectAll();
+	}
+
+	//csv, one row per frame and one column per GPU pass
+	FILE* f = fopen(csv_filename, "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write bench results: " << csv_filename << std::endl;
+		return false;
+	}
+	fprintf(f, "frame,cpu_us,gpu_us,draw_calls,triangles");
+	for (auto& pass : GFX::GPUTimers::passes)
+		fprintf(f, ",%s_us", pass.name.c_str());
+	fprintf(f, "\n");
+
+	std::vector<long> cpu_times;
+	std::vector<long> gpu_times;
+	for (int i = 0; i < num_frames; ++i)
+	{
+		sBenchFrame& bench_frame = frames[i];
+		fprintf(f, "%d,%ld,%ld,%ld,%ld", i, bench_frame.cpu_microseconds, bench_frame.gpu_microseconds, bench_frame.draw_calls, bench_frame.triangles);
+		for (size_t j = 0; j < GFX::GPUTimers::passes.size(); ++j)
+			fprintf(f, ",%ld", j < bench_frame.passes_microseconds.size() ? bench_frame.passes_microseconds[j] : 0);
+		fprintf(f, "\n");
+		cpu_times.push_back(bench_frame.cpu_microseconds);
+		gpu_times.push_back(bench_frame.gpu_microseconds);
+	}
+	fclose(f);
+
+	//summary
+	std::sort(cpu_times.begin(), cpu_times.end());
+	std::sort(gpu_times.begin(), gpu_times.end());
+	int p95 = std::min(num_frames - 1, int(num_frames * 0.95f));
+	std::cout << " * CPU us: median " << cpu_times[num_frames / 2] << " p95 " << cpu_times[p95] << " max " << cpu_times.back() << std::endl;
+	std::cout << " * GPU us: median " << gpu_times[num_frames / 2] << " p95 " << gpu_times[p95] << " max " << gpu_times.back() << std::endl;
+	std::cout << " * Results saved in " << TermColor::YELLOW << csv_filename << TermColor::DEFAULT << std::endl;
+	return true;
+}
+
 void CORE::destroy()
 {
 	// Cleanup
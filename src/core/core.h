@@ -8,6 +8,7 @@ namespace CORE {
 	typedef SDL_Window Window;
 
 	extern std::string base_path;
+	extern bool headless; //no visible window, used for benchmarks
 
 	class BaseApplication
 	{
@@ -43,12 +44,17 @@ namespace CORE {
 		virtual void onGamepadButtonUp(SDL_JoyButtonEvent event) {}
 		virtual void onResize(int width, int height) {}
 		virtual void onFileDrop(std::string filename, std::string relative, SDL_Event event) {};
+
+		//called by benchLoop before rendering every frame, to place the camera
+		virtual void setBenchFrame(int frame, int num_frames) {}
 	};
 
-	void init();
+	void init(bool headless = false);
 	void initUI();
 	Window* createWindow(const char* caption, int width, int height, bool fullscreen = false);
 	void mainLoop(CORE::Window* window, BaseApplication* app);
+	//renders a fixed number of frames with a fixed time step and writes the timings of every frame as CSV
+	bool benchLoop(CORE::Window* window, BaseApplication* app, int num_frames, const char* csv_filename, int capture_every = 0);
 
 	void renderUI(CORE::Window* window, BaseApplication* app);
 	void destroy();
@@ -10,6 +10,12 @@
 #include <algorithm>
 #include <iostream>
 
+#if defined(MATH_USE_SSE)
+	#include <immintrin.h>
+#elif defined(MATH_USE_NEON)
+	#include <arm_neon.h>
+#endif
+
 #define M_PI_2 1.57079632679489661923
 
 //**************************************
@@ -402,32 +408,158 @@ Vector3f Matrix44::project(const Vector3f& v)
 }
 
 
-//Multiply a matrix by another and returns the result
-Matrix44 Matrix44::operator*(const Matrix44& matrix) const
-{
-	Matrix44 ret;
+//** SIMD kernels *******************************************
+// Every kernel performs the same operations in the same order as its scalar version,
+// so the SSE/AVX/NEON paths and the fallback return the same bits (as long as the
+// compiler is not allowed to contract mul+add into FMA, i.e. -ffp-contract=off).
 
-	unsigned int i,j,k;
-	for (i=0;i<4;i++) 	
+//out = a * b, out can point to a or b
+static inline void multiplyMatrix(const float* a, const float* b, float* out)
+{
+#if defined(MATH_USE_AVX)
+	//two rows per iteration, every 128 bits lane holds one row
+	__m256 b0 = _mm256_broadcast_ps((const __m128*)(b));
+	__m256 b1 = _mm256_broadcast_ps((const __m128*)(b + 4));
+	__m256 b2 = _mm256_broadcast_ps((const __m128*)(b + 8));
+	__m256 b3 = _mm256_broadcast_ps((const __m128*)(b + 12));
+	for (int i = 0; i < 16; i += 8)
 	{
-		for (j=0;j<4;j++) 
+		__m256 rows = _mm256_loadu_ps(a + i);
+		__m256 r = _mm256_setzero_ps();
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x00), b0));
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x55), b1));
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xAA), b2));
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xFF), b3));
+		_mm256_storeu_ps(out + i, r);
+	}
+#elif defined(MATH_USE_SSE)
+	__m128 b0 = _mm_loadu_ps(b);
+	__m128 b1 = _mm_loadu_ps(b + 4);
+	__m128 b2 = _mm_loadu_ps(b + 8);
+	__m128 b3 = _mm_loadu_ps(b + 12);
+	for (int i = 0; i < 16; i += 4)
+	{
+		__m128 r = _mm_setzero_ps();
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a[i]), b0));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a[i + 1]), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a[i + 2]), b2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a[i + 3]), b3));
+		_mm_storeu_ps(out + i, r);
+	}
+#elif defined(MATH_USE_NEON)
+	float32x4_t b0 = vld1q_f32(b);
+	float32x4_t b1 = vld1q_f32(b + 4);
+	float32x4_t b2 = vld1q_f32(b + 8);
+	float32x4_t b3 = vld1q_f32(b + 12);
+	for (int i = 0; i < 16; i += 4)
+	{
+		float32x4_t r = vdupq_n_f32(0.0f);
+		r = vaddq_f32(r, vmulq_n_f32(b0, a[i]));
+		r = vaddq_f32(r, vmulq_n_f32(b1, a[i + 1]));
+		r = vaddq_f32(r, vmulq_n_f32(b2, a[i + 2]));
+		r = vaddq_f32(r, vmulq_n_f32(b3, a[i + 3]));
+		vst1q_f32(out + i, r);
+	}
+#else
+	float ret[16];
+	unsigned int i, j, k;
+	for (i = 0; i < 4; i++)
+	{
+		for (j = 0; j < 4; j++)
 		{
-			ret.M[i][j]=0.0;
-			for (k=0;k<4;k++) 
-				ret.M[i][j] += M[i][k] * matrix.M[k][j];
+			ret[i * 4 + j] = 0.0;
+			for (k = 0; k < 4; k++)
+				ret[i * 4 + j] += a[i * 4 + k] * b[k * 4 + j];
 		}
 	}
+	memcpy(out, ret, sizeof(ret));
+#endif
+}
+
+//out = m * (v,1), only xyz are written
+static inline void transformPoint(const float* m, const float* v, float* out)
+{
+#if defined(MATH_USE_SSE)
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(v[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(v[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(v[2])));
+	r = _mm_add_ps(r, _mm_loadu_ps(m + 12));
+	float tmp[4];
+	_mm_storeu_ps(tmp, r);
+	out[0] = tmp[0]; out[1] = tmp[1]; out[2] = tmp[2];
+#elif defined(MATH_USE_NEON)
+	float32x4_t r = vmulq_n_f32(vld1q_f32(m), v[0]);
+	r = vaddq_f32(r, vmulq_n_f32(vld1q_f32(m + 4), v[1]));
+	r = vaddq_f32(r, vmulq_n_f32(vld1q_f32(m + 8), v[2]));
+	r = vaddq_f32(r, vld1q_f32(m + 12));
+	float tmp[4];
+	vst1q_f32(tmp, r);
+	out[0] = tmp[0]; out[1] = tmp[1]; out[2] = tmp[2];
+#else
+	float x = m[0] * v[0] + m[4] * v[1] + m[8] * v[2] + m[12];
+	float y = m[1] * v[0] + m[5] * v[1] + m[9] * v[2] + m[13];
+	float z = m[2] * v[0] + m[6] * v[1] + m[10] * v[2] + m[14];
+	out[0] = x; out[1] = y; out[2] = z;
+#endif
+}
 
+//Multiply a matrix by another and returns the result
+Matrix44 Matrix44::operator*(const Matrix44& matrix) const
+{
+	Matrix44 ret;
+	multiplyMatrix(m, matrix.m, ret.m);
 	return ret;
 }
 
 //Multiplies a vector by a matrix and returns the new vector
 Vector3f operator * (const Matrix44& matrix, const Vector3f& v) 
 {   
-   float x = matrix.m[0] * v.x + matrix.m[4] * v.y + matrix.m[8] * v.z + matrix.m[12]; 
-   float y = matrix.m[1] * v.x + matrix.m[5] * v.y + matrix.m[9] * v.z + matrix.m[13]; 
-   float z = matrix.m[2] * v.x + matrix.m[6] * v.y + matrix.m[10] * v.z + matrix.m[14];
-   return Vector3f(x,y,z);
+	Vector3f result;
+	transformPoint(matrix.m, v.v, result.v);
+	return result;
+}
+
+void transformPoints(const Matrix44& matrix, const Vector3f* src, Vector3f* dst, int num)
+{
+	int i = 0;
+#if defined(MATH_USE_AVX)
+	//two points per iteration, one in every 128 bits lane
+	const float* m = matrix.m;
+	__m256 m0 = _mm256_broadcast_ps((const __m128*)(m));
+	__m256 m1 = _mm256_broadcast_ps((const __m128*)(m + 4));
+	__m256 m2 = _mm256_broadcast_ps((const __m128*)(m + 8));
+	__m256 m3 = _mm256_broadcast_ps((const __m128*)(m + 12));
+	float tmp[8];
+	for (; i + 1 < num; i += 2)
+	{
+		const Vector3f& a = src[i];
+		const Vector3f& b = src[i + 1];
+		__m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a.x)), _mm_set1_ps(b.x), 1);
+		__m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a.y)), _mm_set1_ps(b.y), 1);
+		__m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a.z)), _mm_set1_ps(b.z), 1);
+		__m256 r = _mm256_mul_ps(m0, x);
+		r = _mm256_add_ps(r, _mm256_mul_ps(m1, y));
+		r = _mm256_add_ps(r, _mm256_mul_ps(m2, z));
+		r = _mm256_add_ps(r, m3);
+		_mm256_storeu_ps(tmp, r);
+		dst[i].set(tmp[0], tmp[1], tmp[2]);
+		dst[i + 1].set(tmp[4], tmp[5], tmp[6]);
+	}
+#endif
+	for (; i < num; ++i)
+		transformPoint(matrix.m, src[i].v, dst[i].v);
+}
+
+void multiplyMatrices(const Matrix44* a, const Matrix44* b, Matrix44* result, int num)
+{
+	for (int i = 0; i < num; ++i)
+		multiplyMatrix(a[i].m, b[i].m, result[i].m);
+}
+
+void multiplyMatrices(const Matrix44* a, const Matrix44& b, Matrix44* result, int num)
+{
+	for (int i = 0; i < num; ++i)
+		multiplyMatrix(a[i].m, b.m, result[i].m);
 }
 
 //Multiplies a vector by a matrix and returns the new vector
@@ -513,9 +645,55 @@ void Matrix44::setFrontAndOrthonormalize(Vector3f front)
 	
 }
 
+#if defined(MATH_USE_SSE)
+//one column of the cofactor matrix (scaled by rdet) as the scalar version computes it: minors in float, cofactors in double
+//x are the matrix values (as floats), y the minors (12 doubles, 4 per term), sign the sign of the first row
+static inline __m128 inverseColumnSSE(__m128 x1, __m128 x2, __m128 x3, const double* y, double sign, __m128d rdet)
+{
+	__m128d signs = _mm_setr_pd(sign, -sign); //rows alternate sign
+	__m128d neg_signs = _mm_setr_pd(-sign, sign);
+	__m128 half[2];
+	for (int h = 0; h < 2; ++h)
+	{
+		__m128 a = h ? _mm_movehl_ps(x1, x1) : x1;
+		__m128 b = h ? _mm_movehl_ps(x2, x2) : x2;
+		__m128 c = h ? _mm_movehl_ps(x3, x3) : x3;
+		//signs are applied per term (exact) so even zeros keep the sign of the scalar version
+		__m128d p = _mm_mul_pd(_mm_mul_pd(_mm_cvtps_pd(a), signs), _mm_loadu_pd(y + h * 2));
+		p = _mm_add_pd(p, _mm_mul_pd(_mm_mul_pd(_mm_cvtps_pd(b), neg_signs), _mm_loadu_pd(y + 4 + h * 2)));
+		p = _mm_add_pd(p, _mm_mul_pd(_mm_mul_pd(_mm_cvtps_pd(c), signs), _mm_loadu_pd(y + 8 + h * 2)));
+		half[h] = _mm_cvtpd_ps(_mm_mul_pd(p, rdet));
+	}
+	return _mm_movelh_ps(half[0], half[1]);
+}
+
+#define SHUFFLE4(v, x, y, z, w) _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+#endif
+
 bool Matrix44::inverse()
 {
 	// http://www.geometrictools.com/LibFoundation/Mathematics/Wm4Matrix4.inl
+#if defined(MATH_USE_SSE)
+	__m128 r0 = _mm_loadu_ps(m);
+	__m128 r1 = _mm_loadu_ps(m + 4);
+	__m128 r2 = _mm_loadu_ps(m + 8);
+	__m128 r3 = _mm_loadu_ps(m + 12);
+
+	//2x2 minors: A0..A3, B0..B3 and A4,A5,B4,B5
+	__m128 a03 = _mm_sub_ps(_mm_mul_ps(SHUFFLE4(r0, 0, 0, 0, 1), SHUFFLE4(r1, 1, 2, 3, 2)), _mm_mul_ps(SHUFFLE4(r0, 1, 2, 3, 2), SHUFFLE4(r1, 0, 0, 0, 1)));
+	__m128 b03 = _mm_sub_ps(_mm_mul_ps(SHUFFLE4(r2, 0, 0, 0, 1), SHUFFLE4(r3, 1, 2, 3, 2)), _mm_mul_ps(SHUFFLE4(r2, 1, 2, 3, 2), SHUFFLE4(r3, 0, 0, 0, 1)));
+	__m128 ab45 = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 1, 2, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 3, 3, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 3, 3, 3)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 1, 2, 1))));
+
+	float A[6], B[6], tmp4[4];
+	_mm_storeu_ps(A, a03);
+	_mm_storeu_ps(B, b03);
+	_mm_storeu_ps(tmp4, ab45);
+	A[4] = tmp4[0]; A[5] = tmp4[1]; B[4] = tmp4[2]; B[5] = tmp4[3];
+
+	double det = (double)A[0] * B[5] - (double)A[1] * B[4] + (double)A[2] * B[3] + (double)A[3] * B[2] - (double)A[4] * B[1] + (double)A[5] * B[0];
+#else
 	double A0 = m[0] * m[5] - m[1] * m[4];
 	double A1 = m[0] * m[6] - m[2] * m[4];
 	double A2 = m[0] * m[7] - m[3] * m[4];
@@ -529,6 +707,7 @@ bool Matrix44::inverse()
 	double B4 = m[9] * m[15] - m[11] * m[13];
 	double B5 = m[10] * m[15] - m[11] * m[14];
 	double det = A0 * B5 - A1 * B4 + A2 * B3 + A3 * B2 - A4 * B1 + A5 * B0;
+#endif
 
 	// std::numeric_limits<T>::epsilon() does not work with orthographic matrix with znear/far 0.1, 2000
 	// 1e-10 does not work with ortographic matrix znear/zfar -2000, 2000
@@ -541,39 +720,56 @@ bool Matrix44::inverse()
 
 	auto rdet = double(1) / det;
 
-	Matrix44 tmp;
-	tmp.M[0][0] = +m[5] * B5 - m[6] * B4 + m[7] * B3;
-	tmp.M[1][0] = -m[4] * B5 + m[6] * B2 - m[7] * B1;
-	tmp.M[2][0] = +m[4] * B4 - m[5] * B2 + m[7] * B0;
-	tmp.M[3][0] = -m[4] * B3 + m[5] * B1 - m[6] * B0;
-	tmp.M[0][1] = -m[1] * B5 + m[2] * B4 - m[3] * B3;
-	tmp.M[1][1] = +m[0] * B5 - m[2] * B2 + m[3] * B1;
-	tmp.M[2][1] = -m[0] * B4 + m[1] * B2 - m[3] * B0;
-	tmp.M[3][1] = +m[0] * B3 - m[1] * B1 + m[2] * B0;
-	tmp.M[0][2] = +m[13] * A5 - m[14] * A4 + m[15] * A3;
-	tmp.M[1][2] = -m[12] * A5 + m[14] * A2 - m[15] * A1;
-	tmp.M[2][2] = +m[12] * A4 - m[13] * A2 + m[15] * A0;
-	tmp.M[3][2] = -m[12] * A3 + m[13] * A1 - m[14] * A0;
-	tmp.M[0][3] = -m[9] * A5 + m[10] * A4 - m[11] * A3;
-	tmp.M[1][3] = +m[8] * A5 - m[10] * A2 + m[11] * A1;
-	tmp.M[2][3] = -m[8] * A4 + m[9] * A2 - m[11] * A0;
-	tmp.M[3][3] = +m[8] * A3 - m[9] * A1 + m[10] * A0;
-	m[0] = tmp.m[0] * rdet;
-	m[1] = tmp.m[1] * rdet;
-	m[2] = tmp.m[2] * rdet;
-	m[3] = tmp.m[3] * rdet;
-	m[4] = tmp.m[4] * rdet;
-	m[5] = tmp.m[5] * rdet;
-	m[6] = tmp.m[6] * rdet;
-	m[7] = tmp.m[7] * rdet;
-	m[8] = tmp.m[8] * rdet;
-	m[9] = tmp.m[9] * rdet;
-	m[10] = tmp.m[10] * rdet;
-	m[11] = tmp.m[11] * rdet;
-	m[12] = tmp.m[12] * rdet;
-	m[13] = tmp.m[13] * rdet;
-	m[14] = tmp.m[14] * rdet;
-	m[15] = tmp.m[15] * rdet;
+#if defined(MATH_USE_SSE)
+	const double yb[12] = { B[5], B[5], B[4], B[3],  B[4], B[2], B[2], B[1],  B[3], B[1], B[0], B[0] };
+	const double ya[12] = { A[5], A[5], A[4], A[3],  A[4], A[2], A[2], A[1],  A[3], A[1], A[0], A[0] };
+	__m128d vrdet = _mm_set1_pd(rdet);
+	__m128 c0 = inverseColumnSSE(SHUFFLE4(r1, 1, 0, 0, 0), SHUFFLE4(r1, 2, 2, 1, 1), SHUFFLE4(r1, 3, 3, 3, 2), yb, 1.0, vrdet);
+	__m128 c1 = inverseColumnSSE(SHUFFLE4(r0, 1, 0, 0, 0), SHUFFLE4(r0, 2, 2, 1, 1), SHUFFLE4(r0, 3, 3, 3, 2), yb, -1.0, vrdet);
+	__m128 c2 = inverseColumnSSE(SHUFFLE4(r3, 1, 0, 0, 0), SHUFFLE4(r3, 2, 2, 1, 1), SHUFFLE4(r3, 3, 3, 3, 2), ya, 1.0, vrdet);
+	__m128 c3 = inverseColumnSSE(SHUFFLE4(r2, 1, 0, 0, 0), SHUFFLE4(r2, 2, 2, 1, 1), SHUFFLE4(r2, 3, 3, 3, 2), ya, -1.0, vrdet);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	_mm_storeu_ps(m, c0);
+	_mm_storeu_ps(m + 4, c1);
+	_mm_storeu_ps(m + 8, c2);
+	_mm_storeu_ps(m + 12, c3);
+#else
+	//the cofactors stay in double until the final store, a narrowing in between can be skipped by the compiler
+	//(GCC keeps excess precision when it vectorizes this code) and the SSE version would not match
+	double tmp[16];
+	tmp[0] = +m[5] * B5 - m[6] * B4 + m[7] * B3;
+	tmp[4] = -m[4] * B5 + m[6] * B2 - m[7] * B1;
+	tmp[8] = +m[4] * B4 - m[5] * B2 + m[7] * B0;
+	tmp[12] = -m[4] * B3 + m[5] * B1 - m[6] * B0;
+	tmp[1] = -m[1] * B5 + m[2] * B4 - m[3] * B3;
+	tmp[5] = +m[0] * B5 - m[2] * B2 + m[3] * B1;
+	tmp[9] = -m[0] * B4 + m[1] * B2 - m[3] * B0;
+	tmp[13] = +m[0] * B3 - m[1] * B1 + m[2] * B0;
+	tmp[2] = +m[13] * A5 - m[14] * A4 + m[15] * A3;
+	tmp[6] = -m[12] * A5 + m[14] * A2 - m[15] * A1;
+	tmp[10] = +m[12] * A4 - m[13] * A2 + m[15] * A0;
+	tmp[14] = -m[12] * A3 + m[13] * A1 - m[14] * A0;
+	tmp[3] = -m[9] * A5 + m[10] * A4 - m[11] * A3;
+	tmp[7] = +m[8] * A5 - m[10] * A2 + m[11] * A1;
+	tmp[11] = -m[8] * A4 + m[9] * A2 - m[11] * A0;
+	tmp[15] = +m[8] * A3 - m[9] * A1 + m[10] * A0;
+	m[0] = tmp[0] * rdet;
+	m[1] = tmp[1] * rdet;
+	m[2] = tmp[2] * rdet;
+	m[3] = tmp[3] * rdet;
+	m[4] = tmp[4] * rdet;
+	m[5] = tmp[5] * rdet;
+	m[6] = tmp[6] * rdet;
+	m[7] = tmp[7] * rdet;
+	m[8] = tmp[8] * rdet;
+	m[9] = tmp[9] * rdet;
+	m[10] = tmp[10] * rdet;
+	m[11] = tmp[11] * rdet;
+	m[12] = tmp[12] * rdet;
+	m[13] = tmp[13] * rdet;
+	m[14] = tmp[14] * rdet;
+	m[15] = tmp[15] * rdet;
+#endif
 	return true;
 }
 
@@ -1457,25 +1653,34 @@ float signedDistanceToPlane( const Vector4f& plane, const Vector3f& point )
 	return dot(plane.xyz(), point) + plane.w;
 }
 
-const Vector3f corners[] = { {1,1,1},  {1,1,-1},  {1,-1,1},  {1,-1,-1},  {-1,1,1},  {-1,1,-1},  {-1,-1,1},  {-1,-1,-1} };
-
-BoundingBox transformBoundingBox(const Matrix44 m, const BoundingBox& box)
+//transforms the center and projects the halfsize on the absolute value of the axes (Arvo), instead of transforming the 8 corners
+BoundingBox transformBoundingBox(const Matrix44& m, const BoundingBox& box)
 {
-	Vector3f box_min(10000000.0f,1000000.0f, 1000000.0f);
-	Vector3f box_max(-10000000.0f, -1000000.0f, -1000000.0f);
-
-	for (int i = 0; i < 8; ++i)
-	{
-		Vector3f corner = corners[i];
-		corner = box.halfsize * corner;
-		corner = corner + box.center;
-		corner = m * corner;
-		box_min.setMin(corner);
-		box_max.setMax(corner);
-	}
-
-	Vector3f halfsize = (box_max - box_min) * 0.5f;
-	return BoundingBox(box_max - halfsize, halfsize );
+	BoundingBox result;
+	transformPoint(m.m, box.center.v, result.center.v);
+	const Vector3f& h = box.halfsize;
+#if defined(MATH_USE_SSE)
+	__m128 sign_mask = _mm_set1_ps(-0.0f);
+	__m128 r = _mm_mul_ps(_mm_andnot_ps(sign_mask, _mm_loadu_ps(m.m)), _mm_set1_ps(h.x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_andnot_ps(sign_mask, _mm_loadu_ps(m.m + 4)), _mm_set1_ps(h.y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_andnot_ps(sign_mask, _mm_loadu_ps(m.m + 8)), _mm_set1_ps(h.z)));
+	float tmp[4];
+	_mm_storeu_ps(tmp, r);
+	result.halfsize.set(tmp[0], tmp[1], tmp[2]);
+#elif defined(MATH_USE_NEON)
+	float32x4_t r = vmulq_n_f32(vabsq_f32(vld1q_f32(m.m)), h.x);
+	r = vaddq_f32(r, vmulq_n_f32(vabsq_f32(vld1q_f32(m.m + 4)), h.y));
+	r = vaddq_f32(r, vmulq_n_f32(vabsq_f32(vld1q_f32(m.m + 8)), h.z));
+	float tmp[4];
+	vst1q_f32(tmp, r);
+	result.halfsize.set(tmp[0], tmp[1], tmp[2]);
+#else
+	result.halfsize.set(
+		std::fabs(m.m[0]) * h.x + std::fabs(m.m[4]) * h.y + std::fabs(m.m[8]) * h.z,
+		std::fabs(m.m[1]) * h.x + std::fabs(m.m[5]) * h.y + std::fabs(m.m[9]) * h.z,
+		std::fabs(m.m[2]) * h.x + std::fabs(m.m[6]) * h.y + std::fabs(m.m[10]) * h.z);
+#endif
+	return result;
 }
 
 BoundingBox mergeBoundingBoxes(const BoundingBox& a, const BoundingBox& b)
@@ -15,6 +15,17 @@
 #define DEG2RAD 0.0174532925
 #define RAD2DEG 57.295779513
 
+//SIMD backend used by the Matrix44 kernels, chosen at compile time
+//define MATH_NO_SIMD to force the scalar path (both paths give the same bits)
+#if !defined(MATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define MATH_USE_SSE
+	#ifdef __AVX__
+		#define MATH_USE_AVX
+	#endif
+#elif !defined(MATH_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+	#define MATH_USE_NEON
+#endif
+
 //more standard type definition
 typedef char int8;
 typedef unsigned char uint8;
@@ -295,6 +306,11 @@ class Matrix44
 Vector3f operator * (const Matrix44& matrix, const Vector3f& v);
 Vector4f operator * (const Matrix44& matrix, const Vector4f& v);
 
+//batched versions, faster than calling the operators in a loop (src and dst can be the same array)
+void transformPoints(const Matrix44& matrix, const Vector3f* src, Vector3f* dst, int num);
+void multiplyMatrices(const Matrix44* a, const Matrix44* b, Matrix44* result, int num); //result[i] = a[i] * b[i]
+void multiplyMatrices(const Matrix44* a, const Matrix44& b, Matrix44* result, int num); //result[i] = a[i] * b
+
 //** QUAT ********************************************************
 
 class Quaternion
@@ -392,7 +408,7 @@ public:
 
 //applies a transform to a AABB from object to world
 BoundingBox mergeBoundingBoxes(const BoundingBox& a, const BoundingBox& b);
-BoundingBox transformBoundingBox(const Matrix44 m, const BoundingBox& box);
+BoundingBox transformBoundingBox(const Matrix44& m, const BoundingBox& box);
 
 
 //** RAY ********************************************************
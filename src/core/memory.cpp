@@ -0,0 +1,360 @@
+#include "memory.h"
+#include "arena.h"
+#include "includes.h"
+#include "../utils/utils.h"
+#include "../utils/jsonreader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+using namespace CORE;
+
+#define MEMORY_PANEL_TOP 20 //entries shown in the panel
+
+struct sReporter {
+	const char* tag;
+	MemoryReporter func;
+};
+
+//function static so the reporters can be added from static initializers of other files
+static std::vector<sReporter>& getReporters()
+{
+	static std::vector<sReporter> reporters;
+	return reporters;
+}
+
+struct sBudget {
+	size_t cpu_bytes;
+	size_t gpu_bytes;
+};
+static std::map<std::string, sBudget> budgets;
+
+//counters of the heap tags, constant initialized so operator new can use them before any static constructor
+struct sHeapTag {
+	const char* tag = nullptr;
+	std::atomic<size_t> count{ 0 };
+	std::atomic<size_t> bytes{ 0 };
+	std::atomic<size_t> peak_bytes{ 0 };
+};
+static sHeapTag heap_tags[MEMORY_MAX_TAGS];
+static std::atomic<int> num_heap_tags{ 1 }; //0 is untagged
+static std::mutex heap_tags_mutex;
+static thread_local int t_heap_tag = 0;
+
+//in front of every block, 16 bytes so the memory keeps the alignment of malloc
+struct alignas(16) sAllocationHeader {
+	size_t size;
+	int tag;
+};
+
+static double toMB(size_t bytes)
+{
+	return bytes / (1024.0 * 1024.0);
+}
+
+bool MemoryTracker::addReporter(const char* tag, MemoryReporter reporter)
+{
+	getReporters().push_back(sReporter{ tag, reporter });
+	return true;
+}
+
+void MemoryTracker::collect(std::vector<MemoryEntry>& entries)
+{
+	for (sReporter& reporter : getReporters())
+		reporter.func(entries);
+}
+
+void MemoryTracker::computeTotals(const std::vector<MemoryEntry>& entries, std::vector<MemoryTotal>& totals)
+{
+	totals.clear();
+	for (sReporter& reporter : getReporters())
+	{
+		MemoryTotal total = { reporter.tag, 0, 0, 0, 0, 0 };
+		auto it = budgets.find(reporter.tag);
+		if (it != budgets.end())
+		{
+			total.cpu_budget = it->second.cpu_bytes;
+			total.gpu_budget = it->second.gpu_bytes;
+		}
+		totals.push_back(total);
+	}
+	for (const MemoryEntry& entry : entries)
+		for (MemoryTotal& total : totals)
+			if (strcmp(total.tag, entry.tag) == 0)
+			{
+				total.count++;
+				total.cpu_bytes += entry.cpu_bytes;
+				total.gpu_bytes += entry.gpu_bytes;
+				break;
+			}
+}
+
+void MemoryTracker::setBudget(const char* tag, size_t cpu_bytes, size_t gpu_bytes)
+{
+	budgets[tag] = sBudget{ cpu_bytes, gpu_bytes };
+}
+
+bool MemoryTracker::loadBudgets(const char* filename)
+{
+	std::string content;
+	JSONDocument doc;
+	if (!readFile(filename, content) || !doc.parse(content.data(), content.size()) || doc.root().getType() != JSON_OBJECT)
+	{
+		std::cout << "[ERROR] cannot read memory budgets: " << filename << std::endl;
+		return false;
+	}
+	for (JSONValue value = doc.root().first(); value.isValid(); value = value.next())
+		setBudget(std::string(value.key()).c_str(), (size_t)value.get("cpu").toNumber(0), (size_t)value.get("gpu").toNumber(0));
+	return true;
+}
+
+bool MemoryTracker::checkBudgets()
+{
+	std::vector<MemoryEntry> entries;
+	std::vector<MemoryTotal> totals;
+	collect(entries);
+	computeTotals(entries, totals);
+
+	bool ok = true;
+	for (const MemoryTotal& total : totals)
+	{
+		if (total.cpu_budget && total.cpu_bytes > total.cpu_budget)
+		{
+			std::cout << TermColor::RED << "[BUDGET] " << total.tag << " CPU: " << total.cpu_bytes << " bytes, budget " << total.cpu_budget << TermColor::DEFAULT << std::endl;
+			ok = false;
+		}
+		if (total.gpu_budget && total.gpu_bytes > total.gpu_budget)
+		{
+			std::cout << TermColor::RED << "[BUDGET] " << total.tag << " GPU: " << total.gpu_bytes << " bytes, budget " << total.gpu_budget << TermColor::DEFAULT << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+int MemoryTracker::getTagIndex(const char* tag)
+{
+	const std::lock_guard<std::mutex> lock(heap_tags_mutex);
+	int num = num_heap_tags;
+	for (int i = 1; i < num; ++i)
+		if (strcmp(heap_tags[i].tag, tag) == 0)
+			return i;
+	if (num == MEMORY_MAX_TAGS)
+		return 0;
+	heap_tags[num].tag = tag;
+	num_heap_tags = num + 1;
+	return num;
+}
+
+void MemoryTracker::getHeapTags(std::vector<HeapTag>& tags)
+{
+	tags.clear();
+	if (FrameArena::getHeapAllocations() == -1)
+		return;
+	int num = num_heap_tags;
+	for (int i = 0; i < num; ++i)
+		tags.push_back(HeapTag{ i ? heap_tags[i].tag : "untagged", heap_tags[i].count, heap_tags[i].bytes, heap_tags[i].peak_bytes });
+}
+
+void* MemoryTracker::taggedAllocate(size_t size)
+{
+	sAllocationHeader* header = (sAllocationHeader*)malloc(sizeof(sAllocationHeader) + size);
+	if (!header)
+		return nullptr;
+	header->size = size;
+	header->tag = t_heap_tag;
+
+	sHeapTag& tag = heap_tags[header->tag];
+	tag.count++;
+	size_t bytes = tag.bytes += size;
+	size_t peak = tag.peak_bytes;
+	while (bytes > peak && !tag.peak_bytes.compare_exchange_weak(peak, bytes));
+	return header + 1;
+}
+
+void MemoryTracker::taggedFree(void* ptr)
+{
+	if (!ptr)
+		return;
+	//charged to the tag it was allocated with, it could be freed from anywhere
+	sAllocationHeader* header = (sAllocationHeader*)ptr - 1;
+	sHeapTag& tag = heap_tags[header->tag];
+	tag.count--;
+	tag.bytes -= header->size;
+	free(header);
+}
+
+MemoryScope::MemoryScope(const char* tag)
+{
+	previous = t_heap_tag;
+	t_heap_tag = MemoryTracker::getTagIndex(tag);
+}
+
+MemoryScope::~MemoryScope()
+{
+	t_heap_tag = previous;
+}
+
+//names come from filenames, escape whatever could break the JSON
+static std::string escapeJSON(const std::string& str)
+{
+	std::string result;
+	result.reserve(str.size());
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			result += '\\';
+		if ((unsigned char)c < 0x20)
+			continue;
+		result += c;
+	}
+	return result;
+}
+
+static std::string escapeCSV(const std::string& str)
+{
+	std::string result;
+	for (char c : str)
+	{
+		if (c == '"')
+			result += '"';
+		result += c;
+	}
+	return result;
+}
+
+bool MemoryTracker::dump(const char* filename)
+{
+	std::vector<MemoryEntry> entries;
+	std::vector<MemoryTotal> totals;
+	std::vector<HeapTag> heap;
+	collect(entries);
+	computeTotals(entries, totals);
+	getHeapTags(heap);
+	std::sort(entries.begin(), entries.end(), [](const MemoryEntry& a, const MemoryEntry& b) { return a.cpu_bytes + a.gpu_bytes > b.cpu_bytes + b.gpu_bytes; });
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write memory report: " << filename << std::endl;
+		return false;
+	}
+
+	if (toLowerCase(getExtension(filename)) == "csv")
+	{
+		fprintf(f, "tag,name,cpu_bytes,gpu_bytes\n");
+		for (const MemoryEntry& entry : entries)
+			fprintf(f, "%s,\"%s\",%zu,%zu\n", entry.tag, escapeCSV(entry.name).c_str(), entry.cpu_bytes, entry.gpu_bytes);
+	}
+	else
+	{
+		fprintf(f, "{\n\"totals\":{\n");
+		for (size_t i = 0; i < totals.size(); ++i)
+		{
+			const MemoryTotal& total = totals[i];
+			fprintf(f, "\t\"%s\":{\"count\":%zu,\"cpu\":%zu,\"gpu\":%zu,\"cpu_budget\":%zu,\"gpu_budget\":%zu}%s\n",
+				total.tag, total.count, total.cpu_bytes, total.gpu_bytes, total.cpu_budget, total.gpu_budget, i + 1 < totals.size() ? "," : "");
+		}
+		fprintf(f, "},\n\"heap\":{\n");
+		for (size_t i = 0; i < heap.size(); ++i)
+		{
+			const HeapTag& tag = heap[i];
+			fprintf(f, "\t\"%s\":{\"count\":%zu,\"bytes\":%zu,\"peak\":%zu}%s\n",
+				tag.tag, tag.count, tag.bytes, tag.peak_bytes, i + 1 < heap.size() ? "," : "");
+		}
+		fprintf(f, "},\n\"entries\":[\n");
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			const MemoryEntry& entry = entries[i];
+			fprintf(f, "\t{\"tag\":\"%s\",\"name\":\"%s\",\"cpu\":%zu,\"gpu\":%zu}%s\n",
+				entry.tag, escapeJSON(entry.name).c_str(), entry.cpu_bytes, entry.gpu_bytes, i + 1 < entries.size() ? "," : "");
+		}
+		fprintf(f, "]\n}\n");
+	}
+	fclose(f);
+
+	size_t cpu_bytes = 0, gpu_bytes = 0;
+	for (const MemoryTotal& total : totals)
+	{
+		cpu_bytes += total.cpu_bytes;
+		gpu_bytes += total.gpu_bytes;
+	}
+	std::cout << " + Memory report saved: " << TermColor::YELLOW << filename << TermColor::DEFAULT << " (CPU " << toMB(cpu_bytes) << " MB, GPU " << toMB(gpu_bytes) << " MB)" << std::endl;
+	return true;
+}
+
+void MemoryTracker::renderPanel()
+{
+#ifndef SKIP_IMGUI
+	static std::vector<MemoryEntry> entries;
+	static std::vector<MemoryTotal> totals;
+	static std::vector<HeapTag> heap;
+	static int sort_by = 0; //0: total, 1: cpu, 2: gpu
+	static int tag_filter = -1;
+
+	//gathering it is cheap but there is no need to do it every frame
+	static int frames_to_refresh = 0;
+	if (ImGui::Button("Refresh") || --frames_to_refresh <= 0)
+	{
+		entries.clear();
+		collect(entries);
+		computeTotals(entries, totals);
+		getHeapTags(heap);
+		frames_to_refresh = 30;
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Dump"))
+		dump("memory.json");
+
+	size_t cpu_bytes = 0, gpu_bytes = 0;
+	for (const MemoryTotal& total : totals)
+	{
+		cpu_bytes += total.cpu_bytes;
+		gpu_bytes += total.gpu_bytes;
+	}
+	ImGui::Text("Total CPU: %.2f MB  GPU (estimated): %.2f MB", toMB(cpu_bytes), toMB(gpu_bytes));
+
+	for (int i = 0; i < (int)totals.size(); ++i)
+	{
+		const MemoryTotal& total = totals[i];
+		bool over = (total.cpu_budget && total.cpu_bytes > total.cpu_budget) || (total.gpu_budget && total.gpu_bytes > total.gpu_budget);
+		if (over)
+			ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1, 0.3f, 0.3f, 1));
+		char label[128];
+		snprintf(label, sizeof(label), "%-10s x%-5zu CPU %8.2f MB  GPU %8.2f MB", total.tag, total.count, toMB(total.cpu_bytes), toMB(total.gpu_bytes));
+		if (ImGui::Selectable(label, tag_filter == i))
+			tag_filter = tag_filter == i ? -1 : i;
+		if (over)
+			ImGui::PopStyleColor();
+		if (ImGui::IsItemHovered() && (total.cpu_budget || total.gpu_budget))
+			ImGui::SetTooltip("Budget CPU %.2f MB GPU %.2f MB", toMB(total.cpu_budget), toMB(total.gpu_budget));
+	}
+
+	//what was really allocated, next to what the reporters estimate
+	if (heap.size() && ImGui::TreeNode("Heap by tag"))
+	{
+		for (const HeapTag& tag : heap)
+			ImGui::Text("%-10s x%-7zu %8.2f MB  peak %8.2f MB", tag.tag, tag.count, toMB(tag.bytes), toMB(tag.peak_bytes));
+		ImGui::TreePop();
+	}
+
+	ImGui::Separator();
+	ImGui::Combo("Sort by", &sort_by, "Total\0CPU\0GPU\0");
+	auto getSize = [](const MemoryEntry& e) { return sort_by == 1 ? e.cpu_bytes : (sort_by == 2 ? e.gpu_bytes : e.cpu_bytes + e.gpu_bytes); };
+
+	//top consumers, only the N biggest need to be sorted
+	std::vector<const MemoryEntry*> top;
+	for (const MemoryEntry& entry : entries)
+		if (tag_filter == -1 || (tag_filter < (int)totals.size() && strcmp(entry.tag, totals[tag_filter].tag) == 0))
+			top.push_back(&entry);
+	size_t num = std::min(top.size(), (size_t)MEMORY_PANEL_TOP);
+	std::partial_sort(top.begin(), top.begin() + num, top.end(), [&](const MemoryEntry* a, const MemoryEntry* b) { return getSize(*a) > getSize(*b); });
+	for (size_t i = 0; i < num; ++i)
+		ImGui::Text("%-10s CPU %8.2f MB  GPU %8.2f MB  %s", top[i]->tag, toMB(top[i]->cpu_bytes), toMB(top[i]->gpu_bytes), top[i]->name.c_str());
+#endif
+}
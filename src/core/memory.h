@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+//Memory accounting per subsystem (meshes, textures, shaders...)
+//every subsystem registers a reporter that lists its resources with the CPU bytes they keep and an estimation
+//of the VRAM they use (computed from sizes and formats, the driver may pad or compress them differently)
+//When the heap allocations are counted (COUNT_HEAP_ALLOCATIONS, see arena.h) every operator new is also charged to the tag
+//of the innermost MEMORY_SCOPE of its thread ("untagged" outside them) and given back when it is deleted, so what the
+//reporters estimate can be compared with what was really allocated
+
+#define MEMORY_MAX_TAGS 32
+
+namespace CORE {
+
+	struct MemoryEntry {
+		const char* tag;	//subsystem, static string
+		std::string name;
+		size_t cpu_bytes;
+		size_t gpu_bytes;
+	};
+
+	struct MemoryTotal {
+		const char* tag;
+		size_t count;
+		size_t cpu_bytes;
+		size_t gpu_bytes;
+		size_t cpu_budget; //0 is no budget
+		size_t gpu_budget;
+	};
+
+	//live heap memory of a tag
+	struct HeapTag {
+		const char* tag;
+		size_t count;	//allocations not deleted yet
+		size_t bytes;
+		size_t peak_bytes;
+	};
+
+	typedef std::function<void(std::vector<MemoryEntry>&)> MemoryReporter;
+
+	class MemoryTracker {
+	public:
+		//call it from a static initializer in the .cpp of the subsystem
+		static bool addReporter(const char* tag, MemoryReporter reporter);
+
+		//asks all the reporters, the entries are appended
+		static void collect(std::vector<MemoryEntry>& entries);
+		//per tag, in the order the reporters were added
+		static void computeTotals(const std::vector<MemoryEntry>& entries, std::vector<MemoryTotal>& totals);
+
+		//budgets in bytes, read from a JSON like { "textures": { "gpu": 268435456 }, "meshes": { "cpu": 1000000, "gpu": 1000000 } }
+		static void setBudget(const char* tag, size_t cpu_bytes, size_t gpu_bytes);
+		static bool loadBudgets(const char* filename);
+		//prints the subsystems over budget, returns false if any
+		static bool checkBudgets();
+
+		//writes the totals and every entry as JSON (or CSV if the filename ends in .csv)
+		static bool dump(const char* filename);
+
+		static void renderPanel(); //ImGui table with the totals and the top consumers
+
+		//heap accounting by tag, the tag must be a static string
+		static int getTagIndex(const char* tag); //registers it the first time, 0 (untagged) if there are too many
+		static void getHeapTags(std::vector<HeapTag>& tags); //empty if the allocations are not counted
+		static void* taggedAllocate(size_t size); //used by operator new, a header before the block keeps its size and tag
+		static void taggedFree(void* ptr);
+	};
+
+	//charges the allocations of this thread to the tag until it goes out of scope
+	struct MemoryScope {
+		int previous;
+		MemoryScope(const char* tag);
+		~MemoryScope();
+	};
+};
+
+#define MEMORY_CONCAT_INNER(a, b) a##b
+#define MEMORY_CONCAT(a, b) MEMORY_CONCAT_INNER(a, b)
+#define MEMORY_SCOPE(tag) CORE::MemoryScope MEMORY_CONCAT(_memory_scope_, __LINE__)(tag)
@@ -0,0 +1,86 @@
+#include "pool.h"
+
+#include <new>
+#include <cassert>
+
+#define POOL_SIZE_CLASS 16
+#define POOL_MAX_SIZE 1024
+
+CORE::PoolAllocator::PoolAllocator(size_t block_size, size_t blocks_per_slab)
+{
+	//blocks must be able to store the free list pointer and keep the alignment of the next ones
+	if (block_size < sizeof(sFreeBlock))
+		block_size = sizeof(sFreeBlock);
+	this->block_size = (block_size + 15) & ~(size_t)15;
+	this->blocks_per_slab = blocks_per_slab;
+	num_allocated = 0;
+	free_list = nullptr;
+}
+
+void CORE::PoolAllocator::addSlab()
+{
+	char* slab = (char*)::operator new(block_size * blocks_per_slab, std::align_val_t(POOL_SLAB_ALIGNMENT));
+	slabs.push_back(slab);
+	//in reverse so the blocks are given in memory order
+	for (size_t i = blocks_per_slab; i > 0; --i)
+	{
+		sFreeBlock* block = (sFreeBlock*)(slab + (i - 1) * block_size);
+		block->next = free_list;
+		free_list = block;
+	}
+}
+
+void* CORE::PoolAllocator::allocate()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!free_list)
+		addSlab();
+	sFreeBlock* block = free_list;
+	free_list = block->next;
+	num_allocated++;
+	return block;
+}
+
+void CORE::PoolAllocator::deallocate(void* ptr)
+{
+	if (!ptr)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	assert(num_allocated > 0);
+	sFreeBlock* block = (sFreeBlock*)ptr;
+	block->next = free_list;
+	free_list = block;
+	num_allocated--;
+}
+
+//created on first use and never destroyed, objects could be deleted after the static destructors run
+static CORE::PoolAllocator** getSizePools()
+{
+	static CORE::PoolAllocator** pools = nullptr;
+	static std::once_flag created;
+	std::call_once(created, []() {
+		pools = new CORE::PoolAllocator*[POOL_MAX_SIZE / POOL_SIZE_CLASS];
+		for (int i = 0; i < POOL_MAX_SIZE / POOL_SIZE_CLASS; ++i)
+			pools[i] = new CORE::PoolAllocator((i + 1) * POOL_SIZE_CLASS, 64);
+	});
+	return pools;
+}
+
+void* CORE::poolAllocate(size_t size)
+{
+	if (size == 0 || size > POOL_MAX_SIZE)
+		return ::operator new(size);
+	return getSizePools()[(size - 1) / POOL_SIZE_CLASS]->allocate();
+}
+
+void CORE::poolDeallocate(void* ptr, size_t size)
+{
+	if (!ptr)
+		return;
+	if (size == 0 || size > POOL_MAX_SIZE)
+	{
+		::operator delete(ptr);
+		return;
+	}
+	getSizePools()[(size - 1) / POOL_SIZE_CLASS]->deallocate(ptr);
+}
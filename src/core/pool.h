@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+//Slab allocators for small objects that are created and destroyed very often (nodes, entities)
+//objects are carved from big slabs so they end up close in memory and new/delete dont go to the heap,
+//freed blocks are reused through a free list. Slabs are never returned to the system.
+
+#define POOL_SLAB_ALIGNMENT 64 //cache line
+
+namespace CORE {
+
+	class PoolAllocator {
+	public:
+		size_t block_size;
+		size_t blocks_per_slab;
+		size_t num_allocated; //blocks in use
+
+		PoolAllocator(size_t block_size, size_t blocks_per_slab = 256);
+		void* allocate();
+		void deallocate(void* ptr);
+		size_t getReservedBytes() const { return slabs.size() * blocks_per_slab * block_size; }
+
+	private:
+		struct sFreeBlock { sFreeBlock* next; };
+		sFreeBlock* free_list;
+		std::vector<char*> slabs;
+		std::mutex mutex;
+
+		void addSlab();
+	};
+
+	//for classes whose subclasses have different sizes, there is one pool per size class (multiples of 16 bytes up to 1KB)
+	void* poolAllocate(size_t size);
+	void poolDeallocate(void* ptr, size_t size);
+};
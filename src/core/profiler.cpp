@@ -0,0 +1,224 @@
+#include "profiler.h"
+#include "includes.h"
+#include "../utils/utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cassert>
+
+using namespace CORE;
+
+bool Profiler::enabled = true;
+bool Profiler::paused = false;
+uint64_t Profiler::frame_start = 0;
+uint64_t Profiler::last_frame_start = 0;
+uint64_t Profiler::last_frame_end = 0;
+std::vector<ProfileThread*> Profiler::threads;
+std::mutex Profiler::threads_mutex;
+
+static const std::chrono::steady_clock::time_point profiler_start_time = std::chrono::steady_clock::now();
+static thread_local ProfileThread* current_thread = NULL;
+
+uint64_t Profiler::now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler_start_time).count();
+}
+
+ProfileThread* Profiler::getThread()
+{
+	if (current_thread)
+		return current_thread;
+
+	//first event of this thread, register it (never freed, threads are few and long lived)
+	ProfileThread* thread = new ProfileThread();
+	thread->depth = 0;
+	thread->head = 0;
+	const std::lock_guard<std::mutex> lock(threads_mutex);
+	thread->id = (int)threads.size();
+	thread->name = "Thread " + std::to_string(thread->id);
+	threads.push_back(thread);
+	current_thread = thread;
+	return thread;
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	ProfileThread* thread = getThread();
+	const std::lock_guard<std::mutex> lock(threads_mutex);
+	thread->name = name;
+}
+
+void Profiler::beginFrame()
+{
+	uint64_t time = now();
+	last_frame_start = frame_start;
+	last_frame_end = time;
+	frame_start = time;
+}
+
+void Profiler::begin(const char* name)
+{
+	ProfileThread* thread = getThread();
+	int depth = thread->depth++;
+	if (depth >= PROFILER_MAX_DEPTH)
+		return;
+	thread->open_names[depth] = name;
+	thread->open_recorded[depth] = enabled;
+	thread->open_starts[depth] = enabled ? now() : 0;
+}
+
+void Profiler::end()
+{
+	ProfileThread* thread = getThread();
+	assert(thread->depth > 0 && "Profiler::end without begin");
+	int depth = --thread->depth;
+	if (depth >= PROFILER_MAX_DEPTH || !thread->open_recorded[depth])
+		return;
+
+	uint64_t end_time = now();
+	const std::lock_guard<std::mutex> lock(thread->events_mutex);
+	ProfileEvent& event = thread->events[thread->head & (PROFILER_RING_SIZE - 1)];
+	event.name = thread->open_names[depth];
+	event.start = thread->open_starts[depth];
+	event.end = end_time;
+	event.depth = depth;
+	event.thread = thread->id;
+	thread->head++;
+}
+
+void Profiler::collect(uint64_t from, uint64_t to, std::vector<ProfileEvent>& events)
+{
+	const std::lock_guard<std::mutex> lock(threads_mutex);
+	for (ProfileThread* thread : threads)
+	{
+		//the owner waits to write its next event until the copy is done
+		const std::lock_guard<std::mutex> events_lock(thread->events_mutex);
+		uint64_t head = thread->head;
+		uint64_t num = head < PROFILER_RING_SIZE ? head : PROFILER_RING_SIZE;
+		for (uint64_t i = head - num; i < head; ++i)
+		{
+			const ProfileEvent& event = thread->events[i & (PROFILER_RING_SIZE - 1)];
+			if (event.start >= from && event.end <= to)
+				events.push_back(event);
+		}
+	}
+}
+
+bool Profiler::exportChromeTrace(const char* filename)
+{
+	std::vector<ProfileEvent> events;
+	collect(0, now(), events);
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write profiler trace: " << filename << std::endl;
+		return false;
+	}
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	bool first = true;
+	{
+		const std::lock_guard<std::mutex> lock(threads_mutex);
+		for (ProfileThread* thread : threads)
+		{
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", thread->id, thread->name.c_str());
+			first = false;
+		}
+	}
+	for (const ProfileEvent& event : events)
+	{
+		//timestamps in microseconds
+		fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+			event.name, event.thread, event.start * 0.001, (event.end - event.start) * 0.001);
+		first = false;
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	std::cout << " + Profiler trace saved: " << TermColor::YELLOW << filename << TermColor::DEFAULT << " (" << events.size() << " events)" << std::endl;
+	return true;
+}
+
+void Profiler::renderPanel()
+{
+#ifndef SKIP_IMGUI
+	static std::vector<ProfileEvent> frame_events;
+	static uint64_t shown_start = 0;
+	static uint64_t shown_end = 0;
+
+	ImGui::Checkbox("Enabled", &enabled);
+	ImGui::SameLine();
+	ImGui::Checkbox("Pause", &paused);
+	ImGui::SameLine();
+	if (ImGui::Button("Export trace"))
+		exportChromeTrace("trace.json");
+
+	if (!paused)
+	{
+		shown_start = last_frame_start;
+		shown_end = last_frame_end;
+		frame_events.clear();
+		collect(shown_start, shown_end, frame_events);
+	}
+	if (shown_end <= shown_start)
+		return;
+
+	ImGui::Text("Frame: %.3f ms", (shown_end - shown_start) * 1e-6);
+
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	ImVec2 mouse = ImGui::GetIO().MousePos;
+	const float row_height = 18.0f;
+	float width = ImGui::GetContentRegionAvail().x;
+	double scale = width / double(shown_end - shown_start);
+
+	std::vector<std::string> names;
+	{
+		const std::lock_guard<std::mutex> lock(threads_mutex);
+		for (ProfileThread* thread : threads)
+			names.push_back(thread->name);
+	}
+
+	//one band per thread, one row per depth level
+	for (int i = 0; i < (int)names.size(); ++i)
+	{
+		int max_depth = -1;
+		for (const ProfileEvent& event : frame_events)
+			if (event.thread == i && event.depth > max_depth)
+				max_depth = event.depth;
+		if (max_depth < 0)
+			continue;
+
+		ImGui::TextDisabled("%s", names[i].c_str());
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImGui::PushID(i);
+		ImGui::InvisibleButton("band", ImVec2(width, (max_depth + 1) * row_height));
+		ImGui::PopID();
+		bool hovered = ImGui::IsItemHovered();
+
+		for (const ProfileEvent& event : frame_events)
+		{
+			if (event.thread != i)
+				continue;
+			float x0 = origin.x + float((event.start - shown_start) * scale);
+			float x1 = origin.x + float((event.end - shown_start) * scale);
+			if (x1 < x0 + 1.0f)
+				x1 = x0 + 1.0f;
+			float y0 = origin.y + event.depth * row_height;
+			float y1 = y0 + row_height - 1.0f;
+
+			//same color for the same marker
+			uint32_t hash = (uint32_t)((uintptr_t)event.name * 2654435761u);
+			draw_list->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.7f));
+			if (x1 - x0 > 20.0f)
+			{
+				draw_list->PushClipRect(ImVec2(x0, y0), ImVec2(x1, y1), true);
+				draw_list->AddText(ImVec2(x0 + 2.0f, y0 + 2.0f), IM_COL32_WHITE, event.name);
+				draw_list->PopClipRect();
+			}
+			if (hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1)
+				ImGui::SetTooltip("%s: %.3f ms", event.name, (event.end - event.start) * 1e-6);
+		}
+	}
+#endif
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+
+//CPU profiler: every thread records its scopes in its own ring buffer, with a lock of its own that only
+//the readers (collect) can contend
+//use the macros so it can be compiled out defining DISABLE_PROFILER
+
+#define PROFILER_RING_SIZE (1 << 13) //events kept per thread (must be power of two)
+#define PROFILER_MAX_DEPTH 64
+
+namespace CORE {
+
+	struct ProfileEvent {
+		const char* name;	//must be a static string (literal or __FUNCTION__)
+		uint64_t start;		//nanoseconds since the profiler started
+		uint64_t end;
+		int depth;
+		int thread;
+	};
+
+	//buffers of one thread, only written by its owner
+	struct ProfileThread {
+		std::mutex events_mutex;	//held by the owner while it writes an event and by collect while it copies them
+		std::string name;
+		int id;
+		int depth;
+		const char* open_names[PROFILER_MAX_DEPTH];
+		uint64_t open_starts[PROFILER_MAX_DEPTH];
+		bool open_recorded[PROFILER_MAX_DEPTH];
+		uint64_t head; //total events written
+		ProfileEvent events[PROFILER_RING_SIZE];
+	};
+
+	class Profiler {
+	public:
+		static bool enabled;
+		static bool paused;	//the panel keeps showing the same frame
+		static uint64_t frame_start;
+		static uint64_t last_frame_start;	//range of the last completed frame
+		static uint64_t last_frame_end;
+
+		static std::vector<ProfileThread*> threads;
+		static std::mutex threads_mutex; //guards the list and the names of the threads
+
+		static uint64_t now(); //nanoseconds from steady_clock
+		static void beginFrame(); //called from the main loop at the start of every frame
+		static void begin(const char* name);
+		static void end();
+		static void setThreadName(const char* name);
+		static ProfileThread* getThread();
+
+		//copies the events of all threads inside the time range
+		static void collect(uint64_t from, uint64_t to, std::vector<ProfileEvent>& events);
+		//writes every event still in the ring buffers as chrome://tracing JSON
+		static bool exportChromeTrace(const char* filename);
+
+		static void renderPanel(); //ImGui flame graph of the last frame
+	};
+
+	//RAII marker used by the PROFILE macros
+	struct ProfileScope {
+		ProfileScope(const char* name) { Profiler::begin(name); }
+		~ProfileScope() { Profiler::end(); }
+	};
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifndef DISABLE_PROFILER
+	#define PROFILE_SCOPE(name) CORE::ProfileScope PROFILE_CONCAT(_profile_scope_, __LINE__)(name)
+	#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#else
+	#define PROFILE_SCOPE(name)
+	#define PROFILE_FUNCTION()
+#endif
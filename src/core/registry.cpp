@@ -0,0 +1,29 @@
+#include "registry.h"
+
+#include <algorithm>
+
+CORE::BaseRegistry::BaseRegistry()
+{
+	getRegistries().push_back(this);
+}
+
+CORE::BaseRegistry::~BaseRegistry()
+{
+	std::vector<BaseRegistry*>& registries = getRegistries();
+	auto it = std::find(registries.begin(), registries.end(), this);
+	if (it != registries.end())
+		registries.erase(it);
+}
+
+//inside a function so it exists before the static registries of other files are constructed
+std::vector<CORE::BaseRegistry*>& CORE::BaseRegistry::getRegistries()
+{
+	static std::vector<BaseRegistry*> registries;
+	return registries;
+}
+
+void CORE::BaseRegistry::collectAll()
+{
+	for (BaseRegistry* registry : getRegistries())
+		registry->collect();
+}
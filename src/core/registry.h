@@ -0,0 +1,307 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+
+#include "math.h"
+
+//Registry of named resources (meshes, textures, shaders...)
+//names are found through an open addressing hash table instead of comparing strings in a std::map,
+//items can be referenced with handles that become invalid once the item is removed (the slot generation changes)
+//and items that were retained and then released by everybody are destroyed at the end of the frame (see collectAll)
+//all methods are safe to call from the loader threads
+
+namespace CORE {
+
+	struct Handle {
+		uint32 index = 0;
+		uint32 generation = 0; //0 is the null handle
+
+		bool isValid() const { return generation != 0; }
+		bool operator==(const Handle& h) const { return index == h.index && generation == h.generation; }
+		bool operator!=(const Handle& h) const { return !(*this == h); }
+	};
+
+	//FNV-1a of the path
+	inline uint64_t hashPath(std::string_view path)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (char c : path)
+		{
+			hash ^= (uint8)c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	//so all the registries can be collected without knowing their type
+	class BaseRegistry {
+	public:
+		BaseRegistry();
+		virtual ~BaseRegistry();
+		virtual void collect() = 0;
+
+		static std::vector<BaseRegistry*>& getRegistries();
+		static void collectAll(); //call it once per frame from the main thread (items could have GL objects)
+	};
+
+	template<typename T>
+	class Registry : public BaseRegistry {
+	public:
+		Registry() { num_used = 0; }
+
+		//registers the item with that name (replacing the previous one, which is not deleted)
+		Handle add(std::string_view name, T* item)
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex);
+			uint64_t hash = hashPath(name);
+			int table_index = findInTable(name, hash);
+			if (table_index != -1)
+				freeSlot(table_index);
+
+			uint32 index;
+			if (free_slots.size())
+			{
+				index = free_slots.back();
+				free_slots.pop_back();
+			}
+			else
+			{
+				index = (uint32)slots.size();
+				slots.push_back(sSlot());
+			}
+			sSlot& slot = slots[index];
+			slot.item = item;
+			slot.name = name;
+			slot.hash = hash;
+			slot.refs = 0;
+			if (!slot.generation)
+				slot.generation = 1;
+			insertInTable(index);
+			return Handle{ index, slot.generation };
+		}
+
+		//if item is passed it is only removed when the name still points to it (called from destructors)
+		bool remove(std::string_view name, const T* item = nullptr)
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex);
+			int table_index = findInTable(name, hashPath(name));
+			if (table_index == -1)
+				return false;
+			if (item && slots[table[table_index] - 1].item != item)
+				return false;
+			freeSlot(table_index);
+			return true;
+		}
+
+		T* find(std::string_view name) const
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			int table_index = findInTable(name, hashPath(name));
+			return table_index == -1 ? nullptr : slots[table[table_index] - 1].item;
+		}
+
+		Handle getHandle(std::string_view name) const
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			int table_index = findInTable(name, hashPath(name));
+			if (table_index == -1)
+				return Handle();
+			uint32 index = table[table_index] - 1;
+			return Handle{ index, slots[index].generation };
+		}
+
+		//null if the handle is stale
+		T* get(Handle handle) const
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			if (!isAlive(handle))
+				return nullptr;
+			return slots[handle.index].item;
+		}
+
+		//items that are never retained live until somebody deletes them, like before
+		void retain(Handle handle)
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex);
+			if (isAlive(handle))
+				slots[handle.index].refs++;
+		}
+
+		//when the last reference is released the item is destroyed in the next collect
+		void release(Handle handle)
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex);
+			if (!isAlive(handle) || slots[handle.index].refs <= 0)
+				return;
+			if (--slots[handle.index].refs == 0)
+				pending.push_back(handle);
+		}
+
+		void collect()
+		{
+			std::vector<T*> to_delete;
+			{
+				std::unique_lock<std::shared_mutex> lock(mutex);
+				for (Handle handle : pending)
+				{
+					//it could have been retained again after being released
+					if (!isAlive(handle) || slots[handle.index].refs != 0)
+						continue;
+					const sSlot& slot = slots[handle.index];
+					to_delete.push_back(slot.item);
+					freeSlot(findInTable(slot.name, slot.hash));
+				}
+				pending.clear();
+			}
+			//outside the lock as the destructors also try to remove themselves
+			for (T* item : to_delete)
+				delete item;
+		}
+
+		//copy of the registered items, so they can be deleted while iterating it
+		std::vector<T*> getItems() const
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			std::vector<T*> items;
+			items.reserve(slots.size() - free_slots.size());
+			for (const sSlot& slot : slots)
+				if (slot.item)
+					items.push_back(slot.item);
+			return items;
+		}
+
+		//same with the names they were registered with
+		std::vector<std::pair<std::string, T*>> getNamedItems() const
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			std::vector<std::pair<std::string, T*>> items;
+			items.reserve(slots.size() - free_slots.size());
+			for (const sSlot& slot : slots)
+				if (slot.item)
+					items.push_back(std::make_pair(slot.name, slot.item));
+			return items;
+		}
+
+		size_t size() const
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			return slots.size() - free_slots.size();
+		}
+
+		//forgets all the items without deleting them
+		void clear()
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex);
+			for (uint32 i = 0; i < slots.size(); ++i)
+				if (slots[i].item)
+				{
+					slots[i].item = nullptr;
+					slots[i].name.clear();
+					slots[i].generation++;
+					free_slots.push_back(i);
+				}
+			table.assign(table.size(), 0);
+			num_used = 0;
+			pending.clear();
+		}
+
+	private:
+		static const uint32 TOMBSTONE = 0xFFFFFFFF;
+
+		struct sSlot {
+			T* item = nullptr;
+			std::string name;
+			uint64_t hash = 0;
+			uint32 generation = 0;
+			int refs = 0;
+		};
+
+		std::vector<sSlot> slots;
+		std::vector<uint32> free_slots;
+		std::vector<uint32> table;	//slot index + 1, 0 is empty, power of two size
+		uint32 num_used;			//entries in the table including tombstones
+		std::vector<Handle> pending;	//released, waiting for collect
+		mutable std::shared_mutex mutex;
+
+		bool isAlive(Handle handle) const
+		{
+			return handle.generation && handle.index < slots.size() && slots[handle.index].generation == handle.generation && slots[handle.index].item;
+		}
+
+		//returns the position in the table or -1
+		int findInTable(std::string_view name, uint64_t hash) const
+		{
+			if (table.empty())
+				return -1;
+			uint32 mask = (uint32)table.size() - 1;
+			for (uint32 i = (uint32)hash & mask;; i = (i + 1) & mask)
+			{
+				uint32 entry = table[i];
+				if (entry == 0)
+					return -1;
+				if (entry == TOMBSTONE)
+					continue;
+				const sSlot& slot = slots[entry - 1];
+				if (slot.hash == hash && slot.name == name)
+					return (int)i;
+			}
+		}
+
+		void insertInTable(uint32 index)
+		{
+			//keep it under 75% so the probe sequences stay short (and there is always an empty entry)
+			if ((num_used + 1) * 4 > table.size() * 3)
+			{
+				rehash(); //already includes this slot
+				return;
+			}
+			uint32 mask = (uint32)table.size() - 1;
+			uint32 i = (uint32)slots[index].hash & mask;
+			while (table[i] != 0 && table[i] != TOMBSTONE)
+				i = (i + 1) & mask;
+			if (table[i] == 0)
+				num_used++;
+			table[i] = index + 1;
+		}
+
+		void rehash()
+		{
+			size_t num_items = slots.size() - free_slots.size();
+			size_t size = 16;
+			while (size * 3 < (num_items + 1) * 8) //around 37% after growing
+				size *= 2;
+			table.assign(size, 0);
+			num_used = 0;
+			uint32 mask = (uint32)size - 1;
+			for (uint32 index = 0; index < slots.size(); ++index)
+			{
+				if (!slots[index].item)
+					continue;
+				uint32 i = (uint32)slots[index].hash & mask;
+				while (table[i] != 0)
+					i = (i + 1) & mask;
+				table[i] = index + 1;
+				num_used++;
+			}
+		}
+
+		void freeSlot(int table_index)
+		{
+			uint32 index = table[table_index] - 1;
+			table[table_index] = TOMBSTONE;
+			sSlot& slot = slots[index];
+			slot.item = nullptr;
+			slot.name.clear();
+			slot.refs = 0;
+			slot.generation++;
+			if (!slot.generation) //wrapped, 0 is reserved for null handles
+				slot.generation = 1;
+			free_slots.push_back(index);
+		}
+	};
+
+};
@@ -1,4 +1,5 @@
 #include "task.h"
+#include "profiler.h"
 #include <iostream>       // std::cout
 #include <thread>         // std::thread
 #include <chrono>		  //ms
@@ -17,6 +18,7 @@ void TaskManager::loop()
 {
 	using namespace std::chrono_literals;
 	std::cout << "Starting Task Manager ..." << std::endl;
+	CORE::Profiler::setThreadName("Background tasks");
 
 	while (must_loop)
 	{
@@ -51,6 +53,7 @@ void TaskManager::fetchTask()
 
 	if (task)
 	{
+		PROFILE_SCOPE("Task");
 		task->onExecute();
 		delete task;
 		task = NULL;
@@ -76,4 +79,123 @@ void TaskManager::addTask(Task* task)
 	const std::lock_guard<std::mutex> lock(tasks_mutex);
 	pending_tasks.push_back(task);
 	//release pending_tasks automatically
-}
\ No newline at end of file
+}
+
+JobPool JobPool::global;
+
+JobPool::JobPool()
+{
+	next_batch = 0;
+	job = nullptr;
+	job_data = nullptr;
+	num_batches = batch_size = job_size = 0;
+	generation = 0;
+	active_workers = 0;
+	must_loop = false;
+}
+
+JobPool::~JobPool()
+{
+	stop();
+}
+
+void JobPool::start(int num_threads)
+{
+	assert(workers.empty() && "JobPool already started");
+	if (num_threads <= 0)
+		num_threads = (int)std::thread::hardware_concurrency() - 1;
+	must_loop = true;
+	for (int i = 0; i < num_threads; ++i)
+		workers.push_back(new std::thread(&JobPool::workerLoop, this));
+}
+
+void JobPool::stop()
+{
+	{
+		const std::lock_guard<std::mutex> lock(jobs_mutex);
+		must_loop = false;
+	}
+	wake_condition.notify_all();
+	for (std::thread* worker : workers)
+	{
+		worker->join();
+		delete worker;
+	}
+	workers.clear();
+}
+
+void JobPool::runBatches()
+{
+	while (true)
+	{
+		int batch = next_batch.fetch_add(1);
+		if (batch >= num_batches)
+			break;
+		int start = batch * batch_size;
+		int end = start + batch_size;
+		if (end > job_size)
+			end = job_size;
+		PROFILE_SCOPE("Job batch");
+		job(job_data, start, end);
+	}
+}
+
+void JobPool::workerLoop()
+{
+	int last_generation = 0;
+	CORE::Profiler::setThreadName("Worker");
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(jobs_mutex);
+			wake_condition.wait(lock, [&] { return !must_loop || generation != last_generation; });
+			if (!must_loop)
+				return;
+			last_generation = generation;
+			active_workers++;
+		}
+
+		runBatches();
+
+		{
+			const std::lock_guard<std::mutex> lock(jobs_mutex);
+			active_workers--;
+		}
+		done_condition.notify_all();
+	}
+}
+
+void JobPool::runJob(int num, int batch_size, void (*func)(void* data, int start, int end), void* data)
+{
+	if (num <= 0)
+		return;
+	if (batch_size < 1)
+		batch_size = 1;
+	if (workers.empty() && !must_loop)
+		start();
+	if (workers.empty() || num <= batch_size) //nothing to split
+	{
+		func(data, 0, num);
+		return;
+	}
+
+	{
+		//wait for workers that are still leaving the previous job
+		std::unique_lock<std::mutex> lock(jobs_mutex);
+		done_condition.wait(lock, [&] { return active_workers == 0; });
+		job = func;
+		job_data = data;
+		job_size = num;
+		this->batch_size = batch_size;
+		num_batches = (num + batch_size - 1) / batch_size;
+		next_batch = 0;
+		generation++;
+	}
+	wake_condition.notify_all();
+
+	runBatches();
+
+	//every batch has been taken, wait for the ones still running
+	std::unique_lock<std::mutex> lock(jobs_mutex);
+	done_condition.wait(lock, [&] { return active_workers == 0; });
+}
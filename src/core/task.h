@@ -5,6 +5,8 @@
 #include <mutex>
 #include <thread>         // std::thread
 #include <functional>
+#include <condition_variable>
+#include <atomic>
 
 //any task executed in BG should inherit from this one
 class Task {
@@ -31,4 +33,39 @@ public:
 	void fetchTask();
 	void loop();
 	void startThread();
-};
\ No newline at end of file
+};
+
+//pool of worker threads used to split a loop across all the cores (the calling thread also works)
+class JobPool {
+public:
+	std::vector<std::thread*> workers;
+	std::mutex jobs_mutex;  // protects the job and the counters below
+	std::condition_variable wake_condition;
+	std::condition_variable done_condition;
+	void (*job)(void* data, int start, int end);	//the function of the caller is not copied (std::function would allocate), it waits for the job
+	void* job_data;
+	std::atomic<int> next_batch;
+	int num_batches;
+	int batch_size;
+	int job_size;
+	int generation;	//increased with every job so workers know there is a new one
+	int active_workers;
+	bool must_loop;
+
+	static JobPool global;
+
+	JobPool();
+	~JobPool();
+	void start(int num_threads = 0); //0 means one per core minus the calling thread
+	void stop();
+	//calls func(start, end) for ranges of batch_size covering [0,num), returns when all are done
+	template<typename F>
+	void parallelFor(int num, int batch_size, const F& func)
+	{
+		runJob(num, batch_size, [](void* data, int start, int end) { (*(const F*)data)(start, end); }, (void*)&func);
+	}
+	void runJob(int num, int batch_size, void (*func)(void* data, int start, int end), void* data);
+
+	void workerLoop();
+	void runBatches();
+};
@@ -72,15 +72,21 @@ bool UI::ButtonIcon(int iconx, int icony, float size, float alpha)
 #endif
 }
 
-void UI::inspectObject(Matrix44& matrix)
+bool UI::inspectObject(Matrix44& matrix)
 {
 #ifndef SKIP_IMGUI
 	float matrixTranslation[3], matrixRotation[3], matrixScale[3];
 	ImGuizmo::DecomposeMatrixToComponents(matrix.m, matrixTranslation, matrixRotation, matrixScale);
-	ImGui::DragFloat3("Position", matrixTranslation, 0.1f);
-	ImGui::DragFloat3("Rotation", matrixRotation, 0.1f);
-	ImGui::DragFloat3("Scale", matrixScale, 0.1f);
-	ImGuizmo::RecomposeMatrixFromComponents(matrixTranslation, matrixRotation, matrixScale, matrix.m);
+	bool changed = false;
+	changed |= ImGui::DragFloat3("Position", matrixTranslation, 0.1f);
+	changed |= ImGui::DragFloat3("Rotation", matrixRotation, 0.1f);
+	changed |= ImGui::DragFloat3("Scale", matrixScale, 0.1f);
+	//recomposing it every frame would add some float error to the matrix
+	if (changed)
+		ImGuizmo::RecomposeMatrixFromComponents(matrixTranslation, matrixRotation, matrixScale, matrix.m);
+	return changed;
+#else
+	return false;
 #endif
 }
 
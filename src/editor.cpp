@@ -2,6 +2,8 @@
 #include "litengine.h"
 #include "editor.h"
 
+#define UNDO_MAX_STEPS 1000
+
 long mouse_press_time = 0;
 
 SceneEditor::SceneEditor( SCN::Scene* scene, SCN::Renderer* renderer )
@@ -12,6 +14,9 @@ SceneEditor::SceneEditor( SCN::Scene* scene, SCN::Renderer* renderer )
 	camera = nullptr;
 	sidebar_width = 300;
 	show_textures = false;
+	show_profiler = false;
+	show_memory = false;
+	show_gpu_timings = false;
 }
 
 void SceneEditor::renderDebug(Camera* camera)
@@ -41,6 +46,10 @@ void SceneEditor::render(Camera* camera)
 	Vector2f window_size = CORE::getWindowSize();
 	this->camera = camera;
 
+	//the widget being edited is not visible anymore
+	if (edit_address && !ImGui::IsAnyItemActive())
+		commitEdit();
+
 	ImGui::PushStyleVar(ImGuiStyleVar_PopupBorderSize, 0.0f);
 
 	if (ImGui::BeginMainMenuBar())
@@ -49,6 +58,7 @@ void SceneEditor::render(Camera* camera)
 		{
 			if (ImGui::MenuItem("New", "Ctrl+N"))
 			{
+				clearUndo();
 				scene->clear();
 			}
 			if (ImGui::MenuItem("Load", "Ctrl+L"))
@@ -56,8 +66,11 @@ void SceneEditor::render(Camera* camera)
 				std::string result = CORE::openFileDialog();
 				if (result.size())
 				{
-					if( scene->base_folder == cleanPath(result.substr(0, scene->base_folder.size())) )
+					if (scene->base_folder == cleanPath(result.substr(0, scene->base_folder.size())))
+					{
+						clearUndo();
 						scene->load(result.c_str());
+					}
 					else
 					{
 					}
@@ -65,6 +78,7 @@ void SceneEditor::render(Camera* camera)
 			}
 			if (ImGui::MenuItem("Reload", "F6"))
 			{
+				clearUndo();
 				scene->load(scene->filename.c_str());
 			}
 			if (ImGui::MenuItem("Save", "Ctrl+S"))
@@ -77,8 +91,12 @@ void SceneEditor::render(Camera* camera)
 			ImGui::EndMenu();
 		}
 
-		if (ImGui::BeginMenu("Edit", false))
+		if (ImGui::BeginMenu("Edit"))
 		{
+			if (ImGui::MenuItem("Undo", "Ctrl+Z", false, undo_history.size() > 0))
+				doUndo();
+			if (ImGui::MenuItem("Redo", "Ctrl+Y", false, redo_history.size() > 0))
+				doRedo();
 			ImGui::EndMenu();
 		}
 
@@ -90,7 +108,9 @@ void SceneEditor::render(Camera* camera)
 				{
 					SCN::BaseEntity* ent = it->second->clone();
 					ent->name = "entity";
-					scene->addEntity(ent);
+					EntityCommand* command = new EntityCommand(scene, ent, true);
+					command->redo();
+					addCommand(command);
 					SCN::BaseEntity::s_selected = ent;
 				}
 			}
@@ -101,6 +121,9 @@ void SceneEditor::render(Camera* camera)
 		if (ImGui::BeginMenu("View"))
 		{
 			ImGui::MenuItem("Textures", "F4", &show_textures);
+			ImGui::MenuItem("Profiler", "F3", &show_profiler);
+			ImGui::MenuItem("Memory", "F2", &show_memory);
+			ImGui::MenuItem("GPU Timings", NULL, &show_gpu_timings);
 			ImGui::EndMenu();
 		}
 		ImGui::EndMainMenuBar();
@@ -121,9 +144,13 @@ void SceneEditor::render(Camera* camera)
 		if (SCN::BaseEntity::s_selected)
 		{
 			static bool was_used = false;
-			bool used = UI::manipulateMatrix(SCN::BaseEntity::s_selected->root.model, camera);
-			if (!was_used && used)
-				saveUndo();
+			static Matrix44 drag_start;
+			Matrix44& model = SCN::BaseEntity::s_selected->root.model;
+			if (!was_used)
+				drag_start = model;
+			bool used = UI::manipulateMatrix(model, camera);
+			if (was_used && !used)
+				addCommand(new PropertyCommand(&model, &drag_start, sizeof(Matrix44)));
 			was_used = used;
 		}
 	}
@@ -133,9 +160,24 @@ void SceneEditor::render(Camera* camera)
 	ImGui::SetNextWindowPos(ImVec2(sidebar_width, 48));
 	ImGui::SetNextWindowSize(ImVec2(window_size.x - sidebar_width, 30));
 	if (ImGui::Begin("Stats", nullptr, flags | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoMouseInputs))// Create a window
-		ImGui::Text(GFX::getGPUStats().c_str());					   // Display some text (you can use a format strings too)
+	{
+		ImGui::TextUnformatted(GFX::getGPUStats());
+		ImGui::SameLine();
+		//heap allocations are only counted in debug (see core/arena.h)
+		CORE::LinearArena& arena = CORE::FrameArena::arenas[(CORE::FrameArena::current + 1) % 2]; //last frame
+		ImGui::Text("| Frame arena: %dKB/%dKB Heap allocs: %ld", (int)(arena.used / 1024), (int)(arena.capacity / 1024), CORE::FrameArena::heap_allocations);
+	}
 	ImGui::End();
 
+	if (show_gpu_timings)
+	{
+		ImGui::SetNextWindowPos(ImVec2(sidebar_width, 78), ImGuiCond_FirstUseEver);
+		ImGui::SetNextWindowSize(ImVec2(400, 240), ImGuiCond_FirstUseEver);
+		if (ImGui::Begin("GPU Timings", &show_gpu_timings))
+			GFX::GPUTimers::renderGraph();
+		ImGui::End();
+	}
+
 	int current_y = 18;
 	int remaining_y = window_size.y - current_y;
 
@@ -234,8 +276,12 @@ void SceneEditor::render(Camera* camera)
 	}
 	else
 	{
+		editBegin(scene->background_color);
 		ImGui::ColorEdit3("BG color", scene->background_color.v);
+		editEnd();
+		editBegin(scene->ambient_light);
 		ImGui::ColorEdit3("Ambient Light", scene->ambient_light.v);
+		editEnd();
 
 		if (UI::Filename("Skybox", scene->skybox_filename, scene->base_folder))
 			renderer->setupScene();
@@ -275,6 +321,34 @@ void SceneEditor::render(Camera* camera)
 #endif
 	if(show_textures)
 		renderTexturesPanel();
+	if (show_profiler)
+		renderProfilerPanel();
+	if (show_memory)
+		renderMemoryPanel();
+}
+
+void SceneEditor::renderProfilerPanel()
+{
+	#ifndef SKIP_IMGUI
+	vec2 window_size = CORE::getWindowSize();
+	ImGui::SetNextWindowPos(ImVec2(sidebar_width, window_size.y * 0.6f), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(window_size.x - sidebar_width, window_size.y * 0.4f), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Profiler", &show_profiler))
+		CORE::Profiler::renderPanel();
+	ImGui::End();
+	#endif
+}
+
+void SceneEditor::renderMemoryPanel()
+{
+	#ifndef SKIP_IMGUI
+	vec2 window_size = CORE::getWindowSize();
+	ImGui::SetNextWindowPos(ImVec2(window_size.x - 500, 20), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(500, window_size.y * 0.5f), ImGuiCond_FirstUseEver);
+	if (ImGui::Begin("Memory", &show_memory))
+		CORE::MemoryTracker::renderPanel();
+	ImGui::End();
+	#endif
 }
 
 void SceneEditor::renderTexturesPanel()
@@ -315,13 +389,24 @@ void SceneEditor::inspectEntity(SCN::BaseEntity* entity)
 	char buff[1024];
 	strcpy(buff, entity->name.c_str());
 	//ImGui::Text("Name: %s", name.c_str()); 
+	static std::string name_before;
 	if (ImGui::InputText("Name", buff, 1024))
 		entity->name = buff;
+	if (ImGui::IsItemActivated())
+		name_before = entity->name;
+	if (ImGui::IsItemDeactivatedAfterEdit() && name_before != entity->name)
+		addCommand(new StringCommand(&entity->name, name_before));
 	ImGui::Text("Type: %s", entity->getTypeAsStr());
+	editBegin(entity->visible);
 	ImGui::Checkbox("Visible", &entity->visible);
+	editEnd();
+	editBegin(entity->layers);
 	UI::Layers("Layers", &entity->layers);
+	editEnd();
 
+	editBegin(entity->root.model);
 	UI::inspectObject(entity->root.model);//Model edit
+	editEnd();
 #endif
 }
 
@@ -332,8 +417,11 @@ void SceneEditor::inspectEntity(SCN::PrefabEntity* entity)
 
 	ImGui::Separator();
 
+	std::string filename_before = entity->filename;
 	if (UI::Filename("filename", entity->filename, scene->base_folder))
 	{
+		//the old tree is kept by the command, the commands of its nodes cannot point to freed memory
+		addCommand(new PrefabCommand(entity, filename_before));
 		entity->loadPrefab(entity->filename.c_str());
 	}
 
@@ -345,27 +433,47 @@ void SceneEditor::inspectEntity(SCN::LightEntity* entity)
 #ifndef SKIP_IMGUI
 	this->inspectEntity((SCN::BaseEntity*)entity);
 
+	editBegin(entity->light_type);
 	int light_type = (int)entity->light_type;
 	ImGui::Combo("light_type", &light_type, "UNKNOWN\0POINT\0SPOT\0DIRECTIONAL", 4);
 	entity->light_type = (SCN::eLightType)(light_type);
+	editEnd();
 
+	editBegin(entity->color);
 	ImGui::ColorEdit3("color", entity->color.v);
+	editEnd();
+	editBegin(entity->intensity);
 	ImGui::SliderFloat("intensity", &entity->intensity, 0, 100);
+	editEnd();
+	editBegin(entity->near_distance);
 	ImGui::DragFloat("near_distance", &entity->near_distance, 0.1, -10000.0f, 10000.0f);
+	editEnd();
+	editBegin(entity->max_distance);
 	ImGui::DragFloat("max_distance", &entity->max_distance, 1.0f, 0.0f,10000.0f);
+	editEnd();
 
 	if (light_type == SCN::eLightType::SPOT)
 	{
+		editBegin(entity->cone_info);
 		ImGui::SliderFloat("cone_start", &entity->cone_info.x, 0, 180);
 		ImGui::SliderFloat("cone_end", &entity->cone_info.y, 0, 180);
+		editEnd();
 	}
 	if (light_type == SCN::eLightType::DIRECTIONAL)
+	{
+		editBegin(entity->area);
 		ImGui::DragFloat("area", &entity->area);
+		editEnd();
+	}
 
+	editBegin(entity->cast_shadows);
 	ImGui::Checkbox("cast_shadows", &entity->cast_shadows);
+	editEnd();
 	if (entity->cast_shadows)
 	{
+		editBegin(entity->shadow_bias);
 		ImGui::DragFloat("shadow_bias", &entity->shadow_bias, 0.001, 0.0f, 0.1f);
+		editEnd();
 	}
 #endif
 }
@@ -491,7 +599,9 @@ void SceneEditor::inspectObject(SCN::Node* node)
 	ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.75f, 0.75f, 0.75f, 1.0f));
 
 	//Model edit
+	editBegin(node->model);
 	UI::inspectObject(node->model);
+	editEnd();
 
 	//Material
 	if (node->material && ImGui::TreeNode(node->material, "Material"))
@@ -554,11 +664,21 @@ void SceneEditor::inspectObject(SCN::Material* material)
 {
 #ifndef SKIP_IMGUI
 	ImGui::Text("Name: %s", material->name.c_str()); // Show String
+	editBegin(material->two_sided);
 	ImGui::Checkbox("Two sided", &material->two_sided);
+	editEnd();
+	editBegin(material->alpha_mode);
 	ImGui::Combo("AlphaMode", (int*)&material->alpha_mode, "NO_ALPHA\0MASK\0BLEND", 3);
+	editEnd();
+	editBegin(material->alpha_cutoff);
 	ImGui::SliderFloat("Alpha Cutoff", &material->alpha_cutoff, 0.0f, 1.0f);
+	editEnd();
+	editBegin(material->color);
 	ImGui::ColorEdit4("Color", material->color.v); // Edit 4 floats representing a color + alpha
+	editEnd();
+	editBegin(material->emissive_factor);
 	ImGui::ColorEdit3("Emissive", material->emissive_factor.v);
+	editEnd();
 	for (size_t i = 0; i < SCN::eTextureChannel::ALL; ++i)
 	{
 		if (material->textures[i].texture && ImGui::TreeNode( &material->textures[i], SCN::texture_channel_str[i] ))
@@ -572,52 +692,182 @@ void SceneEditor::inspectObject(SCN::Material* material)
 #endif
 }
 
-std::vector<std::string> undo_history;
-void SceneEditor::saveUndo()
+PropertyCommand::PropertyCommand(void* address, const void* before, size_t size)
 {
-	if (!scene)
+	this->address = address;
+	this->before.resize(size);
+	this->after.resize(size);
+	memcpy(this->before.data(), before, size);
+	memcpy(this->after.data(), address, size);
+}
+
+EntityCommand::EntityCommand(SCN::Scene* scene, SCN::BaseEntity* entity, bool is_add)
+{
+	this->scene = scene;
+	this->entity = entity;
+	this->is_add = is_add;
+	attached = entity->scene != nullptr;
+	index = (int)scene->entities.size();
+	auto it = std::find(scene->entities.begin(), scene->entities.end(), entity);
+	if (it != scene->entities.end())
+		index = (int)(it - scene->entities.begin());
+}
+
+EntityCommand::~EntityCommand()
+{
+	//once the command is gone nobody can bring it back
+	if (!attached)
+		delete entity;
+}
+
+void EntityCommand::attach()
+{
+	if (attached)
 		return;
-	//return;
-	std::cout << "saving undo" << std::endl;
-	std::string data;
-	scene->toString(data);
-	if (undo_history.size() > 100)
+	if (index < 0 || index > (int)scene->entities.size())
+		index = (int)scene->entities.size();
+	scene->entities.insert(scene->entities.begin() + index, entity);
+	entity->scene = scene;
+	attached = true;
+}
+
+void EntityCommand::detach()
+{
+	if (!attached)
+		return;
+	auto it = std::find(scene->entities.begin(), scene->entities.end(), entity);
+	index = (int)(it - scene->entities.begin());
+	scene->removeEntity(entity);
+	entity->scene = nullptr;
+	attached = false;
+	if (SCN::BaseEntity::s_selected == entity)
+		SCN::BaseEntity::s_selected = nullptr;
+	SCN::Node::s_selected = nullptr; //could be one of its nodes
+}
+
+PrefabCommand::PrefabCommand(SCN::PrefabEntity* entity, const std::string& filename_before)
+{
+	this->entity = entity;
+	filename = filename_before;
+	prefab = entity->prefab;
+	if (prefab)
+		prefab->retain(); //the entity releases it when it loads the new one
+	root = new SCN::Node();
+	root->swapChildren(entity->root);
+	SCN::Node::s_selected = nullptr; //could be one of the nodes taken
+}
+
+PrefabCommand::~PrefabCommand()
+{
+	delete root;
+	if (prefab)
+		prefab->release();
+}
+
+void PrefabCommand::swap()
+{
+	std::swap(entity->filename, filename);
+	std::swap(entity->prefab, prefab);
+	entity->root.swapChildren(*root);
+	SCN::Node::s_selected = nullptr;
+}
+
+void SceneEditor::addCommand(EditorCommand* command)
+{
+	undo_history.push_back(command);
+	//the redo steps are not reachable anymore
+	for (auto it : redo_history)
+		delete it;
+	redo_history.clear();
+	while (undo_history.size() > UNDO_MAX_STEPS)
+	{
+		delete undo_history.front();
 		undo_history.pop_front();
-	undo_history.push_back(data);
+	}
 }
 
 void SceneEditor::doUndo()
 {
-	if (!scene)
-		return;
+	commitEdit();
 	if (undo_history.size() == 0)
 		return;
-	std::cout << "doing undo" << std::endl;
-	std::string selected_name = "";
-	if (SCN::BaseEntity::s_selected)
-		selected_name = SCN::BaseEntity::s_selected->name;
-	std::string step = undo_history.back();
+	EditorCommand* command = undo_history.back();
 	undo_history.pop_back();
-
-	scene->fromString(step, scene->base_folder.c_str());
-	SCN::BaseEntity::s_selected = scene->getEntity(selected_name);
+	command->undo();
+	redo_history.push_back(command);
 	UI::addNotification("Undo done");
 }
 
+void SceneEditor::doRedo()
+{
+	commitEdit();
+	if (redo_history.size() == 0)
+		return;
+	EditorCommand* command = redo_history.back();
+	redo_history.pop_back();
+	command->redo();
+	undo_history.push_back(command);
+	UI::addNotification("Redo done");
+}
+
+//call it before the entities of the scene are destroyed
 void SceneEditor::clearUndo()
 {
+	edit_address = nullptr;
+	for (auto it : undo_history)
+		delete it;
+	for (auto it : redo_history)
+		delete it;
 	undo_history.clear();
+	redo_history.clear();
 }
 
+void SceneEditor::editBegin(void* address, size_t size)
+{
+	edit_current = address;
+	edit_snapshot.resize(size);
+	//while it is being edited we keep the value it had when the edit started
+	if (edit_address != address)
+		memcpy(edit_snapshot.data(), address, size);
+}
+
+void SceneEditor::editEnd()
+{
+#ifndef SKIP_IMGUI
+	void* address = edit_current;
+	edit_current = nullptr;
+	if (!address)
+		return;
+	if (edit_address != address)
+	{
+		if (memcmp(address, edit_snapshot.data(), edit_snapshot.size()) == 0)
+			return; //nothing changed
+		commitEdit();
+		edit_address = address;
+		edit_before = edit_snapshot;
+	}
+	//released, otherwise a drag would store one step per frame
+	if (!ImGui::IsAnyItemActive())
+		commitEdit();
+#endif
+}
+
+void SceneEditor::commitEdit()
+{
+	if (!edit_address)
+		return;
+	if (memcmp(edit_address, edit_before.data(), edit_before.size()) != 0)
+		addCommand(new PropertyCommand(edit_address, edit_before.data(), edit_before.size()));
+	edit_address = nullptr;
+}
 
 void SceneEditor::deleteSelection()
 {
 	if (!SCN::BaseEntity::s_selected)
 		return;
-	saveUndo();
-	scene->removeEntity(SCN::BaseEntity::s_selected);
-	delete SCN::BaseEntity::s_selected;
-	SCN::BaseEntity::s_selected = nullptr;
+	EntityCommand* command = new EntityCommand(scene, SCN::BaseEntity::s_selected, false);
+	command->redo();
+	addCommand(command);
 }
 
 //Keyboard event handler (sync input)
@@ -636,8 +886,8 @@ bool SceneEditor::onKeyDown(SDL_KeyboardEvent event)
 	case SDLK_L:
 		if (event.mod & SDL_KMOD_CTRL)
 		{
-			scene->load(scene->filename.c_str());
 			clearUndo();
+			scene->load(scene->filename.c_str());
 		}
 		break;
 	case SDLK_S:
@@ -647,8 +897,11 @@ bool SceneEditor::onKeyDown(SDL_KeyboardEvent event)
 	case SDLK_D:
 		if (event.mod & SDL_KMOD_CTRL && SCN::BaseEntity::s_selected)
 		{
-			SCN::BaseEntity::s_selected = SCN::BaseEntity::s_selected->clone();
-			scene->addEntity(SCN::BaseEntity::s_selected);
+			SCN::BaseEntity* ent = SCN::BaseEntity::s_selected->clone();
+			EntityCommand* command = new EntityCommand(scene, ent, true);
+			command->redo();
+			addCommand(command);
+			SCN::BaseEntity::s_selected = ent;
 		}
 		break;
 	case SDLK_C:
@@ -664,23 +917,33 @@ bool SceneEditor::onKeyDown(SDL_KeyboardEvent event)
 		{
 			if (clipboard)
 			{
-				saveUndo();
-				scene->addEntity(clipboard);
+				EntityCommand* command = new EntityCommand(scene, clipboard, true);
+				command->redo();
+				addCommand(command);
 				SCN::BaseEntity::s_selected = clipboard;
 				clipboard = nullptr;
 			}
 		}
 		break;
 	case SDLK_Z:
-		if (event.mod & SDL_KMOD_CTRL)
+		if ((event.mod & SDL_KMOD_CTRL) && (event.mod & SDL_KMOD_SHIFT))
+			doRedo();
+		else if (event.mod & SDL_KMOD_CTRL)
 			doUndo();
 		break;
+	case SDLK_Y:
+		if (event.mod & SDL_KMOD_CTRL)
+			doRedo();
+		break;
 	case SDLK_1: UI::manipulate_operation = ImGuizmo::TRANSLATE; break;
 	case SDLK_2: UI::manipulate_operation = ImGuizmo::ROTATE; break;
 	case SDLK_3: UI::manipulate_operation = ImGuizmo::SCALE; break;
 	case SDLK_DELETE: deleteSelection(); break; //ESC key, kill the app
 	case SDLK_F4: show_textures = !show_textures;break;
+	case SDLK_F3: show_profiler = !show_profiler; break;
+	case SDLK_F2: show_memory = !show_memory; break;
 	case SDLK_F6: //refresh
+		clearUndo();
 		scene->clear();
 		scene->load(scene->filename.c_str());
 		camera->lookAt(scene->main_camera.eye, scene->main_camera.center, Vector3f(0, 1, 0));
@@ -755,7 +1018,10 @@ void SceneEditor::onFileDrop(std::string filename, std::string relative, SDL_Eve
 	if (relative.find(".glb") != std::string::npos || relative.find(".gltf") != std::string::npos)
 		addPrefab(relative.substr(5).c_str());
 	else if (relative.find(".json") != std::string::npos)
+	{
+		clearUndo();
 		scene->load(relative.c_str());
+	}
 	else
 		std::cout << "Unknown file" << std::endl;
 }
@@ -765,7 +1031,9 @@ void SceneEditor::addPrefab(const char* filename)
 {
 	std::cout << "Adding prefab: " << filename << std::endl;
 	SCN::PrefabEntity* ent = new SCN::PrefabEntity();
-	scene->addEntity(ent);
+	EntityCommand* command = new EntityCommand(scene, ent, true);
+	command->redo();
+	addCommand(command);
 	ent->name = filename;
 	ent->loadPrefab(filename);
 	SCN::BaseEntity::s_selected = ent;
@@ -8,10 +8,82 @@ namespace SCN {
 	class Scene;
 	class Renderer;
 
+	class BaseEntity;
 	class PrefabEntity;
+	class Prefab;
+	class Node;
 	class LightEntity;
 };
 
+//one change done in the editor, it only stores what changed so it can be undone and redone
+class EditorCommand
+{
+public:
+	virtual ~EditorCommand() {}
+	virtual void undo() = 0;
+	virtual void redo() = 0;
+};
+
+//any value that can be copied with memcpy (matrices, colors, flags, ...)
+class PropertyCommand : public EditorCommand
+{
+public:
+	void* address;
+	std::vector<uint8> before;
+	std::vector<uint8> after;
+
+	PropertyCommand(void* address, const void* before, size_t size);
+	void undo() { memcpy(address, before.data(), before.size()); }
+	void redo() { memcpy(address, after.data(), after.size()); }
+};
+
+class StringCommand : public EditorCommand
+{
+public:
+	std::string* target;
+	std::string before;
+	std::string after;
+
+	StringCommand(std::string* target, const std::string& before) { this->target = target; this->before = before; after = *target; }
+	void undo() { *target = before; }
+	void redo() { *target = after; }
+};
+
+//adds or removes an entity, while it is out of the scene the command owns it
+class EntityCommand : public EditorCommand
+{
+public:
+	SCN::Scene* scene;
+	SCN::BaseEntity* entity;
+	int index;
+	bool is_add;
+	bool attached;
+
+	EntityCommand(SCN::Scene* scene, SCN::BaseEntity* entity, bool is_add);
+	~EntityCommand();
+	void undo() { if (is_add) detach(); else attach(); }
+	void redo() { if (is_add) attach(); else detach(); }
+	void attach();
+	void detach();
+};
+
+//changes the prefab of an entity, the tree that is not in the entity is kept here so the commands
+//that point to its nodes stay valid, undo and redo exchange them
+class PrefabCommand : public EditorCommand
+{
+public:
+	SCN::PrefabEntity* entity;
+	std::string filename;
+	SCN::Prefab* prefab; //retained
+	SCN::Node* root; //only its children are used
+
+	PrefabCommand(SCN::PrefabEntity* entity, const std::string& filename_before); //takes the current tree
+	~PrefabCommand();
+	void undo() { swap(); }
+	void redo() { swap(); }
+	void swap();
+};
+
 class SceneEditor
 {
 public:
@@ -22,12 +94,17 @@ public:
 	SCN::BaseEntity* clipboard = nullptr;
 	int sidebar_width;
 	bool show_textures;
+	bool show_profiler;
+	bool show_memory;
+	bool show_gpu_timings;
 
 	SceneEditor(SCN::Scene* scene, SCN::Renderer* renderer);
 
 	void render( Camera* camera );
 	void renderDebug(Camera* camera);
 	void renderTexturesPanel();
+	void renderProfilerPanel();
+	void renderMemoryPanel();
 
 	void inspectEntity(SCN::BaseEntity* entity);
 	void inspectEntity(SCN::PrefabEntity* entity);
@@ -46,11 +123,23 @@ public:
 	void deleteSelection();
 
 	//undo
-	std::deque<std::string> undo_history;
-	void saveUndo();
+	std::deque<EditorCommand*> undo_history;
+	std::deque<EditorCommand*> redo_history;
+	void addCommand(EditorCommand* command); //takes ownership
 	void doUndo();
+	void doRedo();
 	void clearUndo();
 
+	//call them around the widgets that edit a value, the change is stored when the user releases the widget
+	void* edit_address = nullptr; //value being edited
+	void* edit_current = nullptr; //between editBegin and editEnd
+	std::vector<uint8> edit_before;
+	std::vector<uint8> edit_snapshot;
+	void editBegin(void* address, size_t size);
+	template<typename T> void editBegin(T& value) { editBegin(&value, sizeof(T)); }
+	void editEnd();
+	void commitEdit();
+
 
 	void onMouseButtonDown(SDL_MouseButtonEvent event);
 	void onMouseButtonUp(SDL_MouseButtonEvent event);
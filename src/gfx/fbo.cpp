@@ -55,7 +55,7 @@ namespace GFX
 		owns_textures = false;
 	}
 
-	bool FBO::create(int width, int height, int num_textures, int format, int type, bool use_depth_texture)
+	bool FBO::create(int width, int height, int num_textures, int format, int type, bool use_depth_texture, bool use_stencil)
 	{
 		assert(glGetError() == GL_NO_ERROR);
 		assert(width && height);
@@ -78,7 +78,9 @@ namespace GFX
 		//is using a depth_texture slower than using a renderbuffer?
 		//https://stackoverflow.com/questions/45320836/why-is-depth-buffers-faster-than-depth-textures
 		Texture* depth_texture = NULL;
-		if (use_depth_texture)
+		if (use_depth_texture && use_stencil)
+			depth_texture = new Texture(width, height, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, false, NULL, GL_DEPTH24_STENCIL8);
+		else if (use_depth_texture)
 			depth_texture = new Texture(width, height, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, false);
 		owns_textures = true;
 		return setTextures(textures, depth_texture);
@@ -87,7 +89,7 @@ namespace GFX
 	bool FBO::setTexture(Texture* texture, int cubemap_face)
 	{
 		std::vector<Texture*> textures;
-		if (texture->format == GL_DEPTH_COMPONENT)
+		if (texture->format == GL_DEPTH_COMPONENT || texture->format == GL_DEPTH_STENCIL)
 			setTextures(textures, texture, cubemap_face);
 		else
 		{
@@ -125,7 +127,8 @@ namespace GFX
 
 		if (depth_texture)
 		{
-			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture->texture_id, 0);
+			GLenum attachment = depth_texture->format == GL_DEPTH_STENCIL ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, attachment, GL_TEXTURE_2D, depth_texture->texture_id, 0);
 			this->depth_texture = depth_texture;
 		}
 		else
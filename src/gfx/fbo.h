@@ -26,7 +26,7 @@ namespace GFX {
 		FBO();
 		~FBO();
 
-		bool create(int width, int height, int num_textures = 1, int format = GL_RGB, int type = GL_UNSIGNED_BYTE, bool use_depth_texture = true);
+		bool create(int width, int height, int num_textures = 1, int format = GL_RGB, int type = GL_UNSIGNED_BYTE, bool use_depth_texture = true, bool use_stencil = false); //use_stencil makes the depth texture DEPTH24_STENCIL8
 		bool setTexture(Texture* texture, int cubemap_face = -1);
 		bool setTextures(std::vector<Texture*> textures, Texture* depth = NULL, int cubemap_face = -1);
 		bool setDepthOnly(int width, int height); //use this for shadowmaps
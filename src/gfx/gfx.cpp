@@ -1,4 +1,5 @@
 #include "gfx.h"
+#include "../core/profiler.h"
 
 #include "../pipeline/camera.h"
 #include "../gfx/shader.h"
@@ -11,13 +12,18 @@ namespace GFX {
 	long gpu_frame_microseconds = 0;
 	long gpu_frame_microseconds_history[GPU_FRAME_HISTORY_SIZE];
 
+	//labels also open a CPU profiler scope, text must be a static string
 	void startGPULabel(const char* text)
 	{
+		CORE::Profiler::begin(text);
+		GPUTimers::begin(text);
 		//glPushDebugGroup(GL_DEBUG_SOURCE_THIRD_PARTY, 1, -1, text);
 	}
 
 	void endGPULabel()
 	{
+		GPUTimers::end();
+		CORE::Profiler::end();
 		//glPopDebugGroup();
 	}
 
@@ -25,7 +31,7 @@ namespace GFX {
 #define GL_GPU_MEM_INFO_TOTAL_AVAILABLE_MEM_NVX 0x9048
 #define GL_GPU_MEM_INFO_CURRENT_AVAILABLE_MEM_NVX 0x9049
 
-	std::string getGPUStats()
+	const char* getGPUStats()
 	{
 		GLint nTotalMemoryInKB = 0;
 		glGetIntegerv(GL_GPU_MEM_INFO_TOTAL_AVAILABLE_MEM_NVX, &nTotalMemoryInKB);
@@ -37,7 +43,9 @@ namespace GFX {
 			nCurAvailMemoryInKB = 0;
 		}
 
-		std::string str = "FPS: " + std::to_string(CORE::BaseApplication::instance->fps) + " Time: " + std::to_string(gpu_frame_microseconds) + "us DCS: " + std::to_string(Mesh::num_meshes_rendered) + " Tris: " + std::to_string(long(Mesh::num_triangles_rendered * 0.001)) + "Ks  VRAM: " + std::to_string(int((nTotalMemoryInKB - nCurAvailMemoryInKB) * 0.001)) + "MBs / " + std::to_string(int(nTotalMemoryInKB * 0.001)) + "MBs";
+		static char str[256];
+		snprintf(str, sizeof(str), "FPS: %d Time: %dus DCS: %d Tris: %ldKs  VRAM: %dMBs / %dMBs", (int)CORE::BaseApplication::instance->fps, (int)gpu_frame_microseconds,
+			(int)Mesh::num_meshes_rendered, long(Mesh::num_triangles_rendered * 0.001), int((nTotalMemoryInKB - nCurAvailMemoryInKB) * 0.001), int(nTotalMemoryInKB * 0.001));
 		Mesh::num_meshes_rendered = 0;
 		Mesh::num_triangles_rendered = 0;
 		return str;
@@ -208,6 +216,200 @@ namespace GFX {
 
 	//GPU QUERYs 
 
+	//queries of one frame in flight
+	struct sGPUTimerFrame {
+		GLuint queries[GPU_TIMER_MAX_PASSES * 2];
+		int pass_index[GPU_TIMER_MAX_PASSES];
+		int num; //pairs used
+		long frame;
+		GLuint last_query; //queries finish in order, when this one is ready all are
+		bool pending;
+	};
+
+	bool GPUTimers::enabled = true;
+	std::vector<GPUPassTiming> GPUTimers::passes;
+	int GPUTimers::history_pos = 0;
+	long GPUTimers::frames_lost = 0;
+	long GPUTimers::frame = 0;
+	long GPUTimers::last_read_frame = -1;
+
+	static sGPUTimerFrame gpu_timer_frames[GPU_TIMER_FRAMES];
+	static int gpu_timer_current = -1;
+	static int gpu_timer_stack[GPU_TIMER_MAX_PASSES];
+	static int gpu_timer_depth = 0;
+
+	void GPUTimers::beginFrame()
+	{
+		gpu_timer_current = (gpu_timer_current + 1) % GPU_TIMER_FRAMES;
+		sGPUTimerFrame& frame = gpu_timer_frames[gpu_timer_current];
+		gpu_timer_depth = 0;
+		last_read_frame = -1;
+
+		if (!frame.queries[0])
+			glGenQueries(GPU_TIMER_MAX_PASSES * 2, frame.queries);
+
+		//results of the frame that used these queries GPU_TIMER_FRAMES ago
+		if (frame.pending && frame.num)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(frame.last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				long totals[GPU_TIMER_MAX_PASSES] = {};
+				GLuint64 first = 0, last = 0;
+				for (int i = 0; i < frame.num; ++i)
+				{
+					GLuint64 start = 0, end = 0;
+					glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &start);
+					glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+					totals[frame.pass_index[i]] += long((end - start) / 1000);
+					if (!first || start < first)
+						first = start;
+					if (end > last)
+						last = end;
+				}
+				for (int i = 0; i < (int)passes.size(); ++i)
+				{
+					passes[i].microseconds = totals[i];
+					passes[i].history[history_pos] = totals[i];
+				}
+				gpu_frame_microseconds = long((last - first) / 1000);
+				gpu_frame_microseconds_history[history_pos] = gpu_frame_microseconds;
+				history_pos = (history_pos + 1) % GPU_FRAME_HISTORY_SIZE;
+				last_read_frame = frame.frame;
+			}
+			else
+				frames_lost++;
+		}
+		frame.num = 0;
+		frame.pending = false;
+		frame.frame = GPUTimers::frame++;
+	}
+
+	void GPUTimers::endFrame()
+	{
+		if (gpu_timer_current == -1)
+			return;
+		gpu_timer_frames[gpu_timer_current].pending = true;
+	}
+
+	void GPUTimers::begin(const char* name)
+	{
+		if (gpu_timer_current == -1)
+			return;
+		sGPUTimerFrame& frame = gpu_timer_frames[gpu_timer_current];
+		int depth = gpu_timer_depth++;
+		if (!enabled || depth >= GPU_TIMER_MAX_PASSES || frame.num >= GPU_TIMER_MAX_PASSES)
+		{
+			if (depth < GPU_TIMER_MAX_PASSES)
+				gpu_timer_stack[depth] = -1;
+			return;
+		}
+
+		int index = -1;
+		for (int i = 0; i < (int)passes.size(); ++i)
+			if (passes[i].name == name)
+			{
+				index = i;
+				break;
+			}
+		if (index == -1)
+		{
+			if (passes.size() >= GPU_TIMER_MAX_PASSES)
+			{
+				gpu_timer_stack[depth] = -1;
+				return;
+			}
+			GPUPassTiming pass;
+			pass.name = name;
+			pass.depth = depth;
+			pass.microseconds = 0;
+			memset(pass.history, 0, sizeof(pass.history));
+			passes.push_back(pass);
+			index = (int)passes.size() - 1;
+		}
+
+		int slot = frame.num++;
+		frame.pass_index[slot] = index;
+		gpu_timer_stack[depth] = slot;
+		frame.last_query = frame.queries[slot * 2];
+		glQueryCounter(frame.last_query, GL_TIMESTAMP);
+	}
+
+	void GPUTimers::end()
+	{
+		if (gpu_timer_current == -1 || !gpu_timer_depth)
+			return;
+		int depth = --gpu_timer_depth;
+		if (depth >= GPU_TIMER_MAX_PASSES || gpu_timer_stack[depth] == -1)
+			return;
+		sGPUTimerFrame& frame = gpu_timer_frames[gpu_timer_current];
+		frame.last_query = frame.queries[gpu_timer_stack[depth] * 2 + 1];
+		glQueryCounter(frame.last_query, GL_TIMESTAMP);
+	}
+
+#ifndef SKIP_IMGUI
+	static ImColor getPassColor(int index)
+	{
+		return ImColor::HSV(fmodf(index * 0.15f, 1.0f), 0.6f, 0.8f);
+	}
+#endif
+
+	void GPUTimers::renderGraph()
+	{
+#ifndef SKIP_IMGUI
+		if (passes.empty())
+			return;
+
+		//only the passes of one nesting level are stacked, deeper ones are already inside them
+		static int stack_depth = 0;
+		int max_depth = 0;
+		for (auto& pass : passes)
+			max_depth = std::max(max_depth, pass.depth);
+		if (max_depth)
+			ImGui::SliderInt("Level", &stack_depth, 0, max_depth);
+
+		ImVec2 size(ImGui::GetContentRegionAvail().x, 80.0f);
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImGui::Dummy(size);
+		ImDrawList* draw_list = ImGui::GetWindowDrawList();
+		draw_list->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(0, 0, 0, 128));
+
+		//vertical scale from the slowest frame in the history
+		long max_value = 1;
+		for (int i = 0; i < GPU_FRAME_HISTORY_SIZE; ++i)
+			max_value = std::max(max_value, gpu_frame_microseconds_history[i]);
+		float scale_y = size.y / max_value;
+		float step_x = size.x / (GPU_FRAME_HISTORY_SIZE - 1);
+
+		for (int j = 0; j < GPU_FRAME_HISTORY_SIZE; ++j)
+		{
+			int sample = (history_pos + j) % GPU_FRAME_HISTORY_SIZE;
+			float x = origin.x + j * step_x;
+			float y = origin.y + size.y;
+			for (int i = 0; i < (int)passes.size(); ++i)
+			{
+				GPUPassTiming& pass = passes[i];
+				if (pass.depth != stack_depth)
+					continue;
+				float h = pass.history[sample] * scale_y;
+				draw_list->AddRectFilled(ImVec2(x, y - h), ImVec2(x + step_x, y), getPassColor(i));
+				y -= h;
+			}
+		}
+
+		//legend
+		for (int i = 0; i < (int)passes.size(); ++i)
+		{
+			GPUPassTiming& pass = passes[i];
+			ImGui::TextColored(pass.depth == stack_depth ? (ImVec4)getPassColor(i) : ImVec4(0.6f, 0.6f, 0.6f, 1.0f),
+				"%*s%s: %ld us", pass.depth * 2, "", pass.name.c_str(), pass.microseconds);
+		}
+		if (frames_lost)
+			ImGui::TextDisabled("Frames skipped: %ld", frames_lost);
+#endif
+	}
+
 	GPUQuery::GPUQuery(GLuint t) { type = t; handler = 0; value = 0; waiting = false; }
 	GPUQuery::~GPUQuery() { if (handler) glDeleteQueries(1, &handler); }
 
@@ -216,7 +418,7 @@ namespace GFX {
 		GFX::checkGLErrors();
 		if (!handler)
 			glGenQueries(1, &handler);
-		glBeginQuery(GL_TIME_ELAPSED, handler);
+		glBeginQuery(type, handler);
 		waiting = true;
 		GFX::checkGLErrors();
 	}
@@ -225,7 +427,7 @@ namespace GFX {
 	{
 		if (!handler)
 			return;
-		glEndQuery(GL_TIME_ELAPSED);
+		glEndQuery(type);
 	}
 
 	bool GPUQuery::isReady()
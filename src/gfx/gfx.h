@@ -20,7 +20,7 @@ namespace GFX {
 	void startGPULabel(const char* text);
 	void endGPULabel();
 
-	std::string getGPUStats();
+	const char* getGPUStats(); //valid until the next call, it is written in a static buffer to not allocate every frame
 	void drawGrid();
 	bool drawText(float x, float y, std::string text, Vector4f c, float scale);
 	bool drawText3D(Vector3f pos, std::string text, Vector4f c, float scale);
@@ -44,6 +44,45 @@ namespace GFX {
 		bool isReady();
 	};
 
+	//what glDrawElementsIndirect reads from the GL_DRAW_INDIRECT_BUFFER
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instance_count;
+		GLuint first_index;
+		GLint base_vertex;
+		GLuint base_instance;
+	};
+
+	#define GPU_TIMER_FRAMES 3 //frames in flight before reading back, so results are always ready
+	#define GPU_TIMER_MAX_PASSES 32
+
+	//time spent by the GPU in one pass (any startGPULabel/endGPULabel pair)
+	struct GPUPassTiming {
+		std::string name;
+		int depth;	//nesting level the first time it was seen
+		long microseconds;	//last value read
+		long history[GPU_FRAME_HISTORY_SIZE];
+	};
+
+	//pool of timestamp queries reused every GPU_TIMER_FRAMES frames, it never waits for the GPU
+	class GPUTimers
+	{
+	public:
+		static bool enabled;
+		static std::vector<GPUPassTiming> passes;
+		static int history_pos;
+		static long frames_lost; //frames not ready after GPU_TIMER_FRAMES, skipped instead of stalling
+		static long frame;	//frames started
+		static long last_read_frame; //frame whose results were read in the last beginFrame, -1 if none
+
+		static void beginFrame(); //reads the results of an old frame and starts a new one
+		static void endFrame();
+		static void begin(const char* name);
+		static void end();
+
+		static void renderGraph(); //ImGui stacked graph of the passes
+	};
+
 };
 
 
@@ -1,6 +1,8 @@
 #include "mesh.h"
 #include "../extra/textparser.h"
 #include "../utils/utils.h"
+#include "../core/profiler.h"
+#include "../core/memory.h"
 #include "shader.h"
 #include "../core/includes.h"
 #define _USE_MATH_DEFINES
@@ -16,12 +18,22 @@
 #include "texture.h"
 //#include "animation.h"
 #include "../extra/coldet/coldet.h"
+#include "simplify.h"
 
 bool GFX::Mesh::use_binary = true;            //checks if there is .wbin, it there is one tries to read it instead of the other file
 bool GFX::Mesh::auto_upload_to_vram = true;    //uploads the mesh to the GPU VRAM to speed up rendering
 bool GFX::Mesh::interleave_meshes = true;    //places the geometry in an interleaved array
+bool GFX::Mesh::generate_lods = true;        //simplifies the loaded meshes, the levels are stored in the .mbin
+bool GFX::Mesh::generate_meshlets = true;    //splits the big indexed meshes in meshlets
+GFX::Mesh::eResidency GFX::Mesh::default_residency = GFX::Mesh::DROP_CPU_DATA;
+
+CORE::Registry<GFX::Mesh> GFX::Mesh::sMeshesLoaded;
+
+static bool mesh_memory_reporter = CORE::MemoryTracker::addReporter("meshes", [](std::vector<CORE::MemoryEntry>& entries) {
+    for (auto& it : GFX::Mesh::sMeshesLoaded.getNamedItems())
+        entries.push_back(CORE::MemoryEntry{ "meshes", it.first, it.second->getCPUMemory(), it.second->vram_bytes });
+});
 
-std::map<std::string, GFX::Mesh*> GFX::Mesh::sMeshesLoaded;
 long GFX::Mesh::num_meshes_rendered = 0;
 long GFX::Mesh::num_triangles_rendered = 0;
 
@@ -37,14 +49,17 @@ const vec3 corners[] = { {1,1,1},  {1,1,-1},  {1,-1,1},  {1,-1,-1},  {-1,1,1},
 GFX::Mesh::Mesh()
 {
     radius = 0;
-    vertices_vbo_id = uvs_vbo_id = uvs1_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = bones_vbo_id = weights_vbo_id = 0;
+    vertices_vbo_id = uvs_vbo_id = uvs1_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = bones_vbo_id = weights_vbo_id = lod_indices_vbo_id = meshlets_vbo_id = 0;
     collision_model = NULL;
+    residency = KEEP_CPU_DATA;
     clear();
 }
 
 GFX::Mesh::~Mesh()
 {
     clear();
+    if (name.size())
+        sMeshesLoaded.remove(name, this);
 }
 
 void GFX::Mesh::clear()
@@ -68,9 +83,15 @@ void GFX::Mesh::clear()
         glDeleteBuffers(1, &weights_vbo_id);
     if (uvs1_vbo_id)
         glDeleteBuffers(1, &uvs1_vbo_id);
+    if (lod_indices_vbo_id)
+        glDeleteBuffers(1, &lod_indices_vbo_id);
+    if (meshlets_vbo_id)
+        glDeleteBuffers(1, &meshlets_vbo_id);
 
     //VBOs ids
-    vertices_vbo_id = uvs_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = weights_vbo_id = bones_vbo_id = uvs1_vbo_id = 0;
+    vertices_vbo_id = uvs_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = weights_vbo_id = bones_vbo_id = uvs1_vbo_id = lod_indices_vbo_id = meshlets_vbo_id = 0;
+    vram_bytes = 0;
+    num_vertices = num_indices = 0;
 
     //buffers
     vertices.clear();
@@ -82,6 +103,9 @@ void GFX::Mesh::clear()
     bones.clear();
     weights.clear();
     uvs1.clear();
+    lods.clear();
+    lod_indices.clear();
+    meshlets.clear();
 }
 
 int vertex_location = -1;
@@ -104,7 +128,7 @@ void GFX::Mesh::enableBuffers(GFX::Shader* sh)
     int offset_normal = 0;
     int offset_uv = 0;
 
-    if (interleaved.size())
+    if (interleaved_vbo_id || interleaved.size())
     {
         spacing = sizeof(tInterleaved);
         offset_normal = sizeof(vec3);
@@ -127,7 +151,7 @@ void GFX::Mesh::enableBuffers(GFX::Shader* sh)
     checkGLErrors();
 
     normal_location = -1;
-    if (normals.size() || spacing)
+    if (normals_vbo_id || normals.size() || spacing)
     {
         normal_location = sh->getAttribLocation("a_normal");
         if (normal_location != -1)
@@ -145,7 +169,7 @@ void GFX::Mesh::enableBuffers(GFX::Shader* sh)
     checkGLErrors();
 
     uv_location = -1;
-    if (uvs.size() || spacing)
+    if (uvs_vbo_id || uvs.size() || spacing)
     {
         uv_location = sh->getAttribLocation("a_coord");
         if (uv_location != -1)
@@ -162,7 +186,7 @@ void GFX::Mesh::enableBuffers(GFX::Shader* sh)
     }
 
     uv1_location = -1;
-    if (uvs1.size())
+    if (uvs1_vbo_id || uvs1.size())
     {
         uv1_location = sh->getAttribLocation("a_uv1");
         if (uv1_location != -1)
@@ -179,7 +203,7 @@ void GFX::Mesh::enableBuffers(GFX::Shader* sh)
     }
 
     color_location = -1;
-    if (colors.size())
+    if (colors_vbo_id || colors.size())
     {
         color_location = sh->getAttribLocation("a_color");
         if (color_location != -1)
@@ -196,7 +220,7 @@ void GFX::Mesh::enableBuffers(GFX::Shader* sh)
     }
 
     bones_location = -1;
-    if (bones.size())
+    if (bones_vbo_id || bones.size())
     {
         bones_location = sh->getAttribLocation("a_bones");
         if (bones_location != -1)
@@ -212,7 +236,7 @@ void GFX::Mesh::enableBuffers(GFX::Shader* sh)
         }
     }
     weights_location = -1;
-    if (weights.size())
+    if (weights_vbo_id || weights.size())
     {
         weights_location = sh->getAttribLocation("a_weights");
         if (weights_location != -1)
@@ -229,7 +253,7 @@ void GFX::Mesh::enableBuffers(GFX::Shader* sh)
     }
 }
 
-void GFX::Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
+void GFX::Mesh::render(unsigned int primitive, int submesh_id, int num_instances, int lod)
 {
     Shader* shader = Shader::current;
     if (!shader || !shader->compiled)
@@ -237,14 +261,14 @@ void GFX::Mesh::render(unsigned int primitive, int submesh_id, int num_instances
         assert(0 && "no shader or shader not compiled or enabled");
         return;
     }
-    assert((interleaved.size() || vertices.size()) && "No vertices in this mesh");
+    assert(getNumVertices() && "No vertices in this mesh");
 
     //bind buffers to attribute locations
     enableBuffers(shader);
     checkGLErrors();
 
     //draw call
-    drawCall(primitive, submesh_id, num_instances);
+    drawCall(primitive, submesh_id, num_instances, lod);
     checkGLErrors();
 
     //unbind them
@@ -252,23 +276,78 @@ void GFX::Mesh::render(unsigned int primitive, int submesh_id, int num_instances
     checkGLErrors();
 }
 
-void GFX::Mesh::drawCall(unsigned int primitive, int draw_call_id, int num_instances)
+void GFX::Mesh::renderRanges(unsigned int primitive, const int* counts, const void* const* offsets, int num_ranges)
 {
-    size_t start = 0; //in primitives
-    size_t size = vertices.size();
-    if (indices.size())
-        size = indices.size();
-    else if (interleaved.size())
-        size = interleaved.size();
+    Shader* shader = Shader::current;
+    if (!shader || !shader->compiled || !indices_vbo_id || !num_ranges)
+        return;
+
+    enableBuffers(shader);
+    glBindVertexArray(interleaved_vao_id);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+    glMultiDrawElements(primitive, counts, GL_UNSIGNED_INT, offsets, num_ranges);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    disableBuffers(shader);
+    checkGLErrors();
+
+    long num_indices_drawn = 0;
+    for (int i = 0; i < num_ranges; ++i)
+        num_indices_drawn += counts[i];
+    num_triangles_rendered += num_indices_drawn / 3;
+    num_meshes_rendered++;
+}
+
+void GFX::Mesh::renderIndirect(unsigned int primitive, unsigned int indices_buffer, unsigned int indirect_buffer, size_t command_offset)
+{
+    Shader* shader = Shader::current;
+    if (!shader || !shader->compiled)
+        return;
+
+    enableBuffers(shader);
+    glBindVertexArray(interleaved_vao_id);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_buffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+    glDrawElementsIndirect(primitive, GL_UNSIGNED_INT, (void*)command_offset);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    disableBuffers(shader);
+    checkGLErrors();
+
+    num_meshes_rendered++; //the triangles are only known by the GPU
+}
+
+void GFX::Mesh::drawCall(unsigned int primitive, int draw_call_id, int num_instances, int lod)
+{
+    size_t start = 0; //in indices (or vertices if it is not indexed)
+    size_t size = getNumVertices();
+    if (getNumIndices())
+        size = getNumIndices();
 
     //DRAW
-    if (indices.size())
+    if (lod > 0 && lod <= (int)lods.size() && lod_indices_vbo_id)
+    {
+        //its range of the lod indices, over the same vertices
+        const sLOD& level = lods[lod - 1];
+        start = level.start;
+        size = level.count;
+        glBindVertexArray(interleaved_vao_id);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lod_indices_vbo_id);
+        if (num_instances > 0)
+            glDrawElementsInstanced(primitive, size, GL_UNSIGNED_INT, (void*)(start * sizeof(unsigned int)), num_instances);
+        else
+            glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(start * sizeof(unsigned int)));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+    else if (getNumIndices())
     {
         if (num_instances > 0)
         {
             assert(indices_vbo_id && "indices must be uploaded to the GPU");
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-            glDrawElementsInstanced(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(vec3)), num_instances);
+            glDrawElementsInstanced(primitive, size, GL_UNSIGNED_INT, (void*)(start * sizeof(unsigned int)), num_instances);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
         }
         else
@@ -279,12 +358,12 @@ void GFX::Mesh::drawCall(unsigned int primitive, int draw_call_id, int num_insta
             {
                 glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
                 checkGLErrors();
-                glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(vec3)));
+                glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(start * sizeof(unsigned int)));
                 checkGLErrors();
                 glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
             }
             else
-                glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(&indices[0] + start)); //no multiply, its a vector3u pointer)
+                glDrawElements(primitive, size, GL_UNSIGNED_INT, (void*)(&indices[0] + start));
 
             glBindVertexArray(0);
         }
@@ -572,13 +651,89 @@ void GFX::Mesh::uploadToVRAM()
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
     }
+
+    // LODs
+    if (lod_indices.size())
+    {
+        if (lod_indices_vbo_id == 0)
+            glGenBuffers(1, &lod_indices_vbo_id);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lod_indices_vbo_id);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, lod_indices.size() * sizeof(unsigned int), &lod_indices[0], GL_STATIC_DRAW);
+    }
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+    // Meshlets, as a storage buffer
+    if (meshlets.size())
+    {
+        if (meshlets_vbo_id == 0)
+            glGenBuffers(1, &meshlets_vbo_id);
+        glBindBuffer(GL_ARRAY_BUFFER, meshlets_vbo_id);
+        glBufferData(GL_ARRAY_BUFFER, meshlets.size() * sizeof(Meshlet), &meshlets[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
     //glBindVertexArray(0);
 
     checkGLErrors();
 
+    //what was uploaded, the buffers could be cleared afterwards
+    vram_bytes = (interleaved.size() ? interleaved.size() * sizeof(tInterleaved) : vertices.size() * sizeof(vec3) + uvs.size() * sizeof(vec2) + normals.size() * sizeof(vec3))
+        + uvs1.size() * sizeof(vec2) + colors.size() * sizeof(vec4) + bones.size() * sizeof(Vector4ub) + weights.size() * sizeof(vec4) + indices.size() * sizeof(unsigned int)
+        + lod_indices.size() * sizeof(unsigned int) + meshlets.size() * sizeof(Meshlet);
+    num_vertices = getNumVertices();
+    num_indices = (unsigned int)indices.size();
+
     //clear buffers to save memory
+    releaseCPUData();
+}
+
+//swapping with an empty vector is the only way to be sure the memory is freed (clear keeps the capacity)
+template<typename T> static void freeVector(std::vector<T>& v)
+{
+    std::vector<T>().swap(v);
+}
+
+void GFX::Mesh::releaseCPUData()
+{
+    if (residency == KEEP_CPU_DATA || !vram_bytes)
+        return;
+    //nothing to read it from later, keep what collisions need
+    if (residency == DROP_CPU_DATA && source_filename.empty())
+        residency = KEEP_COLLISION_DATA;
+
+    if (residency == KEEP_COLLISION_DATA)
+    {
+        if (interleaved.size())
+        {
+            vertices.resize(interleaved.size());
+            for (size_t i = 0; i < interleaved.size(); ++i)
+                vertices[i] = interleaved[i].vertex;
+        }
+        vertices.shrink_to_fit();
+        indices.shrink_to_fit();
+    }
+    else
+    {
+        freeVector(vertices);
+        freeVector(indices);
+    }
+    freeVector(interleaved);
+    freeVector(normals);
+    freeVector(uvs);
+    freeVector(uvs1);
+    freeVector(colors);
+    freeVector(bones);
+    freeVector(weights);
+    freeVector(lod_indices);
+}
+
+size_t GFX::Mesh::getCPUMemory() const
+{
+    return sizeof(Mesh) + vertices.capacity() * sizeof(vec3) + normals.capacity() * sizeof(vec3) + uvs.capacity() * sizeof(vec2)
+        + uvs1.capacity() * sizeof(vec2) + colors.capacity() * sizeof(vec4) + interleaved.capacity() * sizeof(tInterleaved)
+        + indices.capacity() * sizeof(unsigned int) + bones.capacity() * sizeof(Vector4ub) + weights.capacity() * sizeof(Vector4f)
+        + bones_info.capacity() * sizeof(BoneInfo) + submeshes.capacity() * sizeof(sSubmeshInfo)
+        + lods.capacity() * sizeof(sLOD) + lod_indices.capacity() * sizeof(unsigned int) + meshlets.capacity() * sizeof(Meshlet);
 }
 
 bool GFX::Mesh::interleaveBuffers()
@@ -604,6 +759,146 @@ bool GFX::Mesh::interleaveBuffers()
     return true;
 }
 
+bool GFX::Mesh::generateLODs(int num_lods)
+{
+    PROFILE_FUNCTION();
+
+    int num = (int)(interleaved.size() ? interleaved.size() : vertices.size());
+    if (!num || num_lods <= 0)
+        return false;
+
+    //the simplifier reads the attributes from their own arrays
+    std::vector<vec3> positions, attribute_normals;
+    std::vector<vec2> attribute_uvs;
+    if (interleaved.size())
+    {
+        positions.resize(num);
+        attribute_normals.resize(num);
+        attribute_uvs.resize(num);
+        for (int i = 0; i < num; ++i)
+        {
+            positions[i] = interleaved[i].vertex;
+            attribute_normals[i] = interleaved[i].normal;
+            attribute_uvs[i] = interleaved[i].uv;
+        }
+    }
+    const vec3* position_data = interleaved.size() ? positions.data() : vertices.data();
+    const vec3* normal_data = interleaved.size() ? attribute_normals.data() : (normals.size() == num ? normals.data() : NULL);
+    const vec2* uv_data = interleaved.size() ? attribute_uvs.data() : (uvs.size() == num ? uvs.data() : NULL);
+
+    std::vector<unsigned int> sequential;
+    if (indices.empty())
+    {
+        sequential.resize(num);
+        for (int i = 0; i < num; ++i)
+            sequential[i] = i;
+    }
+    const std::vector<unsigned int>& source = indices.size() ? indices : sequential;
+
+    //every submesh is simplified alone, so the borders between them stay closed
+    std::vector<std::pair<int, int>> ranges;
+    for (auto& submesh : submeshes)
+        if (submesh.start >= 0 && submesh.length > 0 && submesh.start + submesh.length <= (int)source.size())
+            ranges.push_back(std::make_pair(submesh.start, submesh.length));
+    if (ranges.empty())
+        ranges.push_back(std::make_pair(0, (int)source.size()));
+
+    std::vector< std::vector<unsigned int> > levels(num_lods);
+    std::vector<float> errors(num_lods, 0.0f);
+    for (auto& range : ranges)
+    {
+        const unsigned int* range_indices = &source[range.first];
+        int num_triangles = range.second / 3;
+        std::vector<int> targets;
+        for (int i = 1; i <= num_lods; ++i)
+            targets.push_back(num_triangles >> i);
+
+        std::vector<SimplifiedMesh> simplified;
+        if (num_triangles >= 64) //not worth it
+            simplified = simplifyMesh(position_data, normal_data, uv_data, num, range_indices, range.second, targets);
+
+        //the submeshes that cannot go so far keep their last level
+        for (int i = 0; i < num_lods; ++i)
+        {
+            if (simplified.size())
+            {
+                const SimplifiedMesh& level = simplified[std::min(i, (int)simplified.size() - 1)];
+                levels[i].insert(levels[i].end(), level.indices.begin(), level.indices.end());
+                errors[i] = std::max(errors[i], level.error);
+            }
+            else
+                levels[i].insert(levels[i].end(), range_indices, range_indices + num_triangles * 3);
+        }
+    }
+
+    //only the levels that save triangles
+    float size = box.halfsize.length();
+    size_t last_count = source.size();
+    lods.clear();
+    lod_indices.clear();
+    for (int i = 0; i < num_lods; ++i)
+    {
+        if (levels[i].size() > last_count * 0.9f)
+            continue;
+        sLOD lod;
+        lod.start = (unsigned int)lod_indices.size();
+        lod.count = (unsigned int)levels[i].size();
+        lod.error = size > 0.0f ? errors[i] / size : errors[i];
+        lods.push_back(lod);
+        lod_indices.insert(lod_indices.end(), levels[i].begin(), levels[i].end());
+        last_count = levels[i].size();
+    }
+    return lods.size() > 0;
+}
+
+int GFX::Mesh::selectLOD(float projected_radius, float max_error, int current_lod) const
+{
+    //to go to a coarser lod than the current one its error must be clearly below, so it doesnt flicker between two
+    const float hysteresis = 0.75f;
+    int lod = 0;
+    for (int i = 0; i < (int)lods.size(); ++i)
+    {
+        float limit = i + 1 > current_lod ? max_error * hysteresis : max_error;
+        if (lods[i].error * projected_radius > limit)
+            break;
+        lod = i + 1;
+    }
+    return lod;
+}
+
+bool GFX::Mesh::generateMeshlets()
+{
+    PROFILE_FUNCTION();
+
+    //the small ones are culled whole, the not indexed would give meshlets with very few triangles
+    int num = (int)(interleaved.size() ? interleaved.size() : vertices.size());
+    if (!num || indices.size() < MESHLET_MAX_TRIANGLES * 3 * 8)
+        return false;
+
+    std::vector<vec3> positions;
+    if (interleaved.size())
+    {
+        positions.resize(num);
+        for (int i = 0; i < num; ++i)
+            positions[i] = interleaved[i].vertex;
+    }
+    const vec3* position_data = interleaved.size() ? positions.data() : vertices.data();
+
+    //the triangles dont leave their submesh, if the submeshes are consecutive and cover every index (the culled draws only see the meshlets)
+    int next = 0;
+    for (auto& submesh : submeshes)
+        next = submesh.start == next && submesh.length > 0 && submesh.length % 3 == 0 ? next + submesh.length : -1;
+    bool by_submesh = submeshes.size() && next == (int)indices.size();
+
+    meshlets.clear();
+    if (by_submesh)
+        for (auto& submesh : submeshes)
+            buildMeshlets(position_data, num, &indices[submesh.start], submesh.length, meshlets, submesh.start);
+    else
+        buildMeshlets(position_data, num, &indices[0], (int)indices.size(), meshlets);
+    return meshlets.size() > 0;
+}
+
 struct sMeshInfo
 {
     int version = 0;
@@ -617,6 +912,9 @@ struct sMeshInfo
     float radius = 0.0;
     size_t num_bones = 0;
     size_t num_submeshes = 0;
+    size_t num_lods = 0;
+    size_t num_lod_indices = 0;
+    size_t num_meshlets = 0;
     mat4 bind_matrix;
     char streams[8]; //Vertex/Interlaved|Normal|Uvs|Color|Indices|Bones|Weights|Extra|Uvs1
     char extra[32]; //unused
@@ -643,6 +941,7 @@ bool GFX::Mesh::readBin(const char* filename)
     if (memcmp(data, "MBIN", 4) != 0)
     {
         std::cout << "[ERROR] loading BIN: invalid content: " << filename << std::endl;
+        delete[] data;
         return false;
     }
 
@@ -654,6 +953,7 @@ bool GFX::Mesh::readBin(const char* filename)
     if (info.version != MESH_BIN_VERSION || info.header_bytes != sizeof(sMeshInfo))
     {
         std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+        delete[] data;
         return false;
     }
 
@@ -695,7 +995,7 @@ bool GFX::Mesh::readBin(const char* filename)
     {
         indices.resize(info.nuindices);
         memcpy((void*)&indices[0], pos, sizeof(unsigned int) * info.nuindices);
-        pos += sizeof(Vector3u) * info.nuindices;
+        pos += sizeof(unsigned int) * info.nuindices;
     }
 
     if (info.streams[5] == 'B')
@@ -734,16 +1034,38 @@ bool GFX::Mesh::readBin(const char* filename)
     bind_matrix = info.bind_matrix;
 
     submeshes.resize(info.num_submeshes);
-    memcpy(&submeshes[0], pos, sizeof(sSubmeshInfo) * info.num_submeshes);
+    if (info.num_submeshes)
+        memcpy(&submeshes[0], pos, sizeof(sSubmeshInfo) * info.num_submeshes);
     pos += sizeof(sSubmeshInfo) * info.num_submeshes;
 
+    lods.resize(info.num_lods);
+    if (info.num_lods)
+        memcpy(&lods[0], pos, sizeof(sLOD) * info.num_lods);
+    pos += sizeof(sLOD) * info.num_lods;
+
+    lod_indices.resize(info.num_lod_indices);
+    if (info.num_lod_indices)
+        memcpy(&lod_indices[0], pos, sizeof(unsigned int) * info.num_lod_indices);
+    pos += sizeof(unsigned int) * info.num_lod_indices;
+
+    meshlets.resize(info.num_meshlets);
+    if (info.num_meshlets)
+        memcpy(&meshlets[0], pos, sizeof(Meshlet) * info.num_meshlets);
+    pos += sizeof(Meshlet) * info.num_meshlets;
+
+    delete[] data;
     createCollisionModel();
     return true;
 }
 
 bool GFX::Mesh::writeBin(const char* filename)
 {
-    assert(vertices.size() || interleaved.size());
+    //after releasing the CPU data it would write an incomplete mesh
+    if (!hasCPUData() || (vram_bytes && residency != KEEP_CPU_DATA))
+    {
+        std::cout << "[ERROR] cannot write mesh BIN, the geometry is only in VRAM: " << filename << std::endl;
+        return false;
+    }
     std::string s_filename = filename;
     s_filename += ".mbin";
 
@@ -771,6 +1093,9 @@ bool GFX::Mesh::writeBin(const char* filename)
     info.num_bones = bones_info.size();
     info.bind_matrix = bind_matrix;
     info.num_submeshes = submeshes.size();
+    info.num_lods = lods.size();
+    info.num_lod_indices = lod_indices.size();
+    info.num_meshlets = meshlets.size();
 
     info.streams[0] = interleaved.size() ? 'I' : 'V';
     info.streams[1] = normals.size() ? 'N' : ' ';
@@ -806,12 +1131,20 @@ bool GFX::Mesh::writeBin(const char* filename)
         fwrite((void*)&bones[0], bones.size() * sizeof(Vector4ub), 1, f);
     if (weights.size())
         fwrite((void*)&weights[0], weights.size() * sizeof(Vector4f), 1, f);
-    if (bones_info.size())
-        fwrite((void*)&bones_info[0], bones_info.size() * sizeof(BoneInfo), 1, f);
     if (uvs1.size())
         fwrite((void*)&uvs1[0], uvs1.size() * sizeof(Vector2f), 1, f);
+    if (bones_info.size())
+        fwrite((void*)&bones_info[0], bones_info.size() * sizeof(BoneInfo), 1, f);
+
+    if (submeshes.size())
+        fwrite((void*)&submeshes[0], submeshes.size() * sizeof(sSubmeshInfo), 1, f);
 
-    fwrite((void*)&submeshes[0], submeshes.size() * sizeof(sSubmeshInfo), 1, f);
+    if (lods.size())
+        fwrite((void*)&lods[0], lods.size() * sizeof(sLOD), 1, f);
+    if (lod_indices.size())
+        fwrite((void*)&lod_indices[0], lod_indices.size() * sizeof(unsigned int), 1, f);
+    if (meshlets.size())
+        fwrite((void*)&meshlets[0], meshlets.size() * sizeof(Meshlet), 1, f);
 
     fclose(f);
     return true;
@@ -1318,11 +1651,13 @@ GFX::Mesh* GFX::Mesh::getQuad()
 
 GFX::Mesh* GFX::Mesh::Get(const char* filename)
 {
+    PROFILE_FUNCTION();
     assert(filename);
-    std::map<std::string, GFX::Mesh*>::iterator it = sMeshesLoaded.find(filename);
-    if (it != sMeshesLoaded.end())
-        return it->second;
+    GFX::Mesh* cached = sMeshesLoaded.find(filename);
+    if (cached)
+        return cached;
 
+    MEMORY_SCOPE("meshes");
     GFX::Mesh* m = new GFX::Mesh();
     std::string name = filename;
 
@@ -1367,6 +1702,9 @@ GFX::Mesh* GFX::Mesh::Get(const char* filename)
         }
 
         std::cout << "[OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+        m->source_filename = binfilename;
+        m->residency = default_residency;
+        m->releaseCPUData();
         m->registerMesh(filename);
         return m;
     }
@@ -1394,6 +1732,12 @@ GFX::Mesh* GFX::Mesh::Get(const char* filename)
         m->interleaveBuffers();
     }
 
+    //simplified versions for the distance, before the upload so they go to the VRAM and the .mbin
+    if (generate_lods && m->generateLODs())
+        std::cout << "[LODS " << m->lods.size() << "] ";
+    if (generate_meshlets && m->generateMeshlets())
+        std::cout << "[MESHLETS " << m->meshlets.size() << "] ";
+
     //and upload them to VRAM
     if (auto_upload_to_vram)
     {
@@ -1405,10 +1749,13 @@ GFX::Mesh* GFX::Mesh::Get(const char* filename)
     if (use_binary)
     {
         std::cout << "\t\t Writing .BIN ... ";
-        m->writeBin(filename);
+        if (m->writeBin(filename))
+            m->source_filename = binfilename;
         std::cout << "[OK]" << std::endl;
     }
 
+    m->residency = default_residency;
+    m->releaseCPUData();
     m->registerMesh(name);
     return m;
 }
@@ -1416,7 +1763,7 @@ GFX::Mesh* GFX::Mesh::Get(const char* filename)
 void GFX::Mesh::registerMesh(std::string name)
 {
     this->name = name;
-    sMeshesLoaded[name] = this;
+    handle = sMeshesLoaded.add(name, this);
 }
 
 bool GFX::Mesh::createCollisionModel(bool is_static)
@@ -1424,6 +1771,22 @@ bool GFX::Mesh::createCollisionModel(bool is_static)
     if (collision_model)
         return true;
 
+    //the geometry was released after uploading it, read it again only to build the collision model
+    const Mesh* source = this;
+    Mesh reloaded;
+    if (!hasCPUData() && source_filename.size())
+    {
+        if (!reloaded.readBin(source_filename.c_str()))
+        {
+            std::cout << "[ERROR] cannot read the geometry for the collision model: " << source_filename << std::endl;
+            return false;
+        }
+        source = &reloaded;
+    }
+    const std::vector<vec3>& vertices = source->vertices;
+    const std::vector<tInterleaved>& interleaved = source->interleaved;
+    const std::vector<unsigned int>& indices = source->indices;
+
     double time = getTime();
     std::cout << "Creating collision model for: " << this->name << " (" << (interleaved.size() ? interleaved.size() : vertices.size()) / 3 << ") ...";
 
@@ -1486,6 +1849,34 @@ bool GFX::Mesh::createCollisionModel(bool is_static)
     return true;
 }
 
+bool GFX::Mesh::getTriangles(std::vector<vec3>& triangles) const
+{
+    const Mesh* source = this;
+    Mesh reloaded;
+    if (!hasCPUData() && source_filename.size())
+    {
+        if (!reloaded.readBin(source_filename.c_str()))
+            return false;
+        source = &reloaded;
+    }
+
+    if (source->indices.size())
+    {
+        triangles.resize(source->indices.size() / 3 * 3);
+        for (size_t i = 0; i < triangles.size(); ++i)
+            triangles[i] = source->interleaved.size() ? source->interleaved[source->indices[i]].vertex : source->vertices[source->indices[i]];
+    }
+    else if (source->interleaved.size())
+    {
+        triangles.resize(source->interleaved.size() / 3 * 3);
+        for (size_t i = 0; i < triangles.size(); ++i)
+            triangles[i] = source->interleaved[i].vertex;
+    }
+    else
+        triangles.assign(source->vertices.begin(), source->vertices.begin() + source->vertices.size() / 3 * 3);
+    return triangles.size() > 0;
+}
+
 //help: model is the transform of the mesh, ray origin and direction, a Vector3 where to store the collision if found, a Vector3 where to store the normal if there was a collision, max ray distance in case the ray should go to infintiy, and in_object_space to get the collision point in object space or world space
 bool GFX::Mesh::testRayCollision(Matrix44 model, Vector3f start, Vector3f front, Vector3f& collision, Vector3f& normal, float max_ray_dist, bool in_object_space)
 {
@@ -1614,13 +2005,50 @@ void GFX::Mesh::createSphere(float radius, float slices, float arcs)
     this->radius = radius;
 }
 
+void GFX::Mesh::createCone(float radius, float height, int slices)
+{
+    vec3 apex(0, 0, 0);
+    vec3 base_center(0, 0, -height);
+    for (int i = 0; i < slices; ++i)
+    {
+        float ang1 = (i / (float)slices) * M_PI * 2;
+        float ang2 = ((i + 1) / (float)slices) * M_PI * 2;
+        vec3 P1(cos(ang1) * radius, sin(ang1) * radius, -height);
+        vec3 P2(cos(ang2) * radius, sin(ang2) * radius, -height);
+        vec3 N1 = normalize(vec3(cos(ang1) * height, sin(ang1) * height, radius));
+        vec3 N2 = normalize(vec3(cos(ang2) * height, sin(ang2) * height, radius));
+
+        //side
+        vertices.push_back(apex);
+        vertices.push_back(P1);
+        vertices.push_back(P2);
+        normals.push_back(normalize(N1 + N2));
+        normals.push_back(N1);
+        normals.push_back(N2);
+
+        //cap
+        vertices.push_back(base_center);
+        vertices.push_back(P2);
+        vertices.push_back(P1);
+        normals.push_back(vec3(0, 0, -1));
+        normals.push_back(vec3(0, 0, -1));
+        normals.push_back(vec3(0, 0, -1));
+    }
+
+    box.center.set(0, 0, -height * 0.5f);
+    box.halfsize.set(radius, radius, height * 0.5f);
+    this->radius = sqrt(radius * radius + height * height * 0.25f);
+}
+
 GFX::Mesh* GFX::Mesh::Get(const char* filename, bool skip_load)
 {
+    PROFILE_FUNCTION();
     assert(filename);
-    std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
-    if (it != sMeshesLoaded.end())
-        return it->second;
+    Mesh* cached = sMeshesLoaded.find(filename);
+    if (cached)
+        return cached;
 
+    MEMORY_SCOPE("meshes");
     if (skip_load)
         return NULL;
 
@@ -1668,7 +2096,10 @@ GFX::Mesh* GFX::Mesh::Get(const char* filename, bool skip_load)
         }
 
         std::cout << "[OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
-        sMeshesLoaded[filename] = m;
+        m->source_filename = binfilename;
+        m->residency = default_residency;
+        m->releaseCPUData();
+        m->handle = sMeshesLoaded.add(filename, m);
         return m;
     }
 
@@ -1695,6 +2126,12 @@ GFX::Mesh* GFX::Mesh::Get(const char* filename, bool skip_load)
         m->interleaveBuffers();
     }
 
+    //simplified versions for the distance, before the upload so they go to the VRAM and the .mbin
+    if (generate_lods && m->generateLODs())
+        std::cout << "[LODS " << m->lods.size() << "] ";
+    if (generate_meshlets && m->generateMeshlets())
+        std::cout << "[MESHLETS " << m->meshlets.size() << "] ";
+
     //and upload them to VRAM
     if (auto_upload_to_vram)
     {
@@ -1706,10 +2143,13 @@ GFX::Mesh* GFX::Mesh::Get(const char* filename, bool skip_load)
     if (use_binary)
     {
         std::cout << "\t\t Writing .BIN ... ";
-        m->writeBin(filename);
+        if (m->writeBin(filename))
+            m->source_filename = binfilename;
         std::cout << "[OK]" << std::endl;
     }
 
+    m->residency = default_residency;
+    m->releaseCPUData();
     m->registerMesh(name);
     return m;
 }
@@ -5,10 +5,12 @@
 #include <string>
 
 #include "../core/math.h"
+#include "../core/registry.h"
+#include "meshlets.h"
 
 //version from 21/01/2024
 // From CAStudentFramework
-#define MESH_BIN_VERSION 12 //this is used to regenerate bins if the format changes
+#define MESH_BIN_VERSION 15 //this is used to regenerate bins if the format changes
 
 #define MAX_SUBMESH_DRAW_CALLS 16
 
@@ -59,10 +61,23 @@ namespace GFX {
     class Mesh
     {
     public:
-        static std::map<std::string, Mesh*> sMeshesLoaded;
+        static CORE::Registry<Mesh> sMeshesLoaded;
+        CORE::Handle handle; //in sMeshesLoaded, null if it was never registered
+        void retain() { sMeshesLoaded.retain(handle); }
+        void release() { sMeshesLoaded.release(handle); }
         static bool use_binary; //always load the binary version of a mesh when possible
         static bool interleave_meshes; //loaded meshes will me automatically interleaved
         static bool auto_upload_to_vram; //loaded meshes will be stored in the VRAM
+        static bool generate_lods; //loaded meshes get their levels of detail (stored in the .mbin)
+        static bool generate_meshlets; //big indexed meshes are split in meshlets to cull them by parts
+
+        //what stays in RAM once the mesh is in VRAM
+        enum eResidency : uint8 {
+            KEEP_CPU_DATA,          //everything (meshes created or edited from code)
+            KEEP_COLLISION_DATA,    //only positions and indices, for picking and collisions
+            DROP_CPU_DATA           //nothing, the collision model is built from the .mbin when needed
+        };
+        static eResidency default_residency; //used by the meshes loaded from files
         static long num_meshes_rendered;
         static long num_triangles_rendered;
 
@@ -87,6 +102,18 @@ namespace GFX {
 
         std::vector<unsigned int> indices; //for indexed meshes
 
+        //levels of detail: simplified index buffers over the same vertices, from finer to coarser (the mesh itself is lod 0)
+        struct sLOD {
+            unsigned int start; //in lod_indices
+            unsigned int count;
+            float error; //distance to the original surface, relative to the size of the mesh
+        };
+        std::vector<sLOD> lods;
+        std::vector<unsigned int> lod_indices;
+
+        //ranges of the indices (lod 0) with their bounds, they stay in RAM for the culling
+        std::vector<Meshlet> meshlets;
+
         //for animated meshes
         std::vector< Vector4ub > bones; //tells which bones afect the vertex (4 max)
         std::vector< Vector4f > weights; //tells how much affect every bone
@@ -111,28 +138,43 @@ namespace GFX {
         unsigned int bones_vbo_id;
         unsigned int weights_vbo_id;
         unsigned int uvs1_vbo_id;
+        unsigned int lod_indices_vbo_id;
+        unsigned int meshlets_vbo_id; //read by the culling compute shader
+        size_t vram_bytes; //size of the buffers uploaded
+
+        eResidency residency;
+        std::string source_filename; //.mbin to read the geometry again if it was dropped
+        unsigned int num_vertices; //uploaded, still valid after dropping the buffers
+        unsigned int num_indices;
 
         Mesh();
         ~Mesh();
 
         void clear();
 
-        void render(unsigned int primitive, int submesh_id = -1, int num_instances = 0);
+        void render(unsigned int primitive, int submesh_id = -1, int num_instances = 0, int lod = 0);
         void renderInstanced(unsigned int primitive, const mat4* instanced_models, int number);
         void renderInstanced(unsigned int primitive, const std::vector<vec3> positions, const char* uniform_name);
         void renderBounding(const mat4& model, bool world_bounding = true);
+        void renderRanges(unsigned int primitive, const int* counts, const void* const* offsets, int num_ranges); //several ranges of the indices in one call, offsets in bytes
+        void renderIndirect(unsigned int primitive, unsigned int indices_buffer, unsigned int indirect_buffer, size_t command_offset); //indices and command written by the GPU
         void renderFixedPipeline(int primitive); //sloooooooow
         void renderAnimated(unsigned int primitive, Skeleton* sk);
 
         void enableBuffers(Shader* shader);
-        void drawCall(unsigned int primitive, int draw_call_id, int num_instances);
+        void drawCall(unsigned int primitive, int draw_call_id, int num_instances, int lod = 0);
         void disableBuffers(Shader* shader);
 
         bool readBin(const char* filename);
         bool writeBin(const char* filename);
 
         unsigned int getNumSubmeshes() { return (unsigned int)submeshes.size(); }
-        unsigned int getNumVertices() { return (unsigned int)interleaved.size() ? (unsigned int)interleaved.size() : (unsigned int)vertices.size(); }
+        size_t getCPUMemory() const; //bytes reserved by the buffers in RAM
+        unsigned int getNumVertices() const { return interleaved.size() ? (unsigned int)interleaved.size() : (vertices.size() ? (unsigned int)vertices.size() : num_vertices); }
+        unsigned int getNumIndices() const { return indices.size() ? (unsigned int)indices.size() : num_indices; }
+        bool hasCPUData() const { return vertices.size() || interleaved.size(); }
+        int getNumLODs() const { return (int)lods.size() + 1; }
+        int selectLOD(float projected_radius, float max_error, int current_lod = 0) const; //coarsest lod with a projected error below max_error, with hysteresis
 
         //collision testing
         void* collision_model;
@@ -140,6 +182,7 @@ namespace GFX {
         ////help: model is the transform of the mesh, ray origin and direction, a Vector3f where to store the collision if found, a Vector3f where to store the normal if there was a collision, max ray distance in case the ray should go to infintiy, and in_object_space to get the collision point in object space or world space
         bool testRayCollision(Matrix44 model, Vector3f ray_origin, Vector3f ray_direction, Vector3f& collision, Vector3f& normal, float max_ray_dist = 3.4e+38F, bool in_object_space = false);
         bool testSphereCollision(Matrix44 model, Vector3f center, float radius, Vector3f& collision, Vector3f& normal);
+        bool getTriangles(std::vector<vec3>& triangles) const; //positions of every triangle (3 per triangle), reads the .mbin if they were released
 
         //loader
         static Mesh* Get(const char* filename);
@@ -150,6 +193,7 @@ namespace GFX {
         void createPlane(float size);
         void createSubdividedPlane(float size = 1, int subdivisions = 256, bool centered = false);
         void createSphere(float radous, float slices = 24, float arcs = 16);
+        void createCone(float radius, float height, int slices = 24); //apex in the origin, pointing to -Z (like spot lights)
         void createCube();
         void createWireBox();
         void createGrid(float dist);
@@ -160,6 +204,9 @@ namespace GFX {
         //optimize meshes
         void uploadToVRAM();
         bool interleaveBuffers();
+        void releaseCPUData(); //frees what the residency doesnt need once it is in VRAM
+        bool generateLODs(int num_lods = 4); //every lod has half the triangles of the previous one, call it before uploading
+        bool generateMeshlets(); //reorders the indices, only for indexed meshes big enough. Call it before uploading
 
         static Mesh* Get(const char* filename, bool skip_load = false);
 
@@ -0,0 +1,180 @@
+#include "meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace GFX;
+
+//bounding sphere and normal cone of the triangles in the range
+static void computeMeshletBounds(Meshlet& meshlet, const Vector3f* positions, const unsigned int* indices)
+{
+	Vector3f box_min = positions[indices[0]];
+	Vector3f box_max = box_min;
+	for (unsigned int i = 1; i < meshlet.num_indices; ++i)
+	{
+		const Vector3f& p = positions[indices[i]];
+		box_min.setMin(p);
+		box_max.setMax(p);
+	}
+	meshlet.center = (box_min + box_max) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (unsigned int i = 0; i < meshlet.num_indices; ++i)
+		meshlet.radius = std::max(meshlet.radius, (positions[indices[i]] - meshlet.center).length());
+
+	//the cone contains the normals of every triangle
+	Vector3f normals[MESHLET_MAX_TRIANGLES];
+	int num_normals = 0;
+	Vector3f axis(0.0f, 0.0f, 0.0f);
+	for (unsigned int i = 0; i < meshlet.num_indices && num_normals < MESHLET_MAX_TRIANGLES; i += 3)
+	{
+		const Vector3f& p0 = positions[indices[i]];
+		Vector3f n = (positions[indices[i + 1]] - p0).cross(positions[indices[i + 2]] - p0);
+		float area = n.length();
+		if (area <= 0.0f)
+			continue;
+		normals[num_normals] = n * (1.0f / area);
+		axis = axis + normals[num_normals];
+		num_normals++;
+	}
+	meshlet.cone_axis.set(0.0f, 0.0f, 0.0f);
+	meshlet.cone_cutoff = 1.0f;
+	float length = axis.length();
+	if (!num_normals || length <= 0.0f)
+		return;
+	axis = axis * (1.0f / length);
+	float min_dot = 1.0f;
+	for (int i = 0; i < num_normals; ++i)
+		min_dot = std::min(min_dot, normals[i].dot(axis));
+	meshlet.cone_axis = axis;
+	if (min_dot > 0.0f) //more than 90 degrees, some triangle always faces the eye
+		meshlet.cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+void GFX::buildMeshlets(const Vector3f* positions, int num_vertices, unsigned int* indices, int num_indices, std::vector<Meshlet>& meshlets,
+	unsigned int first_index, int max_vertices, int max_triangles)
+{
+	int num_triangles = num_indices / 3;
+	if (!num_triangles)
+		return;
+	max_triangles = std::min(max_triangles, MESHLET_MAX_TRIANGLES);
+
+	//triangles of every vertex
+	std::vector<unsigned int> adjacency_offsets(num_vertices + 1, 0);
+	std::vector<unsigned int> adjacency(num_triangles * 3);
+	for (int i = 0; i < num_triangles * 3; ++i)
+		adjacency_offsets[indices[i] + 1]++;
+	for (int i = 0; i < num_vertices; ++i)
+		adjacency_offsets[i + 1] += adjacency_offsets[i];
+	{
+		std::vector<unsigned int> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+		for (int i = 0; i < num_triangles * 3; ++i)
+			adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<uint8> emitted(num_triangles, 0);
+	std::vector<int> vertex_meshlet(num_vertices, -1);	//last meshlet that used it
+	std::vector<unsigned int> reordered;
+	reordered.reserve(num_triangles * 3);
+	std::vector<int> candidates;
+	int next_triangle = 0;
+
+	auto countNewVertices = [&](int triangle, int meshlet_id) {
+		int count = 0;
+		for (int j = 0; j < 3; ++j)
+			if (vertex_meshlet[indices[triangle * 3 + j]] != meshlet_id)
+				count++;
+		return count;
+	};
+
+	while (true)
+	{
+		while (next_triangle < num_triangles && emitted[next_triangle])
+			next_triangle++;
+		if (next_triangle == num_triangles)
+			break;
+
+		int meshlet_id = (int)meshlets.size();
+		Meshlet meshlet = {};
+		meshlet.first_index = (unsigned int)reordered.size();
+		int meshlet_vertices = 0;
+		int meshlet_triangles = 0;
+		Vector3f box_min = positions[indices[next_triangle * 3]];
+		Vector3f box_max = box_min;
+		candidates.clear();
+
+		int triangle = next_triangle;
+		while (triangle != -1)
+		{
+			emitted[triangle] = 1;
+			for (int j = 0; j < 3; ++j)
+			{
+				unsigned int v = indices[triangle * 3 + j];
+				reordered.push_back(v);
+				const Vector3f& p = positions[v];
+				box_min.setMin(p);
+				box_max.setMax(p);
+				if (vertex_meshlet[v] == meshlet_id)
+					continue;
+				vertex_meshlet[v] = meshlet_id;
+				meshlet_vertices++;
+				for (unsigned int k = adjacency_offsets[v]; k < adjacency_offsets[v + 1]; ++k)
+					if (!emitted[adjacency[k]])
+						candidates.push_back(adjacency[k]);
+			}
+			meshlet_triangles++;
+			if (meshlet_triangles == max_triangles)
+				break;
+
+			//the neighbour that adds less vertices
+			triangle = -1;
+			int best = 4;
+			for (size_t k = 0; k < candidates.size();)
+			{
+				int candidate = candidates[k];
+				if (emitted[candidate])
+				{
+					candidates[k] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				int new_vertices = countNewVertices(candidate, meshlet_id);
+				if (meshlet_vertices + new_vertices <= max_vertices && new_vertices < best)
+				{
+					best = new_vertices;
+					triangle = candidate;
+					if (!new_vertices)
+						break;
+				}
+				k++;
+			}
+
+			//no neighbours left: the next one in order, if it doesnt make the meshlet much bigger
+			if (triangle == -1)
+			{
+				while (next_triangle < num_triangles && emitted[next_triangle])
+					next_triangle++;
+				if (next_triangle < num_triangles && meshlet_vertices + countNewVertices(next_triangle, meshlet_id) <= max_vertices)
+				{
+					Vector3f grown_min = box_min, grown_max = box_max;
+					for (int j = 0; j < 3; ++j)
+					{
+						const Vector3f& p = positions[indices[next_triangle * 3 + j]];
+						grown_min.setMin(p);
+						grown_max.setMax(p);
+					}
+					if ((grown_max - grown_min).length() <= (box_max - box_min).length() * 1.5f)
+						triangle = next_triangle;
+				}
+			}
+		}
+
+		meshlet.num_indices = meshlet_triangles * 3;
+		meshlet.num_vertices = meshlet_vertices;
+		computeMeshletBounds(meshlet, positions, &reordered[meshlet.first_index]);
+		meshlet.first_index += first_index;
+		meshlets.push_back(meshlet);
+	}
+
+	memcpy(indices, reordered.data(), sizeof(unsigned int) * num_triangles * 3);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include "../core/math.h"
+
+//Meshlets: groups of neighbour triangles with their bounds, so the big meshes can be culled by parts.
+//The indices of the mesh are reordered so every meshlet is a range of them
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+namespace GFX {
+
+	//same layout than the std430 struct of the culling compute shader
+	struct Meshlet {
+		Vector3f center;	//bounding sphere
+		float radius;
+		Vector3f cone_axis;	//average normal of its triangles
+		float cone_cutoff;	//sin of the angle of the normals from the axis, 1 if they are too spread to cull it by orientation
+		unsigned int first_index;
+		unsigned int num_indices;
+		unsigned int num_vertices;
+		unsigned int padding;
+	};
+
+	//appends the meshlets of the triangles, the indices are reordered in place. first_index is added to the ranges of the meshlets
+	void buildMeshlets(const Vector3f* positions, int num_vertices, unsigned int* indices, int num_indices, std::vector<Meshlet>& meshlets,
+		unsigned int first_index = 0, int max_vertices = MESHLET_MAX_VERTICES, int max_triangles = MESHLET_MAX_TRIANGLES);
+
+	//false if all its triangles face away from the eye, the cone axis must be in the same space than the eye
+	inline bool isMeshletFrontFacing(const Meshlet& meshlet, const Vector3f& center, float radius, const Vector3f& axis, const Vector3f& eye)
+	{
+		Vector3f to_center = center - eye;
+		return to_center.dot(axis) < meshlet.cone_cutoff * to_center.length() + radius;
+	}
+
+};
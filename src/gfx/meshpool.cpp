@@ -0,0 +1,173 @@
+#include "meshpool.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "../core/includes.h"
+#include "../core/profiler.h"
+#include "mesh.h"
+#include "shader.h"
+#include "gfx.h"
+
+using namespace GFX;
+
+#define MESHPOOL_MIN_CAPACITY (1 << 20)
+
+//a bigger buffer with the same content, the old one is deleted
+static void growBuffer(unsigned int& buffer, size_t& capacity, size_t used, size_t needed)
+{
+	if (used + needed <= capacity)
+		return;
+	size_t new_capacity = std::max(std::max(capacity * 2, used + needed), (size_t)MESHPOOL_MIN_CAPACITY);
+	unsigned int new_buffer = 0;
+	glGenBuffers(1, &new_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, new_capacity, NULL, GL_STATIC_DRAW);
+	if (used)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (buffer)
+		glDeleteBuffers(1, &buffer);
+	buffer = new_buffer;
+	capacity = new_capacity;
+}
+
+static void copyBuffer(unsigned int source, unsigned int destination, size_t destination_offset, size_t size)
+{
+	glBindBuffer(GL_COPY_READ_BUFFER, source);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, destination_offset, size);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+MeshPool::MeshPool()
+{
+	vertices_bytes = 0;
+	indices_bytes = 0;
+	vao_id = 0;
+	vertices_vbo_id = 0;
+	indices_vbo_id = 0;
+	vertices_capacity = 0;
+	indices_capacity = 0;
+	for (int i = 0; i < 3; ++i)
+		attribute_locations[i] = -1;
+}
+
+MeshPool::~MeshPool()
+{
+	if (vao_id)
+		glDeleteVertexArrays(1, &vao_id);
+	if (vertices_vbo_id)
+		glDeleteBuffers(1, &vertices_vbo_id);
+	if (indices_vbo_id)
+		glDeleteBuffers(1, &indices_vbo_id);
+}
+
+void MeshPool::clear()
+{
+	entries.clear();
+	vertices_bytes = 0;
+	indices_bytes = 0;
+}
+
+const MeshPool::sEntry* MeshPool::add(Mesh* mesh)
+{
+	auto it = entries.find(mesh);
+	if (it != entries.end() && it->second.handle == mesh->handle)
+		return &it->second;
+
+	//only the interleaved layout, the one of the loaded meshes
+	if (!mesh->interleaved_vbo_id || !mesh->num_vertices)
+		return nullptr;
+	PROFILE_FUNCTION();
+
+	unsigned int num_vertices = mesh->num_vertices;
+	unsigned int num_indices = mesh->num_indices ? mesh->num_indices : num_vertices;
+	unsigned int num_lod_indices = 0;
+	if (mesh->lod_indices_vbo_id)
+		for (auto& level : mesh->lods)
+			num_lod_indices = std::max(num_lod_indices, level.start + level.count);
+
+	size_t vertex_size = sizeof(Mesh::tInterleaved);
+	growBuffer(vertices_vbo_id, vertices_capacity, vertices_bytes, num_vertices * vertex_size);
+	growBuffer(indices_vbo_id, indices_capacity, indices_bytes, (num_indices + num_lod_indices) * sizeof(unsigned int));
+
+	sEntry entry;
+	entry.base_vertex = (int)(vertices_bytes / vertex_size);
+	entry.num_vertices = num_vertices;
+	entry.handle = mesh->handle;
+	unsigned int first_index = (unsigned int)(indices_bytes / sizeof(unsigned int));
+	entry.levels.push_back({ first_index, num_indices });
+	for (auto& level : mesh->lods)
+		if (num_lod_indices)
+			entry.levels.push_back({ first_index + num_indices + level.start, level.count });
+
+	copyBuffer(mesh->interleaved_vbo_id, vertices_vbo_id, vertices_bytes, num_vertices * vertex_size);
+	if (mesh->num_indices)
+		copyBuffer(mesh->indices_vbo_id, indices_vbo_id, indices_bytes, num_indices * sizeof(unsigned int));
+	else
+	{
+		//not indexed, every vertex once
+		std::vector<unsigned int> indices(num_indices);
+		for (unsigned int i = 0; i < num_indices; ++i)
+			indices[i] = i;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, indices_vbo_id);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indices_bytes, num_indices * sizeof(unsigned int), indices.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	if (num_lod_indices)
+		copyBuffer(mesh->lod_indices_vbo_id, indices_vbo_id, indices_bytes + num_indices * sizeof(unsigned int), num_lod_indices * sizeof(unsigned int));
+	checkGLErrors();
+
+	vertices_bytes += num_vertices * vertex_size;
+	indices_bytes += (num_indices + num_lod_indices) * sizeof(unsigned int);
+	return &(entries[mesh] = entry);
+}
+
+void MeshPool::bind(Shader* shader)
+{
+	if (!vao_id)
+		glGenVertexArrays(1, &vao_id);
+	glBindVertexArray(vao_id);
+
+	//the buffers change when they grow and the locations with the shader
+	for (int i = 0; i < 3; ++i)
+		if (attribute_locations[i] != -1)
+			glDisableVertexAttribArray(attribute_locations[i]);
+	attribute_locations[0] = shader->getAttribLocation("a_vertex");
+	attribute_locations[1] = shader->getAttribLocation("a_normal");
+	attribute_locations[2] = shader->getAttribLocation("a_coord");
+	const int sizes[3] = { 3, 3, 2 };
+	const size_t offsets[3] = { 0, sizeof(vec3), sizeof(vec3) * 2 };
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo_id);
+	for (int i = 0; i < 3; ++i)
+	{
+		if (attribute_locations[i] == -1)
+			continue;
+		glEnableVertexAttribArray(attribute_locations[i]);
+		glVertexAttribPointer(attribute_locations[i], sizes[i], GL_FLOAT, GL_FALSE, sizeof(Mesh::tInterleaved), (void*)offsets[i]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id); //stored in the VAO
+}
+
+void MeshPool::draw(unsigned int primitive, unsigned int indirect_buffer, int first_command, int num_commands)
+{
+	if (!num_commands)
+		return;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+	glMultiDrawElementsIndirect(primitive, GL_UNSIGNED_INT, (void*)(first_command * sizeof(DrawElementsIndirectCommand)), num_commands, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	checkGLErrors();
+}
+
+void MeshPool::unbind()
+{
+	glBindVertexArray(0);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+#include "../core/registry.h"
+
+//Mesh pool: the geometry of many meshes in one vertex buffer and one index buffer, so all of them can be drawn
+//with a single glMultiDrawElementsIndirect. The buffers of the meshes are copied inside the GPU (their CPU data can be released)
+
+namespace GFX {
+
+	class Mesh;
+	class Shader;
+
+	class MeshPool {
+	public:
+		//indices of one level of detail, relative to base_vertex
+		struct sRange {
+			unsigned int first_index;
+			unsigned int num_indices;
+		};
+
+		struct sEntry {
+			int base_vertex;
+			unsigned int num_vertices;
+			std::vector<sRange> levels;	//the mesh, then its lods
+			CORE::Handle handle;	//of the mesh when it was added, a collected mesh could leave its address to another one
+		};
+
+		//stats
+		size_t vertices_bytes;	//used
+		size_t indices_bytes;
+
+		MeshPool();
+		~MeshPool();
+
+		const sEntry* add(Mesh* mesh);	//the same entry if it was added before, nullptr if it cannot be pooled (not interleaved or not in VRAM)
+		void clear();	//forgets every mesh, keeps the buffers
+		int getNumMeshes() const { return (int)entries.size(); }
+
+		void bind(Shader* shader);	//attributes of the pooled vertices and the index buffer, in its own VAO
+		void draw(unsigned int primitive, unsigned int indirect_buffer, int first_command, int num_commands);	//after bind, gl_DrawID starts at 0 in every call
+		void unbind();
+
+	private:
+		std::unordered_map<const Mesh*, sEntry> entries;
+		unsigned int vao_id;
+		unsigned int vertices_vbo_id;
+		unsigned int indices_vbo_id;
+		size_t vertices_capacity;	//in bytes
+		size_t indices_capacity;
+		int attribute_locations[3];	//of the last shader bound
+	};
+
+};
@@ -7,6 +7,8 @@
 #include <locale>
 
 #include "../utils/utils.h"
+#include "../core/profiler.h"
+#include "../core/memory.h"
 
 #include "texture.h"
 
@@ -60,7 +62,20 @@ namespace GFX {
 	std::map<std::string, std::string> Shader::s_shader_files;
 	std::map<std::string, Shader::UberShader*> Shader::s_ubershaders;
 
-	std::map<std::string, Shader*> Shader::s_Shaders;
+	CORE::Registry<Shader> Shader::s_Shaders;
+
+	static bool shader_memory_reporter = CORE::MemoryTracker::addReporter("shaders", [](std::vector<CORE::MemoryEntry>& entries) {
+		for (auto& it : Shader::s_Shaders.getNamedItems())
+		{
+			Shader* shader = it.second;
+			//the size of the linked binary is the closest thing to what the driver keeps
+			GLint binary_size = 0;
+			if (shader->program)
+				glGetProgramiv(shader->program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+			size_t cpu_bytes = sizeof(Shader) + shader->info_log.capacity() + shader->log.capacity() + shader->locations.size() * sizeof(std::pair<const char*, int>);
+			entries.push_back(CORE::MemoryEntry{ "shaders", it.first, cpu_bytes, (size_t)binary_size });
+		}
+	});
 	bool Shader::s_ready = false;
 	Shader* Shader::current = NULL;
 	std::vector<char> Shader::lines_with_error;
@@ -88,6 +103,7 @@ namespace GFX {
 
 	bool Shader::load(const std::string& csf, const char* macros)
 	{
+		MEMORY_SCOPE("shaders");
 		assert(compiled == false);
 		assert(glGetError() == GL_NO_ERROR);
 
@@ -118,6 +134,7 @@ namespace GFX {
 
 	bool Shader::load(const std::string& vsf, const std::string& psf, const char* macros)
 	{
+		MEMORY_SCOPE("shaders");
 		assert(compiled == false);
 		assert(glGetError() == GL_NO_ERROR);
 
@@ -151,30 +168,26 @@ namespace GFX {
 
 	Shader* Shader::Get(const char* vsf, const char* psf, const char* macros)
 	{
-		std::string name;
-
-		if (psf)
-			name = std::string(vsf) + "," + std::string(psf ? psf : "") + (macros ? macros : "");
-		else
-			name = vsf;
-		std::map<std::string, Shader*>::iterator it = s_Shaders.find(name);
-		if (it != s_Shaders.end())
-			return it->second;
-
+		//the shaders of the atlas are found by name every frame, without building a string
 		if (!psf)
-			return NULL;
+			return s_Shaders.find(vsf);
+
+		std::string name = std::string(vsf) + "," + std::string(psf) + (macros ? macros : "");
+		Shader* loaded = s_Shaders.find(name);
+		if (loaded)
+			return loaded;
 
 		Shader* sh = new Shader();
 		if (!sh->load(vsf, psf, macros))
 			return NULL;
-		s_Shaders[name] = sh;
+		s_Shaders.add(name, sh);
 		return sh;
 	}
 
 	void Shader::ReloadAll()
 	{
-		for (std::map<std::string, Shader*>::iterator it = s_Shaders.begin(); it != s_Shaders.end();it++)
-			it->second->recompile();
+		for (Shader* shader : s_Shaders.getItems())
+			shader->recompile();
 		if (!s_shader_atlas_filename.empty())
 			LoadAtlas(s_shader_atlas_filename.c_str());
 		std::cout << "Shaders recompiled" << std::endl;
@@ -850,9 +863,9 @@ namespace GFX {
 
 	Shader* Shader::getDefaultShader(std::string name)
 	{
-		auto it = s_Shaders.find(name);
-		if (it != s_Shaders.end())
-			return it->second;
+		Shader* loaded = s_Shaders.find(name);
+		if (loaded)
+			return loaded;
 
 		std::string vs = "#version 330 core\n ";
 		std::string fs = "#version 330 core\n ";
@@ -1030,7 +1043,7 @@ namespace GFX {
 		sh->setUniform4("u_color", Vector4f(1, 1, 1, 1));
 		sh->disable();
 
-		s_Shaders[name] = sh;
+		s_Shaders.add(name, sh);
 		return sh;
 	}
 
@@ -1085,6 +1098,8 @@ namespace GFX {
 
 	bool Shader::LoadAtlas(const char* filename, const char* base_path_cstr)
 	{
+		PROFILE_FUNCTION();
+		MEMORY_SCOPE("shaders");
 		std::vector<std::string> lines;
 		s_shader_atlas_filename = filename;
 
@@ -1262,18 +1277,16 @@ namespace GFX {
 
 		Shader* shader = NULL;
 		bool is_new = false;
-		auto it2 = s_Shaders.find(name);
-		if (it2 == s_Shaders.end())
+		shader = s_Shaders.find(name);
+		if (!shader)
 		{
 			shader = new Shader();
 			is_new = true;
 		}
-		else
-			shader = it2->second;
 
 		bool compile_shader_result;
 		if (type == COMPUTE_SHADER) {
-			//compile_shader_result = shader->compileComputeShaderFromMemory(vs.c_str());
+			compile_shader_result = shader->compileComputeShaderFromMemory(vs.c_str());
 		}
 		else {
 			compile_shader_result = shader->compileRasterShaderFromMemory(vs.c_str(), fs.c_str());
@@ -1291,7 +1304,7 @@ namespace GFX {
 		//if(macros)
 		//	subshader.default_macros = macros;
 		if (is_new)
-			s_Shaders[name] = shader;
+			s_Shaders.add(name, shader);
 		return shader;
 	}
 
@@ -1374,6 +1387,7 @@ namespace GFX {
 	BufferObject::BufferObject()
 	{
 		id = 0;
+		texture_id = 0;
 		size = 0;
 		type = GL_UNIFORM_BUFFER;
 	}
@@ -1381,6 +1395,7 @@ namespace GFX {
 	BufferObject::BufferObject(const char* name)
 	{
 		id = 0;
+		texture_id = 0;
 		size = 0;
 		type = GL_UNIFORM_BUFFER;
 		if (name)
@@ -1390,6 +1405,8 @@ namespace GFX {
 	BufferObject::~BufferObject()
 	{
 		deallocate();
+		if (texture_id)
+			glDeleteTextures(1, &texture_id);
 	}
 
 	void BufferObject::deallocate()
@@ -1467,4 +1484,15 @@ namespace GFX {
 			glBindBufferRange(type, index, id, start, length);
 		}
 	}
+
+	void BufferObject::bindAsTexture(Shader* shader, const char* varname, int slot, GLenum internal_format)
+	{
+		assert(size && type == GL_TEXTURE_BUFFER);
+		if (!texture_id)
+			glGenTextures(1, &texture_id);
+		glActiveTexture(GL_TEXTURE0 + slot);
+		glBindTexture(GL_TEXTURE_BUFFER, texture_id);
+		glTexBuffer(GL_TEXTURE_BUFFER, internal_format, id); //the buffer id may have changed when it was resized
+		shader->setUniform1(varname, slot);
+	}
 };
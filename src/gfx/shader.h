@@ -10,6 +10,7 @@
 
 #include "../core/includes.h"
 #include "../core/math.h"
+#include "../core/registry.h"
 #include "gfx.h"
 
 
@@ -132,7 +133,7 @@ namespace GFX {
 
 		static Shader* Get(const char* vsf, const char* psf = NULL, const char* macros = NULL);
 		static void ReloadAll();
-		static std::map<std::string, Shader*> s_Shaders;
+		static CORE::Registry<Shader> s_Shaders;
 
 		std::string vs_filename;
 		std::string fs_filename;
@@ -215,6 +216,7 @@ namespace GFX {
 	public:
 		GLuint type;
 		GLuint id;
+		GLuint texture_id; //only for GL_TEXTURE_BUFFER, to read it from a samplerBuffer
 		size_t size;
 		std::string name;
 		BufferObject();
@@ -230,6 +232,8 @@ namespace GFX {
 		void readToPointer(void* data, int size);
 		//the global index behaves similar to slots in textures, you bind a UBO to an index, and a block to the same index
 		void bind(Shader* shader, int global_index, int start = 0, int length = -1);
+		//for GL_TEXTURE_BUFFER, internal_format says how the shader sees every texel (GL_RGBA32F, GL_R16UI...)
+		void bindAsTexture(Shader* shader, const char* varname, int slot, GLenum internal_format);
 	};
 
 };
\ No newline at end of file
@@ -0,0 +1,334 @@
+#include "simplify.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+using namespace GFX;
+
+//symmetric 4x4 matrix with the sum of the squared distances to the planes of the triangles around a vertex
+struct sQuadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	double weight;
+
+	void addPlane(const Vector3f& n, float d, double w)
+	{
+		a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+		b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+		c2 += w * n.z * n.z; cd += w * n.z * d;
+		d2 += w * d * d;
+		weight += w;
+	}
+
+	void add(const sQuadric& q)
+	{
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+		weight += q.weight;
+	}
+
+	double evaluate(const Vector3f& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+			+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+			+ c2 * z * z + 2.0 * cd * z + d2;
+	}
+};
+
+struct sCollapse {
+	double cost;
+	unsigned int from;
+	unsigned int to;
+};
+
+static inline uint64_t edgeKey(unsigned int a, unsigned int b)
+{
+	return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+//merges the used vertices with the same attributes, every vertex points to the first one of its group (stored in welded)
+static void weldVertices(const Vector3f* positions, const Vector3f* normals, const Vector2f* uvs, int num_vertices,
+	const unsigned int* indices, int num_indices, std::vector<unsigned int>& remap, std::vector<int>& welded)
+{
+	auto less = [&](int a, int b) {
+		const Vector3f& pa = positions[a]; const Vector3f& pb = positions[b];
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		if (pa.z != pb.z) return pa.z < pb.z;
+		if (normals)
+		{
+			const Vector3f& na = normals[a]; const Vector3f& nb = normals[b];
+			if (na.x != nb.x) return na.x < nb.x;
+			if (na.y != nb.y) return na.y < nb.y;
+			if (na.z != nb.z) return na.z < nb.z;
+		}
+		if (uvs)
+		{
+			const Vector2f& ua = uvs[a]; const Vector2f& ub = uvs[b];
+			if (ua.x != ub.x) return ua.x < ub.x;
+			if (ua.y != ub.y) return ua.y < ub.y;
+		}
+		return a < b; //the first of every group goes first
+	};
+
+	std::vector<int> order(indices, indices + num_indices);
+	std::sort(order.begin(), order.end());
+	order.erase(std::unique(order.begin(), order.end()), order.end());
+	std::sort(order.begin(), order.end(), less);
+
+	remap.resize(num_vertices);
+	std::iota(remap.begin(), remap.end(), 0);
+	welded.clear();
+	int first = 0;
+	for (int i = 0; i < (int)order.size(); ++i)
+	{
+		int a = order[first];
+		int b = order[i];
+		//same group if only the index makes them different
+		bool same = positions[a].x == positions[b].x && positions[a].y == positions[b].y && positions[a].z == positions[b].z
+			&& (!normals || (normals[a].x == normals[b].x && normals[a].y == normals[b].y && normals[a].z == normals[b].z))
+			&& (!uvs || (uvs[a].x == uvs[b].x && uvs[a].y == uvs[b].y));
+		if (!same)
+			first = i;
+		if (first == i)
+			welded.push_back(b);
+		remap[b] = order[first];
+	}
+}
+
+std::vector<SimplifiedMesh> GFX::simplifyMesh(const Vector3f* positions, const Vector3f* normals, const Vector2f* uvs, int num_vertices,
+	const unsigned int* indices, int num_indices, const std::vector<int>& target_triangles)
+{
+	std::vector<SimplifiedMesh> result;
+
+	std::vector<unsigned int> remap;
+	std::vector<int> welded;
+	weldVertices(positions, normals, uvs, num_vertices, indices, num_indices, remap, welded);
+
+	//welded triangles, without the degenerated ones
+	std::vector<unsigned int> triangles;
+	triangles.reserve(num_indices);
+	for (int i = 0; i + 2 < num_indices; i += 3)
+	{
+		unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+		if (a == b || b == c || a == c)
+			continue;
+		triangles.push_back(a);
+		triangles.push_back(b);
+		triangles.push_back(c);
+	}
+	int original_triangles = (int)triangles.size() / 3;
+
+	//quadrics weighted by area, so the error is an average distance
+	std::vector<sQuadric> quadrics(num_vertices);
+	memset(quadrics.data(), 0, sizeof(sQuadric) * num_vertices);
+	for (size_t i = 0; i < triangles.size(); i += 3)
+	{
+		const Vector3f& p0 = positions[triangles[i]];
+		Vector3f n = (positions[triangles[i + 1]] - p0).cross(positions[triangles[i + 2]] - p0);
+		float area = n.length();
+		if (area <= 0.0f)
+			continue;
+		n = n * (1.0f / area);
+		float d = -n.dot(p0);
+		for (int j = 0; j < 3; ++j)
+			quadrics[triangles[i + j]].addPlane(n, d, area * 0.5f);
+	}
+
+	//locked: vertices in open borders, seams (the same position with other attributes) and non manifold edges
+	std::vector<uint8> locked(num_vertices, 0);
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i += 3)
+			for (int j = 0; j < 3; ++j)
+				edges.push_back(edgeKey(triangles[i + j], triangles[i + (j + 1) % 3]));
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t j = i;
+			while (j < edges.size() && edges[j] == edges[i])
+				j++;
+			if (j - i != 2)
+			{
+				locked[edges[i] >> 32] = 1;
+				locked[edges[i] & 0xFFFFFFFF] = 1;
+			}
+			i = j;
+		}
+
+		std::sort(welded.begin(), welded.end(), [&](int a, int b) {
+			const Vector3f& pa = positions[a]; const Vector3f& pb = positions[b];
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			return pa.z < pb.z;
+		});
+		for (size_t i = 1; i < welded.size(); ++i)
+		{
+			const Vector3f& pa = positions[welded[i - 1]]; const Vector3f& pb = positions[welded[i]];
+			if (pa.x == pb.x && pa.y == pb.y && pa.z == pb.z)
+				locked[welded[i - 1]] = locked[welded[i]] = 1;
+		}
+	}
+
+	std::vector<unsigned int> adjacency_offsets(num_vertices + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<uint8> touched(num_vertices);
+	std::vector<int> collapse_to(num_vertices, -1);
+	std::vector<sCollapse> candidates;
+	std::vector<uint64_t> edges;
+	double max_error = 0.0; //squared
+	int last_triangles = original_triangles;
+	size_t level = 0;
+
+	while (level < target_triangles.size())
+	{
+		int num_triangles = (int)triangles.size() / 3;
+		if (num_triangles <= target_triangles[level])
+		{
+			SimplifiedMesh simplified;
+			simplified.indices = triangles;
+			simplified.error = (float)sqrt(max_error);
+			result.push_back(simplified);
+			last_triangles = num_triangles;
+			level++;
+			continue;
+		}
+
+		//triangles of every vertex
+		std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+		for (unsigned int index : triangles)
+			adjacency_offsets[index + 1]++;
+		for (int i = 0; i < num_vertices; ++i)
+			adjacency_offsets[i + 1] += adjacency_offsets[i];
+		adjacency.resize(triangles.size());
+		{
+			std::vector<unsigned int> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+			for (size_t i = 0; i < triangles.size(); ++i)
+				adjacency[fill[triangles[i]]++] = (unsigned int)(i / 3);
+		}
+
+		//cheapest direction of every edge
+		edges.clear();
+		for (size_t i = 0; i < triangles.size(); i += 3)
+			for (int j = 0; j < 3; ++j)
+				edges.push_back(edgeKey(triangles[i + j], triangles[i + (j + 1) % 3]));
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		candidates.clear();
+		for (uint64_t edge : edges)
+		{
+			unsigned int a = (unsigned int)(edge >> 32);
+			unsigned int b = (unsigned int)(edge & 0xFFFFFFFF);
+			if (locked[a] && locked[b])
+				continue;
+			sQuadric q = quadrics[a];
+			q.add(quadrics[b]);
+			double inv_weight = q.weight > 0.0 ? 1.0 / q.weight : 0.0;
+			sCollapse collapse;
+			collapse.cost = 1e300;
+			if (!locked[a])
+			{
+				collapse.cost = std::max(q.evaluate(positions[b]) * inv_weight, 0.0);
+				collapse.from = a;
+				collapse.to = b;
+			}
+			if (!locked[b])
+			{
+				double cost = std::max(q.evaluate(positions[a]) * inv_weight, 0.0);
+				if (cost < collapse.cost)
+				{
+					collapse.cost = cost;
+					collapse.from = b;
+					collapse.to = a;
+				}
+			}
+			candidates.push_back(collapse);
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const sCollapse& a, const sCollapse& b) { return a.cost < b.cost; });
+
+		//independent collapses, until the target is reached
+		std::fill(touched.begin(), touched.end(), 0);
+		int to_remove = num_triangles - target_triangles[level];
+		int removed = 0;
+		int num_collapses = 0;
+		for (const sCollapse& collapse : candidates)
+		{
+			if (removed >= to_remove)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			//the triangles that stay must keep their orientation
+			bool flips = false;
+			int shared = 0;
+			for (unsigned int k = adjacency_offsets[collapse.from]; k < adjacency_offsets[collapse.from + 1] && !flips; ++k)
+			{
+				const unsigned int* triangle = &triangles[adjacency[k] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					shared++;
+					continue;
+				}
+				Vector3f p[3], moved[3];
+				for (int j = 0; j < 3; ++j)
+				{
+					p[j] = positions[triangle[j]];
+					moved[j] = triangle[j] == collapse.from ? positions[collapse.to] : p[j];
+				}
+				Vector3f before = (p[1] - p[0]).cross(p[2] - p[0]);
+				Vector3f after = (moved[1] - moved[0]).cross(moved[2] - moved[0]);
+				flips = after.dot(before) <= 0.25f * after.length() * before.length(); //flipped, too rotated or degenerated
+			}
+			if (flips)
+				continue;
+
+			collapse_to[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			max_error = std::max(max_error, collapse.cost);
+			for (unsigned int k = adjacency_offsets[collapse.from]; k < adjacency_offsets[collapse.from + 1]; ++k)
+			{
+				const unsigned int* triangle = &triangles[adjacency[k] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+			}
+			touched[collapse.to] = 1;
+			removed += shared;
+			num_collapses++;
+		}
+		if (!num_collapses)
+			break;
+
+		size_t num_indices_left = 0;
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			unsigned int t[3];
+			for (int j = 0; j < 3; ++j)
+				t[j] = collapse_to[triangles[i + j]] != -1 ? (unsigned int)collapse_to[triangles[i + j]] : triangles[i + j];
+			if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2])
+				continue;
+			triangles[num_indices_left++] = t[0];
+			triangles[num_indices_left++] = t[1];
+			triangles[num_indices_left++] = t[2];
+		}
+		triangles.resize(num_indices_left);
+		for (const sCollapse& collapse : candidates)
+			collapse_to[collapse.from] = -1;
+	}
+
+	//it got stuck (locked vertices), the last state is a level if it is clearly smaller
+	if (level < target_triangles.size() && (int)triangles.size() / 3 < last_triangles * 0.9f)
+	{
+		SimplifiedMesh simplified;
+		simplified.indices = triangles;
+		simplified.error = (float)sqrt(max_error);
+		result.push_back(simplified);
+	}
+
+	return result;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include "../core/math.h"
+
+//Quadric error mesh simplification (Garland-Heckbert) by half edge collapses: a vertex is merged into one of its neighbours,
+//no vertex is moved or created, so the simplified indices can be drawn with the original vertex buffer
+
+namespace GFX {
+
+	struct SimplifiedMesh {
+		std::vector<unsigned int> indices;	//of the original vertices
+		float error;	//distance to the original surface estimated by the quadrics, in object units
+	};
+
+	//normals and uvs (can be NULL) only tell which vertices can be welded, the vertices in seams and open borders are never moved.
+	//target_triangles must go from bigger to smaller, the levels that could not be reduced enough are not returned
+	std::vector<SimplifiedMesh> simplifyMesh(const Vector3f* positions, const Vector3f* normals, const Vector2f* uvs, int num_vertices,
+		const unsigned int* indices, int num_indices, const std::vector<int>& target_triangles);
+
+};
@@ -10,6 +10,8 @@
 #include "shader.h"
 
 #include "../utils/utils.h"
+#include "../core/profiler.h"
+#include "../core/memory.h"
 #include "../extra/picopng.h"
 #include "../extra/jpgd.h"
 #define DDSKTX_IMPLEMENT
@@ -51,10 +53,20 @@ Vector4f Image::getPixelInterpolatedHigh(float x, float y, bool repeat) {
 namespace GFX
 {
 
-	std::map<std::string, Texture*> Texture::sTexturesLoaded;
+	CORE::Registry<Texture> Texture::sTexturesLoaded;
 	std::map<unsigned int, Texture*> Texture::sTextures;
 	unsigned int Texture::s_last_index = 0;
 
+	static bool texture_memory_reporter = CORE::MemoryTracker::addReporter("textures", [](std::vector<CORE::MemoryEntry>& entries) {
+		//all the textures, also the render targets that are not registered with a name
+		for (auto& it : Texture::sTextures)
+		{
+			Texture* texture = it.second;
+			size_t cpu_bytes = sizeof(Texture) + (texture->image.data ? texture->image.width * texture->image.height * texture->image.num_channels : 0);
+			entries.push_back(CORE::MemoryEntry{ "textures", texture->filename.size() ? texture->filename : "texture #" + std::to_string(texture->index), cpu_bytes, texture->getGPUMemory() });
+		}
+	});
+
 	int Texture::default_mag_filter = GL_LINEAR;
 	int Texture::default_min_filter = GL_LINEAR_MIPMAP_LINEAR;
 	FBO* Texture::global_fbo = NULL;
@@ -68,8 +80,10 @@ namespace GFX
 		mipmaps = false;
 		format = 0;
 		type = 0;
+		internal_format = 0;
 		texture_type = GL_TEXTURE_2D;
 		loading = false;
+		keep_image = false;
 		index = s_last_index++;
 		sTextures.insert(std::pair<unsigned int, Texture*>(index, this));
 		near_far.set(0.1f, 1000.0f);
@@ -78,6 +92,7 @@ namespace GFX
 	Texture::Texture(unsigned int width, unsigned int height, unsigned int format, unsigned int type, bool mipmaps, Uint8* data, unsigned int internal_format)
 	{
 		loading = false;
+		keep_image = false;
 		texture_id = 0;
 		index = s_last_index++;
 		sTextures.insert(std::pair<unsigned int, Texture*>(index, this));
@@ -88,6 +103,7 @@ namespace GFX
 	Texture::Texture(::Image* img)
 	{
 		loading = false;
+		keep_image = false;
 		texture_id = 0;
 		index = s_last_index++;
 		sTextures.insert(std::pair<unsigned int, Texture*>(index,this));
@@ -119,27 +135,13 @@ namespace GFX
 		}
 
 		if (filename.size())
-		{
-			auto it = sTexturesLoaded.find(filename);
-			if (it != sTexturesLoaded.end())
-				sTexturesLoaded.erase(it);
-		}
+			sTexturesLoaded.remove(filename, this);
 	}
 
 	void Texture::Release()
 	{
-		std::vector<Texture*> texs;
-
-		for (auto mp : sTexturesLoaded)
-		{
-			Texture* m = mp.second;
-			texs.push_back(m);
-		}
-
-		for (Texture* m : texs)
-		{
+		for (Texture* m : sTexturesLoaded.getItems())
 			delete m;
-		}
 		sTexturesLoaded.clear();
 	}
 
@@ -232,10 +234,7 @@ namespace GFX
 	Texture* Texture::Find(const char* filename)
 	{
 		assert(filename);
-		auto it = sTexturesLoaded.find(filename);
-		if (it != sTexturesLoaded.end())
-			return it->second;
-		return NULL;
+		return sTexturesLoaded.find(filename);
 	}
 
 	Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap)
@@ -307,6 +306,8 @@ namespace GFX
 
 	bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int type)
 	{
+		PROFILE_FUNCTION();
+		MEMORY_SCOPE("textures");
 		//non-image based formats
 		std::string str = filename;
 		std::string ext = toLowerCase( getExtension(str) );
@@ -328,11 +329,26 @@ namespace GFX
 
 		loadFromImage(image, mipmaps, wrap, type);
 		setName(filename);
-
-		this->image.clear(); //remove from RAM after loading. ???
+		retainImage(image);
 		return true;
 	}
 
+	void Texture::retainImage(::Image* img)
+	{
+		if (keep_image && img != &image)
+		{
+			//move the pixels instead of copying them
+			image.clear();
+			image.width = img->width;
+			image.height = img->height;
+			image.num_channels = img->num_channels;
+			image.origin_topleft = img->origin_topleft;
+			image.data = img->data;
+			img->data = NULL;
+		}
+		delete img;
+	}
+
 	void Texture::loadFromImage(::Image* image, bool mipmaps, bool wrap, unsigned int type)
 	{
 		unsigned int internal_format = 0;
@@ -632,6 +648,51 @@ namespace GFX
 #endif
 	}
 
+	//bytes per texel as the drivers usually store them (3 channel formats are padded to 4)
+	static size_t getBytesPerPixel(unsigned int internal_format, unsigned int format, unsigned int type)
+	{
+		switch (internal_format)
+		{
+		case GL_R8: return 1;
+		case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+		case GL_RGB8: case GL_RGBA8: case GL_SRGB8: case GL_SRGB8_ALPHA8: case GL_RGB10_A2: case GL_R11F_G11F_B10F:
+		case GL_RG16F: case GL_R32F: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: return 4;
+		case GL_RGB16F: case GL_RGBA16F: case GL_RG32F: return 8;
+		case GL_RGB32F: case GL_RGBA32F: return 16;
+		}
+
+		size_t channels = 4;
+		switch (format)
+		{
+		case GL_RED: case GL_DEPTH_COMPONENT: channels = 1; break;
+		case GL_RG: channels = 2; break;
+		}
+		size_t channel_size = 1;
+		switch (type)
+		{
+		case GL_HALF_FLOAT: case GL_UNSIGNED_SHORT: case GL_SHORT: channel_size = 2; break;
+		case GL_FLOAT: case GL_UNSIGNED_INT: case GL_INT: channel_size = 4; break;
+		}
+		if (format == GL_DEPTH_COMPONENT && type == GL_UNSIGNED_BYTE)
+			channel_size = 4; //depth textures created without type are 24 bits
+		return channels * channel_size;
+	}
+
+	size_t Texture::getGPUMemory() const
+	{
+		if (!texture_id)
+			return 0;
+		size_t layers = 1;
+		if (texture_type == GL_TEXTURE_CUBE_MAP)
+			layers = 6;
+		else if (texture_type == GL_TEXTURE_2D_ARRAY || texture_type == GL_TEXTURE_3D)
+			layers = depth > 0 ? (size_t)depth : 1;
+		size_t bytes = (size_t)width * (size_t)height * layers * getBytesPerPixel(internal_format, format, type);
+		if (mipmaps)
+			bytes += bytes / 3; //the whole mip chain adds a third
+		return bytes;
+	}
+
 
 	void Texture::toViewport(Shader* shader)
 	{
@@ -763,6 +824,7 @@ void Image::fromTexture(GFX::Texture* texture)
 
 bool Image::load(const char* filename)
 {
+	PROFILE_FUNCTION();
 	std::string str = filename;
 	std::string ext = str.substr(str.size() - 4, 4);
 	double time = getTime();
@@ -1120,6 +1182,8 @@ LoadTextureTask::LoadTextureTask(const char* filename, std::vector<uint8>& buffe
 
 void LoadTextureTask::onExecute()
 {
+	PROFILE_FUNCTION();
+	MEMORY_SCOPE("textures");
 	image = new Image();
 
 	if (buffer.size())
@@ -1170,8 +1234,8 @@ void UploadTextureTask::onExecute()
 	assert(image && "image cant be null");
 
 	//in case somehow it got loaded while I was loading it in the background
-	auto it = GFX::Texture::sTexturesLoaded.find(filename);
-	if (it == GFX::Texture::sTexturesLoaded.end())
+	texture = GFX::Texture::sTexturesLoaded.find(filename);
+	if (!texture)
 	{
 		/*
 		//create texture
@@ -1183,12 +1247,10 @@ void UploadTextureTask::onExecute()
 		return;
 	}
 
-	texture = it->second;
-
 	//upload to GPU
 	texture->loadFromImage(image);
 	texture->loading = false;
 
-	//delete image
-	delete image;
+	//delete image (unless the texture wants to keep it)
+	texture->retainImage(image);
 }
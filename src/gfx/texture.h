@@ -7,6 +7,7 @@
 #include "../core/includes.h"
 #include "../core/math.h"
 #include "../core/task.h"
+#include "../core/registry.h"
 #include <map>
 #include <set>
 #include <string>
@@ -116,7 +117,8 @@ namespace GFX {
 		//a general struct to store all the information about a TGA file
 
 		//textures manager
-		static std::map<std::string, Texture*> sTexturesLoaded;
+		static CORE::Registry<Texture> sTexturesLoaded;
+		CORE::Handle handle; //in sTexturesLoaded, null if it has no name
 		static std::map<unsigned int, Texture*> sTextures;
 		static unsigned int s_last_index;
 
@@ -138,8 +140,9 @@ namespace GFX {
 		unsigned int wrapS;
 		unsigned int wrapT;
 
-		//original data info
+		//original data info, only kept when keep_image is set (uploadAsArray needs it)
 		::Image image;
+		bool keep_image;
 
 		Texture();
 		Texture(unsigned int width, unsigned int height, unsigned int format = GL_RGB, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8* data = NULL, unsigned int internal_format = 0);
@@ -177,6 +180,7 @@ namespace GFX {
 		//load without using the manager
 		bool load(const char* filename, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
 		void loadFromImage(::Image* image, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
+		void retainImage(::Image* img); //once uploaded, moves the pixels to image if keep_image, and deletes img
 
 		//load using the manager (caching loaded ones to avoid reloading them)
 		static Texture* Get(const char* filename, bool mipmaps = true, bool wrap = true);
@@ -185,11 +189,13 @@ namespace GFX {
 		static Texture* Find(const char* filename);
 		void setName(const char* name) {
 			filename = name;
-			sTexturesLoaded[filename] = this;
+			handle = sTexturesLoaded.add(filename, this);
 		}
 
 		void generateMipmaps();
 
+		size_t getGPUMemory() const; //estimated from the size and the format
+
 		//show the texture on the current viewport
 		void toViewport(Shader* shader = NULL);
 		//copy to another texture
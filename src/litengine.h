@@ -5,6 +5,9 @@
 #include "core/math.h"
 #include "core/input.h"
 #include "core/ui.h"
+#include "core/profiler.h"
+#include "core/arena.h"
+#include "core/memory.h"
 
 #include "gfx/gfx.h"
 #include "gfx/texture.h"
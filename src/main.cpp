@@ -21,8 +21,40 @@ Application* app = NULL;
 //The application main loop
 int main(int argc, char **argv)
 {
+	//benchmark mode: GTR_Framework --bench scene.json --frames 500 [--csv bench.csv] [--capture 100]
+	//	[--memory-report memory.json] [--memory-budget budget.json] (exits with 1 if a subsystem is over budget)
+	const char* bench_scene = NULL;
+	const char* bench_csv = "bench.csv";
+	const char* memory_report = NULL;
+	const char* memory_budget = NULL;
+	int bench_frames = 500;
+	int bench_capture = 0;
+	for (int i = 1; i < argc - 1; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--bench")
+			bench_scene = argv[++i];
+		else if (arg == "--frames")
+		{
+			bench_frames = atoi(argv[++i]);
+			if (bench_frames <= 0)
+			{
+				std::cout << "[ERROR] --frames must be a positive number: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--csv")
+			bench_csv = argv[++i];
+		else if (arg == "--capture")
+			bench_capture = atoi(argv[++i]);
+		else if (arg == "--memory-report")
+			memory_report = argv[++i];
+		else if (arg == "--memory-budget")
+			memory_budget = argv[++i];
+	}
+
 	std::cout << "Initiating app..." << std::endl;
-	CORE::init();
+	CORE::init(bench_scene != NULL);
 
 	//define window size
 	bool fullscreen = false; 
@@ -36,6 +68,19 @@ int main(int argc, char **argv)
 		return 0;
 
 	//create the app
+	if (bench_scene)
+	{
+		app = new Application(bench_scene);
+		CORE::benchLoop(window, app, bench_frames, bench_csv, bench_capture);
+		//after rendering so everything loaded asynchronously is already in memory
+		int result = 0;
+		if (memory_report)
+			CORE::MemoryTracker::dump(memory_report);
+		if (memory_budget && (!CORE::MemoryTracker::loadBudgets(memory_budget) || !CORE::MemoryTracker::checkBudgets()))
+			result = 1;
+		CORE::destroy();
+		return result;
+	}
 	app = new Application();
 
 	//main loop, application gets inside here till user closes it
@@ -6,9 +6,17 @@
 #include "camera.h"
 #include "../gfx/shader.h"
 #include "../gfx/mesh.h"
+#include "../core/profiler.h"
+#include "../core/memory.h"
 
 #include <sys/stat.h>
 
+#ifdef MATH_USE_SSE
+	#include <immintrin.h>
+#elif defined(MATH_USE_NEON) && defined(__aarch64__)
+	#include <arm_neon.h>
+#endif
+
 Skeleton::Skeleton()
 {
 	num_bones = 0;
@@ -40,7 +48,6 @@ void Skeleton::computeFinalBoneMatrices( std::vector<Matrix44>& bone_matrices, G
 	updateGlobalMatrices();
 
 	bone_matrices.resize(mesh->bones_info.size());
-	#pragma omp for  
 	for (int i = 0; i < mesh->bones_info.size(); ++i)
 	{
 		BoneInfo& bone_info = mesh->bones_info[i];
@@ -48,6 +55,8 @@ void Skeleton::computeFinalBoneMatrices( std::vector<Matrix44>& bone_matrices, G
 	}
 }
 
+static inline void blendBoneKeys(const BoneKey& a, const BoneKey& b, float f, Matrix44& out);
+
 void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 layer)
 {
 	assert(a && b && result && "skeleton cannot be NULL");
@@ -79,7 +88,6 @@ void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 la
 	}
 
 	//blend bones locally
-	#pragma omp for  
 	for (int i = 0; i < result->num_bones; ++i)
 	{
 		Skeleton::Bone& bone = result->bones[i];
@@ -87,9 +95,11 @@ void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 la
 		Skeleton::Bone& boneB = b->bones[i];
 		if ( layer != 0xFF && !(bone.layer & layer) ) //not in the same layer
 			continue;
-		#pragma omp for  
-		for (int j = 0; j < 16; ++j)
-			bone.model.m[j] = lerp( boneA.model.m[j], boneB.model.m[j], w);
+		//lerping the matrices would shear and shrink the rotations
+		BoneKey keyA, keyB;
+		keyA.fromMatrix(boneA.model);
+		keyB.fromMatrix(boneB.model);
+		blendBoneKeys(keyA, keyB, w, bone.model);
 	}
 }
 
@@ -161,10 +171,208 @@ void Skeleton::assignLayer( Bone* bone, uint8 layer )
 	}
 }
 
+void BoneKey::fromMatrix(const Matrix44& m)
+{
+	Matrix44 rot = m;
+	translation.set(m.m[12], m.m[13], m.m[14]);
+	scale = rot.getScale();
+	//mirrored matrix, keep the sign in the scale so the rotation stays valid
+	if (dot(cross(rot.rightVector(), rot.topVector()), rot.frontVector()) < 0.0f)
+		scale.x = -scale.x;
+	for (int i = 0; i < 3; ++i)
+	{
+		float s = scale.v[i] != 0.0f ? 1.0f / scale.v[i] : 0.0f;
+		for (int j = 0; j < 3; ++j)
+			rot.M[i][j] *= s;
+	}
+	rotation.fromMatrix(rot);
+}
+
+void BoneKey::toMatrix(Matrix44& m) const
+{
+	rotation.toMatrix(m);
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j)
+			m.M[i][j] *= scale.v[i];
+	m.m[12] = translation.x;
+	m.m[13] = translation.y;
+	m.m[14] = translation.z;
+}
+
+//quantization of the keys
+#define QUAT_SQRT2 1.41421356f
+
+static void quantizeRotation(const Quaternion& rotation, uint16* out)
+{
+	Quaternion q = rotation;
+	q.normalize();
+	int largest = 0;
+	for (int i = 1; i < 4; ++i)
+		if (fabs(q.q[i]) > fabs(q.q[largest]))
+			largest = i;
+	//q and -q are the same rotation, make the dropped component positive
+	float sign = q.q[largest] < 0.0f ? -1.0f : 1.0f;
+	int j = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i == largest)
+			continue;
+		//the other components are in the range [-1/sqrt(2), 1/sqrt(2)]
+		float v = clamp(q.q[i] * sign * QUAT_SQRT2 * 0.5f + 0.5f, 0.0f, 1.0f);
+		out[j++] = (uint16)(v * 32767.0f + 0.5f);
+	}
+	out[0] |= (uint16)((largest & 1) << 15);
+	out[1] |= (uint16)((largest >> 1) << 15);
+}
+
+#ifndef MATH_USE_SSE
+//where every component of the quaternion is read from (the three stored ones and the dropped one last), by dropped index
+static const int8 dequantize_order[4][4] = { { 3, 0, 1, 2 }, { 0, 3, 1, 2 }, { 0, 1, 3, 2 }, { 0, 1, 2, 3 } };
+#endif
+
+//without branches, the dropped index changes from key to key
+static inline void dequantizeRotation(const uint16* in, float* q)
+{
+	int largest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+	const float scale = 2.0f / (32767.0f * QUAT_SQRT2);
+	const float offset = -1.0f / QUAT_SQRT2;
+#ifdef MATH_USE_SSE
+	__m128 v = _mm_cvtepi32_ps(_mm_setr_epi32(in[0] & 0x7FFF, in[1] & 0x7FFF, in[2], 0));
+	v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(scale)), _mm_setr_ps(offset, offset, offset, 0.0f));
+	__m128 s = _mm_mul_ps(v, v);
+	s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 3, 0, 1)));
+	s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+	__m128 w = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), s), _mm_setzero_ps()));
+	v = _mm_or_ps(v, _mm_and_ps(w, _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1)))); //(a, b, c, w)
+	//w goes to the lane of the dropped component, the other lanes keep their order
+	__m128i l = _mm_set1_epi32(largest);
+	__m128 r = _mm_and_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 1, 0, 3)), _mm_castsi128_ps(_mm_cmpeq_epi32(l, _mm_set1_epi32(0))));
+	r = _mm_or_ps(r, _mm_and_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 1, 3, 0)), _mm_castsi128_ps(_mm_cmpeq_epi32(l, _mm_set1_epi32(1)))));
+	r = _mm_or_ps(r, _mm_and_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 1, 0)), _mm_castsi128_ps(_mm_cmpeq_epi32(l, _mm_set1_epi32(2)))));
+	r = _mm_or_ps(r, _mm_and_ps(v, _mm_castsi128_ps(_mm_cmpeq_epi32(l, _mm_set1_epi32(3)))));
+	_mm_storeu_ps(q, r);
+#else
+	float v[4];
+	v[0] = (in[0] & 0x7FFF) * scale + offset;
+	v[1] = (in[1] & 0x7FFF) * scale + offset;
+	v[2] = in[2] * scale + offset;
+	v[3] = sqrtf(std::max(0.0f, 1.0f - (v[0] * v[0] + v[1] * v[1] + v[2] * v[2])));
+	const int8* order = dequantize_order[largest];
+	for (int i = 0; i < 4; ++i)
+		q[i] = v[order[i]];
+#endif
+}
+
+static inline uint16 quantizeValue(float v, float min, float extent)
+{
+	if (extent <= 0.0f)
+		return 0;
+	return (uint16)(clamp((v - min) / extent, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+//nlerp of two rotations, b is flipped when the dot is negative to take the shortest path
+//the SIMD and scalar paths do the same operations in the same order
+static inline void nlerpRotation(const float* qa_in, const float* qb_in, float f, float* q)
+{
+#ifdef MATH_USE_SSE
+	__m128 wa = _mm_set1_ps(1.0f - f);
+	__m128 wb = _mm_set1_ps(f);
+	__m128 qa = _mm_loadu_ps(qa_in);
+	__m128 qb = _mm_loadu_ps(qb_in);
+	__m128 d = _mm_mul_ps(qa, qb);
+	d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+	d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+	qb = _mm_xor_ps(qb, _mm_and_ps(d, _mm_set1_ps(-0.0f)));
+	__m128 r = _mm_add_ps(_mm_mul_ps(qa, wa), _mm_mul_ps(qb, wb));
+	__m128 l = _mm_mul_ps(r, r);
+	l = _mm_add_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 3, 0, 1)));
+	l = _mm_add_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 0, 3, 2)));
+	_mm_storeu_ps(q, _mm_div_ps(r, _mm_sqrt_ps(l)));
+#elif defined(MATH_USE_NEON) && defined(__aarch64__)
+	float fa = 1.0f - f;
+	float32x4_t qa = vld1q_f32(qa_in);
+	float32x4_t qb = vld1q_f32(qb_in);
+	float32x4_t d = vmulq_f32(qa, qb);
+	d = vaddq_f32(d, vrev64q_f32(d));
+	d = vaddq_f32(d, vextq_f32(d, d, 2));
+	uint32x4_t sign_mask = vandq_u32(vreinterpretq_u32_f32(d), vdupq_n_u32(0x80000000));
+	qb = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(qb), sign_mask));
+	float32x4_t r = vaddq_f32(vmulq_n_f32(qa, fa), vmulq_n_f32(qb, f));
+	float32x4_t l = vmulq_f32(r, r);
+	l = vaddq_f32(l, vrev64q_f32(l));
+	l = vaddq_f32(l, vextq_f32(l, l, 2));
+	vst1q_f32(q, vdivq_f32(r, vsqrtq_f32(l)));
+#else
+	float fa = 1.0f - f;
+	const float* qa = qa_in;
+	const float* qb = qb_in;
+	float d = (qa[0] * qb[0] + qa[1] * qb[1]) + (qa[2] * qb[2] + qa[3] * qb[3]);
+	float sign = std::signbit(d) ? -1.0f : 1.0f;
+	for (int i = 0; i < 4; ++i)
+		q[i] = qa[i] * fa + (qb[i] * sign) * f;
+	float len = sqrtf((q[0] * q[0] + q[1] * q[1]) + (q[2] * q[2] + q[3] * q[3]));
+	for (int i = 0; i < 4; ++i)
+		q[i] = q[i] / len;
+#endif
+}
+
+//interpolates two keys (lerp for translation and scale, nlerp for the rotation)
+static inline void lerpBoneKeys(const BoneKey& a, const BoneKey& b, float f, BoneKey& out)
+{
+	nlerpRotation(a.rotation.q, b.rotation.q, f, out.rotation.q);
+	float fa = 1.0f - f;
+	for (int i = 0; i < 3; ++i)
+	{
+		out.translation.v[i] = a.translation.v[i] * fa + b.translation.v[i] * f;
+		out.scale.v[i] = a.scale.v[i] * fa + b.scale.v[i] * f;
+	}
+}
+
+//same from two quantized keys of a track, translation and scale are linear so they are interpolated
+//before dequantizing them (once instead of twice)
+static inline void lerpQuantizedKeys(const QuantizedBoneKey& a, const QuantizedBoneKey& b, const TrackRange& range, float f, BoneKey& out)
+{
+	float qa[4], qb[4];
+	dequantizeRotation(a.rotation, qa);
+	dequantizeRotation(b.rotation, qb);
+	nlerpRotation(qa, qb, f, out.rotation.q);
+	float fa = (1.0f - f) * (1.0f / 65535.0f);
+	float fb = f * (1.0f / 65535.0f);
+	for (int i = 0; i < 3; ++i)
+	{
+		out.translation.v[i] = range.translation_min.v[i] + range.translation_extent.v[i] * (a.translation[i] * fa + b.translation[i] * fb);
+		out.scale.v[i] = range.scale_min.v[i] + range.scale_extent.v[i] * (a.scale[i] * fa + b.scale[i] * fb);
+	}
+}
+
+//same but writes the bone matrix
+static inline void blendBoneKeys(const BoneKey& a, const BoneKey& b, float f, Matrix44& out)
+{
+	BoneKey key;
+	lerpBoneKeys(a, b, f, key);
+	key.toMatrix(out);
+}
+
+void blendBoneKeys(const BoneKey* a, const BoneKey* b, float w, Skeleton* result, uint8 layer)
+{
+	w = clamp(w, 0.0f, 1.0f);
+	for (int i = 0; i < result->num_bones; ++i)
+	{
+		Skeleton::Bone& bone = result->bones[i];
+		if (layer != 0xFF && !(bone.layer & layer))
+			continue;
+		blendBoneKeys(a[i], b[i], w, bone.model);
+	}
+}
+
+bool Animation::use_quantization = false;
+
 Animation::Animation()
 {
 	duration = 0.0f;
 	keyframes = NULL;
+	quantized_keyframes = NULL;
+	track_ranges = NULL;
 	num_keyframes = 0;
 	num_animated_bones = 0;
 }
@@ -173,11 +381,65 @@ Animation::~Animation()
 {
 	if (keyframes)
 		delete[] keyframes;
+	if (quantized_keyframes)
+		delete[] quantized_keyframes;
+	if (track_ranges)
+		delete[] track_ranges;
+}
+
+void Animation::quantize()
+{
+	if (!keyframes || quantized_keyframes)
+		return;
+
+	//find the range of every track
+	track_ranges = new TrackRange[num_animated_bones];
+	for (int i = 0; i < num_animated_bones; ++i)
+	{
+		Vector3f tmin(1e10f), tmax(-1e10f), smin(1e10f), smax(-1e10f);
+		for (int k = 0; k < num_keyframes; ++k)
+		{
+			BoneKey& key = keyframes[k * num_animated_bones + i];
+			tmin.setMin(key.translation);
+			tmax.setMax(key.translation);
+			smin.setMin(key.scale);
+			smax.setMax(key.scale);
+		}
+		TrackRange& range = track_ranges[i];
+		range.translation_min = tmin;
+		range.translation_extent = tmax - tmin;
+		range.scale_min = smin;
+		range.scale_extent = smax - smin;
+	}
+
+	int num = num_keyframes * num_animated_bones;
+	quantized_keyframes = new QuantizedBoneKey[num];
+	for (int j = 0; j < num; ++j)
+	{
+		BoneKey& key = keyframes[j];
+		QuantizedBoneKey& qkey = quantized_keyframes[j];
+		TrackRange& range = track_ranges[j % num_animated_bones];
+		quantizeRotation(key.rotation, qkey.rotation);
+		for (int i = 0; i < 3; ++i)
+		{
+			qkey.translation[i] = quantizeValue(key.translation.v[i], range.translation_min.v[i], range.translation_extent.v[i]);
+			qkey.scale[i] = quantizeValue(key.scale.v[i], range.scale_min.v[i], range.scale_extent.v[i]);
+		}
+	}
+
+	delete[] keyframes;
+	keyframes = NULL;
 }
 
 void Animation::assignTime(float t, bool loop, bool interpolate, uint8 layers)
 {
-	assert(keyframes && skeleton.num_bones);
+	samplePose(t, skeleton, loop, interpolate, layers);
+	skeleton.updateGlobalMatrices();
+}
+
+void Animation::samplePose(float t, Skeleton& pose, bool loop, bool interpolate, uint8 layers) const
+{
+	assert((keyframes || quantized_keyframes) && skeleton.num_bones);
 
 	if (loop)
 	{
@@ -192,24 +454,74 @@ void Animation::assignTime(float t, bool loop, bool interpolate, uint8 layers)
 	int index2 = index + 1;
 	if (index2 >= num_keyframes)
 		index2 = 0;
-	float f = v - floor(v);
-
-	Matrix44* k = keyframes + index * num_animated_bones;
-	Matrix44* k2 = keyframes + index2 * num_animated_bones;
+	float f = interpolate ? v - floor(v) : 0.0f;
 
 	//compute local bones
-	#pragma omp for  
-	for (int i = 0; i < num_animated_bones; ++i)
+	if (quantized_keyframes)
 	{
-		int bone_index = bones_map[i];
-		Skeleton::Bone& bone = skeleton.bones[bone_index];
-		if (layers != 0xFF && !(bone.layer & layers))
-			continue;
-		for (int j = 0; j < 16; ++j)
-			bone.model.m[j] = lerp(k[i].m[j], k2[i].m[j], f);
+		const QuantizedBoneKey* k = quantized_keyframes + index * num_animated_bones;
+		const QuantizedBoneKey* k2 = quantized_keyframes + index2 * num_animated_bones;
+		for (int i = 0; i < num_animated_bones; ++i)
+		{
+			int bone_index = bones_map[i];
+			Skeleton::Bone& bone = pose.bones[bone_index];
+			if (layers != 0xFF && !(bone.layer & layers))
+				continue;
+			BoneKey key;
+			lerpQuantizedKeys(k[i], k2[i], track_ranges[i], f, key);
+			key.toMatrix(bone.model);
+		}
 	}
+	else
+	{
+		const BoneKey* k = keyframes + index * num_animated_bones;
+		const BoneKey* k2 = keyframes + index2 * num_animated_bones;
+		for (int i = 0; i < num_animated_bones; ++i)
+		{
+			int bone_index = bones_map[i];
+			Skeleton::Bone& bone = pose.bones[bone_index];
+			if (layers != 0xFF && !(bone.layer & layers))
+				continue;
+			blendBoneKeys(k[i], k2[i], f, bone.model);
+		}
+	}
+}
 
-	skeleton.updateGlobalMatrices();
+void Animation::sampleKeys(float t, BoneKey* keys, bool loop, bool interpolate) const
+{
+	assert((keyframes || quantized_keyframes) && skeleton.num_bones);
+
+	if (loop)
+	{
+		t = fmod(t, duration);
+		if (t < 0)
+			t = duration + t;
+	}
+	else
+		t = clamp( t, 0.0f, duration - (1.0/samples_per_second) );
+	float v = samples_per_second * t;
+	int index = clamp(floor(v), 0, num_keyframes - 1);
+	int index2 = index + 1;
+	if (index2 >= num_keyframes)
+		index2 = 0;
+	float f = interpolate ? v - floor(v) : 0.0f;
+
+	if (quantized_keyframes)
+	{
+		const QuantizedBoneKey* k = quantized_keyframes + index * num_animated_bones;
+		const QuantizedBoneKey* k2 = quantized_keyframes + index2 * num_animated_bones;
+		for (int i = 0; i < num_animated_bones; ++i)
+		{
+			lerpQuantizedKeys(k[i], k2[i], track_ranges[i], f, keys[bones_map[i]]);
+		}
+	}
+	else
+	{
+		const BoneKey* k = keyframes + index * num_animated_bones;
+		const BoneKey* k2 = keyframes + index2 * num_animated_bones;
+		for (int i = 0; i < num_animated_bones; ++i)
+			lerpBoneKeys(k[i], k2[i], f, keys[bones_map[i]]);
+	}
 }
 
 
@@ -217,10 +529,13 @@ void Animation::operator = (Animation* anim)
 {
 	memcpy(this, anim, sizeof(Animation));
 	this->keyframes = NULL;
+	this->quantized_keyframes = NULL;
+	this->track_ranges = NULL;
 }
 
 bool Animation::load(const char* filename)
 {
+	PROFILE_FUNCTION();
 	//struct stat stbuffer;
 
 	std::cout << " + Animation loading: " << TermColor::YELLOW << filename << TermColor::DEFAULT << " ... ";
@@ -246,6 +561,8 @@ bool Animation::load(const char* filename)
 				return false;
 			}
 
+			if (use_quantization)
+				quantize();
 			std::cout << "[Writing .ABIN] ... ";
 			writeABIN( filename );
 		}
@@ -263,6 +580,7 @@ struct sAnimHeader {
 	int num_animated_bones;
 	int num_keyframes;
 	int num_bones;
+	int quantized; //keys stored as QuantizedBoneKey followed by the TrackRanges
 	int8 bones_map[128];
 	char extra[16];
 };
@@ -290,6 +608,7 @@ bool Animation::writeABIN(const char* filename)
 	header.num_animated_bones = num_animated_bones;
 	header.num_keyframes = num_keyframes;
 	header.num_bones = skeleton.num_bones;
+	header.quantized = isQuantized() ? 1 : 0;
 	memcpy( header.bones_map, bones_map, sizeof(bones_map)  );
 
 	//write header
@@ -299,7 +618,13 @@ bool Animation::writeABIN(const char* filename)
 	fwrite((void*)skeleton.bones, sizeof(skeleton.bones), 1, f);
 
 	//write keyframes
-	fwrite((void*)keyframes, sizeof(Matrix44) * num_keyframes * num_animated_bones, 1, f);
+	if (header.quantized)
+	{
+		fwrite((void*)quantized_keyframes, sizeof(QuantizedBoneKey) * num_keyframes * num_animated_bones, 1, f);
+		fwrite((void*)track_ranges, sizeof(TrackRange) * num_animated_bones, 1, f);
+	}
+	else
+		fwrite((void*)keyframes, sizeof(BoneKey) * num_keyframes * num_animated_bones, 1, f);
 
 	fclose(f);
 	return true;
@@ -353,10 +678,23 @@ bool Animation::loadABIN(const char* filename)
 	pos += sizeof(skeleton.bones);
 
 	//extract keyframes
-	assert(keyframes == NULL);
-	keyframes = new Matrix44[num_keyframes * num_animated_bones];
-	memcpy( keyframes, pos, sizeof(Matrix44)*num_keyframes * num_animated_bones );
-	pos += sizeof(Matrix44) * num_keyframes * num_animated_bones;
+	assert(keyframes == NULL && quantized_keyframes == NULL);
+	int num = num_keyframes * num_animated_bones;
+	if (header.quantized)
+	{
+		quantized_keyframes = new QuantizedBoneKey[num];
+		memcpy( quantized_keyframes, pos, sizeof(QuantizedBoneKey) * num );
+		pos += sizeof(QuantizedBoneKey) * num;
+		track_ranges = new TrackRange[num_animated_bones];
+		memcpy( track_ranges, pos, sizeof(TrackRange) * num_animated_bones );
+		pos += sizeof(TrackRange) * num_animated_bones;
+	}
+	else
+	{
+		keyframes = new BoneKey[num];
+		memcpy( keyframes, pos, sizeof(BoneKey) * num );
+		pos += sizeof(BoneKey) * num;
+	}
 
 	//compute bone names map
 	for (int i = 0; i < skeleton.num_bones; ++i)
@@ -433,16 +771,20 @@ bool Animation::loadSKANIM(const char* filename)
 				bones_map[j] = bones_map_info[j];
 			num_animated_bones = (int)bones_map_info.size();
 			assert(keyframes == NULL);
-			keyframes = new Matrix44[num_animated_bones * num_keyframes];
+			keyframes = new BoneKey[num_animated_bones * num_keyframes];
 		}
 		else if (type == 'K')
 		{
 			pos = fetchWord(pos, word);
 			//float time = atof(word);
-			Matrix44* k = keyframes + current_keyframe * num_animated_bones;
+			BoneKey* k = keyframes + current_keyframe * num_animated_bones;
 			current_keyframe++;
+			Matrix44 m;
 			for (int j = 0; j < num_animated_bones; ++j)
-				pos = fetchMatrix44(pos, *(k + j));
+			{
+				pos = fetchMatrix44(pos, m);
+				k[j].fromMatrix(m);
+			}
 		}
 		else
 			break; //end of file probably
@@ -475,17 +817,33 @@ bool Animation::loadSKANIM(const char* filename)
 }
 
 
-std::map<std::string, Animation*> Animation::sAnimationsLoaded;
+CORE::Registry<Animation> Animation::sAnimationsLoaded;
+
+static bool animation_memory_reporter = CORE::MemoryTracker::addReporter("animations", [](std::vector<CORE::MemoryEntry>& entries) {
+	for (auto& it : Animation::sAnimationsLoaded.getNamedItems())
+	{
+		Animation* anim = it.second;
+		size_t num_keys = (size_t)anim->num_keyframes * anim->num_animated_bones;
+		size_t cpu_bytes = sizeof(Animation);
+		if (anim->isQuantized())
+			cpu_bytes += num_keys * sizeof(QuantizedBoneKey) + anim->num_animated_bones * sizeof(TrackRange);
+		else if (anim->keyframes)
+			cpu_bytes += num_keys * sizeof(BoneKey);
+		entries.push_back(CORE::MemoryEntry{ "animations", it.first, cpu_bytes, 0 });
+	}
+});
+
 Animation* Animation::Get(const char* filename)
 {
 	assert(filename);
 
 	//check if loaded
-	auto it = sAnimationsLoaded.find(filename);
-	if (it != sAnimationsLoaded.end())
-		return it->second;
+	Animation* loaded = sAnimationsLoaded.find(filename);
+	if (loaded)
+		return loaded;
 
 	//load it
+	MEMORY_SCOPE("animations");
 	Animation* anim = new Animation();
 	if (!anim->load(filename))
 	{
@@ -493,6 +851,6 @@ Animation* Animation::Get(const char* filename)
 		return NULL;
 	}
 
-	sAnimationsLoaded[filename] = anim;
+	anim->handle = sAnimationsLoaded.add(filename, anim);
 	return anim;
 }
@@ -5,11 +5,12 @@
 #include <algorithm>
 #include <iostream>
 #include "../gfx/mesh.h"
+#include "../core/registry.h"
 
 
 class Camera;
 
-#define ANIM_BIN_VERSION 3
+#define ANIM_BIN_VERSION 4
 
 //defined layers for every body
 enum BODY_LAYERS {
@@ -60,6 +61,36 @@ public:
 //this function takes skeleton A and blends it with skeleton B and stores the result in result
 void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 layer = 0xFF);
 
+//local transform of a bone in one keyframe (40 bytes instead of the 64 of a Matrix44)
+struct BoneKey {
+	Quaternion rotation;
+	Vector3f translation;
+	Vector3f scale;
+
+	void fromMatrix(const Matrix44& m);
+	void toMatrix(Matrix44& m) const;
+};
+
+//blends the local keys of two poses (one per bone) and writes the bone matrices of result
+void blendBoneKeys(const BoneKey* a, const BoneKey* b, float w, Skeleton* result, uint8 layer = 0xFF);
+
+//quantized BoneKey (18 bytes), translation and scale are normalized to the range of the track
+//and the rotation uses smallest-three (15 bits per component, the index of the dropped one
+//is stored in the top bit of the first two components)
+struct QuantizedBoneKey {
+	uint16 rotation[3];
+	uint16 translation[3];
+	uint16 scale[3];
+};
+
+//range of the translation and scale of one animated bone, used to dequantize its keys
+struct TrackRange {
+	Vector3f translation_min;
+	Vector3f translation_extent;
+	Vector3f scale_min;
+	Vector3f scale_extent;
+};
+
 //This class contains one animation loaded from a file (it also uses a skeleton to store the current snapshot)
 class Animation {
 public:
@@ -72,13 +103,24 @@ public:
 	int num_keyframes;
 	int8 bones_map[128]; //maps from keyframe data index to bone
 
-	Matrix44* keyframes;
+	BoneKey* keyframes; //num_keyframes * num_animated_bones, NULL if quantized
+	QuantizedBoneKey* quantized_keyframes; //same but quantized, NULL if not
+	TrackRange* track_ranges; //one per animated bone, only when quantized
+
+	static bool use_quantization; //quantize the animations imported from SKANIM (less than half the memory, but slower to sample)
 
 	Animation();
 	~Animation();	//we need the dtor to remove the keyframes memory
 
+	bool isQuantized() const { return quantized_keyframes != NULL; }
+	void quantize(); //converts keyframes to quantized_keyframes and frees them
+
 	//change the skeleton to the given pose according to time
 	void assignTime(float time, bool loop = true, bool interpolate = true, uint8 layers = 0xFF);
+	//writes the local matrices of the pose at a given time in a skeleton with the same structure (thread safe, it doesnt touch this->skeleton)
+	void samplePose(float time, Skeleton& pose, bool loop = true, bool interpolate = true, uint8 layers = 0xFF) const;
+	//same but writes the interpolated keys, in keys[bone index] (the bones without keys are not touched)
+	void sampleKeys(float time, BoneKey* keys, bool loop = true, bool interpolate = true) const;
 
 	//storage
 	bool load(const char* filename);
@@ -86,8 +128,11 @@ public:
 	bool loadABIN(const char* filename);
 	bool writeABIN(const char* filename);
 
-	static std::map<std::string, Animation*> sAnimationsLoaded;
+	static CORE::Registry<Animation> sAnimationsLoaded;
 	static Animation* Get(const char* filename);
+	CORE::Handle handle; //in sAnimationsLoaded, null if it was not loaded with Get
+	void retain() { sAnimationsLoaded.retain(handle); }
+	void release() { sAnimationsLoaded.release(handle); }
 
 	//copy operator to copy the keyframes
 	void operator = (Animation* anim);
@@ -0,0 +1,133 @@
+#include "character.h"
+#include "animation.h"
+#include "material.h"
+#include "../gfx/mesh.h"
+#include "../utils/utils.h"
+#include "../utils/jsonreader.h"
+
+SCN::CharacterEntity::CharacterEntity()
+{
+	speed = 1.0f;
+	time_offset = 0.0f;
+	mesh = NULL;
+	animation = NULL;
+	material = NULL;
+}
+
+SCN::CharacterEntity::~CharacterEntity()
+{
+	releaseResources();
+}
+
+SCN::CharacterEntity& SCN::CharacterEntity::operator=(const CharacterEntity& entity)
+{
+	if (this == &entity)
+		return *this;
+	releaseResources();
+	BaseEntity::operator=(entity);
+	mesh_filename = entity.mesh_filename;
+	animation_filename = entity.animation_filename;
+	material_name = entity.material_name;
+	speed = entity.speed;
+	time_offset = entity.time_offset;
+	mesh = entity.mesh;
+	animation = entity.animation;
+	material = entity.material;
+	retainResources();
+	return *this;
+}
+
+void SCN::CharacterEntity::retainResources()
+{
+	if (mesh)
+		mesh->retain();
+	if (animation)
+		animation->retain();
+	if (material)
+		material->retain();
+}
+
+void SCN::CharacterEntity::releaseResources()
+{
+	if (mesh)
+		mesh->release();
+	if (animation)
+		animation->release();
+	if (material)
+		material->release();
+}
+
+void SCN::CharacterEntity::configure(const JSONValue& json)
+{
+	mesh_filename = readJSONString(json, "mesh", mesh_filename.c_str());
+	animation_filename = readJSONString(json, "animation", animation_filename.c_str());
+	material_name = readJSONString(json, "material", material_name.c_str());
+	speed = readJSONNumber(json, "speed", speed);
+	time_offset = readJSONNumber(json, "time_offset", time_offset);
+	loadResources();
+}
+
+void SCN::CharacterEntity::serialize(cJSON* json)
+{
+	writeJSONString(json, "mesh", mesh_filename.c_str());
+	writeJSONString(json, "animation", animation_filename.c_str());
+	if (material_name.size())
+		writeJSONString(json, "material", material_name.c_str());
+	writeJSONNumber(json, "speed", speed);
+	writeJSONNumber(json, "time_offset", time_offset);
+}
+
+//payload of the characters in the binary scene
+struct sCharacterBinPayload
+{
+	uint32 mesh_filename;	//offsets in the strings block
+	uint32 animation_filename;
+	uint32 material_name;
+	float speed;
+	float time_offset;
+};
+
+void SCN::CharacterEntity::writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer)
+{
+	sCharacterBinPayload info;
+	info.mesh_filename = writer.addString(mesh_filename);
+	info.animation_filename = writer.addString(animation_filename);
+	info.material_name = writer.addString(material_name);
+	info.speed = speed;
+	info.time_offset = time_offset;
+	SceneBinWriter::write(payload, &info, sizeof(info));
+}
+
+void SCN::CharacterEntity::readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader)
+{
+	if (size != sizeof(sCharacterBinPayload))
+		return;
+	sCharacterBinPayload info;
+	memcpy(&info, payload, sizeof(info));
+	mesh_filename = reader.getString(info.mesh_filename);
+	animation_filename = reader.getString(info.animation_filename);
+	material_name = reader.getString(info.material_name);
+	speed = info.speed;
+	time_offset = info.time_offset;
+	loadResources();
+}
+
+void SCN::CharacterEntity::loadResources()
+{
+	assert(scene && "Cannot load the resources without scene (to extract base folder)");
+	//the ones still used are retained again before they are collected
+	releaseResources();
+	mesh = mesh_filename.size() ? GFX::Mesh::Get((scene->base_folder + "/" + mesh_filename).c_str(), false) : NULL;
+	animation = animation_filename.size() ? Animation::Get((scene->base_folder + "/" + animation_filename).c_str()) : NULL;
+	material = material_name.size() ? Material::Get(material_name.c_str()) : NULL;
+	if (!material)
+		material = &Material::default_material;
+
+	//only skinned meshes can follow the skeleton
+	if (mesh && (!mesh->bones_info.size() || (!mesh->bones.size() && !mesh->bones_vbo_id)))
+	{
+		std::cout << "[WARN] character mesh without bones: " << mesh_filename << std::endl;
+		mesh = NULL;
+	}
+	retainResources();
+}
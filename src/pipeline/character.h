@@ -0,0 +1,47 @@
+#pragma once
+
+#include "scene.h"
+
+namespace GFX {
+	class Mesh;
+}
+
+class Animation;
+
+namespace SCN {
+
+	class Material;
+
+	//a skinned mesh playing an animation, the renderer animates all of them together in its crowd
+	class CharacterEntity : public BaseEntity
+	{
+	public:
+		std::string mesh_filename;
+		std::string animation_filename;
+		std::string material_name;	//a material already loaded (by a prefab), the default one if empty
+		float speed;
+		float time_offset;	//so the characters with the same animation are not in sync
+
+		//retained while the entity uses them
+		GFX::Mesh* mesh;
+		Animation* animation;
+		Material* material;
+
+		ENTITY_METHODS(CharacterEntity, CHARACTER, 12,0);
+
+		CharacterEntity();
+		~CharacterEntity();
+		CharacterEntity& operator=(const CharacterEntity& entity); //clones retain the resources too
+
+		void configure(const JSONValue& json);
+		void serialize(cJSON* json);
+		void writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer);
+		void readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader);
+		void loadResources();	//mesh, animation and material from their names
+
+	private:
+		void retainResources();
+		void releaseResources();
+	};
+
+};
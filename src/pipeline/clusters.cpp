@@ -0,0 +1,325 @@
+#include "clusters.h"
+
+#include <cassert>
+#include <cmath>
+#include "light.h"
+#include "camera.h"
+#include "../core/task.h"
+#include "../core/profiler.h"
+#include "../gfx/shader.h"
+
+#ifdef MATH_USE_SSE
+	#include <immintrin.h>
+#elif defined(MATH_USE_NEON)
+	#include <arm_neon.h>
+#endif
+
+using namespace SCN;
+
+LightClusters::LightClusters()
+{
+	far_distance = 500.0f;
+	num_directional = 0;
+	max_lights_in_cluster = 0;
+	slice_scale = slice_bias = 0.0f;
+	near_distance = 0.1f;
+	lights_buffer = clusters_buffer = indices_buffer = NULL;
+	clusters.resize(CLUSTERS_NUM * 2);
+}
+
+LightClusters::~LightClusters()
+{
+	delete lights_buffer;
+	delete clusters_buffer;
+	delete indices_buffer;
+}
+
+int LightClusters::getSlice(float depth) const
+{
+	if (depth <= near_distance)
+		return 0;
+	int slice = (int)floor(log(depth) * slice_scale + slice_bias);
+	return slice < 0 ? 0 : (slice >= CLUSTERS_Z ? CLUSTERS_Z - 1 : slice);
+}
+
+//bounds in view space of every froxel, from the rays of the tile corners between the near and far planes
+void LightClusters::computeClusterBounds(Camera* camera, float far)
+{
+	Matrix44 inv_projection = camera->projection_matrix;
+	inv_projection.inverse();
+
+	Vector3f corner_near[(CLUSTERS_X + 1) * (CLUSTERS_Y + 1)];
+	Vector3f corner_far[(CLUSTERS_X + 1) * (CLUSTERS_Y + 1)];
+	for (int y = 0; y <= CLUSTERS_Y; ++y)
+		for (int x = 0; x <= CLUSTERS_X; ++x)
+		{
+			float ndc_x = x * 2.0f / CLUSTERS_X - 1.0f;
+			float ndc_y = y * 2.0f / CLUSTERS_Y - 1.0f;
+			Vector4f n = inv_projection * Vector4f(ndc_x, ndc_y, -1.0f, 1.0f);
+			Vector4f f = inv_projection * Vector4f(ndc_x, ndc_y, 1.0f, 1.0f);
+			//depth positive
+			corner_near[y * (CLUSTERS_X + 1) + x] = Vector3f(n.x / n.w, n.y / n.w, -n.z / n.w);
+			corner_far[y * (CLUSTERS_X + 1) + x] = Vector3f(f.x / f.w, f.y / f.w, -f.z / f.w);
+		}
+
+	float slice_depths[CLUSTERS_Z + 1];
+	for (int z = 0; z <= CLUSTERS_Z; ++z)
+		slice_depths[z] = near_distance * pow(far / near_distance, z / (float)CLUSTERS_Z);
+	slice_depths[CLUSTERS_Z] = 1e10f; //the last slice gets everything behind
+
+	for (int z = 0; z < CLUSTERS_Z; ++z)
+		for (int y = 0; y < CLUSTERS_Y; ++y)
+			for (int x = 0; x < CLUSTERS_X; ++x)
+			{
+				Vector3f min(1e10f, 1e10f, slice_depths[z]);
+				Vector3f max(-1e10f, -1e10f, std::min(slice_depths[z + 1], camera->far_plane));
+				for (int i = 0; i < 4; ++i)
+				{
+					int corner = (y + (i >> 1)) * (CLUSTERS_X + 1) + x + (i & 1);
+					const Vector3f& n = corner_near[corner];
+					const Vector3f& f = corner_far[corner];
+					//point of the ray at both depths of the slice (works for perspective and orthographic)
+					for (int j = 0; j < 2; ++j)
+					{
+						float depth = j ? max.z : min.z;
+						float t = (f.z - n.z) != 0.0f ? (depth - n.z) / (f.z - n.z) : 0.0f;
+						float px = n.x + (f.x - n.x) * t;
+						float py = n.y + (f.y - n.y) * t;
+						min.x = std::min(min.x, px); max.x = std::max(max.x, px);
+						min.y = std::min(min.y, py); max.y = std::max(max.y, py);
+					}
+				}
+				int index = (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+				cluster_min[index] = min;
+				cluster_max[index] = max;
+			}
+}
+
+ClusterLight LightClusters::packLight(LightEntity* light, int shadow_tile, int num_shadow_tiles)
+{
+	Vector3f position = light->root.model.getTranslation();
+	Vector3f front = light->getFront();
+	ClusterLight data;
+	data.position.set(position.x, position.y, position.z, light->max_distance);
+	data.color.set(light->color.x * light->intensity, light->color.y * light->intensity, light->color.z * light->intensity, (float)light->light_type);
+	data.direction.set(front.x, front.y, front.z, cos(light->cone_info.y * DEG2RAD));
+	data.cone.set(cos(light->cone_info.x * DEG2RAD), (float)shadow_tile, (float)num_shadow_tiles, 0);
+	return data;
+}
+
+void LightClusters::build(LightEntity* const* scene_lights, int num, Camera* camera, const int* shadow_tiles, const int* shadow_num_tiles)
+{
+	PROFILE_FUNCTION();
+	near_distance = std::max(camera->near_plane, 0.001f);
+	float far = std::max(std::min(far_distance, camera->far_plane), near_distance * 2.0f);
+	slice_scale = CLUSTERS_Z / log(far / near_distance);
+	slice_bias = -CLUSTERS_Z * log(near_distance) / log(far / near_distance);
+	computeClusterBounds(camera, far);
+	camera_front = normalize(camera->center - camera->eye);
+
+	//directional lights first, the rest in view space
+	lights.clear();
+	view_lights.clear();
+	for (int pass = 0; pass < 2; ++pass)
+		for (int i = 0; i < num; ++i)
+		{
+			LightEntity* light = scene_lights[i];
+			bool is_directional = light->light_type == eLightType::DIRECTIONAL;
+			if (light->light_type == eLightType::NO_LIGHT || is_directional != (pass == 0) || lights.size() >= CLUSTERS_MAX_LIGHTS)
+				continue;
+
+			ClusterLight data = packLight(light, shadow_tiles ? shadow_tiles[i] : -1, shadow_num_tiles ? shadow_num_tiles[i] : 1);
+			lights.push_back(data);
+			if (is_directional)
+				continue;
+			Vector3f position(data.position.x, data.position.y, data.position.z);
+			Vector3f front(data.direction.x, data.direction.y, data.direction.z);
+			float cos_outer = data.direction.w;
+
+			sViewLight view_light;
+			view_light.position = camera->view_matrix * position;
+			view_light.position.z = -view_light.position.z;
+			view_light.radius = light->max_distance;
+			view_light.is_spot = light->light_type == eLightType::SPOT;
+			view_light.direction = camera->view_matrix.rotateVector(front);
+			view_light.direction.z = -view_light.direction.z;
+			view_light.cos_cone = cos_outer;
+			view_light.sin_cone = sin(light->cone_info.y * DEG2RAD);
+			view_lights.push_back(view_light);
+		}
+	num_directional = (int)(lights.size() - view_lights.size());
+
+	//coarse pass: which slices every light touches (only its depth range)
+	for (int z = 0; z < CLUSTERS_Z; ++z)
+		slice_lights[z].clear();
+	for (int i = 0; i < (int)view_lights.size(); ++i)
+	{
+		const sViewLight& light = view_lights[i];
+		if (light.position.z + light.radius < near_distance)
+			continue; //behind the camera
+		int first = getSlice(light.position.z - light.radius);
+		int last = getSlice(light.position.z + light.radius);
+		for (int z = first; z <= last; ++z)
+			slice_lights[z].push_back(i);
+	}
+
+	//fine pass: every slice tests its candidates against its froxels in a worker
+	JobPool::global.parallelFor(CLUSTERS_Z, 1, [&](int start, int end) {
+		for (int z = start; z < end; ++z)
+			assignSlice(z);
+	});
+
+	//pack the lists of all slices in one array
+	indices.clear();
+	max_lights_in_cluster = 0;
+	for (int z = 0; z < CLUSTERS_Z; ++z)
+	{
+		uint32 base = (uint32)indices.size();
+		indices.insert(indices.end(), slice_indices[z].begin(), slice_indices[z].end());
+		for (int i = z * CLUSTERS_X * CLUSTERS_Y; i < (z + 1) * CLUSTERS_X * CLUSTERS_Y; ++i)
+		{
+			clusters[i * 2] += base;
+			max_lights_in_cluster = std::max(max_lights_in_cluster, (int)clusters[i * 2 + 1]);
+		}
+	}
+	if (indices.empty())
+		indices.push_back(0); //so the buffer is never empty
+}
+
+//writes the offsets relative to the slice, build adds the offset of the slice
+void LightClusters::assignSlice(int z)
+{
+	std::vector<uint16>& result = slice_indices[z];
+	result.clear();
+	const std::vector<int>& candidates = slice_lights[z];
+	int num = (int)candidates.size();
+	int padded = (num + 3) & ~3;
+
+	//SoA of the candidates, padded with lights that never pass
+	std::vector<float>& data = soa[z];
+	data.resize(padded * 4);
+	float* xs = &data[0];
+	float* ys = xs + padded;
+	float* zs = ys + padded;
+	float* rs = zs + padded;
+	for (int i = 0; i < padded; ++i)
+	{
+		if (i < num)
+		{
+			const sViewLight& light = view_lights[candidates[i]];
+			xs[i] = light.position.x;
+			ys[i] = light.position.y;
+			zs[i] = light.position.z;
+			rs[i] = light.radius * light.radius;
+		}
+		else
+		{
+			xs[i] = ys[i] = zs[i] = 0.0f;
+			rs[i] = -1.0f;
+		}
+	}
+
+	for (int i = z * CLUSTERS_X * CLUSTERS_Y; i < (z + 1) * CLUSTERS_X * CLUSTERS_Y; ++i)
+	{
+		uint32 offset = (uint32)result.size();
+		const Vector3f& min = cluster_min[i];
+		const Vector3f& max = cluster_max[i];
+		Vector3f center = (min + max) * 0.5f;
+		float cluster_radius = (max - center).length();
+
+		for (int j = 0; j < padded; j += 4)
+		{
+			//sphere vs box: squared distance from the light to the closest point of the box, for 4 lights at once
+			int mask;
+#ifdef MATH_USE_SSE
+			__m128 zero = _mm_setzero_ps();
+			__m128 x = _mm_loadu_ps(xs + j);
+			__m128 y = _mm_loadu_ps(ys + j);
+			__m128 zz = _mm_loadu_ps(zs + j);
+			__m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(min.x), x), zero), _mm_max_ps(_mm_sub_ps(x, _mm_set1_ps(max.x)), zero));
+			__m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(min.y), y), zero), _mm_max_ps(_mm_sub_ps(y, _mm_set1_ps(max.y)), zero));
+			__m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(min.z), zz), zero), _mm_max_ps(_mm_sub_ps(zz, _mm_set1_ps(max.z)), zero));
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			mask = _mm_movemask_ps(_mm_cmple_ps(dist, _mm_loadu_ps(rs + j)));
+#elif defined(MATH_USE_NEON)
+			float32x4_t zero = vdupq_n_f32(0.0f);
+			float32x4_t x = vld1q_f32(xs + j);
+			float32x4_t y = vld1q_f32(ys + j);
+			float32x4_t zz = vld1q_f32(zs + j);
+			float32x4_t dx = vaddq_f32(vmaxq_f32(vsubq_f32(vdupq_n_f32(min.x), x), zero), vmaxq_f32(vsubq_f32(x, vdupq_n_f32(max.x)), zero));
+			float32x4_t dy = vaddq_f32(vmaxq_f32(vsubq_f32(vdupq_n_f32(min.y), y), zero), vmaxq_f32(vsubq_f32(y, vdupq_n_f32(max.y)), zero));
+			float32x4_t dz = vaddq_f32(vmaxq_f32(vsubq_f32(vdupq_n_f32(min.z), zz), zero), vmaxq_f32(vsubq_f32(zz, vdupq_n_f32(max.z)), zero));
+			float32x4_t dist = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+			uint32x4_t pass = vcleq_f32(dist, vld1q_f32(rs + j));
+			mask = (vgetq_lane_u32(pass, 0) & 1) | (vgetq_lane_u32(pass, 1) & 2) | (vgetq_lane_u32(pass, 2) & 4) | (vgetq_lane_u32(pass, 3) & 8);
+#else
+			mask = 0;
+			for (int k = 0; k < 4; ++k)
+			{
+				float dx = std::max(min.x - xs[j + k], 0.0f) + std::max(xs[j + k] - max.x, 0.0f);
+				float dy = std::max(min.y - ys[j + k], 0.0f) + std::max(ys[j + k] - max.y, 0.0f);
+				float dz = std::max(min.z - zs[j + k], 0.0f) + std::max(zs[j + k] - max.z, 0.0f);
+				if (dx * dx + dy * dy + dz * dz <= rs[j + k])
+					mask |= 1 << k;
+			}
+#endif
+			if (!mask)
+				continue;
+			for (int k = 0; k < 4; ++k)
+			{
+				if (!(mask & (1 << k)))
+					continue;
+				int index = candidates[j + k];
+				const sViewLight& light = view_lights[index];
+				//spots: bounding sphere of the froxel against the cone
+				if (light.is_spot)
+				{
+					Vector3f v = center - light.position;
+					float v_len_sq = v.dot(v);
+					float v1_len = v.dot(light.direction);
+					float distance_closest = light.cos_cone * sqrt(std::max(v_len_sq - v1_len * v1_len, 0.0f)) - v1_len * light.sin_cone;
+					if (distance_closest > cluster_radius || v1_len > cluster_radius + light.radius || v1_len < -cluster_radius)
+						continue;
+				}
+				result.push_back((uint16)(num_directional + index));
+			}
+		}
+		clusters[i * 2] = offset;
+		clusters[i * 2 + 1] = (uint32)result.size() - offset;
+	}
+}
+
+void LightClusters::upload()
+{
+	PROFILE_FUNCTION();
+	if (!lights_buffer)
+	{
+		lights_buffer = new GFX::BufferObject();
+		clusters_buffer = new GFX::BufferObject();
+		indices_buffer = new GFX::BufferObject();
+		lights_buffer->type = clusters_buffer->type = indices_buffer->type = GL_TEXTURE_BUFFER;
+	}
+	int viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	viewport_size.set((float)viewport[2], (float)viewport[3]);
+
+	ClusterLight empty = {};
+	lights_buffer->updateFromPointer(lights.size() ? &lights[0] : &empty, (int)(std::max(lights.size(), (size_t)1) * sizeof(ClusterLight)));
+	clusters_buffer->updateFromPointer(&clusters[0], (int)(clusters.size() * sizeof(uint32)));
+	indices_buffer->updateFromPointer(&indices[0], (int)(indices.size() * sizeof(uint16)));
+}
+
+void LightClusters::bind(GFX::Shader* shader, int first_slot)
+{
+	if (!lights_buffer)
+		return;
+	lights_buffer->bindAsTexture(shader, "u_lights", first_slot, GL_RGBA32F);
+	clusters_buffer->bindAsTexture(shader, "u_clusters", first_slot + 1, GL_RG32UI);
+	indices_buffer->bindAsTexture(shader, "u_light_indices", first_slot + 2, GL_R16UI);
+	shader->setUniform("u_num_directional", num_directional);
+	shader->setUniform3("u_cluster_grid", CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+	shader->setUniform("u_cluster_slice", Vector2f(slice_scale, slice_bias));
+	shader->setUniform("u_viewport_size", viewport_size);
+	shader->setUniform("u_camera_front", camera_front);
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include "../core/math.h"
+
+//Clustered light assignment: the view frustum is split in a grid of froxels (tiles in screen, exponential slices in depth)
+//and every point/spot light is binned into the froxels it touches, so the shader only loops the lights near each pixel
+
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+#define CLUSTERS_NUM (CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z)
+#define CLUSTERS_MAX_LIGHTS 65535 //indices are stored as uint16
+
+class Camera;
+namespace GFX {
+	class Shader;
+	class BufferObject;
+}
+
+namespace SCN {
+
+	class LightEntity;
+
+	//what the shader reads for every light, 4 texels of the lights buffer
+	struct ClusterLight {
+		Vector4f position;	//xyz world position, w max distance
+		Vector4f color;		//rgb color * intensity, w light type
+		Vector4f direction;	//xyz front, w cos of the outer cone
+		Vector4f cone;		//x cos of the inner cone, y first shadow tile (-1 none), z number of tiles (cascades)
+	};
+
+	class LightClusters {
+	public:
+		float far_distance;	//slices stop here, lights further away go to the last slice
+
+		//results of the last build
+		std::vector<ClusterLight> lights;	//directional lights first, they affect every cluster
+		std::vector<uint32> clusters;		//offset and count in indices for every cluster
+		std::vector<uint16> indices;		//packed lights of every cluster
+		int num_directional;
+		int max_lights_in_cluster;
+
+		LightClusters();
+		~LightClusters();
+
+		//bins the lights, the tests run in the JobPool. shadow_tiles and shadow_num_tiles (optional) are the tiles in the ShadowAtlas of every light
+		void build(LightEntity* const* scene_lights, int num, Camera* camera, const int* shadow_tiles = NULL, const int* shadow_num_tiles = NULL);
+		void upload();	//copies the lists to the GPU buffers (once per frame)
+		void bind(GFX::Shader* shader, int first_slot);	//buffers as samplerBuffers and the uniforms to find the cluster of a pixel
+
+		static ClusterLight packLight(LightEntity* light, int shadow_tile = -1, int num_shadow_tiles = 1);
+
+	private:
+		//light data in view space, with depth positive, in SoA to test 4 lights at once
+		struct sViewLight {
+			Vector3f position;
+			float radius;
+			Vector3f direction;
+			float cos_cone;
+			float sin_cone;
+			bool is_spot;
+		};
+		std::vector<sViewLight> view_lights;
+		std::vector<int> slice_lights[CLUSTERS_Z];	//candidates of every depth slice
+		std::vector<uint16> slice_indices[CLUSTERS_Z];	//results of every slice before packing them
+		std::vector<float> soa[CLUSTERS_Z];	//x, y, z and radius squared of the candidates, 4 arrays per slice
+		Vector3f cluster_min[CLUSTERS_NUM];	//view space bounds (depth positive)
+		Vector3f cluster_max[CLUSTERS_NUM];
+		float slice_scale;	//slice = log(depth) * scale + bias
+		float slice_bias;
+		float near_distance;
+		Vector3f camera_front;	//the shader gets the depth of a pixel from it
+		Vector2f viewport_size;	//to find the tile of a pixel from gl_FragCoord
+
+		GFX::BufferObject* lights_buffer;
+		GFX::BufferObject* clusters_buffer;
+		GFX::BufferObject* indices_buffer;
+
+		void computeClusterBounds(Camera* camera, float far);
+		int getSlice(float depth) const;
+		void assignSlice(int z);
+	};
+
+};
@@ -0,0 +1,157 @@
+#include "crowd.h"
+
+#include <cassert>
+#include <cstring>
+#include "../core/task.h"
+#include "../core/profiler.h"
+#include "../gfx/shader.h"
+#include "../gfx/mesh.h"
+
+//agents per job, small enough to balance but big enough to amortize the scheduling
+#define CROWD_BATCH_SIZE 8
+
+AnimationCrowd::AnimationCrowd()
+{
+	palette_buffer = NULL;
+}
+
+AnimationCrowd::~AnimationCrowd()
+{
+	clear();
+}
+
+void AnimationCrowd::clear()
+{
+	for (CrowdAgent* agent : agents)
+		delete agent;
+	agents.clear();
+	for (auto it : bindings)
+		delete it.second;
+	bindings.clear();
+	palette.clear();
+	if (palette_buffer)
+		delete palette_buffer;
+	palette_buffer = NULL;
+}
+
+CrowdAgent* AnimationCrowd::addAgent(GFX::Mesh* mesh, Animation* anim, float time)
+{
+	assert(mesh && anim && mesh->bones_info.size());
+
+	//the bone names are resolved once per mesh and skeleton instead of every frame
+	SkinBinding* binding = NULL;
+	auto key = std::make_pair(mesh, (const Skeleton*)&anim->skeleton);
+	auto it = bindings.find(key);
+	if (it != bindings.end())
+		binding = it->second;
+	else
+	{
+		binding = new SkinBinding();
+		int num = (int)mesh->bones_info.size();
+		binding->bone_index.resize(num);
+		binding->offsets.resize(num);
+		for (int i = 0; i < num; ++i)
+		{
+			BoneInfo& bone_info = mesh->bones_info[i];
+			auto bone = anim->skeleton.bones_by_name.find(bone_info.name);
+			binding->bone_index[i] = bone == anim->skeleton.bones_by_name.end() ? 0 : bone->second;
+			binding->offsets[i] = mesh->bind_matrix * bone_info.bind_pose;
+		}
+		bindings[key] = binding;
+	}
+
+	CrowdAgent* agent = new CrowdAgent();
+	agent->mesh = mesh;
+	agent->anim_a = anim;
+	agent->anim_b = NULL;
+	agent->time_a = agent->time_b = time;
+	agent->blend = 0.0f;
+	agent->speed = 1.0f;
+	agent->material = NULL;
+	agent->pose = anim->skeleton;
+	getBindKeys(anim->skeleton, agent->keys_a);
+	agent->binding = binding;
+	agent->palette_offset = (int)palette.size();
+	palette.resize(palette.size() + binding->offsets.size());
+	agents.push_back(agent);
+	return agent;
+}
+
+void AnimationCrowd::getBindKeys(const Skeleton& skeleton, std::vector<BoneKey>& keys)
+{
+	keys.resize(skeleton.num_bones);
+	for (int i = 0; i < skeleton.num_bones; ++i)
+		keys[i].fromMatrix(skeleton.bones[i].model);
+}
+
+bool AnimationCrowd::sameBones(const Skeleton& a, const Skeleton& b)
+{
+	if (&a == &b)
+		return true;
+	if (a.num_bones != b.num_bones)
+		return false;
+	for (int i = 0; i < a.num_bones; ++i)
+		if (strcmp(a.bones[i].name, b.bones[i].name) != 0)
+			return false;
+	return true;
+}
+
+bool AnimationCrowd::setBlend(CrowdAgent* agent, Animation* anim_b, float blend)
+{
+	if (anim_b && !sameBones(agent->anim_a->skeleton, anim_b->skeleton))
+	{
+		assert(0 && "the blended animation must use the skeleton of the first one");
+		return false;
+	}
+	if (anim_b && anim_b != agent->anim_b)
+		getBindKeys(anim_b->skeleton, agent->keys_b);
+	agent->anim_b = anim_b;
+	agent->blend = anim_b ? blend : 0.0f;
+	return true;
+}
+
+void AnimationCrowd::updateAgent(CrowdAgent* agent, float dt, Matrix44* palette)
+{
+	agent->time_a += dt * agent->speed;
+	if (agent->anim_b && agent->blend > 0.0f)
+	{
+		//blended as keys, lerping the matrices would shear and shrink the rotations
+		agent->time_b += dt * agent->speed;
+		agent->anim_a->sampleKeys(agent->time_a, &agent->keys_a[0]);
+		agent->anim_b->sampleKeys(agent->time_b, &agent->keys_b[0]);
+		blendBoneKeys(&agent->keys_a[0], &agent->keys_b[0], agent->blend, &agent->pose);
+	}
+	else
+		agent->anim_a->samplePose(agent->time_a, agent->pose);
+	agent->pose.updateGlobalMatrices();
+
+	SkinBinding* binding = agent->binding;
+	Matrix44* out = palette + agent->palette_offset;
+	for (int i = 0; i < (int)binding->offsets.size(); ++i)
+		out[i] = binding->offsets[i] * agent->pose.global_bone_matrices[binding->bone_index[i]];
+}
+
+void AnimationCrowd::update(float dt)
+{
+	if (agents.empty())
+		return;
+	PROFILE_SCOPE("Crowd update");
+	Matrix44* output = &palette[0];
+	//every agent writes only its own range of the palette, no locks needed
+	JobPool::global.parallelFor((int)agents.size(), CROWD_BATCH_SIZE, [&](int start, int end) {
+		for (int i = start; i < end; ++i)
+			updateAgent(agents[i], dt, output);
+	});
+}
+
+void AnimationCrowd::uploadPalette()
+{
+	if (palette.empty())
+		return;
+	if (!palette_buffer)
+	{
+		palette_buffer = new GFX::BufferObject("u_bones_buffer");
+		palette_buffer->type = GL_SHADER_STORAGE_BUFFER;
+	}
+	palette_buffer->updateFromPointer(&palette[0], (int)(palette.size() * sizeof(Matrix44)));
+}
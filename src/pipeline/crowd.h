@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include "animation.h"
+
+namespace GFX {
+	class BufferObject;
+}
+namespace SCN {
+	class Material;
+}
+
+//maps the bones of a skinned mesh to the bones of a skeleton, shared by all the agents using the same mesh and skeleton
+struct SkinBinding {
+	std::vector<int> bone_index;		//skeleton bone for every mesh bone
+	std::vector<Matrix44> offsets;	//mesh->bind_matrix * bind_pose for every mesh bone
+};
+
+//one animated character of the crowd, it plays anim_a blended with anim_b
+struct CrowdAgent {
+	GFX::Mesh* mesh;
+	Animation* anim_a;
+	Animation* anim_b;	//can be NULL
+	float time_a;
+	float time_b;
+	float blend;	//0 means only anim_a
+	float speed;
+	Matrix44 model;	//where it is rendered
+	SCN::Material* material;
+	Skeleton pose;	//current pose
+	std::vector<BoneKey> keys_a;	//local keys of every bone sampled while blending, the bones without keys keep the bind pose
+	std::vector<BoneKey> keys_b;
+	SkinBinding* binding;
+	int palette_offset;	//index of the first matrix of this agent in the shared palette
+};
+
+//updates many skinned characters in parallel and stores all their bone matrices in one buffer
+class AnimationCrowd {
+public:
+	std::vector<CrowdAgent*> agents;
+	std::vector<Matrix44> palette;	//final bone matrices of all the agents, ready for skinning
+	GFX::BufferObject* palette_buffer;	//SSBO with the palette, read by skinned.vs
+	std::map<std::pair<GFX::Mesh*, const Skeleton*>, SkinBinding*> bindings;	//the bone indices depend on the skeleton of the animation
+
+	AnimationCrowd();
+	~AnimationCrowd();
+
+	CrowdAgent* addAgent(GFX::Mesh* mesh, Animation* anim, float time = 0.0f);
+	bool setBlend(CrowdAgent* agent, Animation* anim_b, float blend);	//false if anim_b has other bones than anim_a (the binding would not match)
+	void clear();
+
+	void update(float dt);	//samples, blends and computes the palette of every agent using the JobPool
+	void uploadPalette();	//copies the palette to palette_buffer
+
+	static void updateAgent(CrowdAgent* agent, float dt, Matrix44* palette);
+	static bool sameBones(const Skeleton& a, const Skeleton& b);	//same names in the same order
+	static void getBindKeys(const Skeleton& skeleton, std::vector<BoneKey>& keys);	//keys of the bind pose of every bone
+};
@@ -2,6 +2,7 @@
 
 #include "../core/ui.h"
 #include "../utils/utils.h"
+#include "../utils/jsonreader.h"
 
 SCN::LightEntity::LightEntity()
 {
@@ -16,7 +17,7 @@ SCN::LightEntity::LightEntity()
 	area = 1000;
 }
 
-void SCN::LightEntity::configure(cJSON* json)
+void SCN::LightEntity::configure(const JSONValue& json)
 {
 	color = readJSONVector3(json, "color", color );
 	intensity = readJSONNumber(json, "intensity", intensity);
@@ -61,4 +62,48 @@ void SCN::LightEntity::serialize(cJSON* json)
 		writeJSONString(json, "light_type", "DIRECTIONAL");
 }
 
+//payload of the lights in the binary scene
+struct sLightBinPayload
+{
+	uint32 light_type;
+	float intensity;
+	vec3 color;
+	float near_distance;
+	float max_distance;
+	uint32 cast_shadows;
+	float shadow_bias;
+	vec2 cone_info;
+	float area;
+};
+
+void SCN::LightEntity::writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer)
+{
+	sLightBinPayload info;
+	info.light_type = light_type;
+	info.intensity = intensity;
+	info.color = color;
+	info.near_distance = near_distance;
+	info.max_distance = max_distance;
+	info.cast_shadows = cast_shadows ? 1 : 0;
+	info.shadow_bias = shadow_bias;
+	info.cone_info = cone_info;
+	info.area = area;
+	SceneBinWriter::write(payload, &info, sizeof(info));
+}
 
+void SCN::LightEntity::readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader)
+{
+	if (size != sizeof(sLightBinPayload))
+		return;
+	sLightBinPayload info;
+	memcpy(&info, payload, sizeof(info));
+	light_type = (eLightType)info.light_type;
+	intensity = info.intensity;
+	color = info.color;
+	near_distance = info.near_distance;
+	max_distance = info.max_distance;
+	cast_shadows = info.cast_shadows != 0;
+	shadow_bias = info.shadow_bias;
+	cone_info = info.cone_info;
+	area = info.area;
+}
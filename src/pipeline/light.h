@@ -29,8 +29,13 @@ namespace SCN {
 
 		LightEntity();
 
-		void configure(cJSON* json);
+		//spot and directional lights point to -Z, like cameras
+		Vector3f getFront() const { return normalize(root.model.rotateVector(Vector3f(0, 0, -1))); }
+
+		void configure(const JSONValue& json);
 		void serialize(cJSON* json);
+		void writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer);
+		void readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader);
 	};
 
 };
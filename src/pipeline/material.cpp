@@ -7,7 +7,7 @@
 
 using namespace SCN;
 
-std::map<std::string, Material*> Material::sMaterials;
+CORE::Registry<Material> Material::sMaterials;
 uint32 Material::s_last_index = 0;
 Material Material::default_material;
 
@@ -17,42 +17,25 @@ const char* SCN::texture_channel_str[] = { "ALBEDO","EMISSIVE","OPACITY","METALL
 Material* Material::Get(const char* name)
 {
 	assert(name);
-	std::map<std::string, Material*>::iterator it = sMaterials.find(name);
-	if (it != sMaterials.end())
-		return it->second;
-	return NULL;
+	return sMaterials.find(name);
 }
 
 void Material::registerMaterial(const char* name)
 {
 	this->name = name;
-	sMaterials[name] = this;
+	handle = sMaterials.add(name, this);
 }
 
 Material::~Material()
 {
 	if (name.size())
-	{
-		auto it = sMaterials.find(name);
-		if (it != sMaterials.end())
-			sMaterials.erase(it);
-	}
+		sMaterials.remove(name, this);
 }
 
 void Material::Release()
 {
-	std::vector<Material *>mats;
-
-	for (auto mp : sMaterials)
-	{
-		Material *m = mp.second;
-		mats.push_back(m);
-	}
-
-	for (Material *m : mats)
-	{
+	for (Material* m : sMaterials.getItems())
 		delete m;
-	}
 	sMaterials.clear();
 }
 
@@ -101,5 +84,22 @@ void Material::bind(GFX::Shader* shader) {
 
 		// This is used to say which is the alpha threshold to what we should not paint a pixel on the screen (to cut polygons according to texture alpha)
 		shader->setUniform("u_alpha_cutoff", alpha_mode == SCN::eAlphaMode::MASK ? alpha_cutoff : 0.001f);
+
+		// The rest of channels only for the shaders that read them (the gbuffers)
+		if (shader->getUniformLocation("u_metallic_roughness_texture") != -1)
+		{
+			GFX::Texture* white = GFX::Texture::getWhiteTexture();
+			GFX::Texture* emissive = textures[SCN::eTextureChannel::EMISSIVE].texture;
+			GFX::Texture* metallic_roughness = textures[SCN::eTextureChannel::METALLIC_ROUGHNESS].texture;
+			GFX::Texture* occlusion = textures[SCN::eTextureChannel::OCCLUSION].texture;
+			GFX::Texture* normalmap = textures[SCN::eTextureChannel::NORMALMAP].texture;
+			shader->setUniform("u_emissive_texture", emissive ? emissive : white, 1);
+			shader->setUniform("u_metallic_roughness_texture", metallic_roughness ? metallic_roughness : white, 2);
+			shader->setUniform("u_occlusion_texture", occlusion ? occlusion : white, 3);
+			shader->setUniform("u_normal_texture", normalmap ? normalmap : white, 4);
+			shader->setUniform("u_has_normalmap", normalmap != NULL);
+			shader->setUniform("u_emissive_factor", emissive_factor);
+			shader->setUniform("u_metallic_roughness", Vector2f(metallic_factor, roughness_factor));
+		}
 	}
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../core/math.h"
+#include "../core/registry.h"
 #include <cassert>
 #include <map>
 #include <string>
@@ -45,13 +46,16 @@ namespace SCN {
 	public:
 
 		//static manager to reuse materials
-		static std::map<std::string, Material*> sMaterials;
+		static CORE::Registry<Material> sMaterials;
 		static Material* Get(const char* name);
 		static uint32 s_last_index;
 		static Material default_material;
 		std::string name;
 		uint32 index;
 		void registerMaterial(const char* name);
+		CORE::Handle handle; //in sMaterials, null if it was never registered
+		void retain() { sMaterials.retain(handle); }
+		void release() { sMaterials.release(handle); }
 
 		//parameters to control transparency
 		eAlphaMode alpha_mode;	//could be NO_ALPHA, MASK (alpha cut) or BLEND (alpha blend)
@@ -0,0 +1,331 @@
+#include "occlusion.h"
+
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+#include "../core/task.h"
+#include "../core/profiler.h"
+#include "../gfx/mesh.h"
+
+#ifdef MATH_USE_SSE
+	#include <immintrin.h>
+#elif defined(MATH_USE_NEON)
+	#include <arm_neon.h>
+#endif
+
+using namespace SCN;
+
+OcclusionCuller::OcclusionCuller()
+{
+	max_occluders = 32;
+	max_occluder_triangles = 4096;
+	num_occluders = 0;
+	num_triangles = 0;
+	num_tested = 0;
+	num_occluded = 0;
+	for (int i = 0; i < OCCLUSION_LEVELS; ++i)
+		levels[i].assign((OCCLUSION_WIDTH >> i) * (OCCLUSION_HEIGHT >> i), 1.0f);
+}
+
+void OcclusionCuller::begin(const Matrix44& viewprojection)
+{
+	this->viewprojection = viewprojection;
+	occluders.clear();
+	num_occluders = 0;
+	num_triangles = 0;
+	num_tested = 0;
+	num_occluded = 0;
+}
+
+void OcclusionCuller::addOccluder(const Matrix44& model, const Vector3f* triangles, int num_triangles)
+{
+	sOccluder occluder;
+	occluder.mvp = model * viewprojection;
+	occluder.triangles = triangles;
+	occluder.num_triangles = num_triangles;
+	occluder.num_screen_triangles = 0;
+	occluder.first_screen_triangle = 0;
+	occluders.push_back(occluder);
+}
+
+bool OcclusionCuller::addOccluder(const Matrix44& model, GFX::Mesh* mesh)
+{
+	auto it = mesh_triangles.find(mesh);
+	if (it == mesh_triangles.end() || it->second.handle != mesh->handle)
+	{
+		//dont read the big ones, they could be occluders later if max_occluder_triangles grows
+		int num = (int)(mesh->getNumIndices() ? mesh->getNumIndices() : mesh->getNumVertices()) / 3;
+		if (num > max_occluder_triangles)
+			return false;
+		if (it == mesh_triangles.end())
+			it = mesh_triangles.emplace(mesh, sMeshTriangles()).first;
+		it->second.handle = mesh->handle;
+		it->second.triangles.clear();
+		mesh->getTriangles(it->second.triangles);
+	}
+	int num = (int)it->second.triangles.size() / 3;
+	if (!num || num > max_occluder_triangles)
+		return false;
+	addOccluder(model, it->second.triangles.data(), num);
+	return true;
+}
+
+void OcclusionCuller::rasterize()
+{
+	PROFILE_FUNCTION();
+
+	int total = 0;
+	for (sOccluder& occluder : occluders)
+	{
+		occluder.first_screen_triangle = total;
+		total += occluder.num_triangles * 2;
+	}
+	screen_triangles.resize(total);
+
+	JobPool::global.parallelFor((int)occluders.size(), 1, [&](int start, int end) {
+		for (int i = start; i < end; ++i)
+			setupTriangles(occluders[i]);
+	});
+
+	num_occluders = (int)occluders.size();
+	num_triangles = 0;
+	for (const sOccluder& occluder : occluders)
+		num_triangles += occluder.num_screen_triangles;
+
+	//every band only writes its own rows, the result doesnt depend on the order of the jobs
+	std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+	JobPool::global.parallelFor(OCCLUSION_HEIGHT / OCCLUSION_BAND, 1, [&](int start, int end) {
+		for (int i = start; i < end; ++i)
+			rasterizeBand(i);
+	});
+
+	buildLevels();
+}
+
+//clip space, clipped by the near plane, to pixels
+void OcclusionCuller::setupTriangles(sOccluder& occluder)
+{
+	sScreenTriangle* output = &screen_triangles[occluder.first_screen_triangle];
+	int num_output = 0;
+
+	for (int i = 0; i < occluder.num_triangles; ++i)
+	{
+		const Vector3f* v = occluder.triangles + i * 3;
+		Vector4f clip[3];
+		for (int j = 0; j < 3; ++j)
+			clip[j] = occluder.mvp * Vector4f(v[j].x, v[j].y, v[j].z, 1.0f);
+
+		//the three vertices out of the same plane
+		if ((clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) ||
+			(clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) ||
+			(clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) ||
+			(clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w) ||
+			(clip[0].z > clip[0].w && clip[1].z > clip[1].w && clip[2].z > clip[2].w))
+			continue;
+
+		//near plane (z >= -w), a triangle becomes a quad at most
+		Vector4f polygon[4];
+		int num = 0;
+		for (int j = 0; j < 3; ++j)
+		{
+			const Vector4f& a = clip[j];
+			const Vector4f& b = clip[(j + 1) % 3];
+			float da = a.z + a.w;
+			float db = b.z + b.w;
+			if (da >= 0.0f)
+				polygon[num++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				polygon[num++] = lerp(a, b, da / (da - db));
+		}
+		if (num < 3)
+			continue;
+
+		Vector3f screen[4];
+		for (int j = 0; j < num; ++j)
+		{
+			float inv_w = 1.0f / polygon[j].w;
+			screen[j].set((polygon[j].x * inv_w * 0.5f + 0.5f) * OCCLUSION_WIDTH, (polygon[j].y * inv_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT, polygon[j].z * inv_w);
+		}
+
+		for (int j = 2; j < num; ++j)
+		{
+			sScreenTriangle& triangle = output[num_output];
+			triangle.v[0] = screen[0];
+			triangle.v[1] = screen[j - 1];
+			triangle.v[2] = screen[j];
+			//rows whose pixel centers are inside
+			float min_y = std::min(triangle.v[0].y, std::min(triangle.v[1].y, triangle.v[2].y));
+			float max_y = std::max(triangle.v[0].y, std::max(triangle.v[1].y, triangle.v[2].y));
+			triangle.min_y = std::max(0, (int)std::ceil(min_y - 0.5f));
+			triangle.max_y = std::min(OCCLUSION_HEIGHT - 1, (int)std::floor(max_y - 0.5f));
+			if (triangle.min_y <= triangle.max_y)
+				num_output++;
+		}
+	}
+	occluder.num_screen_triangles = num_output;
+}
+
+//nearest depth of the triangles in the rows of the band, 4 pixels at once
+void OcclusionCuller::rasterizeBand(int band)
+{
+	int band_min_y = band * OCCLUSION_BAND;
+	int band_max_y = band_min_y + OCCLUSION_BAND - 1;
+	float* depth = levels[0].data();
+
+	for (const sOccluder& occluder : occluders)
+		for (int i = 0; i < occluder.num_screen_triangles; ++i)
+		{
+			const sScreenTriangle& triangle = screen_triangles[occluder.first_screen_triangle + i];
+			if (triangle.max_y < band_min_y || triangle.min_y > band_max_y)
+				continue;
+
+			//both faces are rasterized, the occluders dont need to be closed
+			Vector3f a = triangle.v[0];
+			Vector3f b = triangle.v[1];
+			Vector3f c = triangle.v[2];
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (std::fabs(area) < 1e-6f)
+				continue;
+			if (area < 0.0f)
+			{
+				std::swap(b, c);
+				area = -area;
+			}
+
+			int min_x = std::max(0, (int)std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f));
+			int max_x = std::min(OCCLUSION_WIDTH - 1, (int)std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f));
+			if (min_x > max_x)
+				continue;
+			min_x &= ~3;
+
+			//edge functions (positive inside) and depth plane: value = dx * x + dy * y + k
+			float edge_dx[3] = { b.y - c.y, c.y - a.y, a.y - b.y };
+			float edge_dy[3] = { c.x - b.x, a.x - c.x, b.x - a.x };
+			float edge_k[3] = { -(edge_dx[0] * b.x + edge_dy[0] * b.y), -(edge_dx[1] * c.x + edge_dy[1] * c.y), -(edge_dx[2] * a.x + edge_dy[2] * a.y) };
+			float inv_area = 1.0f / area;
+			float z_dx = (edge_dx[0] * a.z + edge_dx[1] * b.z + edge_dx[2] * c.z) * inv_area;
+			float z_dy = (edge_dy[0] * a.z + edge_dy[1] * b.z + edge_dy[2] * c.z) * inv_area;
+			float z_k = (edge_k[0] * a.z + edge_k[1] * b.z + edge_k[2] * c.z) * inv_area;
+
+			int min_y = std::max(triangle.min_y, band_min_y);
+			int max_y = std::min(triangle.max_y, band_max_y);
+			for (int y = min_y; y <= max_y; ++y)
+			{
+				float py = y + 0.5f;
+				float row_e0 = edge_dy[0] * py + edge_k[0];
+				float row_e1 = edge_dy[1] * py + edge_k[1];
+				float row_e2 = edge_dy[2] * py + edge_k[2];
+				float row_z = z_dy * py + z_k;
+				float* row = depth + y * OCCLUSION_WIDTH;
+
+				for (int x = min_x; x <= max_x; x += 4)
+				{
+#ifdef MATH_USE_SSE
+					__m128 zero = _mm_setzero_ps();
+					__m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+					__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge_dx[0]), px), _mm_set1_ps(row_e0));
+					__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge_dx[1]), px), _mm_set1_ps(row_e1));
+					__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge_dx[2]), px), _mm_set1_ps(row_e2));
+					__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(z_dx), px), _mm_set1_ps(row_z));
+					__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+					__m128 old = _mm_loadu_ps(row + x);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, z)), _mm_andnot_ps(inside, old)));
+#elif defined(MATH_USE_NEON)
+					float32x4_t zero = vdupq_n_f32(0.0f);
+					const float offsets[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+					float32x4_t px = vaddq_f32(vdupq_n_f32((float)x), vld1q_f32(offsets));
+					float32x4_t e0 = vaddq_f32(vmulq_f32(vdupq_n_f32(edge_dx[0]), px), vdupq_n_f32(row_e0));
+					float32x4_t e1 = vaddq_f32(vmulq_f32(vdupq_n_f32(edge_dx[1]), px), vdupq_n_f32(row_e1));
+					float32x4_t e2 = vaddq_f32(vmulq_f32(vdupq_n_f32(edge_dx[2]), px), vdupq_n_f32(row_e2));
+					float32x4_t z = vaddq_f32(vmulq_f32(vdupq_n_f32(z_dx), px), vdupq_n_f32(row_z));
+					uint32x4_t inside = vandq_u32(vandq_u32(vcgeq_f32(e0, zero), vcgeq_f32(e1, zero)), vcgeq_f32(e2, zero));
+					float32x4_t old = vld1q_f32(row + x);
+					vst1q_f32(row + x, vbslq_f32(inside, vminq_f32(old, z), old));
+#else
+					for (int k = 0; k < 4; ++k)
+					{
+						float px = x + k + 0.5f;
+						if (edge_dx[0] * px + row_e0 >= 0.0f && edge_dx[1] * px + row_e1 >= 0.0f && edge_dx[2] * px + row_e2 >= 0.0f)
+							row[x + k] = std::min(row[x + k], z_dx * px + row_z);
+					}
+#endif
+				}
+			}
+		}
+}
+
+void OcclusionCuller::buildLevels()
+{
+	for (int i = 1; i < OCCLUSION_LEVELS; ++i)
+	{
+		int width = OCCLUSION_WIDTH >> i;
+		int height = OCCLUSION_HEIGHT >> i;
+		const float* src = levels[i - 1].data();
+		float* dst = levels[i].data();
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x)
+			{
+				const float* texel = src + y * 2 * width * 2 + x * 2;
+				dst[y * width + x] = std::max(std::max(texel[0], texel[1]), std::max(texel[width * 2], texel[width * 2 + 1]));
+			}
+	}
+}
+
+bool OcclusionCuller::isVisible(const BoundingBox& box) const
+{
+	//rect and nearest depth of the box on screen
+	float min_x = 1.0f, min_y = 1.0f, min_z = 1.0f;
+	float max_x = -1.0f, max_y = -1.0f;
+	for (int i = 0; i < 8; ++i)
+	{
+		Vector3f corner = box.center + box.halfsize * Vector3f(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+		Vector4f clip = viewprojection * Vector4f(corner.x, corner.y, corner.z, 1.0f);
+		if (clip.w <= 0.0f || clip.z < -clip.w)
+			return true; //crosses the near plane
+		float inv_w = 1.0f / clip.w;
+		float x = clip.x * inv_w;
+		float y = clip.y * inv_w;
+		min_x = std::min(min_x, x);
+		max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y);
+		max_y = std::max(max_y, y);
+		min_z = std::min(min_z, clip.z * inv_w);
+	}
+	if (max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f)
+		return true; //the frustum culling decides
+
+	int x0 = std::min(std::max((int)std::floor((min_x * 0.5f + 0.5f) * OCCLUSION_WIDTH), 0), OCCLUSION_WIDTH - 1);
+	int x1 = std::min(std::max((int)std::floor((max_x * 0.5f + 0.5f) * OCCLUSION_WIDTH), 0), OCCLUSION_WIDTH - 1);
+	int y0 = std::min(std::max((int)std::floor((min_y * 0.5f + 0.5f) * OCCLUSION_HEIGHT), 0), OCCLUSION_HEIGHT - 1);
+	int y1 = std::min(std::max((int)std::floor((max_y * 0.5f + 0.5f) * OCCLUSION_HEIGHT), 0), OCCLUSION_HEIGHT - 1);
+
+	//the level where the rect covers 4x4 texels at most
+	int level = 0;
+	while (level < OCCLUSION_LEVELS - 1 && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3))
+		level++;
+
+	const float* depth = levels[level].data();
+	int width = OCCLUSION_WIDTH >> level;
+	for (int y = y0 >> level; y <= (y1 >> level); ++y)
+		for (int x = x0 >> level; x <= (x1 >> level); ++x)
+			if (depth[y * width + x] >= min_z)
+				return true;
+	return false;
+}
+
+void OcclusionCuller::testBoxes(const BoundingBox* boxes, int num, uint8* visible)
+{
+	PROFILE_FUNCTION();
+	std::atomic<int> occluded(0);
+	JobPool::global.parallelFor(num, 64, [&](int start, int end) {
+		int count = 0;
+		for (int i = start; i < end; ++i)
+		{
+			visible[i] = isVisible(boxes[i]) ? 1 : 0;
+			count += 1 - visible[i];
+		}
+		occluded += count;
+	});
+	num_tested = num;
+	num_occluded = occluded;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include "../core/math.h"
+#include "../core/registry.h"
+
+//Software occlusion culling: the big opaque meshes in front of the camera are rasterized in the CPU into a small depth buffer
+//and the boxes of the renderables are tested against the max depth of its mips before sending them to the GPU
+
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_LEVELS 7	//256x128 to 4x2, every texel has the max depth of its 2x2 texels in the previous level
+#define OCCLUSION_BAND 8	//rows rasterized by every job
+
+namespace GFX {
+	class Mesh;
+}
+
+namespace SCN {
+
+	class OcclusionCuller {
+	public:
+		int max_occluders;	//the ones closer to the camera and bigger
+		int max_occluder_triangles;	//meshes with more triangles are never occluders
+
+		//stats of the last frame
+		int num_occluders;
+		int num_triangles;	//rasterized, after clipping
+		int num_tested;
+		int num_occluded;
+
+		OcclusionCuller();
+
+		void begin(const Matrix44& viewprojection);	//forgets the occluders of the last frame
+		void addOccluder(const Matrix44& model, const Vector3f* triangles, int num_triangles);	//object space, 3 vertices per triangle. They must live until rasterize
+		bool addOccluder(const Matrix44& model, GFX::Mesh* mesh);	//false if the mesh cannot be an occluder
+		void rasterize();	//in the JobPool, then builds the mips
+
+		bool isVisible(const BoundingBox& world_box) const;	//false if the box is behind the occluders, thread safe
+		void testBoxes(const BoundingBox* boxes, int num, uint8* visible);	//in the JobPool, updates the stats
+
+		const float* getDepth(int level = 0) const { return levels[level].data(); }	//NDC depth, 1 where there is nothing
+
+	private:
+		struct sOccluder {
+			Matrix44 mvp;
+			const Vector3f* triangles;
+			int num_triangles;
+			int num_screen_triangles;	//after clipping, stored from first_screen_triangle
+			int first_screen_triangle;
+		};
+
+		//in pixels, z is the NDC depth
+		struct sScreenTriangle {
+			Vector3f v[3];
+			int min_y, max_y;
+		};
+
+		Matrix44 viewprojection;
+		std::vector<sOccluder> occluders;
+		std::vector<sScreenTriangle> screen_triangles;	//two slots per triangle, clipping the near plane can split it
+		std::vector<float> levels[OCCLUSION_LEVELS];
+		struct sMeshTriangles {
+			CORE::Handle handle;	//of the mesh when it was read, a collected mesh could leave its address to another one
+			std::vector<Vector3f> triangles;	//empty if it is not an occluder
+		};
+		std::unordered_map<GFX::Mesh*, sMeshTriangles> mesh_triangles;	//meshes already read
+
+		void setupTriangles(sOccluder& occluder);
+		void rasterizeBand(int band);
+		void buildLevels();
+	};
+
+};
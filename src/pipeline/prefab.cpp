@@ -9,16 +9,20 @@
 
 #include "../utils/gltf_loader.h"
 #include "../utils/utils.h"
+#include "../core/profiler.h"
 #include "../core/math.h"
+#include "../core/pool.h"
+#include "../core/memory.h"
 
 #include <iostream>
+#include <algorithm>
 
 using namespace SCN;
 
 int Node::s_NodeID = 0;
 Node* Node::s_selected = nullptr;
 
-Node::Node() : parent(nullptr), mesh(nullptr), material(nullptr), visible(true)
+Node::Node() : parent(nullptr), mesh(nullptr), material(nullptr), lod(0), visible(true), block(nullptr), block_size(0), in_block(false)
 {
 	m_Id = s_NodeID++;
 }
@@ -41,13 +45,47 @@ Node::~Node()
 
 void Node::clear()
 {
-	//delete children
+	//delete children, the ones in a block are left to its owner (delete[] destroys them in reverse order,
+	//a node of the block cannot touch its children there, they could be already destroyed)
 	for (int i = 0; i < children.size(); ++i)
 	{
+		if (children[i]->in_block)
+			continue;
 		children[i]->parent = NULL;
 		delete children[i]; //triggers clear
 	}
 	children.resize(0);
+
+	//the nodes of the block are destroyed together
+	if (block)
+	{
+		for (int i = 0; i < block_size; ++i)
+			block[i].parent = NULL;
+		delete[] block;
+		block = nullptr;
+		block_size = 0;
+	}
+}
+
+static CORE::PoolAllocator* getNodePool()
+{
+	static CORE::PoolAllocator* pool = new CORE::PoolAllocator(sizeof(Node), 1024);
+	return pool;
+}
+
+void* Node::operator new(size_t size)
+{
+	if (size != sizeof(Node))
+		return ::operator new(size);
+	return getNodePool()->allocate();
+}
+
+void Node::operator delete(void* ptr, size_t size)
+{
+	if (size != sizeof(Node))
+		::operator delete(ptr);
+	else
+		getNodePool()->deallocate(ptr);
 }
 
 BoundingBox Node::getBoundingBox()
@@ -126,28 +164,86 @@ bool Node::testRay(const Ray& ray, Vector3f& result, int layers, float max_dist)
 	return collided;
 }
 
-void Node::operator = (const Node& node)
+int Node::countDescendants() const
 {
-	Node* old_parent = parent;
-	clear(); //remove any children
+	int num = (int)children.size();
+	for (int i = 0; i < children.size(); ++i)
+		num += children[i]->countDescendants();
+	return num;
+}
 
+void Node::copyFields(const Node& node)
+{
 	mesh = node.mesh;
 	material = node.material;
 	name = node.name;
 	visible = node.visible;
 	model = node.model;
 	aabb = node.aabb;
+}
 
-	//clone children
+//depth first, same order the tree is traversed when rendering
+void Node::cloneChildren(const Node& node, Node* nodes, int& index)
+{
+	children.reserve(node.children.size());
 	for (int i = 0; i < node.children.size(); ++i)
 	{
-		Node* child = node.children[i];
-		Node* new_child = new Node();
-		*new_child = *child;
+		Node* new_child = &nodes[index++];
+		new_child->copyFields(*node.children[i]);
+		new_child->in_block = true;
 		addChild(new_child);
+		new_child->cloneChildren(*node.children[i], nodes, index);
 	}
 }
 
+Node* Node::addChildCopy(const Node& node)
+{
+	//only one block per node
+	if (block)
+	{
+		Node* child = new Node();
+		*child = node;
+		addChild(child);
+		return child;
+	}
+
+	block_size = 1 + node.countDescendants();
+	block = new Node[block_size];
+	Node* child = &block[0];
+	child->copyFields(node);
+	child->in_block = true;
+	addChild(child);
+	int index = 1;
+	child->cloneChildren(node, block, index);
+	return child;
+}
+
+void Node::swapChildren(Node& node)
+{
+	std::swap(children, node.children);
+	std::swap(block, node.block);
+	std::swap(block_size, node.block_size);
+	for (Node* child : children)
+		child->parent = this;
+	for (Node* child : node.children)
+		child->parent = &node;
+}
+
+void Node::operator = (const Node& node)
+{
+	clear(); //remove any children
+	copyFields(node);
+
+	//clone children in a single block
+	int num = node.countDescendants();
+	if (!num)
+		return;
+	block_size = num;
+	block = new Node[num];
+	int index = 0;
+	cloneChildren(node, block, index);
+}
+
 Prefab::Prefab()
 {
 }
@@ -155,11 +251,15 @@ Prefab::Prefab()
 Prefab::~Prefab()
 {
 	if (name.size())
-	{
-		auto it = sPrefabsLoaded.find(name);
-		if (it != sPrefabsLoaded.end())
-			sPrefabsLoaded.erase(it);
-	}
+		sPrefabsLoaded.remove(name, this);
+
+	//they are destroyed in the next collect unless other prefabs use them
+	for (CORE::Handle h : mesh_handles)
+		GFX::Mesh::sMeshesLoaded.release(h);
+	for (CORE::Handle h : material_handles)
+		Material::sMaterials.release(h);
+	for (CORE::Handle h : texture_handles)
+		GFX::Texture::sTexturesLoaded.release(h);
 }
 
 void Prefab::updateBounding()
@@ -167,16 +267,28 @@ void Prefab::updateBounding()
 	bounding = root.getBoundingBox();
 }
 
-std::map<std::string, Prefab*> Prefab::sPrefabsLoaded;
+CORE::Registry<Prefab> Prefab::sPrefabsLoaded;
+
+//the meshes and textures are shared, they are reported by their own managers
+static bool prefab_memory_reporter = CORE::MemoryTracker::addReporter("prefabs", [](std::vector<CORE::MemoryEntry>& entries) {
+	for (auto& it : Prefab::sPrefabsLoaded.getNamedItems())
+	{
+		Prefab* prefab = it.second;
+		size_t cpu_bytes = sizeof(Prefab) + prefab->root.countDescendants() * sizeof(Node) + prefab->nodes_by_name.size() * (sizeof(std::string) + sizeof(Node*));
+		entries.push_back(CORE::MemoryEntry{ "prefabs", it.first, cpu_bytes, 0 });
+	}
+});
 
 Prefab* Prefab::Get(const char* filename)
 {
+	PROFILE_FUNCTION();
 	assert(filename);
-	std::map<std::string, Prefab*>::iterator it = sPrefabsLoaded.find(filename);
-	if (it != sPrefabsLoaded.end())
-		return it->second;
+	Prefab* prefab = sPrefabsLoaded.find(filename);
+	if (prefab)
+		return prefab;
+
+	MEMORY_SCOPE("prefabs");
 
-	Prefab* prefab = nullptr;
 	{
 		if (!prefab)
 			prefab = loadGLTF(filename);
@@ -189,13 +301,47 @@ Prefab* Prefab::Get(const char* filename)
 	std::string name = filename;
 	prefab->registerPrefab(name);
 	prefab->updateBounding();
+	prefab->retainResources();
 	return prefab;
 }
 
 void Prefab::registerPrefab(std::string name)
 {
 	this->name = name;
-	sPrefabsLoaded[name] = this;
+	handle = sPrefabsLoaded.add(name, this);
+}
+
+static void addHandle(std::vector<CORE::Handle>& handles, CORE::Handle handle)
+{
+	if (handle.isValid() && std::find(handles.begin(), handles.end(), handle) == handles.end())
+		handles.push_back(handle);
+}
+
+static void gatherHandles(const Node* node, std::vector<CORE::Handle>& meshes, std::vector<CORE::Handle>& materials, std::vector<CORE::Handle>& textures)
+{
+	if (node->mesh)
+		addHandle(meshes, node->mesh->handle);
+	if (node->material)
+	{
+		addHandle(materials, node->material->handle);
+		for (const Sampler& sampler : node->material->textures)
+			if (sampler.texture)
+				addHandle(textures, sampler.texture->handle);
+	}
+	for (const Node* child : node->children)
+		gatherHandles(child, meshes, materials, textures);
+}
+
+void Prefab::retainResources()
+{
+	//once per resource, the same mesh or material can be in many nodes
+	gatherHandles(&root, mesh_handles, material_handles, texture_handles);
+	for (CORE::Handle h : mesh_handles)
+		GFX::Mesh::sMeshesLoaded.retain(h);
+	for (CORE::Handle h : material_handles)
+		Material::sMaterials.retain(h);
+	for (CORE::Handle h : texture_handles)
+		GFX::Texture::sTexturesLoaded.retain(h);
 }
 
 Node* Prefab::getNodeByName(const char* name)
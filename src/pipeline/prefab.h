@@ -5,6 +5,7 @@
 #include <string>
 
 #include "../core/math.h"
+#include "../core/registry.h"
 #include "material.h"
 
 //forward declaration
@@ -37,6 +38,7 @@ namespace SCN {
 
 		GFX::Mesh* mesh;
 		Material* material;
+		int lod;	//level of detail of the mesh in the last frame, the next one depends on it (hysteresis)
 
 		Matrix44 model;	//the matrix that defines where is the object (in relation to its parent)
 		Matrix44 global_model;	//the matrix that defines where is the object (in relation to the world)
@@ -47,8 +49,15 @@ namespace SCN {
 		Node* parent;
 		std::vector<Node*> children;
 
+		//copied trees are stored in one contiguous block owned by the node that made the copy,
+		//nodes inside a block (in_block) are freed with it, never delete them
+		Node* block;
+		int block_size;
+		bool in_block;
+
 		//ctor
 		Node();
+		Node(const Node& node) = delete; //it would share the block, use the operator =
 
 		//dtor
 		virtual ~Node();
@@ -66,6 +75,9 @@ namespace SCN {
 			child->parent = this;
 		}
 		void removeChild(Node* child);
+		Node* addChildCopy(const Node& node); //copies the whole tree of node with a single allocation
+		void swapChildren(Node& node); //exchanges the trees (and their blocks) without copying them
+		int countDescendants() const;
 
 		//compute the global matrix taking into account its parent
 		Matrix44 getGlobalMatrix(bool fast = false) { 
@@ -80,6 +92,14 @@ namespace SCN {
 		Vector3f localToGlobal(Vector3f v) { return global_model * v; }
 
 		void operator = (const Node& node);
+
+		//the nodes created one by one come from a pool
+		static void* operator new(size_t size);
+		static void operator delete(void* ptr, size_t size);
+
+	private:
+		void copyFields(const Node& node);
+		void cloneChildren(const Node& node, Node* nodes, int& index);
 	};
 
 	//a Prefab represent a set of objects in a tree structure
@@ -105,9 +125,21 @@ namespace SCN {
 		Node* getNodeByName(const char* name);
 
 		//Manager to cache loaded prefabs
-		static std::map<std::string, Prefab*> sPrefabsLoaded;
+		static CORE::Registry<Prefab> sPrefabsLoaded;
 		static Prefab* Get(const char* filename);
 		void registerPrefab(std::string name);
+
+		//the users of the prefab retain it, once all of them release it is destroyed with its meshes, materials and textures
+		CORE::Handle handle;
+		void retain() { sPrefabsLoaded.retain(handle); }
+		void release() { sPrefabsLoaded.release(handle); }
+
+	private:
+		//resources of the nodes, retained while the prefab exists
+		std::vector<CORE::Handle> mesh_handles;
+		std::vector<CORE::Handle> material_handles;
+		std::vector<CORE::Handle> texture_handles;
+		void retainResources();
 	};
 
 };
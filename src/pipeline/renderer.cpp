@@ -1,6 +1,9 @@
 #include "renderer.h"
 
 #include <algorithm> //sort
+#include <functional> //greater
+#include <map>
+#include <cstring>
 
 #include "camera.h"
 #include "../gfx/gfx.h"
@@ -14,6 +17,8 @@
 #include "../utils/utils.h"
 #include "../extra/hdre.h"
 #include "../core/ui.h"
+#include "../core/profiler.h"
+#include "../core/task.h"
 
 #include "scene.h"
 
@@ -22,13 +27,152 @@ using namespace SCN;
 
 //some globals
 GFX::Mesh sphere;
+GFX::Mesh cone;	//spot light volumes
+GFX::Mesh cube;	//occlusion query boxes
+
+//core since GL 3.0
+static bool supportsConditionalRender()
+{
+	static int major = 0;
+	if (!major)
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+	return major >= 3;
+}
+
+//compute shaders and indirect draws are core since GL 4.3
+static bool supportsCompute()
+{
+	static int version = 0;
+	if (!version)
+	{
+		int major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		version = major * 10 + minor;
+	}
+	return version >= 43;
+}
+
+//not in the list of the atlas, a compute shader there would stop the whole atlas in older GL versions
+static GFX::Shader* getMeshletCullShader()
+{
+	static GFX::Shader* shader = nullptr;
+	static bool compiled = false;
+	if (!compiled && supportsCompute())
+	{
+		compiled = true;
+		std::string code;
+		if (GFX::Shader::GetShaderFile("meshlet_cull.cs", code))
+			shader = GFX::Shader::CompileShader(GFX::COMPUTE_SHADER, "meshlet_cull", code.c_str(), nullptr, nullptr);
+	}
+	return shader;
+}
+
+//glMultiDrawElementsIndirect is core since GL 4.3, gl_DrawID comes from ARB_shader_draw_parameters (core in 4.6)
+static bool supportsMultiDraw()
+{
+	static int supported = -1;
+	if (supported == -1)
+		supported = supportsCompute() && SDL_GL_ExtensionSupported("GL_ARB_shader_draw_parameters");
+	return supported == 1;
+}
+
+//a vertex and a fragment shader of the atlas, for the ones that need GL 4.3 and cannot be in its list
+static GFX::Shader* compileAtlasShader(const char* prefix, const char* vs_filename, const char* fs_filename)
+{
+	std::string vs_code, fs_code;
+	if (!GFX::Shader::GetShaderFile(vs_filename, vs_code) || !GFX::Shader::GetShaderFile(fs_filename, fs_code))
+		return nullptr;
+	std::string name = prefix + std::string(fs_filename, strlen(fs_filename) - 3);
+	return GFX::Shader::CompileShader(GFX::RASTER_SHADER, name.c_str(), vs_code.c_str(), fs_code.c_str(), nullptr);
+}
+
+//the fragment shaders of the atlas with the vertex shader of the multi draw, compiled the first time like the meshlet culling
+static GFX::Shader* getMultiDrawShader(const char* fs_filename)
+{
+	static std::map<std::string, GFX::Shader*> shaders;
+	auto it = shaders.find(fs_filename);
+	if (it != shaders.end())
+		return it->second;
+
+	GFX::Shader* shader = nullptr;
+	const char* vs_filename = strcmp(fs_filename, "empty.fs") == 0 ? "multidraw_position.vs" : "multidraw.vs";
+	if (supportsMultiDraw())
+		shader = compileAtlasShader("multidraw_", vs_filename, fs_filename);
+	shaders[fs_filename] = shader;
+	return shader;
+}
+
+//the fragment shaders of the atlas with skinned.vs, it reads the bones from a storage buffer
+static GFX::Shader* getSkinnedShader(const char* fs_filename)
+{
+	static std::map<std::string, GFX::Shader*> shaders;
+	auto it = shaders.find(fs_filename);
+	if (it != shaders.end())
+		return it->second;
+
+	GFX::Shader* shader = nullptr;
+	if (supportsCompute())
+		shader = compileAtlasShader("skinned_", "skinned.vs", fs_filename);
+	shaders[fs_filename] = shader;
+	return shader;
+}
 
 Renderer::Renderer(const char* shader_atlas_filename)
 {
 	render_wireframe = false;
 	render_boundaries = false;
+	pipeline_mode = FORWARD;
+	show_gbuffers = false;
+	gbuffers = NULL;
+	illumination_fbo = NULL;
+	use_clustered_lights = true;
+	show_light_heatmap = false;
+	use_shadows = true;
+	prepass_mode = PREPASS_AUTO;
+	prepass_overdraw_threshold = 1.5f;
+	overdraw_measure_frames = 120;
+	overdraw = 0.0f;
+	use_prepass = false;
+	num_opaque_renderables = 0;
+	overdraw_queries[0] = new GFX::GPUQuery(GL_SAMPLES_PASSED);
+	overdraw_queries[1] = new GFX::GPUQuery(GL_SAMPLES_PASSED);
+	measuring_overdraw = false;
+	frames_since_measure = 0;
+	measured_scene = nullptr;
+	use_occlusion_culling = true;
+	use_lods = true;
+	lod_max_error = 0.1f;
+	use_meshlets = true;
+	use_gpu_meshlet_culling = false;
+	num_meshlets_tested = 0;
+	num_meshlets_visible = 0;
+	meshlet_indices_buffer = new GFX::BufferObject("meshlet_indices");
+	meshlet_indices_buffer->type = GL_SHADER_STORAGE_BUFFER;
+	meshlet_commands_buffer = new GFX::BufferObject("meshlet_commands");
+	meshlet_commands_buffer->type = GL_SHADER_STORAGE_BUFFER;
+	use_multidraw = true;
+	num_multidraw_calls = 0;
+	num_multidraw_commands = 0;
+	multidraw_masked_batch = 0;
+	multidraw_blended_batch = 0;
+	pooled_scene = nullptr;
+	multidraw_commands_buffer = new GFX::BufferObject("multidraw_commands");
+	multidraw_commands_buffer->type = GL_DRAW_INDIRECT_BUFFER;
+	multidraw_models_buffer = new GFX::BufferObject("multidraw_models");
+	multidraw_models_buffer->type = GL_SHADER_STORAGE_BUFFER;
+	use_occlusion_queries = false;
+	use_conditional_render = true;
+	num_query_skipped = 0;
+	num_queries_issued = 0;
+	query_latency = 0.0f;
+	frame = 0;
 	scene = nullptr;
 	skybox_cubemap = nullptr;
+	skybox_scene = nullptr;
+	heap_check_scene = nullptr;
+	heap_check_entities = 0;
+	heap_check_frames = 0;
 
 	if (!GFX::Shader::LoadAtlas(shader_atlas_filename))
 		exit(1);
@@ -36,10 +180,18 @@ Renderer::Renderer(const char* shader_atlas_filename)
 
 	sphere.createSphere(1.0f);
 	sphere.uploadToVRAM();
+	cone.createCone(1.0f, 1.0f);
+	cone.uploadToVRAM();
+	cube.createCube();
 }
 
 void Renderer::setupScene()
 {
+	if (scene == skybox_scene && scene->skybox_filename == skybox_filename && scene->base_folder == skybox_folder)
+		return;
+	skybox_scene = scene;
+	skybox_folder = scene->base_folder;
+	skybox_filename = scene->skybox_filename;
 	if (scene->skybox_filename.size())
 		skybox_cubemap = GFX::Texture::Get(std::string(scene->base_folder + "/" + scene->skybox_filename).c_str());
 	else
@@ -47,9 +199,18 @@ void Renderer::setupScene()
 }
 
 void Renderer::parseSceneEntities(SCN::Scene* scene, Camera* cam) {
-	// HERE =====================
-	// TODO: GENERATE RENDERABLES
-	// ==========================
+	PROFILE_FUNCTION();
+
+	//the old lists belong to a previous frame arena, start new ones (sized like the last frame to avoid growing them)
+	size_t last_renderables = renderables.size();
+	size_t last_lights = lights.size();
+	size_t last_casters = shadow_casters.size();
+	renderables = CORE::FrameVector<Renderable>();
+	lights = CORE::FrameVector<LightEntity*>();
+	shadow_casters = CORE::FrameVector<Renderable>();
+	renderables.reserve(last_renderables + 64);
+	lights.reserve(last_lights + 8);
+	shadow_casters.reserve(last_casters + 64);
 
 	for (int i = 0; i < scene->entities.size(); i++) {
 		BaseEntity* entity = scene->entities[i];
@@ -58,23 +219,425 @@ void Renderer::parseSceneEntities(SCN::Scene* scene, Camera* cam) {
 			continue;
 		}
 
-		// Store Prefab Entitys
-		// ...
-		//		Store Children Prefab Entities
+		if (entity->getType() == eEntityType::PREFAB)
+			addRenderables(&entity->root, cam);
+		else if (entity->getType() == eEntityType::LIGHT)
+			lights.push_back((LightEntity*)entity);
+	}
 
-		// Store Lights
-		// ...
+	if (use_occlusion_culling)
+		cullOccludedRenderables(cam);
+
+	//opaque, masked (their discard can stop the early depth test, so the opaque depth goes first) and blended.
+	//front to back for the opaque ones (less overdraw), back to front for the blended ones
+	std::sort(renderables.begin(), renderables.end(), [](const Renderable& a, const Renderable& b) {
+		if (a.material->alpha_mode != b.material->alpha_mode)
+			return a.material->alpha_mode < b.material->alpha_mode;
+		if (a.material->alpha_mode == eAlphaMode::BLEND)
+			return a.distance > b.distance;
+		return a.distance < b.distance;
+	});
+	num_opaque_renderables = (int)(std::partition_point(renderables.begin(), renderables.end(), [](const Renderable& r) {
+		return r.material->alpha_mode == eAlphaMode::NO_ALPHA;
+	}) - renderables.begin());
+}
+
+void Renderer::addRenderables(SCN::Node* node, Camera* camera)
+{
+	if (!node->visible)
+		return;
+
+	if (node->mesh && node->material)
+	{
+		Renderable renderable;
+		renderable.model = node->getGlobalMatrix(true);
+		renderable.aabb = transformBoundingBox(renderable.model, node->mesh->box);
+		renderable.mesh = node->mesh;
+		renderable.material = node->material;
+		renderable.distance = 0.0f;
+		renderable.node = node;
+		renderable.lod = 0;
+		renderable.meshlet_draw = -1;
+		renderable.in_multidraw = false;
+		renderable.query_hidden = false;
+		if (use_shadows && node->material->alpha_mode != eAlphaMode::BLEND)
+			shadow_casters.push_back(renderable); //the lights see things the camera doesnt
+		if (camera->testBoxInFrustum(renderable.aabb.center, renderable.aabb.halfsize) != CLIP_OUTSIDE)
+		{
+			renderable.distance = camera->eye.distance(renderable.aabb.center);
+			if (use_lods && node->mesh->lods.size())
+			{
+				float projected_radius = camera->getProjectedScale(renderable.aabb.center, renderable.aabb.halfsize.length());
+				node->lod = node->mesh->selectLOD(projected_radius, lod_max_error, node->lod);
+				renderable.lod = node->lod;
+			}
+			renderables.push_back(renderable);
+		}
 	}
-	
+	else
+		node->getGlobalMatrix(true); //the children need it
+
+	for (int i = 0; i < node->children.size(); ++i)
+		addRenderables(node->children[i], camera);
+}
+
+void Renderer::cullOccludedRenderables(Camera* camera)
+{
+	PROFILE_FUNCTION();
+	occlusion_culler.begin(camera->viewprojection_matrix);
+
+	//occluders: the opaque renderables that look bigger from the camera
+	CORE::FrameVector<std::pair<float, int>> candidates;
+	for (int i = 0; i < renderables.size(); ++i)
+	{
+		const Renderable& renderable = renderables[i];
+		if (renderable.material->alpha_mode != eAlphaMode::NO_ALPHA)
+			continue;
+		float radius = renderable.aabb.halfsize.length();
+		candidates.push_back(std::make_pair(radius * radius / std::max(renderable.distance * renderable.distance, 0.01f), i));
+	}
+	int num_candidates = std::min((int)candidates.size(), occlusion_culler.max_occluders * 2); //some meshes can be too big
+	std::partial_sort(candidates.begin(), candidates.begin() + num_candidates, candidates.end(), std::greater<std::pair<float, int>>());
+	int num_occluders = 0;
+	for (int i = 0; i < num_candidates && num_occluders < occlusion_culler.max_occluders; ++i)
+	{
+		const Renderable& renderable = renderables[candidates[i].second];
+		if (occlusion_culler.addOccluder(renderable.model, renderable.mesh))
+			num_occluders++;
+	}
+	if (!num_occluders)
+		return;
+	occlusion_culler.rasterize();
+
+	occlusion_boxes.resize(renderables.size());
+	occlusion_visible.resize(renderables.size());
+	for (int i = 0; i < renderables.size(); ++i)
+		occlusion_boxes[i] = renderables[i].aabb;
+	occlusion_culler.testBoxes(occlusion_boxes.data(), (int)occlusion_boxes.size(), occlusion_visible.data());
+
+	int num_visible = 0;
+	for (int i = 0; i < renderables.size(); ++i)
+		if (occlusion_visible[i])
+			renderables[num_visible++] = renderables[i];
+	renderables.resize(num_visible);
+}
+
+void Renderer::cullMeshlets(Camera* camera)
+{
+	PROFILE_FUNCTION();
+	meshlet_draws.clear();
+	meshlet_counts.clear();
+	meshlet_offsets.clear();
+	num_meshlets_tested = 0;
+	num_meshlets_visible = 0;
+
+	GFX::Shader* shader = use_gpu_meshlet_culling ? getMeshletCullShader() : nullptr;
+	CORE::FrameVector<GFX::DrawElementsIndirectCommand> commands;
+	unsigned int num_indices = 0;
+
+	for (Renderable& renderable : renderables)
+	{
+		GFX::Mesh* mesh = renderable.mesh;
+		if (renderable.lod || mesh->meshlets.empty() || !mesh->indices_vbo_id)
+			continue;
+		int num = (int)mesh->meshlets.size();
+		num_meshlets_tested += num;
+		renderable.meshlet_draw = (int)meshlet_draws.size();
+		sMeshletDraw draw;
+
+		//GPU: one command per mesh, its indices go after the ones of the previous mesh
+		if (shader)
+		{
+			GFX::DrawElementsIndirectCommand command = { 0, 1, num_indices, 0, 0 };
+			draw.first = (int)commands.size();
+			draw.num_ranges = -1;
+			meshlet_draws.push_back(draw);
+			commands.push_back(command);
+			num_indices += mesh->getNumIndices();
+			continue;
+		}
+
+		Matrix44 model = renderable.model;
+		Vector3f scale = model.getScale();
+		float max_scale = std::max(scale.x, std::max(scale.y, scale.z));
+		//a mirrored model turns its triangles around
+		bool mirrored = Vector3f(model.m[0], model.m[1], model.m[2]).cross(Vector3f(model.m[4], model.m[5], model.m[6])).dot(Vector3f(model.m[8], model.m[9], model.m[10])) < 0.0f;
+		bool test_cone = !renderable.material->two_sided && !mirrored;
+		const GFX::Meshlet* meshlets = mesh->meshlets.data();
+		meshlet_visible.resize(num);
+		uint8* visible = meshlet_visible.data();
+		JobPool::global.parallelFor(num, 256, [&](int start, int end) {
+			for (int i = start; i < end; ++i)
+			{
+				const GFX::Meshlet& meshlet = meshlets[i];
+				Vector3f center = model * meshlet.center;
+				float radius = meshlet.radius * max_scale;
+				bool inside = camera->testSphereInFrustum(center, radius) != CLIP_OUTSIDE;
+				if (inside && test_cone && meshlet.cone_cutoff < 1.0f)
+					inside = GFX::isMeshletFrontFacing(meshlet, center, radius, model.rotateVector(meshlet.cone_axis).normalize(), camera->eye);
+				visible[i] = inside;
+			}
+		});
+
+		//consecutive visible meshlets are one range
+		draw.first = (int)meshlet_counts.size();
+		size_t range_end = 0;
+		for (int i = 0; i < num; ++i)
+		{
+			if (!visible[i])
+				continue;
+			const GFX::Meshlet& meshlet = meshlets[i];
+			num_meshlets_visible++;
+			if ((int)meshlet_counts.size() > draw.first && range_end == meshlet.first_index)
+				meshlet_counts.back() += meshlet.num_indices;
+			else
+			{
+				meshlet_counts.push_back(meshlet.num_indices);
+				meshlet_offsets.push_back((const void*)(meshlet.first_index * sizeof(unsigned int)));
+			}
+			range_end = meshlet.first_index + meshlet.num_indices;
+		}
+		draw.num_ranges = (int)meshlet_counts.size() - draw.first;
+		meshlet_draws.push_back(draw);
+	}
+
+	if (!shader || commands.empty())
+		return;
+
+	//one group per meshlet, every mesh adds its visible indices to the count of its command
+	GFX::startGPULabel("Meshlet culling");
+	meshlet_commands_buffer->updateFromPointer(commands.data(), (int)(commands.size() * sizeof(GFX::DrawElementsIndirectCommand)));
+	meshlet_indices_buffer->allocate((int)(num_indices * sizeof(unsigned int)));
+	shader->enable();
+	shader->setUniform4Array("u_frustum", &camera->frustum[0][0], 6);
+	shader->setUniform("u_camera_position", camera->eye);
+	meshlet_indices_buffer->bind(nullptr, 2);
+	meshlet_commands_buffer->bind(nullptr, 3);
+	for (const Renderable& renderable : renderables)
+	{
+		if (renderable.meshlet_draw == -1)
+			continue;
+		GFX::Mesh* mesh = renderable.mesh;
+		Matrix44 model = renderable.model;
+		Vector3f scale = model.getScale();
+		bool mirrored = Vector3f(model.m[0], model.m[1], model.m[2]).cross(Vector3f(model.m[4], model.m[5], model.m[6])).dot(Vector3f(model.m[8], model.m[9], model.m[10])) < 0.0f;
+		int num = (int)mesh->meshlets.size();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mesh->meshlets_vbo_id);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mesh->indices_vbo_id);
+		shader->setUniform("u_model", model);
+		shader->setUniform("u_max_scale", std::max(scale.x, std::max(scale.y, scale.z)));
+		shader->setUniform("u_two_sided", (int)(renderable.material->two_sided || mirrored));
+		shader->setUniform("u_num_meshlets", num);
+		shader->setUniform("u_command", meshlet_draws[renderable.meshlet_draw].first);
+		shader->computeDispatch(std::min(num, 65535), (num + 65534) / 65535, 1, false);
+	}
+	shader->disable();
+	glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	GFX::endGPULabel();
+}
+
+void Renderer::buildMultiDraw()
+{
+	PROFILE_FUNCTION();
+	multidraw_batches.clear();
+	multidraw_masked_batch = multidraw_blended_batch = 0;
+	num_multidraw_calls = 0;
+	num_multidraw_commands = 0;
+
+	//every pass needs its shader, otherwise the renderables are drawn one by one
+	if (!use_multidraw || !supportsMultiDraw())
+		return;
+	const char* fragment_shaders[] = { "empty.fs", "texture.fs", "clustered.fs", "gbuffers.fs" };
+	for (const char* fs_filename : fragment_shaders)
+		if (!getMultiDrawShader(fs_filename))
+			return;
+
+	//the meshes of other scenes are not needed anymore
+	if (scene != pooled_scene)
+	{
+		mesh_pool.clear();
+		pooled_scene = scene;
+	}
+
+	//one batch per material for the opaque and the masked ones (in the order of their closest renderable),
+	//the blended ones only join the batch of the previous renderable to keep them back to front
+	int num = (int)renderables.size();
+	CORE::FrameVector<int> renderable_batch(num, -1);
+	CORE::FrameVector<const GFX::MeshPool::sEntry*> renderable_entry(num, nullptr);
+	CORE::FrameVector<int> material_batch(Material::s_last_index, -1); //last batch of every material (by its index)
+	int first_batch = 0; //the masked ones dont join the batches of the opaque ones
+	int masked_batch = -1;
+	int blended_batch = -1;
+	int last_pooled = -1;
+	for (int i = 0; i < num; ++i)
+	{
+		Renderable& renderable = renderables[i];
+		eAlphaMode alpha_mode = renderable.material->alpha_mode;
+		if (alpha_mode == eAlphaMode::MASK && masked_batch == -1)
+		{
+			masked_batch = (int)multidraw_batches.size();
+			first_batch = masked_batch;
+		}
+		if (alpha_mode == eAlphaMode::BLEND && blended_batch == -1)
+			blended_batch = (int)multidraw_batches.size();
+
+		//hidden by its occlusion query (no pass draws it) or drawn from the indices compacted by the GPU
+		if (use_occlusion_queries && renderable.node)
+		{
+			auto it = occlusion_queries.find(renderable.node->m_Id);
+			if (it != occlusion_queries.end() && !it->second.visible && !it->second.query->waiting)
+			{
+				renderable.query_hidden = true;
+				num_query_skipped++;
+				continue;
+			}
+		}
+		if (renderable.meshlet_draw != -1 && meshlet_draws[renderable.meshlet_draw].num_ranges == -1)
+			continue;
+		const GFX::MeshPool::sEntry* entry = mesh_pool.add(renderable.mesh);
+		if (!entry)
+			continue;
+		renderable.in_multidraw = true;
+		int num_commands = renderable.meshlet_draw == -1 ? 1 : meshlet_draws[renderable.meshlet_draw].num_ranges;
+		if (!num_commands) //none of its meshlets is visible
+			continue;
+
+		int batch = -1;
+		if (alpha_mode == eAlphaMode::BLEND)
+		{
+			if (last_pooled == i - 1 && (int)multidraw_batches.size() > blended_batch && multidraw_batches.back().material == renderable.material)
+				batch = (int)multidraw_batches.size() - 1;
+		}
+		else
+		{
+			//a copied material has the same index
+			int last = material_batch[renderable.material->index];
+			if (last >= first_batch && multidraw_batches[last].material == renderable.material)
+				batch = last;
+		}
+		if (batch == -1)
+		{
+			batch = (int)multidraw_batches.size();
+			multidraw_batches.push_back({ renderable.material, 0, 0, 0, i });
+			if (alpha_mode != eAlphaMode::BLEND)
+				material_batch[renderable.material->index] = batch;
+		}
+		multidraw_batches[batch].count += num_commands;
+		renderable_batch[i] = batch;
+		renderable_entry[i] = entry;
+		last_pooled = i;
+	}
+	multidraw_blended_batch = blended_batch == -1 ? (int)multidraw_batches.size() : blended_batch;
+	multidraw_masked_batch = masked_batch == -1 ? multidraw_blended_batch : masked_batch;
+
+	//the commands of every batch are consecutive
+	CORE::FrameVector<int> batch_cursor(multidraw_batches.size());
+	for (size_t i = 0; i < multidraw_batches.size(); ++i)
+	{
+		multidraw_batches[i].first = num_multidraw_commands;
+		batch_cursor[i] = num_multidraw_commands;
+		num_multidraw_commands += multidraw_batches[i].count;
+	}
+	if (!num_multidraw_commands)
+		return;
+
+	CORE::FrameVector<GFX::DrawElementsIndirectCommand> commands(num_multidraw_commands);
+	CORE::FrameVector<Matrix44> models(num_multidraw_commands);
+	for (int i = 0; i < num; ++i)
+	{
+		int batch = renderable_batch[i];
+		if (batch == -1)
+			continue;
+		const Renderable& renderable = renderables[i];
+		const GFX::MeshPool::sEntry* entry = renderable_entry[i];
+		sMultiDrawBatch& draw_batch = multidraw_batches[batch];
+		if (renderable.meshlet_draw == -1)
+		{
+			const GFX::MeshPool::sRange& level = entry->levels[std::min(renderable.lod, (int)entry->levels.size() - 1)];
+			commands[batch_cursor[batch]] = { level.num_indices, 1, level.first_index, entry->base_vertex, 0 };
+			models[batch_cursor[batch]++] = renderable.model;
+			draw_batch.num_indices += level.num_indices;
+			continue;
+		}
+
+		//a command per range of visible meshlets, all with the same model
+		const sMeshletDraw& draw = meshlet_draws[renderable.meshlet_draw];
+		for (int j = draw.first; j < draw.first + draw.num_ranges; ++j)
+		{
+			unsigned int first_index = entry->levels[0].first_index + (unsigned int)((size_t)meshlet_offsets[j] / sizeof(unsigned int));
+			commands[batch_cursor[batch]] = { (unsigned int)meshlet_counts[j], 1, first_index, entry->base_vertex, 0 };
+			models[batch_cursor[batch]++] = renderable.model;
+			draw_batch.num_indices += meshlet_counts[j];
+		}
+	}
+
+	multidraw_commands_buffer->updateFromPointer(commands.data(), (int)(commands.size() * sizeof(GFX::DrawElementsIndirectCommand)));
+	multidraw_models_buffer->updateFromPointer(models.data(), (int)(models.size() * sizeof(Matrix44)));
 }
 
 void Renderer::renderScene(SCN::Scene* scene, Camera* camera)
 {
+#ifdef COUNT_HEAP_ALLOCATIONS
+	long heap_allocations = CORE::FrameArena::getHeapAllocations();
+#endif
 	this->scene = scene;
 	setupScene();
 
 	parseSceneEntities(scene, camera);
 
+	if (use_meshlets)
+		cullMeshlets(camera);
+
+	//only the tiles whose casters changed are rendered
+	if (use_shadows)
+	{
+		shadow_atlas.update(lights.data(), (int)lights.size(), shadow_casters.data(), (int)shadow_casters.size(), camera);
+		shadow_atlas.render();
+	}
+
+	if (use_clustered_lights)
+	{
+		light_clusters.build(lights.data(), (int)lights.size(), camera, use_shadows ? shadow_atlas.light_tiles.data() : NULL, use_shadows ? shadow_atlas.light_num_tiles.data() : NULL);
+		light_clusters.upload();
+	}
+
+	updatePrepassState();
+	updateOcclusionQueries();
+	buildMultiDraw(); //after the queries, the hidden ones are not in the commands
+
+	if (pipeline_mode == DEFERRED)
+		renderDeferred(camera);
+	else
+		renderForward(camera);
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+	checkHeapAllocations(camera, CORE::FrameArena::getHeapAllocations() - heap_allocations);
+#endif
+}
+
+//once the same view of the same scene has been rendered for a while (shaders compiled, meshes pooled, lists grown to their size)
+//rendering it again must not take memory from the heap, the temporary data goes to the frame arena
+void Renderer::checkHeapAllocations(Camera* camera, long allocations)
+{
+	bool same_view = scene == heap_check_scene && scene->entities.size() == heap_check_entities &&
+		memcmp(camera->viewprojection_matrix.m, heap_check_viewprojection.m, sizeof(heap_check_viewprojection.m)) == 0;
+#ifndef SKIP_IMGUI
+	same_view = same_view && !ImGui::IsAnyItemActive(); //the options of the renderer or the entities could be changing
+#endif
+	if (!same_view)
+	{
+		heap_check_scene = scene;
+		heap_check_entities = scene->entities.size();
+		heap_check_viewprojection = camera->viewprojection_matrix;
+		heap_check_frames = 0;
+		return;
+	}
+	if (++heap_check_frames > 60)
+		assert(allocations == 0 && "the renderer allocated memory from the heap in a frame without changes");
+}
+
+void Renderer::renderForward(Camera* camera)
+{
 	//set the clear color (the background color)
 	glClearColor(scene->background_color.x, scene->background_color.y, scene->background_color.z, 1.0);
 
@@ -83,12 +646,492 @@ void Renderer::renderScene(SCN::Scene* scene, Camera* camera)
 	GFX::checkGLErrors();
 
 	//render skybox
-	if(skybox_cubemap)
+	if (skybox_cubemap)
+	{
+		GFX::startGPULabel("Skybox");
 		renderSkybox(skybox_cubemap);
+		GFX::endGPULabel();
+	}
+
+	bool prepass = use_prepass && renderDepthPrepass(camera);
+
+	GFX::startGPULabel("Renderables");
+	renderNonBlended(prepass, false);
+	renderCrowd(false);
+	issueOcclusionQueries(camera);
+	renderBlended();
+	GFX::endGPULabel();
+}
+
+void Renderer::updateOcclusionQueries()
+{
+	frame++;
+	num_query_skipped = 0;
+	num_queries_issued = 0;
+	if (!use_occlusion_queries)
+	{
+		for (auto& it : occlusion_queries)
+			delete it.second.query;
+		occlusion_queries.clear();
+		return;
+	}
+
+	//only the results that are ready, it never waits for the GPU
+	long latency = 0;
+	int num_results = 0;
+	for (auto it = occlusion_queries.begin(); it != occlusion_queries.end();)
+	{
+		sOcclusionQuery& state = it->second;
+		if (frame - state.used_frame > 60)
+		{
+			delete state.query;
+			it = occlusion_queries.erase(it);
+			continue;
+		}
+		if (state.query->waiting && state.query->isReady())
+		{
+			state.visible = state.query->value != 0;
+			latency += frame - state.issued_frame;
+			num_results++;
+		}
+		++it;
+	}
+	if (num_results)
+		query_latency = (float)latency / num_results;
+}
+
+void Renderer::issueOcclusionQueries(Camera* camera)
+{
+	if (!use_occlusion_queries)
+		return;
+	GFX::Shader* shader = GFX::Shader::Get("flat");
+	if (!shader)
+		return;
+
+	GFX::startGPULabel("Occlusion queries");
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glDepthMask(false);
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE); //the winding of the box doesnt matter
+	glColorMask(false, false, false, false);
+	shader->enable();
+	shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
+	shader->setUniform("u_color", Vector4f(1.0f, 1.0f, 1.0f, 1.0f));
+
+	for (const Renderable& renderable : renderables)
+	{
+		if (!renderable.node)
+			continue;
+		sOcclusionQuery& state = occlusion_queries[renderable.node->m_Id];
+		if (!state.query)
+		{
+			state.query = new GFX::GPUQuery(GL_ANY_SAMPLES_PASSED);
+			state.visible = true;
+		}
+		state.used_frame = frame;
+		if (state.query->waiting)
+			continue;
+
+		//from inside the box its faces can be clipped by the near plane
+		const BoundingBox& box = renderable.aabb;
+		Vector3f delta = camera->eye - box.center;
+		float margin = camera->near_plane * 2.0f;
+		if (fabs(delta.x) < box.halfsize.x + margin && fabs(delta.y) < box.halfsize.y + margin && fabs(delta.z) < box.halfsize.z + margin)
+		{
+			state.visible = true;
+			continue;
+		}
+
+		Matrix44 model;
+		model.setTranslation(box.center.x, box.center.y, box.center.z);
+		model.scale(box.halfsize.x, box.halfsize.y, box.halfsize.z);
+		shader->setUniform("u_model", model);
+		state.query->start();
+		cube.render(GL_TRIANGLES);
+		state.query->finish();
+		state.issued_frame = frame;
+		num_queries_issued++;
+	}
 
-	// HERE =====================
-	// TODO: RENDER RENDERABLES
-	// ==========================
+	shader->disable();
+	glColorMask(true, true, true, true);
+	glDepthMask(true);
+	glDepthFunc(GL_LESS);
+	GFX::endGPULabel();
+}
+
+//the ones found hidden are skipped until a new query finds them visible (they can appear one frame late)
+void Renderer::renderRenderable(const Renderable& renderable, bool to_gbuffers)
+{
+	if (renderable.in_multidraw || renderable.query_hidden)
+		return;
+
+	bool conditional = false;
+	if (use_occlusion_queries && renderable.node)
+	{
+		auto it = occlusion_queries.find(renderable.node->m_Id);
+		if (it != occlusion_queries.end())
+		{
+			const sOcclusionQuery& state = it->second;
+			if (!state.visible && !state.query->waiting)
+			{
+				num_query_skipped++;
+				return;
+			}
+			//the GPU skips it if the query in flight is already done and found nothing
+			conditional = use_conditional_render && state.query->waiting && supportsConditionalRender();
+			if (conditional)
+				glBeginConditionalRender(state.query->handler, GL_QUERY_NO_WAIT);
+		}
+	}
+
+	if (to_gbuffers)
+		renderMeshToGBuffers(renderable.model, renderable.mesh, renderable.material, renderable.lod, renderable.meshlet_draw);
+	else
+		renderMeshWithMaterial(renderable.model, renderable.mesh, renderable.material, renderable.lod, renderable.meshlet_draw);
+
+	if (conditional)
+		glEndConditionalRender();
+}
+
+void Renderer::updatePrepassState()
+{
+	//results of the last measure, it never waits for the GPU
+	if (overdraw_queries[0]->waiting || overdraw_queries[1]->waiting)
+	{
+		bool ready = overdraw_queries[0]->isReady();
+		ready = overdraw_queries[1]->isReady() && ready;
+		if (ready)
+		{
+			//the prepass passes the depth test where the shading would run without it, the opaque pass only where it is visible
+			GLuint64 shaded = overdraw_queries[0]->value;
+			GLuint64 visible = overdraw_queries[1]->value;
+			overdraw = visible ? (float)((double)shaded / (double)visible) : 1.0f;
+		}
+	}
+
+	frames_since_measure++;
+	bool measure = false;
+	if (prepass_mode != PREPASS_OFF && !overdraw_queries[0]->waiting && !overdraw_queries[1]->waiting)
+		measure = scene != measured_scene || frames_since_measure >= overdraw_measure_frames || prepass_mode == PREPASS_ON;
+	if (measure)
+	{
+		measured_scene = scene;
+		frames_since_measure = 0;
+	}
+
+	//in auto the frames that measure use the prepass too
+	if (prepass_mode == PREPASS_AUTO)
+		use_prepass = measure || (measured_scene == scene && overdraw > prepass_overdraw_threshold);
+	else
+		use_prepass = prepass_mode == PREPASS_ON;
+	if (render_wireframe)
+		use_prepass = measure = false; //the lines behind the surfaces would be hidden
+	measuring_overdraw = measure;
+}
+
+//only the depth of the opaque renderables, with a position only shader
+bool Renderer::renderDepthPrepass(Camera* camera)
+{
+	GFX::Shader* shader = GFX::Shader::Get("prepass");
+	if (!shader)
+		return false;
+
+	GFX::startGPULabel("Depth prepass");
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(true);
+	glDisable(GL_BLEND);
+	glColorMask(false, false, false, false);
+	shader->enable();
+	shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
+
+	if (measuring_overdraw)
+		overdraw_queries[0]->start();
+	for (int i = 0; i < num_opaque_renderables; ++i)
+	{
+		const Renderable& renderable = renderables[i];
+		if (!renderable.mesh->getNumVertices() || renderable.in_multidraw || renderable.query_hidden)
+			continue;
+		if (renderable.material->two_sided)
+			glDisable(GL_CULL_FACE);
+		else
+			glEnable(GL_CULL_FACE);
+		shader->setUniform("u_model", renderable.model);
+		drawMesh(renderable.mesh, renderable.lod, renderable.meshlet_draw); //the same triangles than the main pass or the depth wont match
+	}
+	shader->disable();
+	renderMultiDraw(0, multidraw_masked_batch, true, false);
+	if (measuring_overdraw)
+		overdraw_queries[0]->finish();
+
+	glColorMask(true, true, true, true);
+	GFX::endGPULabel();
+	return true;
+}
+
+void Renderer::renderNonBlended(bool prepass, bool to_gbuffers)
+{
+	//with the depth of the prepass every pixel is shaded once, by the surface that is visible
+	if (prepass)
+	{
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(false);
+		if (measuring_overdraw)
+			overdraw_queries[1]->start();
+	}
+	renderMultiDraw(0, multidraw_masked_batch, false, to_gbuffers);
+	for (int i = 0; i < num_opaque_renderables; ++i)
+		renderRenderable(renderables[i], to_gbuffers);
+	if (prepass)
+	{
+		if (measuring_overdraw)
+			overdraw_queries[1]->finish();
+		glDepthFunc(GL_LESS);
+		glDepthMask(true);
+	}
+
+	//the masked ones write their depth, they are not in the prepass
+	renderMultiDraw(multidraw_masked_batch, multidraw_blended_batch, false, to_gbuffers);
+	for (int i = num_opaque_renderables; i < renderables.size(); ++i)
+	{
+		if (renderables[i].material->alpha_mode == eAlphaMode::BLEND)
+			break;
+		renderRenderable(renderables[i], to_gbuffers);
+	}
+}
+
+void Renderer::renderBlended()
+{
+	int batch = multidraw_blended_batch;
+	for (int i = num_opaque_renderables; i < renderables.size(); ++i)
+	{
+		if (renderables[i].material->alpha_mode != eAlphaMode::BLEND)
+			continue;
+		if (batch < (int)multidraw_batches.size() && multidraw_batches[batch].renderable == i)
+		{
+			renderMultiDraw(batch, batch + 1, false, false);
+			batch++;
+		}
+		renderRenderable(renderables[i], false);
+	}
+}
+
+void Renderer::renderDeferred(Camera* camera)
+{
+	int viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	int width = viewport[2];
+	int height = viewport[3];
+	if (!gbuffers || gbuffers->width != width || gbuffers->height != height)
+	{
+		delete gbuffers;
+		delete illumination_fbo;
+		gbuffers = new GFX::FBO();
+		gbuffers->create(width, height, 3, GL_RGBA, GL_UNSIGNED_BYTE, true, true);
+		illumination_fbo = new GFX::FBO();
+		illumination_fbo->create(width, height, 1, GL_RGBA, GL_HALF_FLOAT, true, true);
+	}
+
+	//opaque surfaces to the gbuffers
+	GFX::startGPULabel("GBuffers");
+	gbuffers->bind();
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	bool prepass = use_prepass && renderDepthPrepass(camera);
+	renderNonBlended(prepass, true);
+	renderCrowd(true);
+	issueOcclusionQueries(camera);
+	gbuffers->unbind();
+	GFX::endGPULabel();
+
+	//the illumination gets a copy of the depth to test the light volumes (the gbuffers depth is read in the shaders)
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffers->fbo_id);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, illumination_fbo->fbo_id);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	illumination_fbo->bind();
+	glClearColor(scene->background_color.x, scene->background_color.y, scene->background_color.z, 1.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	if (skybox_cubemap)
+	{
+		GFX::startGPULabel("Skybox");
+		renderSkybox(skybox_cubemap);
+		GFX::endGPULabel();
+	}
+
+	GFX::startGPULabel("Lights");
+	renderDeferredLights(camera);
+	GFX::endGPULabel();
+
+	//blended surfaces on top, forward
+	GFX::startGPULabel("Renderables");
+	renderBlended();
+	GFX::endGPULabel();
+	illumination_fbo->unbind();
+
+	//to the screen with its depth
+	GFX::Shader* shader = GFX::Shader::Get("deferred_resolve");
+	if (shader)
+	{
+		shader->enable();
+		shader->setUniform("u_texture", illumination_fbo->color_textures[0], 0);
+		shader->setUniform("u_depth_texture", illumination_fbo->depth_texture, 1);
+		shader->setUniform("u_iRes", Vector2f(1.0f / width, 1.0f / height));
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_ALWAYS);
+		glDisable(GL_BLEND);
+		glDisable(GL_CULL_FACE);
+		GFX::Mesh::getQuad()->render(GL_TRIANGLES);
+		glDepthFunc(GL_LESS);
+		shader->disable();
+	}
+
+	if (show_gbuffers)
+	{
+		GFX::Shader* depth_shader = GFX::Shader::getDefaultShader("linear_depth");
+		depth_shader->enable();
+		depth_shader->setUniform("u_camera_nearfar", Vector2f(camera->near_plane, camera->far_plane));
+		for (int i = 0; i < 4; ++i)
+		{
+			glViewport(viewport[0] + (i % 2) * width / 2, viewport[1] + (1 - i / 2) * height / 2, width / 2, height / 2);
+			GFX::Texture* texture = i < 3 ? gbuffers->color_textures[i] : gbuffers->depth_texture;
+			texture->toViewport(i < 3 ? NULL : depth_shader);
+		}
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+}
+
+//ambient and emissive in one quad, directional lights as quads and the rest as volumes: a light only shades the pixels inside it
+void Renderer::renderDeferredLights(Camera* camera)
+{
+	GFX::Shader* global_shader = GFX::Shader::Get("deferred_global");
+	GFX::Shader* quad_shader = GFX::Shader::Get("deferred_light_quad");
+	GFX::Shader* volume_shader = GFX::Shader::Get("deferred_light_volume");
+	GFX::Shader* stencil_shader = GFX::Shader::Get("flat");
+	if (!global_shader || !quad_shader || !volume_shader || !stencil_shader)
+		return;
+	GFX::Mesh* quad = GFX::Mesh::getQuad();
+	Vector2f iRes(1.0f / gbuffers->width, 1.0f / gbuffers->height);
+
+	auto bindGBuffers = [&](GFX::Shader* shader) {
+		shader->setUniform("u_gbuffer0", gbuffers->color_textures[0], 0);
+		shader->setUniform("u_gbuffer1", gbuffers->color_textures[1], 1);
+		shader->setUniform("u_gbuffer2", gbuffers->color_textures[2], 2);
+		shader->setUniform("u_depth_texture", gbuffers->depth_texture, 3);
+		shader->setUniform("u_inverse_viewprojection", camera->inverse_viewprojection_matrix);
+		shader->setUniform("u_camera_position", camera->eye);
+		shader->setUniform("u_iRes", iRes);
+	};
+	auto setLight = [&](GFX::Shader* shader, const ClusterLight& light) {
+		shader->setUniform("u_light_position", light.position);
+		shader->setUniform("u_light_color", light.color);
+		shader->setUniform("u_light_direction", light.direction);
+		shader->setUniform("u_light_cone", light.cone);
+	};
+
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(false);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_BLEND);
+
+	//overwrites the skybox where there is geometry
+	global_shader->enable();
+	bindGBuffers(global_shader);
+	global_shader->setUniform("u_ambient_light", scene->ambient_light);
+	quad->render(GL_TRIANGLES);
+	global_shader->disable();
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	quad_shader->enable();
+	bindGBuffers(quad_shader);
+	shadow_atlas.bind(quad_shader, 4);
+	for (int i = 0; i < (int)lights.size(); ++i)
+	{
+		LightEntity* light = lights[i];
+		if (light->light_type != eLightType::DIRECTIONAL)
+			continue;
+		bool shadowed = use_shadows && shadow_atlas.light_tiles[i] != -1;
+		setLight(quad_shader, LightClusters::packLight(light, shadowed ? shadow_atlas.light_tiles[i] : -1, shadowed ? shadow_atlas.light_num_tiles[i] : 1));
+		quad->render(GL_TRIANGLES);
+	}
+	quad_shader->disable();
+
+	//volumes: first the stencil marks the pixels whose geometry is inside the volume (back faces behind it, front faces in front),
+	//then the light pass shades them and clears the stencil, so the faces dont add twice and the next light starts from zero
+	glEnable(GL_STENCIL_TEST);
+	glEnable(GL_DEPTH_TEST);
+	for (int i = 0; i < (int)lights.size(); ++i)
+	{
+		LightEntity* light = lights[i];
+		if (light->light_type != eLightType::POINT && light->light_type != eLightType::SPOT)
+			continue;
+		Vector3f position = light->root.model.getTranslation();
+		float radius = light->max_distance * 1.05f; //the meshes are inside the true shape
+		if (camera->testSphereInFrustum(position, radius) == CLIP_OUTSIDE)
+			continue;
+
+		GFX::Mesh* volume = &sphere;
+		Matrix44 model;
+		if (light->light_type == eLightType::SPOT && light->cone_info.y < 60.0f)
+		{
+			//cone along the light front, as long as the max distance
+			Vector3f z = light->getFront() * -1.0f;
+			Vector3f up = fabs(z.y) < 0.99f ? Vector3f(0, 1, 0) : Vector3f(1, 0, 0);
+			Vector3f x = normalize(up.cross(z));
+			Vector3f y = z.cross(x);
+			float cone_radius = radius * tan(light->cone_info.y * DEG2RAD);
+			x = x * cone_radius;
+			y = y * cone_radius;
+			z = z * radius;
+			model.m[0] = x.x; model.m[1] = x.y; model.m[2] = x.z;
+			model.m[4] = y.x; model.m[5] = y.y; model.m[6] = y.z;
+			model.m[8] = z.x; model.m[9] = z.y; model.m[10] = z.z;
+			model.m[12] = position.x; model.m[13] = position.y; model.m[14] = position.z;
+			volume = &cone;
+		}
+		else
+		{
+			model.setTranslation(position.x, position.y, position.z);
+			model.scale(radius, radius, radius);
+		}
+
+		stencil_shader->enable();
+		stencil_shader->setUniform("u_model", model);
+		stencil_shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
+		glColorMask(false, false, false, false);
+		glDepthFunc(GL_LESS);
+		glStencilFunc(GL_ALWAYS, 0, 0xFF);
+		glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+		glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+		volume->render(GL_TRIANGLES);
+		stencil_shader->disable();
+
+		glColorMask(true, true, true, true);
+		glDisable(GL_DEPTH_TEST);
+		glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+		volume_shader->enable();
+		bindGBuffers(volume_shader);
+		shadow_atlas.bind(volume_shader, 4);
+		volume_shader->setUniform("u_model", model);
+		volume_shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
+		bool shadowed = use_shadows && shadow_atlas.light_tiles[i] != -1;
+		setLight(volume_shader, LightClusters::packLight(light, shadowed ? shadow_atlas.light_tiles[i] : -1, shadowed ? shadow_atlas.light_num_tiles[i] : 1));
+		volume->render(GL_TRIANGLES);
+		volume_shader->disable();
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	glDisable(GL_STENCIL_TEST);
+	glDisable(GL_BLEND);
+	glDepthFunc(GL_LESS);
+	glDepthMask(true);
+	glEnable(GL_DEPTH_TEST);
 }
 
 
@@ -133,7 +1176,7 @@ void Renderer::renderSkybox(GFX::Texture* cubemap)
 }
 
 // Renders a mesh given its transform and material
-void Renderer::renderMeshWithMaterial(const Matrix44 model, GFX::Mesh* mesh, SCN::Material* material)
+void Renderer::renderMeshWithMaterial(const Matrix44 model, GFX::Mesh* mesh, SCN::Material* material, int lod, int meshlet_draw)
 {
 	//in case there is nothing to do
 	if (!mesh || !mesh->getNumVertices() || !material )
@@ -146,8 +1189,12 @@ void Renderer::renderMeshWithMaterial(const Matrix44 model, GFX::Mesh* mesh, SCN
 
 	glEnable(GL_DEPTH_TEST);
 
-	//chose a shader
-	shader = GFX::Shader::Get("texture");
+	//chose a shader, the clustered one lights the scene
+	if (use_clustered_lights)
+		shader = GFX::Shader::Get("clustered");
+	bool clustered = shader != NULL;
+	if (!shader)
+		shader = GFX::Shader::Get("texture");
 
     assert(glGetError() == GL_NO_ERROR);
 
@@ -169,12 +1216,20 @@ void Renderer::renderMeshWithMaterial(const Matrix44 model, GFX::Mesh* mesh, SCN
 	float t = getTime();
 	shader->setUniform("u_time", t );
 
+	if (clustered)
+	{
+		light_clusters.bind(shader, 8); //after the material textures
+		shadow_atlas.bind(shader, 11);
+		shader->setUniform("u_ambient_light", scene->ambient_light);
+		shader->setUniform("u_light_heatmap", show_light_heatmap);
+	}
+
 	// Render just the verticies as a wireframe
 	if (render_wireframe)
 		glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 
 	//do the draw call that renders the mesh into the screen
-	mesh->render(GL_TRIANGLES);
+	drawMesh(mesh, lod, meshlet_draw);
 
 	//disable shader
 	shader->disable();
@@ -184,6 +1239,195 @@ void Renderer::renderMeshWithMaterial(const Matrix44 model, GFX::Mesh* mesh, SCN
 	glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
 }
 
+//only the surface properties, the lights are added later
+void Renderer::renderMeshToGBuffers(const Matrix44 model, GFX::Mesh* mesh, SCN::Material* material, int lod, int meshlet_draw)
+{
+	if (!mesh || !mesh->getNumVertices() || !material)
+		return;
+
+	GFX::Shader* shader = GFX::Shader::Get("gbuffers");
+	if (!shader)
+		return;
+	Camera* camera = Camera::current;
+
+	glEnable(GL_DEPTH_TEST);
+	shader->enable();
+	material->bind(shader);
+	glDisable(GL_BLEND); //the gbuffers cant be blended
+	shader->setUniform("u_model", model);
+	shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
+
+	if (render_wireframe)
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	drawMesh(mesh, lod, meshlet_draw);
+	shader->disable();
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+void Renderer::drawMesh(GFX::Mesh* mesh, int lod, int meshlet_draw)
+{
+	if (meshlet_draw == -1)
+	{
+		mesh->render(GL_TRIANGLES, -1, 0, lod);
+		return;
+	}
+	const sMeshletDraw& draw = meshlet_draws[meshlet_draw];
+	if (draw.num_ranges == -1)
+		mesh->renderIndirect(GL_TRIANGLES, meshlet_indices_buffer->id, meshlet_commands_buffer->id, draw.first * sizeof(GFX::DrawElementsIndirectCommand));
+	else if (draw.num_ranges) //nothing visible
+		mesh->renderRanges(GL_TRIANGLES, &meshlet_counts[draw.first], &meshlet_offsets[draw.first], draw.num_ranges);
+}
+
+//the shader state of renderMeshWithMaterial, renderMeshToGBuffers or the prepass once, then a multi draw per batch
+void Renderer::renderMultiDraw(int first_batch, int last_batch, bool prepass, bool to_gbuffers)
+{
+	if (first_batch >= last_batch)
+		return;
+
+	Camera* camera = Camera::current;
+	bool clustered = !prepass && !to_gbuffers && use_clustered_lights;
+	GFX::Shader* shader = getMultiDrawShader(prepass ? "empty.fs" : (to_gbuffers ? "gbuffers.fs" : (clustered ? "clustered.fs" : "texture.fs")));
+	if (!shader)
+		return;
+
+	glEnable(GL_DEPTH_TEST);
+	shader->enable();
+	shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
+	if (!prepass && !to_gbuffers)
+	{
+		shader->setUniform("u_camera_position", camera->eye);
+		shader->setUniform("u_time", (float)getTime());
+	}
+	if (clustered)
+	{
+		light_clusters.bind(shader, 8); //after the material textures
+		shadow_atlas.bind(shader, 11);
+		shader->setUniform("u_ambient_light", scene->ambient_light);
+		shader->setUniform("u_light_heatmap", show_light_heatmap);
+	}
+	if (render_wireframe && !prepass)
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+	multidraw_models_buffer->bind(nullptr, 0);
+	mesh_pool.bind(shader);
+	for (int i = first_batch; i < last_batch; ++i)
+	{
+		const sMultiDrawBatch& batch = multidraw_batches[i];
+		if (prepass)
+		{
+			if (batch.material->two_sided)
+				glDisable(GL_CULL_FACE);
+			else
+				glEnable(GL_CULL_FACE);
+		}
+		else
+		{
+			batch.material->bind(shader);
+			if (to_gbuffers)
+				glDisable(GL_BLEND); //the gbuffers cant be blended
+		}
+		shader->setUniform("u_first_draw", batch.first);
+		mesh_pool.draw(GL_TRIANGLES, multidraw_commands_buffer->id, batch.first, batch.count);
+		num_multidraw_calls++;
+		GFX::Mesh::num_meshes_rendered += batch.count;
+		GFX::Mesh::num_triangles_rendered += batch.num_indices / 3;
+	}
+	mesh_pool.unbind();
+
+	shader->disable();
+	glDisable(GL_BLEND);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+//one agent per visible character with its resources, the crowd is only rebuilt when they change
+void Renderer::updateCrowd(SCN::Scene* scene, float dt)
+{
+	PROFILE_FUNCTION();
+	scene_characters.clear();
+	for (BaseEntity* entity : scene->entities)
+	{
+		if (!entity->visible || entity->getType() != eEntityType::CHARACTER)
+			continue;
+		CharacterEntity* character = (CharacterEntity*)entity;
+		if (character->mesh && character->animation)
+			scene_characters.push_back(character);
+	}
+
+	bool changed = scene_characters.size() != crowd_characters.size();
+	for (size_t i = 0; !changed && i < scene_characters.size(); ++i)
+		changed = scene_characters[i] != crowd_characters[i] || crowd.agents[i]->mesh != scene_characters[i]->mesh || crowd.agents[i]->anim_a != scene_characters[i]->animation;
+	if (changed)
+	{
+		crowd.clear();
+		crowd_characters = scene_characters;
+		for (CharacterEntity* character : crowd_characters)
+			crowd.addAgent(character->mesh, character->animation, character->time_offset);
+	}
+
+	for (size_t i = 0; i < crowd_characters.size(); ++i)
+	{
+		CrowdAgent* agent = crowd.agents[i];
+		agent->speed = crowd_characters[i]->speed;
+		agent->material = crowd_characters[i]->material;
+		agent->model = crowd_characters[i]->root.model;
+	}
+	crowd.update(dt);
+}
+
+//like renderMeshWithMaterial but the vertices follow the bones of every agent, read from the palette with u_bones_offset
+void Renderer::renderCrowd(bool to_gbuffers)
+{
+	if (crowd.agents.empty())
+		return;
+
+	Camera* camera = Camera::current;
+	bool clustered = !to_gbuffers && use_clustered_lights;
+	GFX::Shader* shader = getSkinnedShader(to_gbuffers ? "gbuffers.fs" : (clustered ? "clustered.fs" : "texture.fs"));
+	if (!shader)
+		return;
+	PROFILE_FUNCTION();
+	GFX::startGPULabel("Crowd");
+	crowd.uploadPalette();
+
+	glEnable(GL_DEPTH_TEST);
+	shader->enable();
+	shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
+	if (!to_gbuffers)
+	{
+		shader->setUniform("u_camera_position", camera->eye);
+		shader->setUniform("u_time", (float)getTime());
+	}
+	if (clustered)
+	{
+		light_clusters.bind(shader, 8); //after the material textures
+		shadow_atlas.bind(shader, 11);
+		shader->setUniform("u_ambient_light", scene->ambient_light);
+		shader->setUniform("u_light_heatmap", show_light_heatmap);
+	}
+	if (render_wireframe)
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+	crowd.palette_buffer->bind(nullptr, 0);
+	for (CrowdAgent* agent : crowd.agents)
+	{
+		//the box of the bind pose, grown because the animation can move the vertices out of it
+		BoundingBox box = transformBoundingBox(agent->model, agent->mesh->box);
+		if (camera->testBoxInFrustum(box.center, box.halfsize * 1.5f) == CLIP_OUTSIDE)
+			continue;
+		agent->material->bind(shader);
+		if (to_gbuffers)
+			glDisable(GL_BLEND); //the gbuffers cant be blended
+		shader->setUniform("u_model", agent->model);
+		shader->setUniform("u_bones_offset", agent->palette_offset);
+		agent->mesh->render(GL_TRIANGLES);
+	}
+
+	shader->disable();
+	glDisable(GL_BLEND);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	GFX::endGPULabel();
+}
+
 #ifndef SKIP_IMGUI
 
 void Renderer::showUI()
@@ -192,6 +1436,79 @@ void Renderer::showUI()
 	ImGui::Checkbox("Wireframe", &render_wireframe);
 	ImGui::Checkbox("Boundaries", &render_boundaries);
 
+	ImGui::Combo("Pipeline", (int*)&pipeline_mode, "Forward\0Deferred\0");
+	if (pipeline_mode == DEFERRED)
+		ImGui::Checkbox("Show GBuffers", &show_gbuffers);
+
+	ImGui::Combo("Depth prepass", (int*)&prepass_mode, "Off\0On\0Auto\0");
+	if (prepass_mode == PREPASS_AUTO)
+	{
+		ImGui::SliderFloat("Prepass above overdraw", &prepass_overdraw_threshold, 1.0f, 4.0f);
+		ImGui::Text("Prepass: %s", use_prepass ? "on" : "off");
+	}
+	if (prepass_mode != PREPASS_OFF)
+		ImGui::Text("Overdraw: %.2f", overdraw);
+
+	ImGui::Checkbox("Occlusion culling", &use_occlusion_culling);
+	if (use_occlusion_culling)
+	{
+		ImGui::SliderInt("Max occluders", &occlusion_culler.max_occluders, 1, 256);
+		ImGui::SliderInt("Max occluder triangles", &occlusion_culler.max_occluder_triangles, 12, 65536);
+		ImGui::Text("Occluders: %d (%d triangles) Occluded: %d / %d", occlusion_culler.num_occluders, occlusion_culler.num_triangles, occlusion_culler.num_occluded, occlusion_culler.num_tested);
+	}
+
+	ImGui::Checkbox("LODs", &use_lods);
+	if (use_lods)
+		ImGui::SliderFloat("LOD max error", &lod_max_error, 0.01f, 1.0f);
+
+	ImGui::Checkbox("Meshlets", &use_meshlets);
+	if (use_meshlets)
+	{
+		ImGui::Checkbox("GPU meshlet culling", &use_gpu_meshlet_culling);
+		if (use_gpu_meshlet_culling && !supportsCompute())
+			ImGui::Text("Needs OpenGL 4.3, culled in the CPU");
+		else if (use_gpu_meshlet_culling)
+			ImGui::Text("Meshlets: %d", num_meshlets_tested);
+		else
+			ImGui::Text("Meshlets: %d / %d", num_meshlets_visible, num_meshlets_tested);
+	}
+
+	ImGui::Checkbox("Multi draw indirect", &use_multidraw);
+	if (use_multidraw && !supportsMultiDraw())
+		ImGui::Text("Needs OpenGL 4.3 and ARB_shader_draw_parameters");
+	else if (use_multidraw)
+		ImGui::Text("Calls: %d Commands: %d Meshes pooled: %d (%.1f MB)", num_multidraw_calls, num_multidraw_commands, mesh_pool.getNumMeshes(), (mesh_pool.vertices_bytes + mesh_pool.indices_bytes) / (1024.0f * 1024.0f));
+
+	ImGui::Checkbox("Occlusion queries", &use_occlusion_queries);
+	if (use_occlusion_queries)
+	{
+		ImGui::Checkbox("Conditional render", &use_conditional_render);
+		ImGui::Text("Queries: %d Skipped: %d Latency: %.1f frames", num_queries_issued, num_query_skipped, query_latency);
+	}
+
+	ImGui::Checkbox("Clustered lights", &use_clustered_lights);
+	if (use_clustered_lights)
+	{
+		ImGui::Checkbox("Light heatmap", &show_light_heatmap);
+		ImGui::SliderFloat("Clusters far", &light_clusters.far_distance, 10.0f, 5000.0f);
+		ImGui::Text("Lights: %d (%d directional) Max per cluster: %d Indices: %d", (int)light_clusters.lights.size(), light_clusters.num_directional, light_clusters.max_lights_in_cluster, (int)light_clusters.indices.size());
+	}
+
+	if (ImGui::Checkbox("Shadows", &use_shadows))
+		shadow_atlas.invalidate();
+	if (use_shadows)
+	{
+		ImGui::Checkbox("Cache static shadows", &shadow_atlas.use_cache);
+		ImGui::SliderFloat("Shadow importance", &shadow_atlas.importance_scale, 0.25f, 8.0f);
+		ImGui::SliderInt("Cascades", &shadow_atlas.num_cascades, 0, SHADOW_MAX_CASCADES);
+		ImGui::SliderFloat("Cascades distance", &shadow_atlas.cascade_distance, 10.0f, 1000.0f);
+		ImGui::SliderFloat("Cascades split", &shadow_atlas.cascade_split_lambda, 0.0f, 1.0f);
+		ImGui::Checkbox("Slow far cascades", &shadow_atlas.slow_far_cascades);
+		ImGui::Text("Tiles: %d Rendered: %d Casters: %d", (int)shadow_atlas.tiles.size(), shadow_atlas.num_rendered, shadow_atlas.num_casters_rendered);
+		if (GFX::Texture* atlas = shadow_atlas.getTexture())
+			ImGui::Image((void*)(intptr_t)atlas->texture_id, ImVec2(256, 256), ImVec2(0, 1), ImVec2(1, 0));
+	}
+
 	//add here your stuff
 	//...
 }
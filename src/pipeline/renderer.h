@@ -1,8 +1,16 @@
 #pragma once
+#include <unordered_map>
 #include "scene.h"
 #include "prefab.h"
+#include "../core/arena.h"
 
 #include "light.h"
+#include "clusters.h"
+#include "shadows.h"
+#include "occlusion.h"
+#include "crowd.h"
+#include "character.h"
+#include "../gfx/meshpool.h"
 
 //forward declarations
 class Camera;
@@ -11,6 +19,9 @@ namespace GFX {
 	class Shader;
 	class Mesh;
 	class FBO;
+	class Texture;
+	class GPUQuery;
+	class BufferObject;
 }
 
 namespace SCN {
@@ -18,6 +29,31 @@ namespace SCN {
 	class Prefab;
 	class Material;
 
+	//one mesh to draw, the list is rebuilt every frame in parseSceneEntities
+	struct Renderable {
+		Matrix44 model;
+		GFX::Mesh* mesh;
+		Material* material;
+		BoundingBox aabb;	//world space
+		float distance;		//to the camera, to sort them
+		const Node* node;	//the same between frames, to keep its occlusion query
+		int lod;	//of the mesh, from its projected size
+		int meshlet_draw;	//in meshlet_draws if its meshlets were culled this frame, -1 draws the whole mesh
+		bool in_multidraw;	//drawn with its batch, not alone
+		bool query_hidden;	//left out of the batches by its occlusion query (already counted in num_query_skipped)
+	};
+
+	enum ePipelineMode {
+		FORWARD,
+		DEFERRED
+	};
+
+	enum ePrepassMode {
+		PREPASS_OFF,
+		PREPASS_ON,
+		PREPASS_AUTO	//only when the measured overdraw is high
+	};
+
 	// This class is in charge of rendering anything in our system.
 	// Separating the render from anything else makes the code cleaner
 	class Renderer
@@ -25,11 +61,66 @@ namespace SCN {
 	public:
 		bool render_wireframe;
 		bool render_boundaries;
+		ePipelineMode pipeline_mode;
+		bool show_gbuffers;
+		bool use_clustered_lights;
+		bool show_light_heatmap;
+		bool use_shadows;
+
+		//depth only pass of the opaque renderables, then they are shaded once per pixel
+		ePrepassMode prepass_mode;
+		float prepass_overdraw_threshold;	//auto turns the prepass on above this overdraw
+		int overdraw_measure_frames;	//frames between measures in auto
+		float overdraw;	//fragments shaded without prepass / visible fragments, of the opaque renderables
+		bool use_prepass;	//this frame
+
+		bool use_occlusion_culling;
+
+		//simplified meshes in the distance
+		bool use_lods;
+		float lod_max_error;	//projected error allowed (Camera::getProjectedScale units, 0.1 is about a pixel at 1080p)
+
+		//the big meshes are culled by meshlets, only the visible ranges of their indices are drawn
+		bool use_meshlets;
+		bool use_gpu_meshlet_culling;	//a compute shader compacts the indices of the visible meshlets, drawn with an indirect call
+		int num_meshlets_tested;	//last frame
+		int num_meshlets_visible;	//only known with the CPU culling
+
+		//the renderables of the pooled meshes are written as indirect commands, a pass is one glMultiDrawElementsIndirect per material
+		bool use_multidraw;
+		int num_multidraw_calls;	//last frame
+		int num_multidraw_commands;
+		GFX::MeshPool mesh_pool;	//geometry of the meshes drawn with the multi draw
+
+		//hardware occlusion queries of the boxes against the depth of the frame, their results are used in the next frames
+		bool use_occlusion_queries;
+		bool use_conditional_render;	//draws the ones still waiting only if the GPU found them visible
+		int num_query_skipped;	//last frame
+		int num_queries_issued;
+		float query_latency;	//frames from a query to its result, average of the last results read
+
+		//skinned characters, one agent per CharacterEntity, their bones are computed in parallel and read from one buffer
+		AnimationCrowd crowd;
 
 		GFX::Texture* skybox_cubemap;
 
 		SCN::Scene* scene;
 
+		//temporary, their memory comes from the frame arena
+		CORE::FrameVector<Renderable> renderables;	//opaque, masked and blended, in this order
+		int num_opaque_renderables;
+		CORE::FrameVector<LightEntity*> lights;
+		CORE::FrameVector<Renderable> shadow_casters;	//every opaque renderable, not only the visible ones
+
+		//lights binned in froxels, rebuilt every frame
+		LightClusters light_clusters;
+		ShadowAtlas shadow_atlas;
+		OcclusionCuller occlusion_culler;
+
+		//deferred: albedo + occlusion, normal + metallic + roughness, emissive and depth-stencil. The lights are added in illumination_fbo
+		GFX::FBO* gbuffers;
+		GFX::FBO* illumination_fbo;
+
 		//updated every frame
 		Renderer(const char* shaders_atlas_filename );
 
@@ -40,17 +131,92 @@ namespace SCN {
 		//...
 
 		void parseSceneEntities(SCN::Scene* scene, Camera* camera);
+		void addRenderables(SCN::Node* node, Camera* camera);
+		void cullOccludedRenderables(Camera* camera);	//removes the renderables hidden behind the big opaque ones
+		void cullMeshlets(Camera* camera);	//meshlets of the renderables in full detail, against the frustum and by orientation
+		void buildMultiDraw();	//commands and batches of the visible renderables, after the culling
 
 		//renders several elements of the scene
 		void renderScene(SCN::Scene* scene, Camera* camera);
+		void renderForward(Camera* camera);
+		void renderDeferred(Camera* camera);
+		void renderDeferredLights(Camera* camera);
+		bool renderDepthPrepass(Camera* camera);
+		void renderNonBlended(bool prepass, bool to_gbuffers);	//opaque and masked renderables
+		void renderRenderable(const Renderable& renderable, bool to_gbuffers);	//unless its occlusion query says it is hidden
+		void renderBlended();	//back to front, with their batches in the place of their first renderable
+		void renderMultiDraw(int first_batch, int last_batch, bool prepass, bool to_gbuffers);	//one call per batch
+		void updateOcclusionQueries();	//reads the results that are ready
+		void issueOcclusionQueries(Camera* camera);	//box of every renderable against the current depth
+		void updatePrepassState();	//reads the overdraw measured some frames ago
+		void updateCrowd(SCN::Scene* scene, float dt);	//agents of the characters of the scene, then their poses
+		void renderCrowd(bool to_gbuffers);	//with the opaque renderables
 
 		//render the skybox
 		void renderSkybox(GFX::Texture* cubemap);
 
 		//to render one mesh given its material and transformation matrix
-		void renderMeshWithMaterial(const Matrix44 model, GFX::Mesh* mesh, SCN::Material* material);
+		void renderMeshWithMaterial(const Matrix44 model, GFX::Mesh* mesh, SCN::Material* material, int lod = 0, int meshlet_draw = -1);
+		void renderMeshToGBuffers(const Matrix44 model, GFX::Mesh* mesh, SCN::Material* material, int lod = 0, int meshlet_draw = -1);
+		void drawMesh(GFX::Mesh* mesh, int lod, int meshlet_draw);	//the whole mesh, a lod or its visible meshlets
 
 		void showUI();
+
+	private:
+		GFX::GPUQuery* overdraw_queries[2];	//samples passed in the prepass and in the opaque pass
+		bool measuring_overdraw;
+		int frames_since_measure;
+		SCN::Scene* measured_scene;
+		std::vector<BoundingBox> occlusion_boxes;
+		std::vector<uint8> occlusion_visible;
+
+		struct sOcclusionQuery {
+			GFX::GPUQuery* query;
+			long issued_frame;
+			long used_frame;	//deleted if its node is not rendered for a while
+			bool visible;
+		};
+		std::unordered_map<int, sOcclusionQuery> occlusion_queries;	//by Node::m_Id, the pool gives the addresses of deleted nodes to new ones
+		long frame;
+
+		std::string skybox_folder;	//full path of skybox_cubemap in two parts, so it is only built when one of them changes
+		std::string skybox_filename;
+		SCN::Scene* skybox_scene;
+
+		//debug builds check that rendering the same view again doesnt allocate (see checkHeapAllocations)
+		SCN::Scene* heap_check_scene;
+		size_t heap_check_entities;
+		Matrix44 heap_check_viewprojection;
+		int heap_check_frames;	//rendered without changes
+		void checkHeapAllocations(Camera* camera, long allocations);
+
+		struct sMeshletDraw {
+			int first;	//CPU: its first range in meshlet_counts and meshlet_offsets, GPU: its command
+			int num_ranges;	//-1 if the GPU culled it
+		};
+		std::vector<sMeshletDraw> meshlet_draws;
+		std::vector<int> meshlet_counts;	//indices of every range of consecutive visible meshlets
+		std::vector<const void*> meshlet_offsets;	//in bytes
+		std::vector<uint8> meshlet_visible;
+		GFX::BufferObject* meshlet_indices_buffer;	//GPU culling: compacted indices of every culled mesh
+		GFX::BufferObject* meshlet_commands_buffer;	//GPU culling: one command per culled mesh
+
+		//renderables with the same material in consecutive commands
+		struct sMultiDrawBatch {
+			Material* material;
+			int first;	//command
+			int count;
+			int num_indices;
+			int renderable;	//the first one
+		};
+		std::vector<sMultiDrawBatch> multidraw_batches;	//opaque, masked and blended, like the renderables
+		int multidraw_masked_batch;	//first of the masked ones
+		int multidraw_blended_batch;
+		SCN::Scene* pooled_scene;	//the pool is emptied when the scene changes
+		GFX::BufferObject* multidraw_commands_buffer;
+		GFX::BufferObject* multidraw_models_buffer;	//one model per command, read with gl_DrawID
+		std::vector<CharacterEntity*> crowd_characters;	//owner of every agent of the crowd, in the same order
+		std::vector<CharacterEntity*> scene_characters;	//this frame, the crowd is rebuilt when they differ
 	};
 
 };
\ No newline at end of file
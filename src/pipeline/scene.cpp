@@ -5,11 +5,84 @@
 
 #include "prefab.h"
 #include "../extra/cJSON.h"
+#include "../utils/jsonreader.h"
 #include "../core/ui.h"
 #include "../gfx/texture.h"
+#include "../core/profiler.h"
+#include "../core/memory.h"
 
 SCN::Scene* SCN::Scene::instance = NULL;
 
+#define SCENE_BIN_VERSION 1 //change it if the binary format changes
+
+//binary scene layout: "SBIN", header, transforms, entity table, type table, string pool, payload blocks
+struct sSceneBinHeader
+{
+	int version;
+	int header_bytes;
+	uint32 num_entities;
+	uint32 num_types;
+	uint32 strings_size;
+	uint32 payloads_size;
+	Vector3f background_color;
+	Vector3f ambient_light;
+	Vector3f camera_eye;
+	Vector3f camera_center;
+	float camera_fov;
+	uint32 skybox; //offset in the string pool
+	char extra[32]; //unused
+};
+
+struct sSceneBinEntity
+{
+	uint32 name; //offset in the string pool
+	uint32 type; //index in the type table
+	uint32 payload_offset; //inside the payload block of its type
+	uint32 payload_size;
+	uint8 layers;
+	uint8 visible;
+	uint8 padding[2];
+};
+
+//the payloads of all the entities of one type are stored together
+struct sSceneBinType
+{
+	uint32 name; //offset in the string pool
+	uint32 payload_offset;
+	uint32 payload_size;
+	uint32 num_entities;
+};
+
+SCN::SceneBinWriter::SceneBinWriter()
+{
+	strings.push_back('\0');
+	string_offsets[""] = 0;
+}
+
+uint32 SCN::SceneBinWriter::addString(const std::string& str)
+{
+	auto it = string_offsets.find(str);
+	if (it != string_offsets.end())
+		return it->second;
+	uint32 offset = (uint32)strings.size();
+	strings.insert(strings.end(), str.c_str(), str.c_str() + str.size() + 1);
+	string_offsets[str] = offset;
+	return offset;
+}
+
+void SCN::SceneBinWriter::write(std::vector<uint8>& payload, const void* data, size_t size)
+{
+	const uint8* bytes = (const uint8*)data;
+	payload.insert(payload.end(), bytes, bytes + size);
+}
+
+const char* SCN::SceneBinReader::getString(uint32 offset) const
+{
+	if (offset >= strings_size)
+		return "";
+	return strings + offset;
+}
+
 //test ray against sphere
 bool SCN::BaseEntity::testRay(const Ray& ray, Vector3f& coll, float max_dist )
 {
@@ -42,8 +115,13 @@ void SCN::Scene::clear()
 
 bool SCN::Scene::load(const char* filename)
 {
+	PROFILE_FUNCTION();
+	MEMORY_SCOPE("scene");
 	std::string content;
 
+	if (getExtension(filename) == "sbin")
+		return loadBinary(filename);
+
 	this->filename = filename;
 	this->base_folder = getFolderName(filename);
 	std::cout << " + Reading scene JSON: " << TermColor::YELLOW << filename << TermColor::DEFAULT << "..." << std::endl;
@@ -57,18 +135,218 @@ bool SCN::Scene::load(const char* filename)
 	return fromString(content, base_folder.c_str());
 }
 
+bool SCN::Scene::loadBinary(const char* filename)
+{
+	PROFILE_FUNCTION();
+	std::cout << " + Reading scene BIN: " << TermColor::YELLOW << filename << TermColor::DEFAULT << "..." << std::endl;
+
+	//mapped instead of read, only the pages we touch are loaded
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cout << "- ERROR: Scene file not found: " << TermColor::RED << filename << TermColor::DEFAULT << std::endl;
+		return false;
+	}
+
+	if (file.size < 4 + sizeof(sSceneBinHeader) || memcmp(file.data, "SBIN", 4) != 0)
+	{
+		std::cout << "[ERROR] loading scene BIN: invalid content: " << filename << std::endl;
+		return false;
+	}
+
+	sSceneBinHeader header;
+	memcpy(&header, file.data + 4, sizeof(sSceneBinHeader));
+	if (header.version != SCENE_BIN_VERSION || header.header_bytes != sizeof(sSceneBinHeader))
+	{
+		std::cout << "[WARN] loading scene BIN: old version: " << filename << std::endl;
+		return false;
+	}
+
+	size_t expected_size = 4 + sizeof(sSceneBinHeader) + (size_t)header.num_entities * (sizeof(Matrix44) + sizeof(sSceneBinEntity)) +
+		(size_t)header.num_types * sizeof(sSceneBinType) + header.strings_size + header.payloads_size;
+	const char* pos = file.data + 4 + sizeof(sSceneBinHeader);
+	const char* transforms = pos;
+	const sSceneBinEntity* table = (const sSceneBinEntity*)(transforms + header.num_entities * sizeof(Matrix44));
+	const sSceneBinType* types = (const sSceneBinType*)(table + header.num_entities);
+	SceneBinReader reader;
+	reader.strings = (const char*)(types + header.num_types);
+	reader.strings_size = header.strings_size;
+	const uint8* payloads = (const uint8*)(reader.strings + header.strings_size);
+	if (expected_size != file.size || (header.strings_size && reader.strings[header.strings_size - 1] != '\0'))
+	{
+		std::cout << "[ERROR] loading scene BIN: corrupted file: " << filename << std::endl;
+		return false;
+	}
+
+	clear();
+	this->filename = filename;
+	this->base_folder = getFolderName(filename);
+
+	background_color = header.background_color;
+	ambient_light = header.ambient_light;
+	main_camera.eye = header.camera_eye;
+	main_camera.center = header.camera_center;
+	main_camera.fov = header.camera_fov;
+	skybox_filename = reader.getString(header.skybox);
+
+	//resolve the factory once per type instead of once per entity
+	std::vector<BaseEntity*> prototypes(header.num_types);
+	for (uint32 i = 0; i < header.num_types; ++i)
+	{
+		const char* type_str = reader.getString(types[i].name);
+		auto it = BaseEntity::s_factory.find(type_str);
+		prototypes[i] = it == BaseEntity::s_factory.end() ? nullptr : it->second;
+		if (!prototypes[i] && strcmp(type_str, "UNKNOWN") != 0)
+			std::cout << " - Entity type unknown: " << TermColor::RED << type_str << TermColor::DEFAULT << std::endl;
+		if (types[i].payload_offset + (size_t)types[i].payload_size > header.payloads_size)
+		{
+			std::cout << "[ERROR] loading scene BIN: corrupted file: " << filename << std::endl;
+			return false;
+		}
+	}
+
+	entities.reserve(header.num_entities);
+	for (uint32 i = 0; i < header.num_entities; ++i)
+	{
+		const sSceneBinEntity& record = table[i];
+		if (record.type >= header.num_types || record.payload_offset + (size_t)record.payload_size > types[record.type].payload_size)
+		{
+			std::cout << "[ERROR] loading scene BIN: invalid entity " << i << ": " << filename << std::endl;
+			continue;
+		}
+
+		BaseEntity* ent = nullptr;
+		if (prototypes[record.type])
+			ent = prototypes[record.type]->clone();
+		else
+		{
+			UnknownEntity* uent = new UnknownEntity();
+			uent->original_type = reader.getString(types[record.type].name);
+			ent = uent;
+		}
+
+		//add to scene
+		addEntity(ent);
+
+		ent->name = reader.getString(record.name);
+		ent->layers = record.layers;
+		ent->visible = record.visible != 0;
+		memcpy(&ent->root.model, transforms + i * sizeof(Matrix44), sizeof(Matrix44));
+
+		ent->readBinary(payloads + types[record.type].payload_offset + record.payload_offset, record.payload_size, reader);
+	}
+
+	std::cout << " + Scene loaded: " << entities.size() << " entities" << std::endl;
+	return true;
+}
+
+bool SCN::Scene::saveBinary(const char* filename)
+{
+	std::cout << " + Writing scene to BIN: " << filename << "..." << std::endl;
+
+	SceneBinWriter writer;
+	std::vector<Matrix44> transforms(entities.size());
+	std::vector<sSceneBinEntity> table(entities.size());
+	std::vector<sSceneBinType> types;
+	std::vector<std::vector<uint8>> blocks; //payloads of every type
+	std::map<std::string, uint32> types_index;
+
+	for (size_t i = 0; i < entities.size(); ++i)
+	{
+		BaseEntity* ent = entities[i];
+
+		//unknown entities keep the type they had in the file
+		std::string type_str = ent->getType() == eEntityType::UNKNOWN ? ((UnknownEntity*)ent)->original_type : ent->getTypeAsStr();
+		auto it = types_index.find(type_str);
+		uint32 type_index = 0;
+		if (it != types_index.end())
+			type_index = it->second;
+		else
+		{
+			type_index = (uint32)types.size();
+			types_index[type_str] = type_index;
+			sSceneBinType type;
+			memset(&type, 0, sizeof(type));
+			type.name = writer.addString(type_str);
+			types.push_back(type);
+			blocks.resize(types.size());
+		}
+
+		std::vector<uint8>& block = blocks[type_index];
+		sSceneBinEntity& record = table[i];
+		memset(&record, 0, sizeof(record));
+		record.name = writer.addString(ent->name);
+		record.type = type_index;
+		record.layers = ent->layers;
+		record.visible = ent->visible ? 1 : 0;
+		record.payload_offset = (uint32)block.size();
+		ent->writeBinary(block, writer);
+		record.payload_size = (uint32)block.size() - record.payload_offset;
+		types[type_index].num_entities++;
+		transforms[i] = ent->root.model;
+	}
+
+	uint32 payloads_size = 0;
+	for (size_t i = 0; i < types.size(); ++i)
+	{
+		types[i].payload_offset = payloads_size;
+		types[i].payload_size = (uint32)blocks[i].size();
+		payloads_size += types[i].payload_size;
+	}
+
+	sSceneBinHeader header = {};
+	header.version = SCENE_BIN_VERSION;
+	header.header_bytes = sizeof(sSceneBinHeader);
+	header.num_entities = (uint32)entities.size();
+	header.num_types = (uint32)types.size();
+	header.payloads_size = payloads_size;
+	header.background_color = background_color;
+	header.ambient_light = ambient_light;
+	header.camera_eye = main_camera.eye;
+	header.camera_center = main_camera.center;
+	header.camera_fov = main_camera.fov;
+	header.skybox = writer.addString(skybox_filename);
+	header.strings_size = (uint32)writer.strings.size(); //after the last addString
+
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL)
+	{
+		std::cout << "[ERROR] cannot write scene BIN: " << filename << std::endl;
+		return false;
+	}
+
+	fwrite("SBIN", sizeof(char), 4, f);
+	fwrite(&header, sizeof(sSceneBinHeader), 1, f);
+	if (transforms.size())
+	{
+		fwrite(&transforms[0], sizeof(Matrix44), transforms.size(), f);
+		fwrite(&table[0], sizeof(sSceneBinEntity), table.size(), f);
+	}
+	if (types.size())
+		fwrite(&types[0], sizeof(sSceneBinType), types.size(), f);
+	fwrite(&writer.strings[0], 1, writer.strings.size(), f);
+	for (std::vector<uint8>& block : blocks)
+		if (block.size())
+			fwrite(&block[0], 1, block.size(), f);
+	fclose(f);
+	return true;
+}
+
 bool SCN::Scene::fromString(std::string& data, const char* base_folder)
 {
+	PROFILE_FUNCTION();
+
 	//erase all
 	clear();
 
-	//parse json string 
-	cJSON* json = cJSON_Parse(data.c_str());
-	if (!json)
+	//parse json string, the values point to data so it must be alive while reading them
+	JSONDocument doc;
+	if (!doc.parse(data.c_str(), data.size()))
 	{
-		std::cout << "ERROR: Scene JSON has errors: " << TermColor::RED << filename << TermColor::DEFAULT << std::endl;
+		std::cout << "ERROR: Scene JSON has errors: " << TermColor::RED << filename << TermColor::DEFAULT << " (at byte " << doc.error_position << ")" << std::endl;
 		return false;
 	}
+	JSONValue json = doc.root();
 
 	//read global properties
 	background_color = readJSONVector3(json, "background_color", background_color);
@@ -79,11 +357,26 @@ bool SCN::Scene::fromString(std::string& data, const char* base_folder)
 	skybox_filename = readJSONString(json, "skybox", skybox_filename.c_str());
 
 	//entities
-	cJSON* entities_json = cJSON_GetObjectItemCaseSensitive(json, "entities");
-	cJSON* entity_json;
-	cJSON_ArrayForEach(entity_json, entities_json)
+	JSONValue entities_json = json.get("entities");
+	for (JSONValue entity_json = entities_json.first(); entity_json.isValid(); entity_json = entity_json.next())
 	{
-		std::string type_str = cJSON_GetObjectItem(entity_json, "type")->valuestring;
+		//one pass over the members instead of one lookup per property
+		JSONValue type_json, name_json, layers_json, position_json, angle_json, rotation_json, target_json, scale_json, visible_json;
+		for (JSONValue item = entity_json.first(); item.isValid(); item = item.next())
+		{
+			std::string_view key = item.key();
+			if (key == "type") type_json = item;
+			else if (key == "name") name_json = item;
+			else if (key == "layers") layers_json = item;
+			else if (key == "position") position_json = item;
+			else if (key == "angle") angle_json = item;
+			else if (key == "rotation") rotation_json = item;
+			else if (key == "target") target_json = item;
+			else if (key == "scale") scale_json = item;
+			else if (key == "visible") visible_json = item;
+		}
+
+		std::string type_str = type_json.toString();
 		BaseEntity* ent = BaseEntity::createEntity(type_str.c_str());
 		if (!ent)
 		{
@@ -97,26 +390,26 @@ bool SCN::Scene::fromString(std::string& data, const char* base_folder)
 		addEntity(ent);
 
 		//parse generic stuff
-		if (cJSON_GetObjectItem(entity_json, "name"))
+		if (name_json.isValid())
 		{
-			ent->name = cJSON_GetObjectItem(entity_json, "name")->valuestring;
+			ent->name = name_json.toString();
 			std::cout << " + Entity: " << TermColor::GREEN << ent->name << TermColor::DEFAULT << std::endl;
 		}
 
-		if (cJSON_GetObjectItem(entity_json, "layers"))
-			ent->layers = cJSON_GetObjectItem(entity_json, "layers")->valueint;
+		if (layers_json.isValid())
+			ent->layers = (uint8)layers_json.toNumber(ent->layers);
 
 		//read transform
-		if (cJSON_GetObjectItem(entity_json, "position"))
+		if (position_json.isValid())
 		{
 			ent->root.model.setIdentity();
-			Vector3f position = readJSONVector3(entity_json, "position", Vector3f());
+			Vector3f position = position_json.toVector3(Vector3f());
 			ent->root.model.translate(position.x, position.y, position.z);
 		}
 
-		if (cJSON_GetObjectItem(entity_json, "angle"))
+		if (angle_json.isValid())
 		{
-			float angle = cJSON_GetObjectItem(entity_json, "angle")->valuedouble;
+			float angle = (float)angle_json.toNumber(0.0);
 			//Quaternion q;
 			//Matrix44 R;
 			//q.fromEuler(Vector3(angle * DEG2RAD, 0, 0));
@@ -125,36 +418,33 @@ bool SCN::Scene::fromString(std::string& data, const char* base_folder)
 			//ent->model = R * ent->model;
 		}
 
-		if (cJSON_GetObjectItem(entity_json, "rotation"))
+		if (rotation_json.isValid())
 		{
-			Vector4f rotation = readJSONVector4(entity_json, "rotation");
+			Vector4f rotation = rotation_json.toVector4(Vector4f());
 			Quaternion q(rotation.x, rotation.y, rotation.z, rotation.w);
 			Matrix44 R;
 			q.toMatrix(R);
 			ent->root.model = R * ent->root.model;
 		}
 
-		if (cJSON_GetObjectItem(entity_json, "target"))
+		if (target_json.isValid())
 		{
-			Vector3f target = readJSONVector3(entity_json, "target", Vector3f());
+			Vector3f target = target_json.toVector3(Vector3f());
 			Vector3f front = (target - ent->root.model.getTranslation()) * -1.0f;
 			ent->root.model.setFrontAndOrthonormalize(front);
 		}
 
-		if (cJSON_GetObjectItem(entity_json, "scale"))
+		if (scale_json.isValid())
 		{
-			Vector3f scale = readJSONVector3(entity_json, "scale", Vector3f(1, 1, 1));
+			Vector3f scale = scale_json.toVector3(Vector3f(1, 1, 1));
 			ent->root.model.scale(scale.x, scale.y, scale.z);
 		}
 
-		ent->visible = readJSONBool(entity_json, "visible", true);
+		ent->visible = visible_json.isValid() ? visible_json.toBool(false) : true;
 
 		ent->configure(entity_json);
 	}
 
-	//free memory
-	cJSON_Delete(json);
-
 	return true;
 }
 
@@ -205,13 +495,16 @@ bool SCN::Scene::toString( std::string& data )
 	int size = strlen(str);
 	data.resize(size);
 	memcpy(&data[0], str, size);
-	delete str;
+	free(str); //cJSON allocates with malloc
 
 	return true;
 }
 
 bool SCN::Scene::save(const char* filename)
 {
+	if (getExtension(filename) == "sbin")
+		return saveBinary(filename);
+
 	std::cout << " + Writing scene to JSON: " << filename << "..." << std::endl;
 	std::string data;
 	toString(data);
@@ -269,11 +562,30 @@ SCN::PrefabEntity::PrefabEntity()
 	prefab = NULL;
 }
 
-void SCN::PrefabEntity::configure(cJSON* json)
+SCN::PrefabEntity::~PrefabEntity()
+{
+	if (prefab)
+		prefab->release();
+}
+
+SCN::PrefabEntity& SCN::PrefabEntity::operator=(const PrefabEntity& entity)
+{
+	if (entity.prefab)
+		entity.prefab->retain();
+	if (prefab)
+		prefab->release();
+	BaseEntity::operator=(entity);
+	filename = entity.filename;
+	prefab = entity.prefab;
+	return *this;
+}
+
+void SCN::PrefabEntity::configure(const JSONValue& json)
 {
-	if (cJSON_GetObjectItem(json, "filename"))
+	JSONValue filename_json = json.get("filename");
+	if (filename_json.isValid())
 	{
-		filename = cJSON_GetObjectItem(json, "filename")->valuestring;
+		filename = filename_json.toString();
 		loadPrefab( filename.c_str() );
 	}
 }
@@ -283,18 +595,39 @@ void SCN::PrefabEntity::serialize(cJSON* json)
 	cJSON_AddStringToObject(json, "filename", filename.c_str());
 }
 
+void SCN::PrefabEntity::writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer)
+{
+	uint32 offset = writer.addString(filename);
+	SceneBinWriter::write(payload, &offset, sizeof(offset));
+}
+
+void SCN::PrefabEntity::readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader)
+{
+	if (size < sizeof(uint32))
+		return;
+	uint32 offset;
+	memcpy(&offset, payload, sizeof(offset));
+	filename = reader.getString(offset);
+	if (filename.size())
+		loadPrefab(filename.c_str());
+}
+
 void SCN::PrefabEntity::loadPrefab(const char* filename)
 {
 	assert(scene && "Cannot assign filename without scene (to extract base folder)");
 	std::string fullpath = scene->base_folder + "/" + filename;
-	prefab = SCN::Prefab::Get(fullpath.c_str());
-	if (!prefab)
+	SCN::Prefab* loaded = SCN::Prefab::Get(fullpath.c_str());
+	if (!loaded)
 		return;
+
+	//before releasing the old one, it could be the same
+	loaded->retain();
+	if (prefab)
+		prefab->release();
+	prefab = loaded;
 	
-	SCN::Node* child = new SCN::Node();
-	*child = prefab->root;
 	root.clear();
-	root.addChild(child);
+	root.addChildCopy(prefab->root);
 }
 
 bool SCN::PrefabEntity::testRay(const Ray& ray, Vector3f& coll, float max_dist)
@@ -314,11 +647,13 @@ SCN::UnknownEntity::~UnknownEntity()
 		cJSON_Delete((cJSON*)data);
 }
 
-void SCN::UnknownEntity::configure(cJSON* json)
+void SCN::UnknownEntity::configure(const JSONValue& json)
 {
 	if(data)
 		cJSON_Delete((cJSON*)data);
-	data = cJSON_Duplicate(json, true);
+	//only the entities we dont understand pay for a cJSON tree
+	std::string text(json.raw());
+	data = cJSON_Parse(text.c_str());
 }
 
 void SCN::UnknownEntity::serialize(cJSON* json)
@@ -339,6 +674,38 @@ void SCN::UnknownEntity::serialize(cJSON* json)
 	}
 }
 
+//the properties we dont understand are stored as JSON text
+void SCN::UnknownEntity::writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer)
+{
+	uint32 offset = 0;
+	if (data)
+	{
+		char* str = cJSON_PrintUnformatted((cJSON*)data);
+		offset = writer.addString(str);
+		free(str);
+	}
+	SceneBinWriter::write(payload, &offset, sizeof(offset));
+}
+
+void SCN::UnknownEntity::readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader)
+{
+	if (data)
+		cJSON_Delete((cJSON*)data);
+	data = nullptr;
+
+	//could be the payload of a type that is not registered now
+	if (size != sizeof(uint32))
+	{
+		std::cout << " - Payload of entity type " << TermColor::RED << original_type << TermColor::DEFAULT << " discarded" << std::endl;
+		return;
+	}
+	uint32 offset;
+	memcpy(&offset, payload, sizeof(offset));
+	const char* str = reader.getString(offset);
+	if (*str)
+		data = cJSON_Parse(str);
+}
+
 SCN::RayTestResult SCN::Scene::testRay(Ray& ray, uint8 layers)
 {
 	RayTestResult result;
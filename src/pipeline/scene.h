@@ -3,6 +3,7 @@
 #include <string>
 
 #include "../core/math.h"
+#include "../core/pool.h"
 #include "camera.h"
 #include "animation.h"
 #include "prefab.h"
@@ -10,6 +11,7 @@
 
 //forward declaration
 class cJSON; 
+class JSONValue;
 
 
 //our namespace
@@ -52,6 +54,27 @@ namespace SCN {
 		BaseEntity* entity;
 	};
 
+	//used by the entities to store their payload in the binary scene (see Scene::saveBinary)
+	class SceneBinWriter
+	{
+	public:
+		std::vector<char> strings; //string pool, offset 0 is always the empty string
+		std::map<std::string, uint32> string_offsets; //repeated strings are stored once
+
+		SceneBinWriter();
+		uint32 addString(const std::string& str); //returns the offset in the pool
+		static void write(std::vector<uint8>& payload, const void* data, size_t size);
+	};
+
+	class SceneBinReader
+	{
+	public:
+		const char* strings;
+		uint32 strings_size;
+
+		const char* getString(uint32 offset) const; //returns "" if the offset is not valid
+	};
+
 	#define ENTITY_METHODS(_A,_B,_ICONX,_ICONY) \
 		virtual BaseEntity* clone() const { auto it = new _A(); *it = *this; it->scene = nullptr; return it; };\
 		virtual eEntityType getType() const { return eEntityType::_B; }; \
@@ -76,8 +99,10 @@ namespace SCN {
 		BaseEntity() { scene = nullptr; visible = true; layers = 3; }
 		virtual ~BaseEntity() { assert(!scene); if (s_selected == this) s_selected = nullptr; };
 		
-		virtual void configure(cJSON* json) {}
+		virtual void configure(const JSONValue& json) {}
 		virtual void serialize(cJSON* json) {}
+		virtual void writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer) {}
+		virtual void readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader) {}
 
 		virtual BaseEntity* clone() const = 0; //must be implemented
 		virtual eEntityType getType() const { return eEntityType::NONE; }
@@ -86,6 +111,10 @@ namespace SCN {
 
 		virtual bool testRay(const Ray& ray, Vector3f& coll, float max_dist = 100000.0f);
 
+		//entities of every type come from pools (by size), to keep them together in memory
+		static void* operator new(size_t size) { return CORE::poolAllocate(size); }
+		static void operator delete(void* ptr, size_t size) { CORE::poolDeallocate(ptr, size); }
+
 		static void registerEntityType(BaseEntity* entity);
 		static BaseEntity* createEntity(const char* type);
 	};
@@ -95,14 +124,18 @@ namespace SCN {
 	{
 	public:
 		std::string filename;
-		Prefab* prefab;
+		Prefab* prefab;	//retained while the entity uses it
 		
 		PrefabEntity();
+		~PrefabEntity();
+		PrefabEntity& operator=(const PrefabEntity& entity); //clones retain the prefab too
 
 		ENTITY_METHODS(PrefabEntity, PREFAB, 11,0);
 
-		virtual void configure(cJSON* json);
+		virtual void configure(const JSONValue& json);
 		virtual void serialize(cJSON* json);
+		virtual void writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer);
+		virtual void readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader);
 		void loadPrefab(const char* filename);
 
 		bool testRay(const Ray& ray, Vector3f& coll, float max_dist = 100000.0f);
@@ -118,8 +151,10 @@ namespace SCN {
 		~UnknownEntity();
 
 		ENTITY_METHODS( UnknownEntity, UNKNOWN,1,0 );
-		virtual void configure(cJSON* json);
+		virtual void configure(const JSONValue& json);
 		virtual void serialize(cJSON* json);
+		virtual void writeBinary(std::vector<uint8>& payload, SceneBinWriter& writer);
+		virtual void readBinary(const uint8* payload, uint32 size, const SceneBinReader& reader);
 		virtual const char* getTypeAsStr() { return original_type.c_str(); };
 	};
 
@@ -144,10 +179,12 @@ namespace SCN {
 		void addEntity(BaseEntity* entity);
 		void removeEntity(BaseEntity* entity);
 
-		bool load(const char* filename);
-		bool save(const char* filename);
+		bool load(const char* filename); //.json or .sbin
+		bool save(const char* filename); //binary if the extension is .sbin
 		bool toString(std::string& data);
 		bool fromString(std::string& data, const char* base_folder = nullptr);
+		bool loadBinary(const char* filename);
+		bool saveBinary(const char* filename);
 
 		BaseEntity* getEntity(std::string name);
 
@@ -0,0 +1,392 @@
+#include "shadows.h"
+
+#include <algorithm>
+#include <cstring>
+#include "light.h"
+#include "renderer.h"
+#include "material.h"
+#include "../core/task.h"
+#include "../core/profiler.h"
+#include "../gfx/gfx.h"
+#include "../gfx/fbo.h"
+#include "../gfx/mesh.h"
+#include "../gfx/shader.h"
+#include "../gfx/texture.h"
+
+using namespace SCN;
+
+ShadowAtlas::ShadowAtlas()
+{
+	use_cache = true;
+	importance_scale = 2.0f;
+	num_cascades = 3;
+	cascade_tile_size = SHADOW_TILE_MAX / 2;
+	cascade_distance = 150.0f;
+	cascade_split_lambda = 0.75f;
+	slow_far_cascades = true;
+	frame = 0;
+	memset(cascade_splits, 0, sizeof(cascade_splits));
+	num_rendered = 0;
+	num_casters_rendered = 0;
+	fbo = NULL;
+	shadows_buffer = NULL;
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+	delete fbo;
+	delete shadows_buffer;
+}
+
+GFX::Texture* ShadowAtlas::getTexture()
+{
+	return fbo ? fbo->depth_texture : NULL;
+}
+
+//FNV-1a, enough to know if the casters of a tile changed
+static uint64 hashBytes(uint64 hash, const void* data, size_t size)
+{
+	const uint8* bytes = (const uint8*)data;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+static int nextPowerOfTwo(int v)
+{
+	int p = 1;
+	while (p < v)
+		p <<= 1;
+	return p;
+}
+
+//the light's radius in pixels, directional lights cover everything
+int ShadowAtlas::computeTileSize(LightEntity* light, Camera* camera, float viewport_height)
+{
+	if (light->light_type == eLightType::DIRECTIONAL)
+		return SHADOW_TILE_MAX;
+	Vector3f position = light->root.model.getTranslation();
+	float distance = camera->eye.distance(position);
+	if (distance <= light->max_distance)
+		return SHADOW_TILE_MAX;
+	float pixels = light->max_distance / (distance * tan(camera->fov * 0.5f * DEG2RAD)) * viewport_height * 0.5f;
+	return std::min(std::max(nextPowerOfTwo((int)(pixels * importance_scale)), SHADOW_TILE_MIN), SHADOW_TILE_MAX);
+}
+
+bool ShadowAtlas::setupTileCamera(ShadowTile& tile)
+{
+	LightEntity* light = tile.light;
+	Vector3f position = light->root.model.getTranslation();
+	Vector3f up = light->root.model.rotateVector(Vector3f(0, 1, 0));
+	float near_plane = std::max(light->near_distance, 0.01f);
+	if (light->light_type == eLightType::SPOT)
+		tile.camera.setPerspective(light->cone_info.y * 2.0f, 1.0f, near_plane, light->max_distance);
+	else if (light->light_type == eLightType::DIRECTIONAL)
+	{
+		float half_size = light->area * 0.5f;
+		tile.camera.setOrthographic(-half_size, half_size, -half_size, half_size, near_plane, light->max_distance);
+	}
+	else
+		return false; //point lights would need 6 tiles
+	tile.camera.lookAt(position, position + light->getFront(), up);
+	return true;
+}
+
+//ortho camera around the bounding sphere of a slice of the camera frustum. The sphere doesnt change when the camera rotates
+//and its center is snapped to the texels of the tile, so the shadow edges dont shimmer when the camera moves
+void ShadowAtlas::setupCascadeCamera(ShadowTile& tile, Camera* camera)
+{
+	LightEntity* light = tile.light;
+	float near_split = cascade_splits[tile.cascade];
+	float far_split = cascade_splits[tile.cascade + 1];
+
+	//corners of the slice in view space (so the sphere doesnt depend on the camera rotation), along the lines between the near and far plane corners
+	Matrix44 inv_projection = camera->projection_matrix;
+	inv_projection.inverse();
+	Vector3f corners[8];
+	Vector3f center;
+	for (int i = 0; i < 4; ++i)
+	{
+		Vector4f ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, -1.0f, 1.0f);
+		Vector4f n = inv_projection * ndc;
+		ndc.z = 1.0f;
+		Vector4f f = inv_projection * ndc;
+		Vector3f near_corner(n.x / n.w, n.y / n.w, n.z / n.w);
+		Vector3f far_corner(f.x / f.w, f.y / f.w, f.z / f.w);
+		float range = camera->far_plane - camera->near_plane;
+		corners[i] = near_corner + (far_corner - near_corner) * ((near_split - camera->near_plane) / range);
+		corners[i + 4] = near_corner + (far_corner - near_corner) * ((far_split - camera->near_plane) / range);
+		center = center + corners[i] + corners[i + 4];
+	}
+	center = center * (1.0f / 8.0f);
+	float radius = 0.0f;
+	for (int i = 0; i < 8; ++i)
+		radius = std::max(radius, center.distance(corners[i]));
+	radius = ceil(radius * 16.0f) / 16.0f;
+	Matrix44 inv_view = camera->view_matrix;
+	inv_view.inverse();
+	center = inv_view * center;
+
+	//snap the center in the light space (only rotation, it doesnt change while the light doesnt rotate)
+	Vector3f front = light->getFront();
+	Vector3f up = light->root.model.rotateVector(Vector3f(0, 1, 0));
+	Camera light_space;
+	light_space.lookAt(Vector3f(0, 0, 0), front, up);
+	Matrix44 inv_rotation = light_space.view_matrix;
+	inv_rotation.inverse();
+	float texel_size = radius * 2.0f / tile.size;
+	Vector3f local = light_space.view_matrix * center;
+	local.x = floor(local.x / texel_size) * texel_size;
+	local.y = floor(local.y / texel_size) * texel_size;
+	center = inv_rotation * local;
+
+	//max_distance is how far behind the slice the casters are
+	float back = std::max(light->max_distance, radius);
+	tile.camera.setOrthographic(-radius, radius, -radius, radius, 0.0f, back + radius);
+	tile.camera.lookAt(center - front * back, center, up);
+}
+
+void ShadowAtlas::update(LightEntity* const* lights, int num_lights, const Renderable* casters, int num_casters, Camera* camera)
+{
+	PROFILE_FUNCTION();
+	last_tiles.swap(tiles);
+	tiles.clear();
+	light_tiles.assign(num_lights, -1);
+	light_num_tiles.assign(num_lights, 0);
+	frame++;
+
+	//practical split scheme: blend of logarithmic and uniform splits
+	int cascades = std::min(std::max(num_cascades, 0), SHADOW_MAX_CASCADES);
+	float near_split = camera->near_plane;
+	float far_split = std::max(std::min(cascade_distance, camera->far_plane), near_split * 2.0f);
+	for (int i = 0; i <= cascades; ++i)
+	{
+		float f = i / (float)std::max(cascades, 1);
+		float log_split = near_split * pow(far_split / near_split, f);
+		float linear_split = near_split + (far_split - near_split) * f;
+		cascade_splits[i] = log_split * cascade_split_lambda + linear_split * (1.0f - cascade_split_lambda);
+	}
+
+	//desired sizes, a light keeps its last size until it needs less than half of it (avoids re-rendering when the camera moves a bit)
+	requests.clear();
+	int viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	for (int i = 0; i < num_lights; ++i)
+	{
+		LightEntity* light = lights[i];
+		if (!light->cast_shadows || light->light_type == eLightType::POINT || light->light_type == eLightType::NO_LIGHT)
+			continue;
+		if (light->light_type == eLightType::DIRECTIONAL && cascades)
+		{
+			for (int j = 0; j < cascades; ++j)
+				requests.push_back(sRequest{ i, cascade_tile_size, j });
+			continue;
+		}
+		int size = computeTileSize(light, camera, (float)viewport[3]);
+		for (const ShadowTile& last : last_tiles)
+			if (last.light == light && last.size == size * 2)
+				size = last.size;
+		requests.push_back(sRequest{ i, size, -1 });
+	}
+	//biggest first, so the free squares can always be split in four (then in the order they were added: the cascades of a light stay together).
+	//not stable_sort, it takes a buffer from the heap
+	std::sort(requests.begin(), requests.end(), [](const sRequest& a, const sRequest& b) {
+		if (a.size != b.size)
+			return a.size > b.size;
+		if (a.light != b.light)
+			return a.light < b.light;
+		return a.cascade < b.cascade;
+	});
+
+	free_squares.clear();
+	free_squares.push_back(sSquare{ 0, 0, SHADOW_ATLAS_SIZE });
+	for (sRequest& request : requests)
+	{
+		//smallest free square that fits, if the atlas is full try smaller tiles
+		int best = -1;
+		while (best == -1 && request.size >= SHADOW_TILE_MIN)
+		{
+			for (int i = 0; i < (int)free_squares.size(); ++i)
+				if (free_squares[i].size >= request.size && (best == -1 || free_squares[i].size < free_squares[best].size))
+					best = i;
+			if (best == -1)
+				request.size /= 2;
+		}
+		if (best == -1)
+			continue; //no room, no shadow
+		sSquare square = free_squares[best];
+		free_squares.erase(free_squares.begin() + best);
+		while (square.size > request.size)
+		{
+			square.size /= 2;
+			free_squares.push_back(sSquare{ square.x + square.size, square.y, square.size });
+			free_squares.push_back(sSquare{ square.x, square.y + square.size, square.size });
+			free_squares.push_back(sSquare{ square.x + square.size, square.y + square.size, square.size });
+		}
+
+		ShadowTile tile;
+		tile.light = lights[request.light];
+		tile.cascade = request.cascade;
+		tile.x = square.x;
+		tile.y = square.y;
+		tile.size = square.size;
+		tile.num_casters = 0;
+		tile.casters_hash = 0;
+		tile.cached = false;
+		if (tile.cascade == -1 && !setupTileCamera(tile))
+			continue;
+		if (tile.cascade != -1)
+		{
+			//far cascades change less on screen, they can wait some frames with the last camera and depth
+			const ShadowTile* last = NULL;
+			for (const ShadowTile& last_tile : last_tiles)
+				if (last_tile.light == tile.light && last_tile.cascade == tile.cascade && last_tile.x == tile.x && last_tile.y == tile.y && last_tile.size == tile.size)
+					last = &last_tile;
+			int interval = 1 << tile.cascade;
+			if (use_cache && slow_far_cascades && last && (frame + tile.cascade) % interval != 0)
+			{
+				tile.camera = last->camera;
+				tile.casters_hash = last->casters_hash;
+				tile.cached = true;
+			}
+			else
+				setupCascadeCamera(tile, camera);
+		}
+		if (light_tiles[request.light] == -1)
+			light_tiles[request.light] = (int)tiles.size();
+		light_num_tiles[request.light]++;
+		tiles.push_back(tile);
+	}
+
+	//render list of every tile, each job only touches the list of its tiles
+	if (tile_casters.size() < tiles.size())
+		tile_casters.resize(tiles.size());
+	JobPool::global.parallelFor((int)tiles.size(), 1, [&](int start, int end) {
+		for (int i = start; i < end; ++i)
+		{
+			ShadowTile& tile = tiles[i];
+			std::vector<const Renderable*>& list = tile_casters[i];
+			list.clear();
+			if (tile.cached)
+				continue; //waiting cascade
+			uint64 hash = 14695981039346656037ull;
+			for (int j = 0; j < num_casters; ++j)
+			{
+				const Renderable& caster = casters[j];
+				if (tile.camera.testBoxInFrustum(caster.aabb.center, caster.aabb.halfsize) == CLIP_OUTSIDE)
+					continue;
+				list.push_back(&caster);
+				hash = hashBytes(hash, &caster.mesh, sizeof(caster.mesh));
+				hash = hashBytes(hash, &caster.material, sizeof(caster.material));
+				hash = hashBytes(hash, caster.model.m, sizeof(caster.model.m));
+			}
+			tile.num_casters = (int)list.size();
+			tile.casters_hash = hash;
+		}
+	});
+
+	//same place, same light matrices and same casters than last frame: the depth in the atlas is still valid
+	for (ShadowTile& tile : tiles)
+		for (const ShadowTile& last : last_tiles)
+			if (use_cache && !tile.cached && last.light == tile.light && last.cascade == tile.cascade && last.x == tile.x && last.y == tile.y && last.size == tile.size && last.casters_hash == tile.casters_hash &&
+				memcmp(last.camera.viewprojection_matrix.m, tile.camera.viewprojection_matrix.m, sizeof(tile.camera.viewprojection_matrix.m)) == 0)
+			{
+				tile.cached = true;
+				break;
+			}
+}
+
+void ShadowAtlas::render()
+{
+	PROFILE_FUNCTION();
+	num_rendered = 0;
+	num_casters_rendered = 0;
+
+	if (!fbo)
+	{
+		fbo = new GFX::FBO();
+		fbo->setDepthOnly(SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE);
+		//the shader compares the depth itself, interpolating it would be wrong
+		fbo->depth_texture->bind();
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		fbo->depth_texture->unbind();
+		shadows_buffer = new GFX::BufferObject();
+		shadows_buffer->type = GL_TEXTURE_BUFFER;
+	}
+
+	//viewprojection and rect of every tile, for the shader
+	shadows_data.resize(std::max(tiles.size(), (size_t)1) * SHADOW_TEXELS * 4);
+	for (int i = 0; i < (int)tiles.size(); ++i)
+	{
+		const ShadowTile& tile = tiles[i];
+		float* data = &shadows_data[i * SHADOW_TEXELS * 4];
+		memcpy(data, tile.camera.viewprojection_matrix.m, sizeof(float) * 16);
+		data[16] = tile.x / (float)SHADOW_ATLAS_SIZE;
+		data[17] = tile.y / (float)SHADOW_ATLAS_SIZE;
+		data[18] = tile.size / (float)SHADOW_ATLAS_SIZE;
+		data[19] = tile.light->shadow_bias;
+	}
+	shadows_buffer->updateFromPointer(&shadows_data[0], (int)(shadows_data.size() * sizeof(float)));
+
+	bool dirty = false;
+	for (const ShadowTile& tile : tiles)
+		dirty = dirty || !tile.cached;
+	if (!dirty)
+		return;
+
+	GFX::Shader* shader = GFX::Shader::Get("flat");
+	if (!shader)
+		return;
+
+	GFX::startGPULabel("Shadows");
+	fbo->bind();
+	glColorMask(false, false, false, false);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(true);
+	glDisable(GL_BLEND);
+	glEnable(GL_SCISSOR_TEST);
+	shader->enable();
+	for (int i = 0; i < (int)tiles.size(); ++i)
+	{
+		const ShadowTile& tile = tiles[i];
+		if (tile.cached)
+			continue;
+		glViewport(tile.x, tile.y, tile.size, tile.size);
+		glScissor(tile.x, tile.y, tile.size, tile.size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		shader->setUniform("u_viewprojection", tile.camera.viewprojection_matrix);
+		for (const Renderable* caster : tile_casters[i])
+		{
+			if (caster->material->two_sided)
+				glDisable(GL_CULL_FACE);
+			else
+				glEnable(GL_CULL_FACE);
+			shader->setUniform("u_model", caster->model);
+			caster->mesh->render(GL_TRIANGLES);
+		}
+		num_rendered++;
+		num_casters_rendered += tile.num_casters;
+	}
+	shader->disable();
+	glDisable(GL_SCISSOR_TEST);
+	glColorMask(true, true, true, true);
+	fbo->unbind();
+	GFX::endGPULabel();
+}
+
+void ShadowAtlas::bind(GFX::Shader* shader, int first_slot)
+{
+	//the samplers are always set, two samplers of different type in the same slot is an error
+	if (fbo)
+	{
+		shader->setUniform("u_shadow_atlas", fbo->depth_texture, first_slot);
+		shadows_buffer->bindAsTexture(shader, "u_shadows", first_slot + 1, GL_RGBA32F);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	else
+	{
+		shader->setUniform("u_shadow_atlas", first_slot);
+		shader->setUniform("u_shadows", first_slot + 1);
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include "../core/math.h"
+#include "camera.h"
+
+//Shadow atlas: one depth texture shared by all the lights that cast shadows, every light gets a square tile
+//sized by how big it looks on screen. A tile is only rendered again when something inside its frustum changed.
+
+#define SHADOW_ATLAS_SIZE 4096
+#define SHADOW_TILE_MAX (SHADOW_ATLAS_SIZE / 2)
+#define SHADOW_TILE_MIN 128
+#define SHADOW_TEXELS 5 //texels of the shadows buffer per tile: viewprojection (4) and tile rect + bias
+#define SHADOW_MAX_CASCADES 4
+
+namespace GFX {
+	class Shader;
+	class Texture;
+	class FBO;
+	class BufferObject;
+}
+
+namespace SCN {
+
+	class LightEntity;
+	struct Renderable;
+
+	struct ShadowTile {
+		LightEntity* light;
+		int cascade;		//-1 if the light has a single tile
+		int x, y, size;		//in pixels of the atlas
+		Camera camera;		//to cull and render the tile
+		int num_casters;	//in its render list (ShadowAtlas::tile_casters with the same index)
+		uint64 casters_hash;	//meshes, materials and transforms of the casters, if it doesnt change the tile is reused
+		bool cached;		//not rendered this frame
+	};
+
+	class ShadowAtlas {
+	public:
+		bool use_cache;
+		float importance_scale;	//tile size = projected size of the light * scale
+
+		//directional lights: cascades fitted to slices of the camera frustum (0 uses one tile of the light's area)
+		int num_cascades;
+		int cascade_tile_size;
+		float cascade_distance;	//shadows end here
+		float cascade_split_lambda;	//0 linear splits, 1 logarithmic
+		bool slow_far_cascades;	//cascade i is updated every 2^i frames
+
+		std::vector<ShadowTile> tiles;
+		std::vector<int> light_tiles;	//first tile of every light passed to update, -1 if it has no shadow
+		std::vector<int> light_num_tiles;	//its number of consecutive tiles (cascades)
+		float cascade_splits[SHADOW_MAX_CASCADES + 1];	//distances to the camera of the last update
+
+		//stats of the last frame
+		int num_rendered;
+		int num_casters_rendered;
+
+		ShadowAtlas();
+		~ShadowAtlas();
+
+		//assigns the tiles and builds the render lists, the lights and casters must be the ones of this frame
+		void update(LightEntity* const* lights, int num_lights, const Renderable* casters, int num_casters, Camera* camera);
+		void render();	//renders the tiles that are not cached
+		void bind(GFX::Shader* shader, int first_slot);	//atlas and shadows buffer
+		void invalidate() { tiles.clear(); }	//render everything the next frame
+
+		GFX::Texture* getTexture();
+
+	private:
+		GFX::FBO* fbo;
+		GFX::BufferObject* shadows_buffer;
+		std::vector<float> shadows_data;
+		std::vector<ShadowTile> last_tiles;
+		int frame;
+
+		//kept between frames so updating the tiles doesnt allocate
+		struct sRequest { int light; int size; int cascade; };
+		struct sSquare { int x, y, size; };
+		std::vector<sRequest> requests;
+		std::vector<sSquare> free_squares;
+		std::vector<std::vector<const Renderable*>> tile_casters;	//render list of every tile
+
+		int computeTileSize(LightEntity* light, Camera* camera, float viewport_height);
+		bool setupTileCamera(ShadowTile& tile);
+		void setupCascadeCamera(ShadowTile& tile, Camera* camera);
+	};
+
+};
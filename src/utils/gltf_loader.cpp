@@ -10,6 +10,7 @@
 #include "../pipeline/material.h"
 #include "../pipeline/prefab.h"
 #include "../utils/utils.h"
+#include "../core/profiler.h"
 
 #include <iostream>
 
@@ -334,6 +335,14 @@ std::vector<GFX::Mesh*> parseGLTFMesh(cgltf_mesh* meshdata, const char* basename
 			if (primitive->indices && primitive->indices->count)
 				parseGLTFBufferIndices(mesh->indices, primitive->indices);
 		}
+		//simplified at import, there is no .mbin to store them
+		if (GFX::Mesh::generate_lods && primitive->type == cgltf_primitive_type_triangles)
+			mesh->generateLODs();
+		if (GFX::Mesh::generate_meshlets && primitive->type == cgltf_primitive_type_triangles)
+			mesh->generateMeshlets();
+
+		//there is no .mbin to read it again, so at most it drops to the collision data
+		mesh->residency = GFX::Mesh::default_residency;
 		mesh->uploadToVRAM();
 		if (meshdata->name)
 			mesh->registerMesh(submesh_name);
@@ -679,6 +688,7 @@ SCN::Prefab* loadGLTF(const std::vector<unsigned char>& dat, const std::string&
 
 SCN::Prefab* loadGLTF(const char* filename)
 {
+	PROFILE_FUNCTION();
 	std::cout << "loading gltf " << TermColor::YELLOW << filename << TermColor::DEFAULT << " ..." << std::endl;
 	cgltf_options options;
 	memset(&options, 0, sizeof(cgltf_options));
@@ -0,0 +1,443 @@
+#include "jsonreader.h"
+
+#include <charconv>
+#include <cstring>
+
+#define JSON_MAX_DEPTH 512 //to avoid stack overflows with malicious files
+
+//recursive descent parser that appends the tokens in pre-order
+struct sJSONParser {
+	const char* start;
+	const char* pos;
+	const char* end;
+	std::vector<JSONToken>* tokens;
+
+	void skipSpaces()
+	{
+		while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t'))
+			++pos;
+	}
+
+	int addToken(eJSONType type, const char* token_start)
+	{
+		JSONToken token;
+		token.type = type;
+		token.escaped = 0;
+		token.start = (uint32)(token_start - start);
+		token.end = token.start;
+		token.size = 0;
+		token.next = 0;
+		tokens->push_back(token);
+		return (int)tokens->size() - 1;
+	}
+
+	bool parseString()
+	{
+		int index = addToken(JSON_STRING, ++pos); //skip the quote
+		bool escaped = false;
+		while (pos < end && *pos != '"')
+		{
+			if (*pos == '\\')
+			{
+				escaped = true;
+				++pos;
+			}
+			++pos;
+		}
+		if (pos >= end)
+			return false;
+		JSONToken& token = (*tokens)[index];
+		token.end = (uint32)(pos - start);
+		token.escaped = escaped ? 1 : 0;
+		token.next = index + 1;
+		++pos; //closing quote
+		return true;
+	}
+
+	bool parseLiteral(const char* literal, eJSONType type)
+	{
+		size_t len = strlen(literal);
+		if ((size_t)(end - pos) < len || memcmp(pos, literal, len) != 0)
+			return false;
+		int index = addToken(type, pos);
+		pos += len;
+		(*tokens)[index].end = (uint32)(pos - start);
+		(*tokens)[index].next = index + 1;
+		return true;
+	}
+
+	bool parseNumber()
+	{
+		int index = addToken(JSON_NUMBER, pos);
+		while (pos < end && ((*pos >= '0' && *pos <= '9') || *pos == '-' || *pos == '+' || *pos == '.' || *pos == 'e' || *pos == 'E'))
+			++pos;
+		JSONToken& token = (*tokens)[index];
+		token.end = (uint32)(pos - start);
+		token.next = index + 1;
+		return token.end > token.start;
+	}
+
+	bool parseValue(int depth)
+	{
+		if (depth > JSON_MAX_DEPTH)
+			return false;
+		skipSpaces();
+		if (pos >= end)
+			return false;
+
+		switch (*pos)
+		{
+		case '"': return parseString();
+		case 't': return parseLiteral("true", JSON_BOOL);
+		case 'f': return parseLiteral("false", JSON_BOOL);
+		case 'n': return parseLiteral("null", JSON_NULL);
+		case '{':
+		case '[':
+		{
+			bool is_object = *pos == '{';
+			char closing = is_object ? '}' : ']';
+			int index = addToken(is_object ? JSON_OBJECT : JSON_ARRAY, pos);
+			++pos;
+			uint32 size = 0;
+			skipSpaces();
+			if (pos < end && *pos == closing)
+				++pos;
+			else
+			{
+				while (true)
+				{
+					if (is_object)
+					{
+						skipSpaces();
+						if (pos >= end || *pos != '"' || !parseString())
+							return false;
+						skipSpaces();
+						if (pos >= end || *pos != ':')
+							return false;
+						++pos;
+					}
+					if (!parseValue(depth + 1))
+						return false;
+					size++;
+					skipSpaces();
+					if (pos >= end)
+						return false;
+					if (*pos == ',')
+					{
+						++pos;
+						continue;
+					}
+					if (*pos != closing)
+						return false;
+					++pos;
+					break;
+				}
+			}
+			//tokens may have been reallocated
+			JSONToken& token = (*tokens)[index];
+			token.end = (uint32)(pos - start);
+			token.size = size;
+			token.next = (uint32)tokens->size();
+			return true;
+		}
+		default:
+			return parseNumber();
+		}
+	}
+};
+
+JSONDocument::JSONDocument()
+{
+	source = nullptr;
+	error_position = -1;
+}
+
+bool JSONDocument::parse(const char* data, size_t size)
+{
+	source = data;
+	tokens.clear();
+	//rough guess to avoid most of the reallocations
+	tokens.reserve(size / 16 + 16);
+
+	sJSONParser parser;
+	parser.start = parser.pos = data;
+	parser.end = data + size;
+	parser.tokens = &tokens;
+	if (!parser.parseValue(0))
+	{
+		error_position = (int)(parser.pos - data);
+		tokens.clear();
+		return false;
+	}
+	error_position = -1;
+	return true;
+}
+
+eJSONType JSONValue::getType() const
+{
+	if (index < 0)
+		return JSON_INVALID;
+	return (eJSONType)doc->tokens[index].type;
+}
+
+int JSONValue::size() const
+{
+	if (index < 0)
+		return 0;
+	return (int)doc->tokens[index].size;
+}
+
+//keys are compared ignoring the case, like cJSON_GetObjectItem
+static inline char toLowerASCII(char c)
+{
+	return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static bool equalsNoCase(std::string_view a, std::string_view b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i)
+		if (toLowerASCII(a[i]) != toLowerASCII(b[i]))
+			return false;
+	return true;
+}
+
+JSONValue JSONValue::get(std::string_view name) const
+{
+	if (getType() != JSON_OBJECT)
+		return JSONValue();
+	const std::vector<JSONToken>& tokens = doc->tokens;
+	uint32 num = tokens[index].size;
+	uint32 key = index + 1;
+	for (uint32 i = 0; i < num; ++i)
+	{
+		const JSONToken& token = tokens[key];
+		std::string_view key_name(doc->source + token.start, token.end - token.start);
+		//the keys with escape sequences are decoded first (rare, it allocates)
+		if (token.escaped ? equalsNoCase(JSONValue(doc, key).toString(), name) : equalsNoCase(key_name, name))
+			return JSONValue(doc, key + 1, index);
+		key = tokens[key + 1].next;
+	}
+	return JSONValue();
+}
+
+JSONValue JSONValue::operator[](int i) const
+{
+	if (getType() != JSON_ARRAY || i < 0 || i >= size())
+		return JSONValue();
+	JSONValue value = first();
+	while (i-- > 0)
+		value = value.next();
+	return value;
+}
+
+JSONValue JSONValue::first() const
+{
+	eJSONType type = getType();
+	if ((type != JSON_ARRAY && type != JSON_OBJECT) || !doc->tokens[index].size)
+		return JSONValue();
+	return JSONValue(doc, index + (type == JSON_OBJECT ? 2 : 1), index);
+}
+
+JSONValue JSONValue::next() const
+{
+	if (index < 0 || parent < 0)
+		return JSONValue();
+	const std::vector<JSONToken>& tokens = doc->tokens;
+	uint32 sibling = tokens[index].next;
+	if (sibling >= tokens[parent].next)
+		return JSONValue();
+	if (tokens[parent].type == JSON_OBJECT)
+		sibling++; //skip the key
+	return JSONValue(doc, sibling, parent);
+}
+
+std::string_view JSONValue::key() const
+{
+	if (index < 0 || parent < 0 || doc->tokens[parent].type != JSON_OBJECT)
+		return std::string_view();
+	const JSONToken& token = doc->tokens[index - 1];
+	return std::string_view(doc->source + token.start, token.end - token.start);
+}
+
+bool JSONValue::toBool(bool default_value) const
+{
+	if (getType() != JSON_BOOL)
+		return default_value;
+	return doc->source[doc->tokens[index].start] == 't';
+}
+
+double JSONValue::toNumber(double default_value) const
+{
+	if (getType() != JSON_NUMBER)
+		return default_value;
+	const JSONToken& token = doc->tokens[index];
+	double value = 0.0;
+	std::from_chars_result result = std::from_chars(doc->source + token.start, doc->source + token.end, value);
+	if (result.ec != std::errc())
+		return default_value;
+	return value;
+}
+
+std::string_view JSONValue::toStringView() const
+{
+	if (getType() != JSON_STRING)
+		return std::string_view();
+	const JSONToken& token = doc->tokens[index];
+	return std::string_view(doc->source + token.start, token.end - token.start);
+}
+
+static void appendUTF8(std::string& str, uint32 code)
+{
+	if (code < 0x80)
+		str += (char)code;
+	else if (code < 0x800)
+	{
+		str += (char)(0xC0 | (code >> 6));
+		str += (char)(0x80 | (code & 0x3F));
+	}
+	else if (code < 0x10000)
+	{
+		str += (char)(0xE0 | (code >> 12));
+		str += (char)(0x80 | ((code >> 6) & 0x3F));
+		str += (char)(0x80 | (code & 0x3F));
+	}
+	else
+	{
+		str += (char)(0xF0 | (code >> 18));
+		str += (char)(0x80 | ((code >> 12) & 0x3F));
+		str += (char)(0x80 | ((code >> 6) & 0x3F));
+		str += (char)(0x80 | (code & 0x3F));
+	}
+}
+
+static uint32 parseHex4(const char* str, const char* end)
+{
+	uint32 value = 0;
+	if (end - str < 4 || std::from_chars(str, str + 4, value, 16).ptr != str + 4)
+		return 0xFFFD; //replacement character
+	return value;
+}
+
+std::string JSONValue::toString(const char* default_str) const
+{
+	if (getType() != JSON_STRING)
+		return default_str;
+	std::string_view view = toStringView();
+	if (!doc->tokens[index].escaped)
+		return std::string(view);
+
+	std::string str;
+	str.reserve(view.size());
+	const char* end = view.data() + view.size();
+	for (const char* c = view.data(); c < end; ++c)
+	{
+		if (*c != '\\' || c + 1 >= end)
+		{
+			str += *c;
+			continue;
+		}
+		++c;
+		switch (*c)
+		{
+		case 'n': str += '\n'; break;
+		case 't': str += '\t'; break;
+		case 'r': str += '\r'; break;
+		case 'b': str += '\b'; break;
+		case 'f': str += '\f'; break;
+		case 'u':
+		{
+			uint32 code = parseHex4(c + 1, end);
+			c += 4;
+			//surrogate pair
+			if (code >= 0xD800 && code < 0xDC00 && end - c > 6 && c[1] == '\\' && c[2] == 'u')
+			{
+				uint32 low = parseHex4(c + 3, end);
+				code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				c += 6;
+			}
+			appendUTF8(str, code);
+			break;
+		}
+		default: str += *c; break; //quotes, slashes
+		}
+	}
+	return str;
+}
+
+bool JSONValue::toVector(std::vector<float>& dst) const
+{
+	if (getType() != JSON_ARRAY)
+		return false;
+	dst.resize(size());
+	int i = 0;
+	for (JSONValue value = first(); value.isValid(); value = value.next())
+		dst[i++] = (float)value.toNumber(0.0);
+	return true;
+}
+
+//without the temporary std::vector of the cJSON version
+Vector3f JSONValue::toVector3(Vector3f default_value) const
+{
+	if (getType() != JSON_ARRAY || size() != 3)
+		return default_value;
+	JSONValue x = first();
+	JSONValue y = x.next();
+	JSONValue z = y.next();
+	return Vector3f((float)x.toNumber(0.0), (float)y.toNumber(0.0), (float)z.toNumber(0.0));
+}
+
+Vector4f JSONValue::toVector4(Vector4f default_value) const
+{
+	if (getType() != JSON_ARRAY || size() != 4)
+		return default_value;
+	JSONValue x = first();
+	JSONValue y = x.next();
+	JSONValue z = y.next();
+	JSONValue w = z.next();
+	return Vector4f((float)x.toNumber(0.0), (float)y.toNumber(0.0), (float)z.toNumber(0.0), (float)w.toNumber(0.0));
+}
+
+std::string_view JSONValue::raw() const
+{
+	if (index < 0)
+		return std::string_view();
+	const JSONToken& token = doc->tokens[index];
+	if (token.type == JSON_STRING)
+		return std::string_view(doc->source + token.start - 1, token.end - token.start + 2);
+	return std::string_view(doc->source + token.start, token.end - token.start);
+}
+
+bool readJSONBool(const JSONValue& obj, const char* name, bool default_value)
+{
+	JSONValue value = obj.get(name);
+	if (!value.isValid())
+		return default_value;
+	return value.toBool(false);
+}
+
+float readJSONNumber(const JSONValue& obj, const char* name, float default_value)
+{
+	return (float)obj.get(name).toNumber(default_value);
+}
+
+std::string readJSONString(const JSONValue& obj, const char* name, const char* default_str)
+{
+	return obj.get(name).toString(default_str);
+}
+
+bool readJSONVector(const JSONValue& obj, const char* name, std::vector<float>& dst)
+{
+	return obj.get(name).toVector(dst);
+}
+
+Vector3f readJSONVector3(const JSONValue& obj, const char* name, Vector3f default_value)
+{
+	return obj.get(name).toVector3(default_value);
+}
+
+Vector4f readJSONVector4(const JSONValue& obj, const char* name)
+{
+	return obj.get(name).toVector4(Vector4f());
+}
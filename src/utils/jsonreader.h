@@ -0,0 +1,88 @@
+/*  On-demand JSON reader used to load the scenes.
+	A single pass over the text builds a flat array of tokens (no tree of nodes, no copied strings),
+	then values are read lazily from the source buffer. Strings are views into the source and
+	numbers are decoded with std::from_chars. The source buffer must outlive the JSONDocument.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../core/math.h"
+
+enum eJSONType : uint8 {
+	JSON_INVALID = 0,
+	JSON_NULL,
+	JSON_BOOL,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT
+};
+
+struct JSONToken {
+	uint8 type;
+	uint8 escaped;	//string with escape sequences, they are decoded when reading it as std::string
+	uint32 start;	//offset in the source (strings without the quotes)
+	uint32 end;
+	uint32 size;	//members of an object or elements of an array
+	uint32 next;	//index of the token after this one and all its children
+};
+
+class JSONDocument;
+
+//one value of the document, it is just an index so it can be copied around
+class JSONValue {
+public:
+	const JSONDocument* doc;
+	int index;	//-1 if not valid
+	int parent;	//array or object that contains it, -1 in the root
+
+	JSONValue() { doc = nullptr; index = parent = -1; }
+	JSONValue(const JSONDocument* doc, int index, int parent = -1) { this->doc = doc; this->index = index; this->parent = parent; }
+
+	bool isValid() const { return index >= 0; }
+	eJSONType getType() const;
+	int size() const;	//members or elements
+
+	JSONValue get(std::string_view name) const;	//member of an object (the case is ignored, like in cJSON), invalid if not found
+	JSONValue operator[](int i) const;	//element of an array
+	bool has(std::string_view name) const { return get(name).isValid(); }
+
+	//to iterate the children: for(JSONValue v = array.first(); v.isValid(); v = v.next())
+	//in objects the children are the members, use key() to get the name
+	JSONValue first() const;
+	JSONValue next() const;
+	std::string_view key() const;
+
+	bool toBool(bool default_value = false) const;
+	double toNumber(double default_value = 0.0) const;
+	std::string_view toStringView() const;	//raw characters between the quotes, escapes are not decoded
+	std::string toString(const char* default_str = "") const;
+	bool toVector(std::vector<float>& dst) const;
+	Vector3f toVector3(Vector3f default_value) const;	//only if it is an array of 3 numbers
+	Vector4f toVector4(Vector4f default_value) const;
+	std::string_view raw() const;	//text of the value in the source, including its children
+};
+
+class JSONDocument {
+public:
+	const char* source;
+	std::vector<JSONToken> tokens;
+	int error_position;	//-1 if parsed
+
+	JSONDocument();
+
+	bool parse(const char* data, size_t size);
+	JSONValue root() const { return JSONValue(this, tokens.size() ? 0 : -1); }
+};
+
+//same as the cJSON ones in utils.h
+bool readJSONBool(const JSONValue& obj, const char* name, bool default_value);
+float readJSONNumber(const JSONValue& obj, const char* name, float default_value);
+std::string readJSONString(const JSONValue& obj, const char* name, const char* default_str);
+bool readJSONVector(const JSONValue& obj, const char* name, std::vector<float>& dst);
+Vector3f readJSONVector3(const JSONValue& obj, const char* name, Vector3f default_value);
+Vector4f readJSONVector4(const JSONValue& obj, const char* name);
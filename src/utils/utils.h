@@ -18,6 +18,23 @@ long getTime(); //there is also CORE::getTime
 bool readFile(const std::string& filename, std::string& content);
 bool readFileBin(const std::string& filename, std::vector<unsigned char>& buffer);
 bool writeFile(const std::string& filename, std::string& content);
+
+//read-only memory mapped file, the OS loads the pages when they are accessed
+class MappedFile {
+public:
+	const char* data;
+	size_t size;
+
+	MappedFile();
+	~MappedFile();
+	bool open(const char* filename);
+	void close();
+
+private:
+	void* handle;
+	void* mapping;
+};
+
 std::string getRelativePath(std::string path);
 
 //work with file paths